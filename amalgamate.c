@@ -178,6 +178,10 @@ do_headers (FILE * out, struct masked_keyword *first)
     fprintf (out, "#endif\n");
     fprintf (out, "#else\n");
     fprintf (out, "#include <unistd.h>\n");
+    fprintf (out, "#include <fcntl.h>\n");
+    fprintf (out, "#include <sys/stat.h>\n");
+    fprintf (out, "#include <sys/mman.h>\n");
+    fprintf (out, "#include <pthread.h>\n");
     fprintf (out, "#endif\n\n");
     fprintf (out, "#ifndef OMIT_GEOS	/* including GEOS */\n");
     fprintf (out, "#include <geos_c.h>\n");
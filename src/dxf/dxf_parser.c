@@ -639,25 +639,186 @@ linked_rings (gaiaDxfPolylinePtr line)
     line->is_closed = 1;
 }
 
+struct dxf_hash_item
+{
+/* an item of a Layers/Blocks hash index */
+    unsigned int hash;
+    void *object;
+    struct dxf_hash_item *next;
+};
+
+struct dxf_hash_index
+{
+/* an hash index supporting Layers and Blocks lookups */
+    struct dxf_hash_item **buckets;
+    unsigned int n_buckets;
+    unsigned int count;
+};
+
+static struct dxf_hash_index *
+alloc_dxf_hash_index (void)
+{
+/* allocating an empty hash index */
+    struct dxf_hash_index *index = malloc (sizeof (struct dxf_hash_index));
+    index->n_buckets = 256;
+    index->count = 0;
+    index->buckets =
+	calloc (index->n_buckets, sizeof (struct dxf_hash_item *));
+    return index;
+}
+
 static void
-insert_dxf_hatch (gaiaDxfParserPtr dxf, const char *layer_name,
-		  gaiaDxfHatchPtr hatch)
+destroy_dxf_hash_index (struct dxf_hash_index *index)
 {
-/* inserting a HATCH object into the appropriate Layer */
-    gaiaDxfLayerPtr lyr = dxf->first_layer;
-    while (lyr != NULL)
+/* memory cleanup - destroying an hash index [indexed objects aren't freed] */
+    unsigned int i;
+    struct dxf_hash_item *item;
+    struct dxf_hash_item *n_item;
+    if (index == NULL)
+	return;
+    for (i = 0; i < index->n_buckets; i++)
       {
-	  if (strcmp (lyr->layer_name, layer_name) == 0)
+	  item = index->buckets[i];
+	  while (item != NULL)
 	    {
-		/* found the matching Layer */
-		if (lyr->first_hatch == NULL)
-		    lyr->first_hatch = hatch;
-		if (lyr->last_hatch != NULL)
-		    lyr->last_hatch->next = hatch;
-		lyr->last_hatch = hatch;
-		return;
+		n_item = item->next;
+		free (item);
+		item = n_item;
+	    }
+      }
+    free (index->buckets);
+    free (index);
+}
+
+static unsigned int
+dxf_hash_string (unsigned int hash, const char *str)
+{
+/* FNV-1a hashing of a string */
+    const unsigned char *p = (const unsigned char *) str;
+    while (*p != '\0')
+      {
+	  hash ^= *p++;
+	  hash *= 16777619U;
+      }
+    return hash;
+}
+
+static unsigned int
+dxf_layer_hash (const char *layer_name)
+{
+/* computing the hash key of a Layer */
+    return dxf_hash_string (2166136261U, layer_name);
+}
+
+static unsigned int
+dxf_block_hash (const char *layer_name, const char *block_id)
+{
+/* computing the hash key of a Block [Layer Name + Block ID] */
+    unsigned int hash = dxf_hash_string (2166136261U, layer_name);
+    hash = (hash ^ 0xff) * 16777619U;
+    return dxf_hash_string (hash, block_id);
+}
+
+static void
+dxf_hash_add (struct dxf_hash_index *index, unsigned int hash, void *object)
+{
+/* adding an object into the hash index */
+    struct dxf_hash_item *item;
+    if (index->count >= index->n_buckets * 2)
+      {
+	  /* growing the hash index */
+	  unsigned int i;
+	  unsigned int n_buckets = index->n_buckets * 4;
+	  struct dxf_hash_item *n_item;
+	  struct dxf_hash_item **buckets =
+	      calloc (n_buckets, sizeof (struct dxf_hash_item *));
+	  for (i = 0; i < index->n_buckets; i++)
+	    {
+		item = index->buckets[i];
+		while (item != NULL)
+		  {
+		      n_item = item->next;
+		      item->next = buckets[item->hash % n_buckets];
+		      buckets[item->hash % n_buckets] = item;
+		      item = n_item;
+		  }
 	    }
-	  lyr = lyr->next;
+	  free (index->buckets);
+	  index->buckets = buckets;
+	  index->n_buckets = n_buckets;
+      }
+    item = malloc (sizeof (struct dxf_hash_item));
+    item->hash = hash;
+    item->object = object;
+    item->next = index->buckets[hash % index->n_buckets];
+    index->buckets[hash % index->n_buckets] = item;
+    index->count++;
+}
+
+static gaiaDxfLayerPtr
+find_dxf_layer (gaiaDxfParserPtr dxf, const char *layer_name)
+{
+/* attempting to find a Layer object by its Name */
+    unsigned int hash;
+    struct dxf_hash_item *item;
+    struct dxf_hash_index *index =
+	(struct dxf_hash_index *) (dxf->layers_index);
+    if (layer_name == NULL || index == NULL)
+	return NULL;
+    hash = dxf_layer_hash (layer_name);
+    item = index->buckets[hash % index->n_buckets];
+    while (item != NULL)
+      {
+	  gaiaDxfLayerPtr lyr = (gaiaDxfLayerPtr) (item->object);
+	  if (item->hash == hash && strcmp (lyr->layer_name, layer_name) == 0)
+	      return lyr;
+	  item = item->next;
+      }
+    return NULL;
+}
+
+static gaiaDxfBlockPtr
+find_dxf_block (gaiaDxfParserPtr dxf, const char *layer_name,
+		const char *block_id)
+{
+/* attempting to find a Block object by its Id */
+    unsigned int hash;
+    struct dxf_hash_item *item;
+    struct dxf_hash_index *index =
+	(struct dxf_hash_index *) (dxf->blocks_index);
+    if (layer_name == NULL || block_id == NULL || index == NULL)
+	return NULL;
+    hash = dxf_block_hash (layer_name, block_id);
+    item = index->buckets[hash % index->n_buckets];
+    while (item != NULL)
+      {
+	  gaiaDxfBlockPtr blk = (gaiaDxfBlockPtr) (item->object);
+	  if (item->hash == hash && strcmp (blk->layer_name, layer_name) == 0
+	      && strcmp (blk->block_id, block_id) == 0)
+	    {
+		/* ok, matching item found */
+		return blk;
+	    }
+	  item = item->next;
+      }
+    return NULL;
+}
+
+static void
+insert_dxf_hatch (gaiaDxfParserPtr dxf, const char *layer_name,
+		  gaiaDxfHatchPtr hatch)
+{
+/* inserting a HATCH object into the appropriate Layer */
+    gaiaDxfLayerPtr lyr = find_dxf_layer (dxf, layer_name);
+    if (lyr != NULL)
+      {
+	  /* found the matching Layer */
+	  if (lyr->first_hatch == NULL)
+	      lyr->first_hatch = hatch;
+	  if (lyr->last_hatch != NULL)
+	      lyr->last_hatch->next = hatch;
+	  lyr->last_hatch = hatch;
+	  return;
       }
     destroy_dxf_hatch (hatch);
 }
@@ -766,34 +927,30 @@ insert_dxf_text (gaiaDxfParserPtr dxf, const char *layer_name,
 		 gaiaDxfTextPtr txt)
 {
 /* inserting a TEXT object into the appropriate Layer */
-    gaiaDxfLayerPtr lyr = dxf->first_layer;
-    while (lyr != NULL)
-      {
-	  if (strcmp (lyr->layer_name, layer_name) == 0)
+    gaiaDxfLayerPtr lyr = find_dxf_layer (dxf, layer_name);
+    if (lyr != NULL)
+      {
+	  /* found the matching Layer */
+	  if (lyr->first_text == NULL)
+	      lyr->first_text = txt;
+	  if (lyr->last_text != NULL)
+	      lyr->last_text->next = txt;
+	  lyr->last_text = txt;
+	  if (dxf->force_dims == GAIA_DXF_FORCE_2D
+	      || dxf->force_dims == GAIA_DXF_FORCE_3D)
+	      ;
+	  else
 	    {
-		/* found the matching Layer */
-		if (lyr->first_text == NULL)
-		    lyr->first_text = txt;
-		if (lyr->last_text != NULL)
-		    lyr->last_text->next = txt;
-		lyr->last_text = txt;
-		if (dxf->force_dims == GAIA_DXF_FORCE_2D
-		    || dxf->force_dims == GAIA_DXF_FORCE_3D)
-		    ;
-		else
-		  {
-		      if (is_3d_text (txt))
-			  lyr->is3Dtext = 1;
-		  }
-		txt->first = dxf->first_ext;
-		txt->last = dxf->last_ext;
-		dxf->first_ext = NULL;
-		dxf->last_ext = NULL;
-		if (txt->first != NULL)
-		    lyr->hasExtraText = 1;
-		return;
+		if (is_3d_text (txt))
+		    lyr->is3Dtext = 1;
 	    }
-	  lyr = lyr->next;
+	  txt->first = dxf->first_ext;
+	  txt->last = dxf->last_ext;
+	  dxf->first_ext = NULL;
+	  dxf->last_ext = NULL;
+	  if (txt->first != NULL)
+	      lyr->hasExtraText = 1;
+	  return;
       }
     destroy_dxf_text (txt);
 }
@@ -918,76 +1075,72 @@ insert_dxf_insert (gaiaDxfParserPtr dxf, const char *layer_name,
 		   gaiaDxfInsertPtr ins)
 {
 /* inserting an INSERT object into the appropriate Layer */
-    gaiaDxfLayerPtr lyr = dxf->first_layer;
-    while (lyr != NULL)
-      {
-	  if (strcmp (lyr->layer_name, layer_name) == 0)
-	    {
-		/* found the matching Layer */
-		ins->first = dxf->first_ext;
-		ins->last = dxf->last_ext;
-		dxf->first_ext = NULL;
-		dxf->last_ext = NULL;
-		if (ins->hasText)
-		  {
-		      /* indirect Text reference */
-		      gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
-		      if (lyr->first_ins_text == NULL)
-			  lyr->first_ins_text = ins2;
-		      if (lyr->last_ins_text != NULL)
-			  lyr->last_ins_text->next = ins2;
-		      lyr->last_ins_text = ins2;
-		      if (ins2->is3Dtext)
-			  lyr->is3DinsText = 1;
-		      if (ins2->first != NULL)
-			  lyr->hasExtraInsText = 1;
-		  }
-		if (ins->hasPoint)
-		  {
-		      /* indirect Point reference */
-		      gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
-		      if (lyr->first_ins_point == NULL)
-			  lyr->first_ins_point = ins2;
-		      if (lyr->last_ins_point != NULL)
-			  lyr->last_ins_point->next = ins2;
-		      lyr->last_ins_point = ins2;
-		      if (ins2->is3Dpoint)
-			  lyr->is3DinsPoint = 1;
-		      if (ins2->first != NULL)
-			  lyr->hasExtraInsPoint = 1;
-		  }
-		if (ins->hasLine)
-		  {
-		      /* indirect Polyline (Linestring) reference */
-		      gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
-		      if (lyr->first_ins_line == NULL)
-			  lyr->first_ins_line = ins2;
-		      if (lyr->last_ins_line != NULL)
-			  lyr->last_ins_line->next = ins2;
-		      lyr->last_ins_line = ins2;
-		      if (ins2->is3Dline)
-			  lyr->is3DinsLine = 1;
-		      if (ins2->first != NULL)
-			  lyr->hasExtraInsLine = 1;
-		  }
-		if (ins->hasPolyg)
-		  {
-		      /* indirect Polyline (Polygon) reference */
-		      gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
-		      if (lyr->first_ins_polyg == NULL)
-			  lyr->first_ins_polyg = ins2;
-		      if (lyr->last_ins_polyg != NULL)
-			  lyr->last_ins_polyg->next = ins2;
-		      lyr->last_ins_polyg = ins2;
-		      if (ins2->is3Dpolyg)
-			  lyr->is3DinsPolyg = 1;
-		      if (ins2->first != NULL)
-			  lyr->hasExtraInsPolyg = 1;
-		  }
-		destroy_dxf_insert (ins);
-		return;
+    gaiaDxfLayerPtr lyr = find_dxf_layer (dxf, layer_name);
+    if (lyr != NULL)
+      {
+	  /* found the matching Layer */
+	  ins->first = dxf->first_ext;
+	  ins->last = dxf->last_ext;
+	  dxf->first_ext = NULL;
+	  dxf->last_ext = NULL;
+	  if (ins->hasText)
+	    {
+		/* indirect Text reference */
+		gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
+		if (lyr->first_ins_text == NULL)
+		    lyr->first_ins_text = ins2;
+		if (lyr->last_ins_text != NULL)
+		    lyr->last_ins_text->next = ins2;
+		lyr->last_ins_text = ins2;
+		if (ins2->is3Dtext)
+		    lyr->is3DinsText = 1;
+		if (ins2->first != NULL)
+		    lyr->hasExtraInsText = 1;
+	    }
+	  if (ins->hasPoint)
+	    {
+		/* indirect Point reference */
+		gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
+		if (lyr->first_ins_point == NULL)
+		    lyr->first_ins_point = ins2;
+		if (lyr->last_ins_point != NULL)
+		    lyr->last_ins_point->next = ins2;
+		lyr->last_ins_point = ins2;
+		if (ins2->is3Dpoint)
+		    lyr->is3DinsPoint = 1;
+		if (ins2->first != NULL)
+		    lyr->hasExtraInsPoint = 1;
 	    }
-	  lyr = lyr->next;
+	  if (ins->hasLine)
+	    {
+		/* indirect Polyline (Linestring) reference */
+		gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
+		if (lyr->first_ins_line == NULL)
+		    lyr->first_ins_line = ins2;
+		if (lyr->last_ins_line != NULL)
+		    lyr->last_ins_line->next = ins2;
+		lyr->last_ins_line = ins2;
+		if (ins2->is3Dline)
+		    lyr->is3DinsLine = 1;
+		if (ins2->first != NULL)
+		    lyr->hasExtraInsLine = 1;
+	    }
+	  if (ins->hasPolyg)
+	    {
+		/* indirect Polyline (Polygon) reference */
+		gaiaDxfInsertPtr ins2 = clone_dxf_insert (ins);
+		if (lyr->first_ins_polyg == NULL)
+		    lyr->first_ins_polyg = ins2;
+		if (lyr->last_ins_polyg != NULL)
+		    lyr->last_ins_polyg->next = ins2;
+		lyr->last_ins_polyg = ins2;
+		if (ins2->is3Dpolyg)
+		    lyr->is3DinsPolyg = 1;
+		if (ins2->first != NULL)
+		    lyr->hasExtraInsPolyg = 1;
+	    }
+	  destroy_dxf_insert (ins);
+	  return;
       }
     destroy_dxf_insert (ins);
 }
@@ -1038,34 +1191,30 @@ insert_dxf_point (gaiaDxfParserPtr dxf, const char *layer_name,
 		  gaiaDxfPointPtr pt)
 {
 /* inserting a POINT object into the appropriate Layer */
-    gaiaDxfLayerPtr lyr = dxf->first_layer;
-    while (lyr != NULL)
-      {
-	  if (strcmp (lyr->layer_name, layer_name) == 0)
+    gaiaDxfLayerPtr lyr = find_dxf_layer (dxf, layer_name);
+    if (lyr != NULL)
+      {
+	  /* found the matching Layer */
+	  if (lyr->first_point == NULL)
+	      lyr->first_point = pt;
+	  if (lyr->last_point != NULL)
+	      lyr->last_point->next = pt;
+	  lyr->last_point = pt;
+	  if (dxf->force_dims == GAIA_DXF_FORCE_2D
+	      || dxf->force_dims == GAIA_DXF_FORCE_3D)
+	      ;
+	  else
 	    {
-		/* found the matching Layer */
-		if (lyr->first_point == NULL)
-		    lyr->first_point = pt;
-		if (lyr->last_point != NULL)
-		    lyr->last_point->next = pt;
-		lyr->last_point = pt;
-		if (dxf->force_dims == GAIA_DXF_FORCE_2D
-		    || dxf->force_dims == GAIA_DXF_FORCE_3D)
-		    ;
-		else
-		  {
-		      if (is_3d_point (pt))
-			  lyr->is3Dpoint = 1;
-		  }
-		pt->first = dxf->first_ext;
-		pt->last = dxf->last_ext;
-		dxf->first_ext = NULL;
-		dxf->last_ext = NULL;
-		if (pt->first != NULL)
-		    lyr->hasExtraPoint = 1;
-		return;
+		if (is_3d_point (pt))
+		    lyr->is3Dpoint = 1;
 	    }
-	  lyr = lyr->next;
+	  pt->first = dxf->first_ext;
+	  pt->last = dxf->last_ext;
+	  dxf->first_ext = NULL;
+	  dxf->last_ext = NULL;
+	  if (pt->first != NULL)
+	      lyr->hasExtraPoint = 1;
+	  return;
       }
     destroy_dxf_point (pt);
 }
@@ -1394,61 +1543,57 @@ insert_dxf_polyline (gaiaDxfParserPtr dxf, const char *layer_name,
 		     gaiaDxfPolylinePtr ln)
 {
 /* inserting a POLYLINE object into the appropriate Layer */
-    gaiaDxfLayerPtr lyr = dxf->first_layer;
-    while (lyr != NULL)
-      {
-	  if (strcmp (lyr->layer_name, layer_name) == 0)
-	    {
-		/* found the matching Layer */
-		if (dxf->linked_rings)
-		    linked_rings (ln);
-		if (dxf->unlinked_rings)
-		    unlinked_rings (ln);
-		if (ln->is_closed)
+    gaiaDxfLayerPtr lyr = find_dxf_layer (dxf, layer_name);
+    if (lyr != NULL)
+      {
+	  /* found the matching Layer */
+	  if (dxf->linked_rings)
+	      linked_rings (ln);
+	  if (dxf->unlinked_rings)
+	      unlinked_rings (ln);
+	  if (ln->is_closed)
+	    {
+		/* it's a Ring */
+		if (lyr->first_polyg == NULL)
+		    lyr->first_polyg = ln;
+		if (lyr->last_polyg != NULL)
+		    lyr->last_polyg->next = ln;
+		lyr->last_polyg = ln;
+		if (dxf->force_dims == GAIA_DXF_FORCE_2D
+		    || dxf->force_dims == GAIA_DXF_FORCE_3D)
+		    ;
+		else
 		  {
-		      /* it's a Ring */
-		      if (lyr->first_polyg == NULL)
-			  lyr->first_polyg = ln;
-		      if (lyr->last_polyg != NULL)
-			  lyr->last_polyg->next = ln;
-		      lyr->last_polyg = ln;
-		      if (dxf->force_dims == GAIA_DXF_FORCE_2D
-			  || dxf->force_dims == GAIA_DXF_FORCE_3D)
-			  ;
-		      else
-			{
-			    if (is_3d_line (ln))
-				lyr->is3Dpolyg = 1;
-			}
+		      if (is_3d_line (ln))
+			  lyr->is3Dpolyg = 1;
 		  }
+	    }
+	  else
+	    {
+		/* it's a Linestring */
+		if (lyr->first_line == NULL)
+		    lyr->first_line = ln;
+		if (lyr->last_line != NULL)
+		    lyr->last_line->next = ln;
+		lyr->last_line = ln;
+		if (dxf->force_dims == GAIA_DXF_FORCE_2D
+		    || dxf->force_dims == GAIA_DXF_FORCE_3D)
+		    ;
 		else
 		  {
-		      /* it's a Linestring */
-		      if (lyr->first_line == NULL)
-			  lyr->first_line = ln;
-		      if (lyr->last_line != NULL)
-			  lyr->last_line->next = ln;
-		      lyr->last_line = ln;
-		      if (dxf->force_dims == GAIA_DXF_FORCE_2D
-			  || dxf->force_dims == GAIA_DXF_FORCE_3D)
-			  ;
-		      else
-			{
-			    if (is_3d_line (ln))
-				lyr->is3Dline = 1;
-			}
+		      if (is_3d_line (ln))
+			  lyr->is3Dline = 1;
 		  }
-		ln->first = dxf->first_ext;
-		ln->last = dxf->last_ext;
-		dxf->first_ext = NULL;
-		dxf->last_ext = NULL;
-		if (ln->is_closed && ln->first != NULL)
-		    lyr->hasExtraPolyg = 1;
-		if (ln->is_closed == 0 && ln->first != NULL)
-		    lyr->hasExtraLine = 1;
-		return;
-	    }
-	  lyr = lyr->next;
+	    }
+	  ln->first = dxf->first_ext;
+	  ln->last = dxf->last_ext;
+	  dxf->first_ext = NULL;
+	  dxf->last_ext = NULL;
+	  if (ln->is_closed && ln->first != NULL)
+	      lyr->hasExtraPolyg = 1;
+	  if (ln->is_closed == 0 && ln->first != NULL)
+	      lyr->hasExtraLine = 1;
+	  return;
       }
     destroy_dxf_polyline (ln);
 }
@@ -1638,6 +1783,12 @@ insert_dxf_block (gaiaDxfParserPtr dxf)
     if (dxf->last_block != NULL)
 	dxf->last_block->next = blk;
     dxf->last_block = blk;
+    if (find_dxf_block (dxf, blk->layer_name, blk->block_id) == NULL)
+      {
+	  /* only the first Block sharing the same Id is ever referenced */
+	  dxf_hash_add ((struct dxf_hash_index *) (dxf->blocks_index),
+			dxf_block_hash (blk->layer_name, blk->block_id), blk);
+      }
 }
 
 static gaiaDxfLayerPtr
@@ -1803,6 +1954,12 @@ insert_dxf_layer (gaiaDxfParserPtr dxf, gaiaDxfLayerPtr lyr)
     if (dxf->last_layer != NULL)
 	dxf->last_layer->next = lyr;
     dxf->last_layer = lyr;
+    if (find_dxf_layer (dxf, lyr->layer_name) == NULL)
+      {
+	  /* only the first Layer sharing the same Name is ever referenced */
+	  dxf_hash_add ((struct dxf_hash_index *) (dxf->layers_index),
+			dxf_layer_hash (lyr->layer_name), lyr);
+      }
 }
 
 static void
@@ -1820,19 +1977,9 @@ force_missing_layer (gaiaDxfParserPtr dxf)
       }
     if (ok_layer)
       {
-	  int already_defined = 0;
-	  gaiaDxfLayerPtr lyr = dxf->first_layer;
-	  while (lyr != NULL)
-	    {
-		if (strcmp (lyr->layer_name, dxf->curr_layer_name) == 0)
-		  {
-		      already_defined = 1;
-		      break;
-		  }
-		lyr = lyr->next;
-	    }
-	  if (already_defined)
-	      return;
+	  gaiaDxfLayerPtr lyr = find_dxf_layer (dxf, dxf->curr_layer_name);
+	  if (lyr != NULL)
+	      return;		/* already defined */
 	  lyr = alloc_dxf_layer (dxf->curr_layer_name, dxf->force_dims);
 	  insert_dxf_layer (dxf, lyr);
       }
@@ -1993,28 +2140,6 @@ reset_dxf_block (gaiaDxfParserPtr dxf)
     dxf->curr_block.is3Dpolyg = 0;
 }
 
-static gaiaDxfBlockPtr
-find_dxf_block (gaiaDxfParserPtr dxf, const char *layer_name,
-		const char *block_id)
-{
-/* attempting to find a Block object by its Id */
-    gaiaDxfBlockPtr blk = dxf->first_block;
-    while (blk != NULL)
-      {
-	  if (layer_name != NULL && block_id != NULL)
-	    {
-		if (strcmp (blk->layer_name, layer_name) == 0
-		    && strcmp (blk->block_id, block_id) == 0)
-		  {
-		      /* ok, matching item found */
-		      return blk;
-		  }
-	    }
-	  blk = blk->next;
-      }
-    return NULL;
-}
-
 static void
 save_current_circle (gaiaDxfParserPtr dxf)
 {
@@ -3300,6 +3425,8 @@ gaiaCreateDxfParser (int srid,
     dxf->last_layer = NULL;
     dxf->first_block = NULL;
     dxf->last_block = NULL;
+    dxf->layers_index = alloc_dxf_hash_index ();
+    dxf->blocks_index = alloc_dxf_hash_index ();
     dxf->curr_hatch = NULL;
     dxf->force_dims = force_dims;
     if (srid <= 0)
@@ -3371,6 +3498,8 @@ gaiaDestroyDxfParser (gaiaDxfParserPtr dxf)
       }
     if (dxf->curr_hatch != NULL)
 	destroy_dxf_hatch (dxf->curr_hatch);
+    destroy_dxf_hash_index ((struct dxf_hash_index *) (dxf->layers_index));
+    destroy_dxf_hash_index ((struct dxf_hash_index *) (dxf->blocks_index));
     reset_dxf_block (dxf);
     free (dxf);
 }
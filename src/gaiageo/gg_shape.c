@@ -57,6 +57,12 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "config.h"
 #endif
 
+#if !defined(_WIN32) && !defined(WIN32)
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 #if OMIT_ICONV == 0		/* if ICONV is disabled no SHP support is available */
 
 #if defined(__MINGW32__) || defined(_WIN32)
@@ -362,6 +368,286 @@ gaiaCloneDbfEntity (gaiaDbfListPtr org)
     return entity;
 }
 
+#define SHP_MAPPED_SHX	0
+#define SHP_MAPPED_SHP	1
+#define SHP_MAPPED_DBF	2
+
+struct shp_mapped_file
+{
+/* a read-only memory-mapped file */
+    unsigned char *Base;
+    size_t Size;
+    size_t Pos;
+};
+
+struct shp_mapped_files
+{
+/* the memory-mapped SHX, SHP and DBF files */
+    struct shp_mapped_file Files[3];
+};
+
+static int
+shp_map_file (FILE * fl, struct shp_mapped_file *map)
+{
+/* attempting to memory-map a file already opened for reading */
+#if !defined(_WIN32) && !defined(WIN32)
+    struct stat st;
+    void *base;
+#endif
+    map->Base = NULL;
+    map->Size = 0;
+    map->Pos = 0;
+    if (fl == NULL)
+	return 0;
+#if !defined(_WIN32) && !defined(WIN32)
+    if (fstat (fileno (fl), &st) != 0)
+	return 0;
+    if (st.st_size <= 0 || (off_t) ((size_t) st.st_size) != st.st_size)
+	return 0;
+    base =
+	mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno (fl),
+	      0);
+    if (base == MAP_FAILED)
+	return 0;
+    map->Base = base;
+    map->Size = (size_t) st.st_size;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static void *
+shp_map_files (FILE * fl_shx, FILE * fl_shp, FILE * fl_dbf)
+{
+/*
+/ memory-mapping the Shapefile's files
+/ NULL means that plain stdio will be used for all of them
+*/
+    int mapped = 0;
+    struct shp_mapped_files *maps = malloc (sizeof (struct shp_mapped_files));
+    mapped += shp_map_file (fl_shx, maps->Files + SHP_MAPPED_SHX);
+    mapped += shp_map_file (fl_shp, maps->Files + SHP_MAPPED_SHP);
+    mapped += shp_map_file (fl_dbf, maps->Files + SHP_MAPPED_DBF);
+    if (!mapped)
+      {
+	  free (maps);
+	  return NULL;
+      }
+    return maps;
+}
+
+static void
+shp_unmap_files (void *map_obj)
+{
+/* releasing the memory-mapped files */
+    int i;
+    struct shp_mapped_files *maps = (struct shp_mapped_files *) map_obj;
+    if (maps == NULL)
+	return;
+#if !defined(_WIN32) && !defined(WIN32)
+    for (i = 0; i < 3; i++)
+      {
+	  if (maps->Files[i].Base != NULL)
+	      munmap (maps->Files[i].Base, maps->Files[i].Size);
+      }
+#else
+    i = 0;			/* unused variable warning suppression */
+#endif
+    free (maps);
+}
+
+/* size of the stdio buffers supporting the output files */
+#define SHP_OUTPUT_BUFSIZE	(1024 * 1024)
+
+struct shp_output_buffers
+{
+/* the stdio buffers of the SHX, SHP and DBF output files */
+    char *Buffers[3];
+};
+
+static void *
+shp_buffer_files (FILE * fl_shx, FILE * fl_shp, FILE * fl_dbf)
+{
+/*
+/ setting up large stdio buffers for the Shapefile's output files,
+/ so that each feature doesn't cost several tiny writes
+/ must be called before any other I/O operation on these files
+*/
+    FILE *files[3];
+    int i;
+    struct shp_output_buffers *bufs =
+	malloc (sizeof (struct shp_output_buffers));
+    files[SHP_MAPPED_SHX] = fl_shx;
+    files[SHP_MAPPED_SHP] = fl_shp;
+    files[SHP_MAPPED_DBF] = fl_dbf;
+    for (i = 0; i < 3; i++)
+      {
+	  bufs->Buffers[i] = NULL;
+	  if (files[i] == NULL)
+	      continue;
+	  bufs->Buffers[i] = malloc (SHP_OUTPUT_BUFSIZE);
+	  if (bufs->Buffers[i] == NULL)
+	      continue;
+	  if (setvbuf (files[i], bufs->Buffers[i], _IOFBF, SHP_OUTPUT_BUFSIZE)
+	      != 0)
+	    {
+		/* defaulting to the standard stdio buffer */
+		free (bufs->Buffers[i]);
+		bufs->Buffers[i] = NULL;
+	    }
+      }
+    return bufs;
+}
+
+static void
+shp_free_buffers (void *buf_obj)
+{
+/* releasing the output buffers: the files must be already closed */
+    int i;
+    struct shp_output_buffers *bufs = (struct shp_output_buffers *) buf_obj;
+    if (bufs == NULL)
+	return;
+    for (i = 0; i < 3; i++)
+      {
+	  if (bufs->Buffers[i] != NULL)
+	      free (bufs->Buffers[i]);
+      }
+    free (bufs);
+}
+
+static struct shp_mapped_file *
+shp_mapped (void *map_obj, int which)
+{
+/* returns the memory-mapped file; NULL means stdio */
+    struct shp_mapped_files *maps = (struct shp_mapped_files *) map_obj;
+    if (maps == NULL || maps->Files[which].Base == NULL)
+	return NULL;
+    return maps->Files + which;
+}
+
+static int
+shp_seek (FILE * fl, struct shp_mapped_file *map, int offset)
+{
+/* positioning a file at the given offset */
+    if (map == NULL)
+	return fseek (fl, offset, SEEK_SET);
+    if (offset < 0)
+	return -1;
+    map->Pos = offset;
+    return 0;
+}
+
+static int
+shp_read (FILE * fl, struct shp_mapped_file *map, unsigned char *buf,
+	  int len, const unsigned char **data)
+{
+/*
+/ reading the next LEN bytes from a file; returns the count of bytes read
+/ and sets DATA to point to them
+/ memory-mapped files are accessed in place (bounds-checked, no copy),
+/ otherwise the bytes are read into BUF
+*/
+    size_t avail;
+    *data = buf;
+    if (len <= 0)
+	return 0;
+    if (map == NULL)
+	return fread (buf, sizeof (unsigned char), len, fl);
+    avail = (map->Pos < map->Size) ? map->Size - map->Pos : 0;
+    if ((size_t) len > avail)
+	len = avail;
+    *data = map->Base + map->Pos;
+    map->Pos += len;
+    return len;
+}
+
+/*
+/ fast DBF record decoding
+/
+/ when the charset conversion leaves any ASCII char untouched (this is
+/ checked once, by actually converting all ASCII chars) pure ASCII text
+/ fields are directly copied, and all other text fields belonging to the
+/ same record are converted by a single iconv() call, using NUL chars
+/ as separators; numeric fields are parsed in place
+*/
+
+struct shp_dbf_decoder
+{
+/* the DBF record decoder */
+    char *Text;			/* the text fields to be converted */
+    size_t TextSize;
+    char *Utf8;			/* the converted text fields */
+    size_t Utf8Size;
+    gaiaDbfFieldPtr *Pending;	/* the text fields to be converted */
+};
+
+static void *
+shp_alloc_decoder (void *iconv_obj, gaiaDbfListPtr list, int reclen)
+{
+/*
+/ creating the DBF record decoder
+/ NULL means that the charsets aren't ASCII-compatible
+*/
+    char ascii[128];
+    char out[512];
+#if !defined(__MINGW32__) && defined(_WIN32)
+    const char *pBuf;
+#else /* not WIN32 */
+    char *pBuf;
+#endif
+    char *pOut;
+    size_t len;
+    size_t out_len;
+    size_t ret;
+    int i;
+    int count = 0;
+    gaiaDbfFieldPtr pFld;
+    struct shp_dbf_decoder *decoder;
+    if (iconv_obj == NULL || list == NULL)
+	return NULL;
+    for (i = 0; i < 128; i++)
+	ascii[i] = (char) i;
+    pBuf = ascii;
+    len = 128;
+    pOut = out;
+    out_len = sizeof (out);
+    ret = iconv ((iconv_t) (iconv_obj), &pBuf, &len, &pOut, &out_len);
+/* resetting the conversion state */
+    iconv ((iconv_t) (iconv_obj), NULL, NULL, NULL, NULL);
+    if (ret == (size_t) (-1) || len != 0 || out_len != sizeof (out) - 128)
+	return NULL;
+    if (memcmp (out, ascii, 128) != 0)
+	return NULL;
+    pFld = list->First;
+    while (pFld)
+      {
+	  count++;
+	  pFld = pFld->Next;
+      }
+    decoder = malloc (sizeof (struct shp_dbf_decoder));
+    decoder->TextSize = reclen + count + 1;
+    decoder->Text = malloc (decoder->TextSize);
+/* twice the input covers any Latin text; longer outputs fall back */
+    decoder->Utf8Size = decoder->TextSize * 2;
+    decoder->Utf8 = malloc (decoder->Utf8Size);
+    decoder->Pending = malloc (sizeof (gaiaDbfFieldPtr) * (count + 1));
+    return decoder;
+}
+
+static void
+shp_free_decoder (void *decoder_obj)
+{
+/* destroying the DBF record decoder */
+    struct shp_dbf_decoder *decoder = (struct shp_dbf_decoder *) decoder_obj;
+    if (decoder == NULL)
+	return;
+    free (decoder->Text);
+    free (decoder->Utf8);
+    free (decoder->Pending);
+    free (decoder);
+}
+
 GAIAGEO_DECLARE gaiaShapefilePtr
 gaiaAllocShapefile ()
 {
@@ -392,6 +678,9 @@ gaiaAllocShapefile ()
     shp->Valid = 0;
     shp->IconvObj = NULL;
     shp->LastError = NULL;
+    shp->MapObj = NULL;
+    shp->DecoderObj = NULL;
+    shp->BuffersObj = NULL;
     return shp;
 }
 
@@ -417,6 +706,12 @@ gaiaFreeShapefile (gaiaShapefilePtr shp)
 	iconv_close ((iconv_t) shp->IconvObj);
     if (shp->LastError)
 	free (shp->LastError);
+    if (shp->MapObj)
+	shp_unmap_files (shp->MapObj);
+    if (shp->DecoderObj)
+	shp_free_decoder (shp->DecoderObj);
+    if (shp->BuffersObj)
+	shp_free_buffers (shp->BuffersObj);
     free (shp);
 }
 
@@ -623,8 +918,15 @@ gaiaOpenShpRead (gaiaShapefilePtr shp, const char *path, const char *charFrom,
     shp->BufDbf = malloc (sizeof (unsigned char) * dbf_reclen);
     shp->DbfHdsz = dbf_size + 1;
     shp->DbfReclen = dbf_reclen;
+/* SHP and SHX file sizes [in 16 bits words !!!], as declared by the headers */
+    shp->ShpSize = gaiaImport32 (buf_shp + 24, GAIA_BIG_ENDIAN, endian_arch);
+    shp->ShxSize = gaiaImport32 (buf_shx + 24, GAIA_BIG_ENDIAN, endian_arch);
     shp->Valid = 1;
     shp->endian_arch = endian_arch;
+/* attempting to memory-map the files; stdio is used when this fails */
+    shp->MapObj = shp_map_files (fl_shx, fl_shp, fl_dbf);
+/* the fast DBF decoder requires ASCII-compatible charsets */
+    shp->DecoderObj = shp_alloc_decoder (shp->IconvObj, dbf_list, dbf_reclen);
     return;
   unsupported_conversion:
 /* illegal charset */
@@ -933,6 +1235,7 @@ gaiaOpenShpWrite (gaiaShapefilePtr shp, const char *path, int shape,
 		   sys_err);
 	  goto no_file;
       }
+    shp->BuffersObj = shp_buffer_files (fl_shx, fl_shp, fl_dbf);
 /* allocating DBF buffer */
     dbf_reclen = 1;		/* an extra byte is needed because in DBF rows first byte is a marker for deletion */
     fld = dbf_list->First;
@@ -1228,7 +1531,8 @@ to_sqlite_julian_date (int year, int month, int day, double *julian)
 }
 
 static int
-parseDbfField (unsigned char *buf_dbf, void *iconv_obj, gaiaDbfFieldPtr pFld)
+parseDbfField (const unsigned char *buf_dbf, void *iconv_obj,
+	       gaiaDbfFieldPtr pFld)
 {
 /* parsing a generic DBF field */
     unsigned char buf[512];
@@ -1320,17 +1624,243 @@ parseDbfField (unsigned char *buf_dbf, void *iconv_obj, gaiaDbfFieldPtr pFld)
 			  break;
 		  }
 		len = strlen ((char *) buf);
-		utf8len = 2048;
+		utf8len = 2047;
 		pBuf = (char *) buf;
 		pUtf8buf = utf8buf;
 		if (iconv
 		    ((iconv_t) (iconv_obj), &pBuf, &len, &pUtf8buf,
 		     &utf8len) == (size_t) (-1))
 		    return 0;
-		memcpy (buf, utf8buf, 2048 - utf8len);
-		buf[2048 - utf8len] = '\0';
-		gaiaSetStrValue (pFld, (char *) buf);
+		/* the converted text may well exceed the field buffer */
+		utf8buf[2047 - utf8len] = '\0';
+		gaiaSetStrValue (pFld, utf8buf);
+	    }
+      }
+    return 1;
+}
+
+static void
+shp_set_text_value (gaiaDbfFieldPtr field, const char *str, int len)
+{
+/* same as gaiaSetStrValue(), but the string isn't NUL-terminated */
+    if (field->Value)
+	gaiaFreeValue (field->Value);
+    field->Value = malloc (sizeof (gaiaValue));
+    field->Value->Type = GAIA_TEXT_VALUE;
+    field->Value->TxtValue = malloc (len + 1);
+    memcpy (field->Value->TxtValue, str, len);
+    *(field->Value->TxtValue + len) = '\0';
+}
+
+static sqlite3_int64
+shp_parse_int (const unsigned char *p, int length)
+{
+/* same as atoll(), directly on a fixed width field [at most 18 digits] */
+    const unsigned char *end = p + length;
+    sqlite3_int64 value = 0;
+    int negative = 0;
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+	p++;
+    if (p < end && (*p == '+' || *p == '-'))
+      {
+	  negative = (*p == '-');
+	  p++;
+      }
+    while (p < end && *p >= '0' && *p <= '9')
+      {
+	  value = (value * 10) + (*p - '0');
+	  p++;
+      }
+    return negative ? -value : value;
+}
+
+static int
+shp_parse_double (const unsigned char *p, int length, double *value)
+{
+/*
+/ same as atof(), directly on a fixed width field
+/
+/ only plain decimal notation is supported, and the mantissa must be
+/ exactly representable [at most 2^53]: so a single division by an exact
+/ power of ten returns the correctly rounded value; 0 is returned in any
+/ other case
+*/
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    static const double powers[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const unsigned char *end = p + length;
+    sqlite3_int64 mantissa = 0;
+    int negative = 0;
+    int digits = 0;
+    int decimals = 0;
+    double dbl;
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+	p++;
+    if (p < end && (*p == '+' || *p == '-'))
+      {
+	  negative = (*p == '-');
+	  p++;
+      }
+    while (p < end && *p >= '0' && *p <= '9')
+      {
+	  if (mantissa >= 900719925474099)
+	      return 0;
+	  mantissa = (mantissa * 10) + (*p - '0');
+	  digits++;
+	  p++;
+      }
+    if (p < end && *p == '.')
+      {
+	  p++;
+	  while (p < end && *p >= '0' && *p <= '9')
+	    {
+		if (mantissa >= 900719925474099)
+		    return 0;
+		mantissa = (mantissa * 10) + (*p - '0');
+		digits++;
+		decimals++;
+		p++;
+	    }
+      }
+    if (digits == 0 || decimals > 22)
+	return 0;
+    if (p < end && (*p == 'e' || *p == 'E' || *p == 'x' || *p == 'X'))
+	return 0;		/* exponent or hexadecimal notation */
+    dbl = (double) mantissa;
+    if (decimals > 0)
+	dbl /= powers[decimals];
+    *value = negative ? -dbl : dbl;
+    return 1;
+#else
+    p = p;			/* unused arg warning suppression */
+    length = length;		/* unused arg warning suppression */
+    value = value;		/* unused arg warning suppression */
+    return 0;
+#endif
+}
+
+static int
+shp_parse_dbf_record (const unsigned char *buf_dbf, void *iconv_obj,
+		      void *decoder_obj, gaiaDbfListPtr list,
+		      const char *read_fields)
+{
+/* parsing all the required fields of a DBF record */
+    struct shp_dbf_decoder *decoder = (struct shp_dbf_decoder *) decoder_obj;
+    gaiaDbfFieldPtr pFld;
+    const unsigned char *p;
+    double dbl;
+    int ifld;
+    int len;
+    int i;
+    int pending = 0;
+    size_t text_len = 0;
+#if !defined(__MINGW32__) && defined(_WIN32)
+    const char *pBuf;
+#else /* not WIN32 */
+    char *pBuf;
+#endif
+    char *pUtf8buf;
+    char *pText;
+    char *pEnd;
+    size_t in_len;
+    size_t utf8len;
+    pFld = list->First;
+    ifld = 0;
+    while (pFld)
+      {
+	  if (read_fields != NULL && !read_fields[ifld])
+	      goto next;
+	  if (decoder == NULL)
+	    {
+		/* slow path: field by field */
+		if (!parseDbfField (buf_dbf, iconv_obj, pFld))
+		    return 0;
+		goto next;
+	    }
+	  p = buf_dbf + pFld->Offset + 1;
+	  if (*p == '\0')
+	    {
+		gaiaSetNullValue (pFld);
+		goto next;
+	    }
+	  if (pFld->Type == 'N' && pFld->Decimals == 0 && pFld->Length <= 18)
+	    {
+		/* INTEGER value */
+		gaiaSetIntValue (pFld, shp_parse_int (p, pFld->Length));
+		goto next;
+	    }
+	  if ((pFld->Type == 'N' || pFld->Type == 'F')
+	      && shp_parse_double (p, pFld->Length, &dbl))
+	    {
+		/* DOUBLE value */
+		gaiaSetDoubleValue (pFld, dbl);
+		goto next;
 	    }
+	  if (pFld->Type == 'N' || pFld->Type == 'F' || pFld->Type == 'D'
+	      || pFld->Type == 'L')
+	    {
+		/* any other non-text value */
+		if (!parseDbfField (buf_dbf, iconv_obj, pFld))
+		    return 0;
+		goto next;
+	    }
+	  /* CHARACTER value: cleaning up trailing spaces */
+	  len = 0;
+	  while (len < pFld->Length && p[len] != '\0')
+	      len++;
+	  while (len > 0 && p[len - 1] == ' ')
+	      len--;
+	  for (i = 0; i < len; i++)
+	    {
+		if (p[i] & 0x80)
+		    break;
+	    }
+	  if (i == len)
+	    {
+		/* pure ASCII: no conversion is required */
+		shp_set_text_value (pFld, (const char *) p, len);
+		goto next;
+	    }
+	  memcpy (decoder->Text + text_len, p, len);
+	  text_len += len;
+	  decoder->Text[text_len++] = '\0';
+	  decoder->Pending[pending++] = pFld;
+	next:
+	  ifld++;
+	  pFld = pFld->Next;
+      }
+    if (pending == 0)
+	return 1;
+/* converting all the pending text fields at once */
+    pBuf = decoder->Text;
+    in_len = text_len;
+    pUtf8buf = decoder->Utf8;
+    utf8len = decoder->Utf8Size;
+    if (iconv
+	((iconv_t) (iconv_obj), &pBuf, &in_len, &pUtf8buf,
+	 &utf8len) == (size_t) (-1))
+      {
+	  if (errno != E2BIG)
+	      return 0;
+	  /* unexpectedly long: converting field by field */
+	  iconv ((iconv_t) (iconv_obj), NULL, NULL, NULL, NULL);
+	  for (i = 0; i < pending; i++)
+	    {
+		if (!parseDbfField (buf_dbf, iconv_obj, decoder->Pending[i]))
+		    return 0;
+	    }
+	  return 1;
+      }
+    pText = decoder->Utf8;
+    for (i = 0; i < pending; i++)
+      {
+	  pEnd = memchr (pText, '\0', pUtf8buf - pText);
+	  if (pEnd == NULL)
+	      return 0;
+	  shp_set_text_value (decoder->Pending[i], pText, pEnd - pText);
+	  pText = pEnd + 1;
       }
     return 1;
 }
@@ -1548,6 +2078,72 @@ GAIAGEO_DECLARE int
 gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 {
 /* trying to read an entity from shapefile */
+    return gaiaReadShpEntity_ex (shp, current_row, srid, 1, NULL);
+}
+
+static int
+shp_check_record (int shape, int sz, const unsigned char *bufshp,
+		  int endian_arch)
+{
+/*
+/ checking a MULTIPOINT, POLYLINE or POLYGON record before accessing it:
+/ the declared parts, points and Z range must fit into the record length
+/ and any part offset must be within the points range
+/ [any M range is only accessed when the record length exactly covers it]
+/ returns 0 if the record is corrupted
+*/
+    int len = (sz * 2) - 36;
+    int n;
+    int n1;
+    int base;
+    int ind;
+    int start;
+    int end;
+    if (len < 4)
+	return 0;
+    n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, endian_arch);
+    if (shape == GAIA_SHP_MULTIPOINT || shape == GAIA_SHP_MULTIPOINTZ
+	|| shape == GAIA_SHP_MULTIPOINTM)
+      {
+	  if (n < 0 || n > (len - 4) / 16)
+	      return 0;
+	  base = 4;
+	  n1 = n;
+      }
+    else
+      {
+	  if (len < 8 || n < 0 || n > (len - 8) / 4)
+	      return 0;
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN, endian_arch);
+	  base = 8 + (n * 4);
+	  if (n1 < 0 || n1 > (len - base) / 16)
+	      return 0;
+	  start = 0;
+	  for (ind = 1; ind < n; ind++)
+	    {
+		/* the first part always starts from the first point */
+		end = gaiaImport32 (bufshp + 8 + (ind * 4),
+				    GAIA_LITTLE_ENDIAN, endian_arch);
+		if (end < start || end > n1)
+		    return 0;
+		start = end;
+	    }
+      }
+    if (shape == GAIA_SHP_MULTIPOINTZ || shape == GAIA_SHP_POLYLINEZ
+	|| shape == GAIA_SHP_POLYGONZ)
+      {
+	  /* the Z range and values are mandatory */
+	  if (n1 > (len - base - 16) / 24)
+	      return 0;
+      }
+    return 1;
+}
+
+GAIAGEO_DECLARE int
+gaiaReadShpEntity_ex (gaiaShapefilePtr shp, int current_row, int srid,
+		      int read_geometry, const char *read_fields)
+{
+/* trying to read an entity from shapefile [selected columns only] */
     unsigned char buf[512];
     int len;
     int rd;
@@ -1577,39 +2173,49 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     gaiaGeomCollPtr geom = NULL;
     gaiaLinestringPtr line = NULL;
     gaiaRingPtr ring = NULL;
-    gaiaDbfFieldPtr pFld;
     struct shp_ring_collection ringsColl;
+    const unsigned char *p_buf;
+    const unsigned char *bufshp;
+    const unsigned char *bufdbf;
+    struct shp_mapped_file *map_shx = shp_mapped (shp->MapObj, SHP_MAPPED_SHX);
+    struct shp_mapped_file *map_shp = shp_mapped (shp->MapObj, SHP_MAPPED_SHP);
+    struct shp_mapped_file *map_dbf = shp_mapped (shp->MapObj, SHP_MAPPED_DBF);
 /* initializing the RING collection */
     ringsColl.First = NULL;
     ringsColl.Last = NULL;
 /* positioning and reading the SHX file */
     offset = 100 + (current_row * 8);	/* 100 bytes for the header + current row displacement; each SHX row = 8 bytes */
-    skpos = fseek (shp->flShx, offset, SEEK_SET);
+    skpos = shp_seek (shp->flShx, map_shx, offset);
     if (skpos != 0)
 	goto eof;
-    rd = fread (buf, sizeof (unsigned char), 8, shp->flShx);
+    rd = shp_read (shp->flShx, map_shx, buf, 8, &p_buf);
     if (rd != 8)
 	goto eof;
-    off_shp = gaiaImport32 (buf, GAIA_BIG_ENDIAN, shp->endian_arch);
+    off_shp = gaiaImport32 (p_buf, GAIA_BIG_ENDIAN, shp->endian_arch);
 /* positioning and reading the DBF file */
     offset = shp->DbfHdsz + (current_row * shp->DbfReclen);
-    skpos = fseek (shp->flDbf, offset, SEEK_SET);
+    skpos = shp_seek (shp->flDbf, map_dbf, offset);
     if (skpos != 0)
 	goto error;
-    rd = fread (shp->BufDbf, sizeof (unsigned char), shp->DbfReclen,
-		shp->flDbf);
+    rd = shp_read (shp->flDbf, map_dbf, shp->BufDbf, shp->DbfReclen,
+		   &bufdbf);
     if (rd != shp->DbfReclen)
 	goto error;
+    if (!read_geometry)
+      {
+	  /* the Geometry isn't required at all */
+	  goto null_shape;
+      }
 /* positioning and reading corresponding SHP entity - geometry */
     offset = off_shp * 2;
-    skpos = fseek (shp->flShp, offset, SEEK_SET);
+    skpos = shp_seek (shp->flShp, map_shp, offset);
     if (skpos != 0)
 	goto error;
-    rd = fread (buf, sizeof (unsigned char), 12, shp->flShp);
+    rd = shp_read (shp->flShp, map_shp, buf, 12, &p_buf);
     if (rd != 12)
 	goto error;
-    sz = gaiaImport32 (buf + 4, GAIA_BIG_ENDIAN, shp->endian_arch);
-    shape = gaiaImport32 (buf + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    sz = gaiaImport32 (p_buf + 4, GAIA_BIG_ENDIAN, shp->endian_arch);
+    shape = gaiaImport32 (p_buf + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
     if (shape == GAIA_SHP_NULL)
       {
 	  /* handling a NULL shape */
@@ -1617,7 +2223,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
       }
     else if (shape != shp->Shape)
 	goto error;
-    if ((sz * 2) > shp->ShpBfsz)
+    if (map_shp == NULL && (sz * 2) > shp->ShpBfsz)
       {
 	  /* current buffer is too small; we need to allocate a bigger buffer */
 	  free (shp->BufShp);
@@ -1627,11 +2233,11 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POINT)
       {
 	  /* shape point */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 16, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 16, &bufshp);
 	  if (rd != 16)
 	      goto error;
-	  x = gaiaImport64 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  y = gaiaImport64 (shp->BufShp + 8, GAIA_LITTLE_ENDIAN,
+	  x = gaiaImport64 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  y = gaiaImport64 (bufshp + 8, GAIA_LITTLE_ENDIAN,
 			    shp->endian_arch);
 	  if (shp->EffectiveDims == GAIA_XY_Z)
 	    {
@@ -1659,22 +2265,22 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POINTZ)
       {
 	  /* shape point Z */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	    {
 		/* required by some buggish SHP (e.g. the GDAL/OGR ones) */
 		if (rd != 24)
 		    goto error;
 	    }
-	  x = gaiaImport64 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  y = gaiaImport64 (shp->BufShp + 8, GAIA_LITTLE_ENDIAN,
+	  x = gaiaImport64 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  y = gaiaImport64 (bufshp + 8, GAIA_LITTLE_ENDIAN,
 			    shp->endian_arch);
-	  z = gaiaImport64 (shp->BufShp + 16, GAIA_LITTLE_ENDIAN,
+	  z = gaiaImport64 (bufshp + 16, GAIA_LITTLE_ENDIAN,
 			    shp->endian_arch);
 	  if (rd == 24)
 	      m = 0.0;
 	  else
-	      m = gaiaImport64 (shp->BufShp + 24, GAIA_LITTLE_ENDIAN,
+	      m = gaiaImport64 (bufshp + 24, GAIA_LITTLE_ENDIAN,
 				shp->endian_arch);
 	  if (shp->EffectiveDims == GAIA_XY_Z)
 	    {
@@ -1702,13 +2308,13 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POINTM)
       {
 	  /* shape point M */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 24, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 24, &bufshp);
 	  if (rd != 24)
 	      goto error;
-	  x = gaiaImport64 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  y = gaiaImport64 (shp->BufShp + 8, GAIA_LITTLE_ENDIAN,
+	  x = gaiaImport64 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  y = gaiaImport64 (bufshp + 8, GAIA_LITTLE_ENDIAN,
 			    shp->endian_arch);
-	  m = gaiaImport64 (shp->BufShp + 16, GAIA_LITTLE_ENDIAN,
+	  m = gaiaImport64 (bufshp + 16, GAIA_LITTLE_ENDIAN,
 			    shp->endian_arch);
 	  if (shp->EffectiveDims == GAIA_XY_Z)
 	    {
@@ -1736,15 +2342,17 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POLYLINE)
       {
 	  /* shape polyline */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN,
 			     shp->endian_arch);
 	  base = 8 + (n * 4);
 	  start = 0;
@@ -1752,7 +2360,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	    {
 		if (ind < (n - 1))
 		    end =
-			gaiaImport32 (shp->BufShp + 8 + ((ind + 1) * 4),
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    end = n1;
@@ -1768,9 +2376,9 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 		points = 0;
 		for (iv = start; iv < end; iv++)
 		  {
-		      x = gaiaImport64 (shp->BufShp + base + (iv * 16),
+		      x = gaiaImport64 (bufshp + base + (iv * 16),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		      y = gaiaImport64 (shp->BufShp + base + (iv * 16) +
+		      y = gaiaImport64 (bufshp + base + (iv * 16) +
 					8, GAIA_LITTLE_ENDIAN,
 					shp->endian_arch);
 		      if (shp->EffectiveDims == GAIA_XY_Z)
@@ -1815,15 +2423,17 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POLYLINEZ)
       {
 	  /* shape polyline Z */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN,
 			     shp->endian_arch);
 	  hasM = 0;
 	  max_size = 38 + (2 * n) + (n1 * 16);	/* size [in 16 bits words !!!] ZM */
@@ -1840,7 +2450,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	    {
 		if (ind < (n - 1))
 		    end =
-			gaiaImport32 (shp->BufShp + 8 + ((ind + 1) * 4),
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    end = n1;
@@ -1856,15 +2466,15 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 		points = 0;
 		for (iv = start; iv < end; iv++)
 		  {
-		      x = gaiaImport64 (shp->BufShp + base + (iv * 16),
+		      x = gaiaImport64 (bufshp + base + (iv * 16),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		      y = gaiaImport64 (shp->BufShp + base + (iv * 16) +
+		      y = gaiaImport64 (bufshp + base + (iv * 16) +
 					8, GAIA_LITTLE_ENDIAN,
 					shp->endian_arch);
-		      z = gaiaImport64 (shp->BufShp + baseZ + (iv * 8),
+		      z = gaiaImport64 (bufshp + baseZ + (iv * 8),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		      if (hasM)
-			  m = gaiaImport64 (shp->BufShp + baseM +
+			  m = gaiaImport64 (bufshp + baseM +
 					    (iv * 8), GAIA_LITTLE_ENDIAN,
 					    shp->endian_arch);
 		      else
@@ -1912,15 +2522,17 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POLYLINEM)
       {
 	  /* shape polyline M */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN,
 			     shp->endian_arch);
 	  hasM = 0;
 	  max_size = 30 + (2 * n) + (n1 * 12);	/* size [in 16 bits words !!!] M */
@@ -1936,7 +2548,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	    {
 		if (ind < (n - 1))
 		    end =
-			gaiaImport32 (shp->BufShp + 8 + ((ind + 1) * 4),
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    end = n1;
@@ -1952,13 +2564,13 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 		points = 0;
 		for (iv = start; iv < end; iv++)
 		  {
-		      x = gaiaImport64 (shp->BufShp + base + (iv * 16),
+		      x = gaiaImport64 (bufshp + base + (iv * 16),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		      y = gaiaImport64 (shp->BufShp + base + (iv * 16) +
+		      y = gaiaImport64 (bufshp + base + (iv * 16) +
 					8, GAIA_LITTLE_ENDIAN,
 					shp->endian_arch);
 		      if (hasM)
-			  m = gaiaImport64 (shp->BufShp + baseM +
+			  m = gaiaImport64 (bufshp + baseM +
 					    (iv * 8), GAIA_LITTLE_ENDIAN,
 					    shp->endian_arch);
 		      else
@@ -2007,15 +2619,17 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POLYGON)
       {
 	  /* shape polygon */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN,
 			     shp->endian_arch);
 	  base = 8 + (n * 4);
 	  start = 0;
@@ -2023,7 +2637,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	    {
 		if (ind < (n - 1))
 		    end =
-			gaiaImport32 (shp->BufShp + 8 + ((ind + 1) * 4),
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    end = n1;
@@ -2039,9 +2653,9 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 		points = 0;
 		for (iv = start; iv < end; iv++)
 		  {
-		      x = gaiaImport64 (shp->BufShp + base + (iv * 16),
+		      x = gaiaImport64 (bufshp + base + (iv * 16),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		      y = gaiaImport64 (shp->BufShp + base + (iv * 16) +
+		      y = gaiaImport64 (bufshp + base + (iv * 16) +
 					8, GAIA_LITTLE_ENDIAN,
 					shp->endian_arch);
 		      if (shp->EffectiveDims == GAIA_XY_Z)
@@ -2086,15 +2700,17 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POLYGONZ)
       {
 	  /* shape polygon Z */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN,
 			     shp->endian_arch);
 	  hasM = 0;
 	  max_size = 38 + (2 * n) + (n1 * 16);	/* size [in 16 bits words !!!] ZM */
@@ -2111,7 +2727,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	    {
 		if (ind < (n - 1))
 		    end =
-			gaiaImport32 (shp->BufShp + 8 + ((ind + 1) * 4),
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    end = n1;
@@ -2127,15 +2743,15 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 		points = 0;
 		for (iv = start; iv < end; iv++)
 		  {
-		      x = gaiaImport64 (shp->BufShp + base + (iv * 16),
+		      x = gaiaImport64 (bufshp + base + (iv * 16),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		      y = gaiaImport64 (shp->BufShp + base + (iv * 16) +
+		      y = gaiaImport64 (bufshp + base + (iv * 16) +
 					8, GAIA_LITTLE_ENDIAN,
 					shp->endian_arch);
-		      z = gaiaImport64 (shp->BufShp + baseZ + (iv * 8),
+		      z = gaiaImport64 (bufshp + baseZ + (iv * 8),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		      if (hasM)
-			  m = gaiaImport64 (shp->BufShp + baseM +
+			  m = gaiaImport64 (bufshp + baseM +
 					    (iv * 8), GAIA_LITTLE_ENDIAN,
 					    shp->endian_arch);
 		      else
@@ -2183,15 +2799,17 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_POLYGONM)
       {
 	  /* shape polygon M */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN,
 			     shp->endian_arch);
 	  hasM = 0;
 	  max_size = 30 + (2 * n) + (n1 * 12);	/* size [in 16 bits words !!!] M */
@@ -2207,7 +2825,7 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	    {
 		if (ind < (n - 1))
 		    end =
-			gaiaImport32 (shp->BufShp + 8 + ((ind + 1) * 4),
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    end = n1;
@@ -2223,13 +2841,13 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 		points = 0;
 		for (iv = start; iv < end; iv++)
 		  {
-		      x = gaiaImport64 (shp->BufShp + base + (iv * 16),
+		      x = gaiaImport64 (bufshp + base + (iv * 16),
 					GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		      y = gaiaImport64 (shp->BufShp + base + (iv * 16) +
+		      y = gaiaImport64 (bufshp + base + (iv * 16) +
 					8, GAIA_LITTLE_ENDIAN,
 					shp->endian_arch);
 		      if (hasM)
-			  m = gaiaImport64 (shp->BufShp + baseM +
+			  m = gaiaImport64 (bufshp + baseM +
 					    (iv * 8), GAIA_LITTLE_ENDIAN,
 					    shp->endian_arch);
 		      m = 0.0;
@@ -2277,14 +2895,16 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_MULTIPOINT)
       {
 	  /* shape multipoint */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
 	  if (shp->EffectiveDims == GAIA_XY_Z)
 	      geom = gaiaAllocGeomCollXYZ ();
 	  else if (shp->EffectiveDims == GAIA_XY_M)
@@ -2297,9 +2917,9 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	  geom->Srid = srid;
 	  for (iv = 0; iv < n; iv++)
 	    {
-		x = gaiaImport64 (shp->BufShp + 4 + (iv * 16),
+		x = gaiaImport64 (bufshp + 4 + (iv * 16),
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		y = gaiaImport64 (shp->BufShp + 4 + (iv * 16) + 8,
+		y = gaiaImport64 (bufshp + 4 + (iv * 16) + 8,
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		if (shp->EffectiveDims == GAIA_XY_Z)
 		    gaiaAddPointToGeomCollXYZ (geom, x, y, 0.0);
@@ -2314,14 +2934,16 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_MULTIPOINTZ)
       {
 	  /* shape multipoint Z */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
 	  hasM = 0;
 	  max_size = 38 + (n * 16);	/* size [in 16 bits words !!!] ZM */
 	  min_size = 30 + (n * 12);	/* size [in 16 bits words !!!] Z-only */
@@ -2343,14 +2965,14 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	  geom->Srid = srid;
 	  for (iv = 0; iv < n; iv++)
 	    {
-		x = gaiaImport64 (shp->BufShp + 4 + (iv * 16),
+		x = gaiaImport64 (bufshp + 4 + (iv * 16),
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		y = gaiaImport64 (shp->BufShp + 4 + (iv * 16) + 8,
+		y = gaiaImport64 (bufshp + 4 + (iv * 16) + 8,
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		z = gaiaImport64 (shp->BufShp + baseZ + (iv * 8),
+		z = gaiaImport64 (bufshp + baseZ + (iv * 8),
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		if (hasM)
-		    m = gaiaImport64 (shp->BufShp + baseM + (iv * 8),
+		    m = gaiaImport64 (bufshp + baseM + (iv * 8),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    m = 0.0;
@@ -2369,14 +2991,16 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     if (shape == GAIA_SHP_MULTIPOINTM)
       {
 	  /* shape multipoint M */
-	  rd = fread (shp->BufShp, sizeof (unsigned char), 32, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
 	  if (rd != 32)
 	      goto error;
-	  rd = fread (shp->BufShp, sizeof (unsigned char), (sz * 2) - 36,
-		      shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp,
+			 (sz * 2) - 36, &bufshp);
 	  if (rd != (sz * 2) - 36)
 	      goto error;
-	  n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  if (!shp_check_record (shape, sz, bufshp, shp->endian_arch))
+	      goto error;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
 	  hasM = 0;
 	  max_size = 30 + (n * 12);	/* size [in 16 bits words !!!] M */
 	  min_size = 22 + (n * 8);	/* size [in 16 bits words !!!] no-M */
@@ -2397,12 +3021,12 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
 	  geom->Srid = srid;
 	  for (iv = 0; iv < n; iv++)
 	    {
-		x = gaiaImport64 (shp->BufShp + 4 + (iv * 16),
+		x = gaiaImport64 (bufshp + 4 + (iv * 16),
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
-		y = gaiaImport64 (shp->BufShp + 4 + (iv * 16) + 8,
+		y = gaiaImport64 (bufshp + 4 + (iv * 16) + 8,
 				  GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		if (hasM)
-		    m = gaiaImport64 (shp->BufShp + baseM + (iv * 8),
+		    m = gaiaImport64 (bufshp + baseM + (iv * 8),
 				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
 		else
 		    m = 0.0;
@@ -2424,13 +3048,9 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     shp->Dbf->RowId = current_row;
     shp->Dbf->Geometry = geom;
 /* fetching the DBF values */
-    pFld = shp->Dbf->First;
-    while (pFld)
-      {
-	  if (!parseDbfField (shp->BufDbf, shp->IconvObj, pFld))
-	      goto conversion_error;
-	  pFld = pFld->Next;
-      }
+    if (!shp_parse_dbf_record
+	(bufdbf, shp->IconvObj, shp->DecoderObj, shp->Dbf, read_fields))
+	goto conversion_error;
     if (shp->LastError)
 	free (shp->LastError);
     shp->LastError = NULL;
@@ -2462,14 +3082,94 @@ gaiaReadShpEntity (gaiaShapefilePtr shp, int current_row, int srid)
     return 0;
 }
 
-static void
-gaiaSaneClockwise (gaiaPolygonPtr polyg)
+GAIAGEO_DECLARE int
+gaiaReadShpEntityMbr (gaiaShapefilePtr shp, int current_row, int *is_null,
+		      double *minx, double *miny, double *maxx, double *maxy)
 {
-/*
-/ when exporting POLYGONs to SHAPEFILE, we must guarantee that:
-/ - all EXTERIOR RING must be clockwise
-/ - all INTERIOR RING must be anti-clockwise
-/
+/* trying to read an entity's MBR from the shapefile record header */
+    unsigned char buf[44];
+    int len;
+    int rd;
+    int off_shp;
+    int shape;
+    char errMsg[1024];
+    const unsigned char *p_buf;
+    struct shp_mapped_file *map_shx = shp_mapped (shp->MapObj, SHP_MAPPED_SHX);
+    struct shp_mapped_file *map_shp = shp_mapped (shp->MapObj, SHP_MAPPED_SHP);
+    *is_null = 0;
+/* positioning and reading the SHX file */
+    if (shp_seek (shp->flShx, map_shx, 100 + (current_row * 8)) != 0)
+	goto eof;
+    rd = shp_read (shp->flShx, map_shx, buf, 8, &p_buf);
+    if (rd != 8)
+	goto eof;
+    off_shp = gaiaImport32 (p_buf, GAIA_BIG_ENDIAN, shp->endian_arch);
+/*
+/ reading the SHP record header: 8 bytes + the shape type, followed
+/ either by the point coordinates or by the entity's bounding box
+*/
+    if (shp_seek (shp->flShp, map_shp, off_shp * 2) != 0)
+	goto error;
+    rd = shp_read (shp->flShp, map_shp, buf, 44, &p_buf);
+    if (rd < 12)
+	goto error;
+    shape = gaiaImport32 (p_buf + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    if (shape == GAIA_SHP_NULL)
+      {
+	  /* handling a NULL shape */
+	  *is_null = 1;
+	  goto ok;
+      }
+    if (shape != shp->Shape)
+	goto error;
+    if (shape == GAIA_SHP_POINT || shape == GAIA_SHP_POINTZ
+	|| shape == GAIA_SHP_POINTM)
+      {
+	  /* a point has no bounding box */
+	  if (rd < 28)
+	      goto error;
+	  *minx = gaiaImport64 (p_buf + 12, GAIA_LITTLE_ENDIAN,
+				shp->endian_arch);
+	  *miny = gaiaImport64 (p_buf + 20, GAIA_LITTLE_ENDIAN,
+				shp->endian_arch);
+	  *maxx = *minx;
+	  *maxy = *miny;
+	  goto ok;
+      }
+    if (rd != 44)
+	goto error;
+    *minx = gaiaImport64 (p_buf + 12, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    *miny = gaiaImport64 (p_buf + 20, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    *maxx = gaiaImport64 (p_buf + 28, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    *maxy = gaiaImport64 (p_buf + 36, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+  ok:
+    if (shp->LastError)
+	free (shp->LastError);
+    shp->LastError = NULL;
+    return 1;
+  eof:
+    if (shp->LastError)
+	free (shp->LastError);
+    shp->LastError = NULL;
+    return 0;
+  error:
+    if (shp->LastError)
+	free (shp->LastError);
+    sprintf (errMsg, "'%s' is corrupted / has invalid format", shp->Path);
+    len = strlen (errMsg);
+    shp->LastError = malloc (len + 1);
+    strcpy (shp->LastError, errMsg);
+    return 0;
+}
+
+static void
+gaiaSaneClockwise (gaiaPolygonPtr polyg)
+{
+/*
+/ when exporting POLYGONs to SHAPEFILE, we must guarantee that:
+/ - all EXTERIOR RING must be clockwise
+/ - all INTERIOR RING must be anti-clockwise
+/
 / this function checks for the above conditions,
 / and if needed inverts the rings
 */
@@ -4319,11 +5019,131 @@ gaiaFlushShpHeaders (gaiaShapefilePtr shp)
     fwrite (buf_shp, 1, 32, fl_dbf);
 }
 
+static int
+shp_ring_clockwise (const unsigned char *coords, int start, int end,
+		    int endian_arch)
+{
+/*
+/ determines the direction of a Ring directly from the SHP record,
+/ exactly as gaiaClockwise() does on the decoded Ring
+*/
+    int ind;
+    int ix;
+    double xx;
+    double yy;
+    double x;
+    double y;
+    int points = end - start;
+    double area = 0.0;
+    for (ind = 0; ind < points; ind++)
+      {
+	  xx = gaiaImport64 (coords + ((start + ind) * 16), GAIA_LITTLE_ENDIAN,
+			     endian_arch);
+	  yy = gaiaImport64 (coords + ((start + ind) * 16) + 8,
+			     GAIA_LITTLE_ENDIAN, endian_arch);
+	  ix = (ind + 1) % points;
+	  x = gaiaImport64 (coords + ((start + ix) * 16), GAIA_LITTLE_ENDIAN,
+			    endian_arch);
+	  y = gaiaImport64 (coords + ((start + ix) * 16) + 8,
+			    GAIA_LITTLE_ENDIAN, endian_arch);
+	  area += ((xx * y) - (x * yy));
+      }
+    area /= 2.0;
+    if (area >= 0.0)
+	return 0;
+    return 1;
+}
+
+static int
+shp_analyze_polygon (const unsigned char *bufshp, int n, int n1,
+		     int endian_arch)
+{
+/*
+/ checks if a multi-part SHP polygon will produce a MULTIPOLYGON
+/
+/ accordingly to SHP rules clockwise rings are exteriors, and any
+/ anticlockwise ring not contained into some exterior becomes an
+/ exterior as well; so only the "one exterior + n holes" case really
+/ requires to build the rings and to arrange them
+*/
+    int ind;
+    int iv;
+    int base = 8 + (n * 4);
+    int start;
+    int end;
+    int points;
+    int polygons;
+    int clockwise = 0;
+    double x;
+    double y;
+    gaiaRingPtr ring;
+    struct shp_ring_item *pExt;
+    struct shp_ring_collection ringsColl;
+    start = 0;
+    for (ind = 0; ind < n; ind++)
+      {
+	  if (ind < (n - 1))
+	      end =
+		  gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
+				GAIA_LITTLE_ENDIAN, endian_arch);
+	  else
+	      end = n1;
+	  if (end < start || end > n1)
+	      return 0;		/* corrupted record */
+	  clockwise += shp_ring_clockwise (bufshp + base, start, end,
+					   endian_arch);
+	  start = end;
+      }
+    if (clockwise != 1)
+	return 1;
+/* building the rings and checking for orphan interiors */
+    ringsColl.First = NULL;
+    ringsColl.Last = NULL;
+    start = 0;
+    for (ind = 0; ind < n; ind++)
+      {
+	  if (ind < (n - 1))
+	      end =
+		  gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
+				GAIA_LITTLE_ENDIAN, endian_arch);
+	  else
+	      end = n1;
+	  points = end - start;
+	  ring = gaiaAllocRing (points);
+	  points = 0;
+	  for (iv = start; iv < end; iv++)
+	    {
+		x = gaiaImport64 (bufshp + base + (iv * 16),
+				  GAIA_LITTLE_ENDIAN, endian_arch);
+		y = gaiaImport64 (bufshp + base + (iv * 16) + 8,
+				  GAIA_LITTLE_ENDIAN, endian_arch);
+		gaiaSetPoint (ring->Coords, points, x, y);
+		points++;
+	    }
+	  shp_add_ring (&ringsColl, ring);
+	  start = end;
+      }
+    shp_arrange_rings (&ringsColl);
+    pExt = ringsColl.First;
+    polygons = 0;
+    while (pExt != NULL)
+      {
+	  if (pExt->IsExterior)
+	      polygons++;
+	  pExt = pExt->Next;
+      }
+    shp_free_rings (&ringsColl);
+    return (polygons > 1) ? 1 : 0;
+}
+
 GAIAGEO_DECLARE void
 gaiaShpAnalyze (gaiaShapefilePtr shp)
 {
 /* analyzing the SHP content, in order to detect if there are LINESTRINGS or MULTILINESTRINGS 
 / the same check is needed in order to detect if there are POLYGONS or MULTIPOLYGONS 
+/
+/ only the record headers and the parts/points counts are actually read;
+/ the coordinates are only required by multi-part polygons
  */
     unsigned char buf[512];
     int rd;
@@ -4332,67 +5152,76 @@ gaiaShpAnalyze (gaiaShapefilePtr shp)
     int off_shp;
     int sz;
     int shape;
-    int points;
     int n;
     int n1;
-    int base;
-    int start;
-    int end;
-    int iv;
-    int ind;
-    double x;
-    double y;
-    int polygons;
     int ZM_size;
     int multi = 0;
     int hasM = 0;
+    int check_multi = 0;
+    int check_m = 0;
     int current_row = 0;
+    const unsigned char *p_buf;
+    const unsigned char *bufshp;
+    struct shp_mapped_file *map_shx =
+	shp_mapped (shp->MapObj, SHP_MAPPED_SHX);
+    struct shp_mapped_file *map_shp =
+	shp_mapped (shp->MapObj, SHP_MAPPED_SHP);
 
-    gaiaRingPtr ring = NULL;
-    while (1)
+    if (shp->Shape == GAIA_SHP_POLYLINE || shp->Shape == GAIA_SHP_POLYLINEZ
+	|| shp->Shape == GAIA_SHP_POLYLINEM || shp->Shape == GAIA_SHP_POLYGON
+	|| shp->Shape == GAIA_SHP_POLYGONZ || shp->Shape == GAIA_SHP_POLYGONM)
+	check_multi = 1;
+    if (shp->Shape == GAIA_SHP_POLYLINEZ || shp->Shape == GAIA_SHP_POLYGONZ
+	|| shp->Shape == GAIA_SHP_MULTIPOINTZ)
+	check_m = 1;
+    while (check_multi || check_m)
       {
 	  /* positioning and reading the SHX file */
 	  offset = 100 + (current_row * 8);	/* 100 bytes for the header + current row displacement; each SHX row = 8 bytes */
-	  skpos = fseek (shp->flShx, offset, SEEK_SET);
+	  skpos = shp_seek (shp->flShx, map_shx, offset);
 	  if (skpos != 0)
 	      goto exit;
-	  rd = fread (buf, sizeof (unsigned char), 8, shp->flShx);
+	  rd = shp_read (shp->flShx, map_shx, buf, 8, &p_buf);
 	  if (rd != 8)
 	      goto exit;
-	  off_shp = gaiaImport32 (buf, GAIA_BIG_ENDIAN, shp->endian_arch);
+	  off_shp = gaiaImport32 (p_buf, GAIA_BIG_ENDIAN, shp->endian_arch);
 	  /* positioning and reading corresponding SHP entity - geometry */
 	  offset = off_shp * 2;
-	  skpos = fseek (shp->flShp, offset, SEEK_SET);
+	  skpos = shp_seek (shp->flShp, map_shp, offset);
 	  if (skpos != 0)
 	      goto exit;
-	  rd = fread (buf, sizeof (unsigned char), 12, shp->flShp);
+	  rd = shp_read (shp->flShp, map_shp, buf, 12, &p_buf);
 	  if (rd != 12)
 	      goto exit;
-	  sz = gaiaImport32 (buf + 4, GAIA_BIG_ENDIAN, shp->endian_arch);
-	  shape = gaiaImport32 (buf + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
-	  if ((sz * 2) > shp->ShpBfsz)
+	  sz = gaiaImport32 (p_buf + 4, GAIA_BIG_ENDIAN, shp->endian_arch);
+	  shape =
+	      gaiaImport32 (p_buf + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  current_row++;
+	  if (shape != GAIA_SHP_POLYLINE && shape != GAIA_SHP_POLYLINEZ
+	      && shape != GAIA_SHP_POLYLINEM && shape != GAIA_SHP_POLYGON
+	      && shape != GAIA_SHP_POLYGONZ && shape != GAIA_SHP_POLYGONM
+	      && shape != GAIA_SHP_MULTIPOINTZ)
+	      continue;
+	  /* skipping the BBOX and reading the parts/points counts */
+	  skpos = shp_seek (shp->flShp, map_shp, offset + 44);
+	  if (skpos != 0)
+	      goto exit;
+	  if (map_shp == NULL && (sz * 2) > shp->ShpBfsz)
 	    {
 		/* current buffer is too small; we need to allocate a bigger buffer */
 		free (shp->BufShp);
 		shp->ShpBfsz = sz * 2;
 		shp->BufShp = malloc (sizeof (unsigned char) * shp->ShpBfsz);
 	    }
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, 8, &bufshp);
+	  if (rd != 8)
+	      goto exit;
+	  n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN, shp->endian_arch);
 	  if (shape == GAIA_SHP_POLYLINE || shape == GAIA_SHP_POLYLINEZ
 	      || shape == GAIA_SHP_POLYLINEM)
 	    {
 		/* shape polyline */
-		rd = fread (shp->BufShp, sizeof (unsigned char), 32,
-			    shp->flShp);
-		if (rd != 32)
-		    goto exit;
-		rd = fread (shp->BufShp, sizeof (unsigned char),
-			    (sz * 2) - 36, shp->flShp);
-		if (rd != (sz * 2) - 36)
-		    goto exit;
-		n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN,
-				  shp->endian_arch);
-		n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
-				   shp->endian_arch);
 		if (n > 1)
 		    multi++;
 		if (shape == GAIA_SHP_POLYLINEZ)
@@ -4406,68 +5235,24 @@ gaiaShpAnalyze (gaiaShapefilePtr shp)
 	      || shape == GAIA_SHP_POLYGONM)
 	    {
 		/* shape polygon */
-		struct shp_ring_item *pExt;
-		struct shp_ring_collection ringsColl;
-		/* initializing the RING collection */
-		ringsColl.First = NULL;
-		ringsColl.Last = NULL;
-
-		rd = fread (shp->BufShp, sizeof (unsigned char), 32,
-			    shp->flShp);
-		if (rd != 32)
-		    goto exit;
-		rd = fread (shp->BufShp, sizeof (unsigned char),
-			    (sz * 2) - 36, shp->flShp);
-		if (rd != (sz * 2) - 36)
-		    goto exit;
-		n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN,
-				  shp->endian_arch);
-		n1 = gaiaImport32 (shp->BufShp + 4, GAIA_LITTLE_ENDIAN,
-				   shp->endian_arch);
-		base = 8 + (n * 4);
-		start = 0;
-		for (ind = 0; ind < n; ind++)
+		if (n > 1 && !multi)
 		  {
-		      if (ind < (n - 1))
-			  end =
-			      gaiaImport32 (shp->BufShp + 8 +
-					    ((ind + 1) * 4),
-					    GAIA_LITTLE_ENDIAN,
-					    shp->endian_arch);
+		      /* the rings' coordinates are required */
+		      if (n1 < 0 || n > sz || n1 > sz
+			  || 8 + (n * 4) + (n1 * 16) > (sz * 2) - 36)
+			  ;	/* corrupted record: ignoring */
 		      else
-			  end = n1;
-		      points = end - start;
-		      ring = gaiaAllocRing (points);
-		      points = 0;
-		      for (iv = start; iv < end; iv++)
 			{
-			    x = gaiaImport64 (shp->BufShp + base +
-					      (iv * 16), GAIA_LITTLE_ENDIAN,
-					      shp->endian_arch);
-			    y = gaiaImport64 (shp->BufShp + base +
-					      (iv * 16) + 8,
-					      GAIA_LITTLE_ENDIAN,
-					      shp->endian_arch);
-			    gaiaSetPoint (ring->Coords, points, x, y);
-			    start++;
-			    points++;
+			    rd = shp_read (shp->flShp, map_shp,
+					   shp->BufShp + 8, (sz * 2) - 44,
+					   &p_buf);
+			    if (rd != (sz * 2) - 44)
+				goto exit;
+			    if (shp_analyze_polygon
+				(bufshp, n, n1, shp->endian_arch))
+				multi++;
 			}
-		      shp_add_ring (&ringsColl, ring);
-		      ring = NULL;
-		  }
-		shp_arrange_rings (&ringsColl);
-		pExt = ringsColl.First;
-		polygons = 0;
-		while (pExt != NULL)
-		  {
-		      if (pExt->IsExterior)
-			  polygons++;
-		      pExt = pExt->Next;
 		  }
-		shp_free_rings (&ringsColl);
-
-		if (polygons > 1)
-		    multi++;
 		if (shape == GAIA_SHP_POLYGONZ)
 		  {
 		      ZM_size = 38 + (2 * n) + (n1 * 16);	/* size [in 16 bits words !!!] ZM */
@@ -4478,25 +5263,16 @@ gaiaShpAnalyze (gaiaShapefilePtr shp)
 	  if (shape == GAIA_SHP_MULTIPOINTZ)
 	    {
 		/* shape multipoint Z */
-		rd = fread (shp->BufShp, sizeof (unsigned char), 32,
-			    shp->flShp);
-		if (rd != 32)
-		    goto exit;
-		rd = fread (shp->BufShp, sizeof (unsigned char),
-			    (sz * 2) - 36, shp->flShp);
-		if (rd != (sz * 2) - 36)
-		    goto exit;
-		n = gaiaImport32 (shp->BufShp, GAIA_LITTLE_ENDIAN,
-				  shp->endian_arch);
 		ZM_size = 38 + (n * 16);	/* size [in 16 bits words !!!] ZM */
 		if (sz == ZM_size)
 		    hasM = 1;
 	    }
-	  current_row++;
+	  if (multi)
+	      check_multi = 0;
+	  if (hasM)
+	      check_m = 0;
       }
   exit:
-    if (ring)
-	gaiaFreeRing (ring);
     if (shp->LastError)
 	free (shp->LastError);
     shp->LastError = NULL;
@@ -4529,6 +5305,740 @@ gaiaShpAnalyze (gaiaShapefilePtr shp)
       }
 }
 
+/*
+/ the SHP-to-BLOB transcoder
+/
+/ both SHP records and SpatiaLite BLOBs store little endian doubles, so
+/ any X,Y pair can be directly copied from the SHP record into the BLOB;
+/ the resulting BLOB is exactly the same one gaiaToSpatiaLiteBlobWkb()
+/ would produce from the Geometry built by gaiaReadShpEntity()
+*/
+
+struct shp_blob_coords
+{
+/* the vertices of a SHP record */
+    const unsigned char *XY;	/* the X,Y pairs */
+    const unsigned char *Z;	/* the Z values [may be NULL] */
+    const unsigned char *M;	/* the M values [may be NULL] */
+    int Dims;			/* the BLOB dimension model */
+    int endian_arch;
+};
+
+struct shp_blob_ring
+{
+/* a Polygon Ring, still lying within the SHP record */
+    int Start;
+    int End;
+    double MinX;
+    double MinY;
+    double MaxX;
+    double MaxY;
+    int IsExterior;
+    int Mother;			/* the containing Exterior Ring; -1 if none */
+};
+
+static int
+shp_blob_class (int type, int dims)
+{
+/* returns the BLOB class for the given dimension model */
+    if (dims == GAIA_XY_Z)
+	return type + 1000;
+    if (dims == GAIA_XY_M)
+	return type + 2000;
+    if (dims == GAIA_XY_Z_M)
+	return type + 3000;
+    return type;
+}
+
+static int
+shp_blob_vertex_size (int dims)
+{
+/* returns the size [in bytes] of a BLOB vertex */
+    if (dims == GAIA_XY_Z || dims == GAIA_XY_M)
+	return 24;
+    if (dims == GAIA_XY_Z_M)
+	return 32;
+    return 16;
+}
+
+static unsigned char *
+shp_blob_header (unsigned char *ptr, int srid, double minx, double miny,
+		 double maxx, double maxy, int type, int endian_arch)
+{
+/* writes the BLOB header; returns the position of the Geometry body */
+    *ptr = GAIA_MARK_START;	/* START signature */
+    *(ptr + 1) = GAIA_LITTLE_ENDIAN;	/* byte ordering */
+    gaiaExport32 (ptr + 2, srid, 1, endian_arch);	/* the SRID */
+    gaiaExport64 (ptr + 6, minx, 1, endian_arch);	/* MBR - minimum X */
+    gaiaExport64 (ptr + 14, miny, 1, endian_arch);	/* MBR - minimum Y */
+    gaiaExport64 (ptr + 22, maxx, 1, endian_arch);	/* MBR - maximum X */
+    gaiaExport64 (ptr + 30, maxy, 1, endian_arch);	/* MBR - maximum Y */
+    *(ptr + 38) = GAIA_MARK_MBR;	/* MBR signature */
+    gaiaExport32 (ptr + 39, type, 1, endian_arch);	/* geometric class */
+    return ptr + 43;
+}
+
+static void
+shp_blob_mbr (struct shp_blob_coords *coords, int start, int end,
+	      double *minx, double *miny, double *maxx, double *maxy)
+{
+/* updates the MBR so to include a run of vertices */
+    int iv;
+    double x;
+    double y;
+    for (iv = start; iv < end; iv++)
+      {
+	  x = gaiaImport64 (coords->XY + (iv * 16), GAIA_LITTLE_ENDIAN,
+			    coords->endian_arch);
+	  y = gaiaImport64 (coords->XY + (iv * 16) + 8, GAIA_LITTLE_ENDIAN,
+			    coords->endian_arch);
+	  if (x < *minx)
+	      *minx = x;
+	  if (y < *miny)
+	      *miny = y;
+	  if (x > *maxx)
+	      *maxx = x;
+	  if (y > *maxy)
+	      *maxy = y;
+      }
+}
+
+static unsigned char *
+shp_blob_vertices (unsigned char *ptr, struct shp_blob_coords *coords,
+		   int start, int end)
+{
+/* copies a run of vertices into the BLOB */
+    int iv;
+    double z;
+    double m;
+    if (coords->Dims == GAIA_XY)
+      {
+	  /* plain X,Y pairs: a straight copy */
+	  memcpy (ptr, coords->XY + (start * 16), (end - start) * 16);
+	  return ptr + ((end - start) * 16);
+      }
+    for (iv = start; iv < end; iv++)
+      {
+	  memcpy (ptr, coords->XY + (iv * 16), 16);
+	  ptr += 16;
+	  if (coords->Dims == GAIA_XY_Z || coords->Dims == GAIA_XY_Z_M)
+	    {
+		z = 0.0;
+		if (coords->Z)
+		    z = gaiaImport64 (coords->Z + (iv * 8), GAIA_LITTLE_ENDIAN,
+				      coords->endian_arch);
+		gaiaExport64 (ptr, z, 1, coords->endian_arch);
+		ptr += 8;
+	    }
+	  if (coords->Dims == GAIA_XY_M || coords->Dims == GAIA_XY_Z_M)
+	    {
+		m = 0.0;
+		if (coords->M)
+		    m = gaiaImport64 (coords->M + (iv * 8), GAIA_LITTLE_ENDIAN,
+				      coords->endian_arch);
+		if (m < SHAPEFILE_NO_DATA)
+		    m = 0.0;
+		gaiaExport64 (ptr, m, 1, coords->endian_arch);
+		ptr += 8;
+	    }
+      }
+    return ptr;
+}
+
+static int
+shp_blob_point_on_ring (struct shp_blob_coords *coords,
+			struct shp_blob_ring *ring, double pt_x, double pt_y)
+{
+/* same as gaiaIsPointOnRingSurface(), directly reading the SHP vertices */
+    int isInternal = 0;
+    int cnt;
+    int i;
+    int j;
+    double x;
+    double y;
+    double xi;
+    double yi;
+    double xj;
+    double yj;
+    double minx = DBL_MAX;
+    double miny = DBL_MAX;
+    double maxx = -DBL_MAX;
+    double maxy = -DBL_MAX;
+    cnt = ring->End - ring->Start;
+    cnt--;			/* ignoring last vertex because surely identical to the first one */
+    if (cnt < 2)
+	return 0;
+    for (i = 0; i < cnt; i++)
+      {
+	  x = gaiaImport64 (coords->XY + ((ring->Start + i) * 16),
+			    GAIA_LITTLE_ENDIAN, coords->endian_arch);
+	  y = gaiaImport64 (coords->XY + ((ring->Start + i) * 16) + 8,
+			    GAIA_LITTLE_ENDIAN, coords->endian_arch);
+	  if (x < minx)
+	      minx = x;
+	  if (x > maxx)
+	      maxx = x;
+	  if (y < miny)
+	      miny = y;
+	  if (y > maxy)
+	      maxy = y;
+      }
+    if (pt_x < minx || pt_x > maxx)
+	return 0;		/* outside the bounding box (x axis) */
+    if (pt_y < miny || pt_y > maxy)
+	return 0;		/* outside the bounding box (y axis) */
+    for (i = 0, j = cnt - 1; i < cnt; j = i++)
+      {
+	  xi = gaiaImport64 (coords->XY + ((ring->Start + i) * 16),
+			     GAIA_LITTLE_ENDIAN, coords->endian_arch);
+	  yi = gaiaImport64 (coords->XY + ((ring->Start + i) * 16) + 8,
+			     GAIA_LITTLE_ENDIAN, coords->endian_arch);
+	  xj = gaiaImport64 (coords->XY + ((ring->Start + j) * 16),
+			     GAIA_LITTLE_ENDIAN, coords->endian_arch);
+	  yj = gaiaImport64 (coords->XY + ((ring->Start + j) * 16) + 8,
+			     GAIA_LITTLE_ENDIAN, coords->endian_arch);
+	  if ((((yi <= pt_y) && (pt_y < yj)) || ((yj <= pt_y) && (pt_y < yi)))
+	      && (pt_x < (xj - xi) * (pt_y - yi) / (yj - yi) + xi))
+	      isInternal = !isInternal;
+      }
+    return isInternal;
+}
+
+static int
+shp_blob_check_rings (struct shp_blob_coords *coords,
+		      struct shp_blob_ring *exterior,
+		      struct shp_blob_ring *candidate)
+{
+/*
+/ same as shp_mbr_contains() + shp_check_rings(): checks if the candidate
+/ could be an interior Ring contained into the exterior Ring
+*/
+    double x;
+    double y;
+    int mid;
+    if (!(candidate->MinX >= exterior->MinX
+	  && candidate->MinX <= exterior->MaxX))
+	return 0;
+    if (!(candidate->MaxX >= exterior->MinX
+	  && candidate->MaxX <= exterior->MaxX))
+	return 0;
+    if (!(candidate->MinY >= exterior->MinY
+	  && candidate->MinY <= exterior->MaxY))
+	return 0;
+    if (!(candidate->MaxY >= exterior->MinY
+	  && candidate->MaxY <= exterior->MaxY))
+	return 0;
+/* testing if the first point falls on the exterior ring surface */
+    x = gaiaImport64 (coords->XY + (candidate->Start * 16), GAIA_LITTLE_ENDIAN,
+		      coords->endian_arch);
+    y = gaiaImport64 (coords->XY + (candidate->Start * 16) + 8,
+		      GAIA_LITTLE_ENDIAN, coords->endian_arch);
+    if (shp_blob_point_on_ring (coords, exterior, x, y))
+	return 1;
+/* testing if the middle point falls on the exterior ring surface */
+    mid = candidate->Start + ((candidate->End - candidate->Start) / 2);
+    x = gaiaImport64 (coords->XY + (mid * 16), GAIA_LITTLE_ENDIAN,
+		      coords->endian_arch);
+    y = gaiaImport64 (coords->XY + (mid * 16) + 8, GAIA_LITTLE_ENDIAN,
+		      coords->endian_arch);
+    if (shp_blob_point_on_ring (coords, exterior, x, y))
+	return 1;
+    return 0;
+}
+
+static unsigned char *
+shp_blob_polygon (unsigned char *ptr, struct shp_blob_coords *coords,
+		  struct shp_blob_ring *rings, int n_rings, int exterior)
+{
+/* writes the body of the Polygon having the given Exterior Ring */
+    int ind;
+    int holes = 0;
+    struct shp_blob_ring *ring;
+    for (ind = 0; ind < n_rings; ind++)
+      {
+	  if (rings[ind].Mother == exterior)
+	      holes++;
+      }
+    gaiaExport32 (ptr, holes + 1, 1, coords->endian_arch);	/* # rings */
+    ring = rings + exterior;
+    gaiaExport32 (ptr + 4, ring->End - ring->Start, 1, coords->endian_arch);	/* # points - exterior ring */
+    ptr = shp_blob_vertices (ptr + 8, coords, ring->Start, ring->End);
+    for (ind = 0; ind < n_rings; ind++)
+      {
+	  ring = rings + ind;
+	  if (ring->Mother != exterior)
+	      continue;
+	  gaiaExport32 (ptr, ring->End - ring->Start, 1, coords->endian_arch);	/* # points - interior ring */
+	  ptr = shp_blob_vertices (ptr + 4, coords, ring->Start, ring->End);
+      }
+    return ptr;
+}
+
+static int
+shp_blob_rings (struct shp_blob_coords *coords, struct shp_blob_ring *rings,
+		int n_rings)
+{
+/*
+/ assigning any interior Ring to its containing exterior Ring, exactly
+/ as shp_arrange_rings() does; returns the number of Polygons
+/
+/ the Ring MBRs and orientations are computed directly from the SHP
+/ vertices, and the point-in-ring test is only performed when the
+/ interior MBR is fully contained within the exterior MBR
+*/
+    int ie;
+    int ii;
+    int polygons = 0;
+    struct shp_blob_ring *ring;
+    for (ie = 0; ie < n_rings; ie++)
+      {
+	  ring = rings + ie;
+	  ring->MinX = DBL_MAX;
+	  ring->MinY = DBL_MAX;
+	  ring->MaxX = -DBL_MAX;
+	  ring->MaxY = -DBL_MAX;
+	  shp_blob_mbr (coords, ring->Start, ring->End, &(ring->MinX),
+			&(ring->MinY), &(ring->MaxX), &(ring->MaxY));
+	  /* accordingly to SHP rules interior/exterior depends on direction */
+	  ring->IsExterior =
+	      shp_ring_clockwise (coords->XY, ring->Start, ring->End,
+				  coords->endian_arch);
+	  ring->Mother = -1;
+      }
+    for (ie = 0; ie < n_rings; ie++)
+      {
+	  /* looping on Exterior Rings */
+	  if (!rings[ie].IsExterior)
+	      continue;
+	  for (ii = 0; ii < n_rings; ii++)
+	    {
+		/* looping on Interior Rings */
+		ring = rings + ii;
+		if (ring->IsExterior == 0 && ring->Mother < 0
+		    && shp_blob_check_rings (coords, rings + ie, ring))
+		    ring->Mother = ie;
+	    }
+      }
+    for (ie = 0; ie < n_rings; ie++)
+      {
+	  ring = rings + ie;
+	  if (ring->IsExterior == 0 && ring->Mother < 0)
+	    {
+		/* orphan ring: promoting to Exterior */
+		ring->IsExterior = 1;
+	    }
+	  if (ring->IsExterior)
+	      polygons++;
+      }
+    return polygons;
+}
+
+static int
+shp_transcode_entity (gaiaShapefilePtr shp, int current_row, int srid,
+		      unsigned char **blob, int *blob_size)
+{
+/*
+/ transcoding a SHP record into a SpatiaLite BLOB Geometry
+/ returns 1 on success (a NULL shape will return a NULL BLOB), 0 if
+/ the record has to be handled by the generic Geometry path, or -1 if
+/ the record is corrupted
+*/
+    unsigned char buf[12];
+    int rd;
+    int off_shp;
+    int sz;
+    int shape;
+    int len;
+    int n;
+    int n1;
+    int base;
+    int baseZ;
+    int baseM;
+    int max_size;
+    int min_size;
+    int ind;
+    int start;
+    int end;
+    int polygons;
+    int vsize;
+    int type;
+    double x;
+    double y;
+    double z = 0.0;
+    double m = 0.0;
+    double minx = DBL_MAX;
+    double miny = DBL_MAX;
+    double maxx = -DBL_MAX;
+    double maxy = -DBL_MAX;
+    unsigned char *ptr;
+    struct shp_blob_coords coords;
+    struct shp_blob_ring *rings = NULL;
+    const unsigned char *p_buf;
+    const unsigned char *bufshp;
+    struct shp_mapped_file *map_shx = shp_mapped (shp->MapObj, SHP_MAPPED_SHX);
+    struct shp_mapped_file *map_shp = shp_mapped (shp->MapObj, SHP_MAPPED_SHP);
+    *blob = NULL;
+    *blob_size = 0;
+/* positioning and reading the SHX file */
+    if (shp_seek (shp->flShx, map_shx, 100 + (current_row * 8)) != 0)
+	return -1;
+    rd = shp_read (shp->flShx, map_shx, buf, 8, &p_buf);
+    if (rd != 8)
+	return -1;
+    off_shp = gaiaImport32 (p_buf, GAIA_BIG_ENDIAN, shp->endian_arch);
+/* positioning and reading the SHP record header */
+    if (shp_seek (shp->flShp, map_shp, off_shp * 2) != 0)
+	return -1;
+    rd = shp_read (shp->flShp, map_shp, buf, 12, &p_buf);
+    if (rd != 12)
+	return -1;
+    sz = gaiaImport32 (p_buf + 4, GAIA_BIG_ENDIAN, shp->endian_arch);
+    shape = gaiaImport32 (p_buf + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    if (shape == GAIA_SHP_NULL)
+	return 1;
+    if (shape != shp->Shape)
+	return -1;
+    if (map_shp == NULL && (sz * 2) > shp->ShpBfsz)
+      {
+	  /* current buffer is too small; we need to allocate a bigger buffer */
+	  free (shp->BufShp);
+	  shp->ShpBfsz = sz * 2;
+	  shp->BufShp = malloc (sizeof (unsigned char) * shp->ShpBfsz);
+      }
+    coords.Z = NULL;
+    coords.M = NULL;
+    coords.Dims = shp->EffectiveDims;
+    coords.endian_arch = shp->endian_arch;
+    vsize = shp_blob_vertex_size (shp->EffectiveDims);
+    if (shape == GAIA_SHP_POINT || shape == GAIA_SHP_POINTZ
+	|| shape == GAIA_SHP_POINTM)
+      {
+	  /* shape point: the record simply contains the coordinates */
+	  len = (shape == GAIA_SHP_POINTZ) ? 32 : 16;
+	  if (shape == GAIA_SHP_POINTM)
+	      len = 24;
+	  rd = shp_read (shp->flShp, map_shp, shp->BufShp, len, &bufshp);
+	  if (rd != len)
+	    {
+		/* required by some buggish SHP (e.g. the GDAL/OGR ones) */
+		if (shape != GAIA_SHP_POINTZ || rd != 24)
+		    return -1;
+	    }
+	  x = gaiaImport64 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  y = gaiaImport64 (bufshp + 8, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  if (shape == GAIA_SHP_POINTZ)
+	    {
+		z = gaiaImport64 (bufshp + 16, GAIA_LITTLE_ENDIAN,
+				  shp->endian_arch);
+		if (rd == 32)
+		    m = gaiaImport64 (bufshp + 24, GAIA_LITTLE_ENDIAN,
+				      shp->endian_arch);
+	    }
+	  if (shape == GAIA_SHP_POINTM)
+	      m = gaiaImport64 (bufshp + 16, GAIA_LITTLE_ENDIAN,
+				shp->endian_arch);
+	  *blob_size = 44 + vsize;
+	  *blob = malloc (*blob_size);
+	  ptr = shp_blob_header (*blob, srid, x, y, x, y,
+				 shp_blob_class (GAIA_POINT,
+						 shp->EffectiveDims),
+				 shp->endian_arch);
+	  memcpy (ptr, bufshp, 16);
+	  ptr += 16;
+	  if (shp->EffectiveDims == GAIA_XY_Z
+	      || shp->EffectiveDims == GAIA_XY_Z_M)
+	    {
+		gaiaExport64 (ptr, z, 1, shp->endian_arch);
+		ptr += 8;
+	    }
+	  if (shp->EffectiveDims == GAIA_XY_M
+	      || shp->EffectiveDims == GAIA_XY_Z_M)
+	    {
+		gaiaExport64 (ptr, m, 1, shp->endian_arch);
+		ptr += 8;
+	    }
+	  *ptr = GAIA_MARK_END;	/* END signature */
+	  return 1;
+      }
+/* any other shape: skipping the bounding box and reading the whole record */
+    rd = shp_read (shp->flShp, map_shp, shp->BufShp, 32, &bufshp);
+    if (rd != 32)
+	return -1;
+    len = (sz * 2) - 36;
+    if (len < 4)
+	return -1;
+    rd = shp_read (shp->flShp, map_shp, shp->BufShp, len, &bufshp);
+    if (rd != len)
+	return -1;
+    n = gaiaImport32 (bufshp, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    if (shape == GAIA_SHP_MULTIPOINT || shape == GAIA_SHP_MULTIPOINTZ
+	|| shape == GAIA_SHP_MULTIPOINTM)
+      {
+	  /* shape multipoint */
+	  if (n < 0 || n > (len - 4) / 16)
+	      return -1;
+	  coords.XY = bufshp + 4;
+	  if (shape == GAIA_SHP_MULTIPOINTZ)
+	    {
+		max_size = 38 + (n * 16);	/* size [in 16 bits words !!!] ZM */
+		min_size = 30 + (n * 12);	/* size [in 16 bits words !!!] Z-only */
+		if (sz < min_size)
+		    return -1;
+		baseZ = 4 + (n * 16) + 16;
+		baseM = baseZ + (n * 8) + 16;
+		coords.Z = bufshp + baseZ;
+		if (sz == max_size)
+		    coords.M = bufshp + baseM;
+	    }
+	  if (shape == GAIA_SHP_MULTIPOINTM)
+	    {
+		max_size = 30 + (n * 12);	/* size [in 16 bits words !!!] M */
+		min_size = 22 + (n * 8);	/* size [in 16 bits words !!!] no-M */
+		if (sz < min_size)
+		    return -1;
+		baseM = 4 + (n * 16) + 16;
+		if (sz == max_size)
+		    coords.M = bufshp + baseM;
+	    }
+	  if (coords.Z != NULL && (coords.Z - bufshp) + (n * 8) > len)
+	      return -1;
+	  if (coords.M != NULL && (coords.M - bufshp) + (n * 8) > len)
+	      return -1;
+	  if (n == 0)
+	      return 1;		/* an empty Geometry */
+	  shp_blob_mbr (&coords, 0, n, &minx, &miny, &maxx, &maxy);
+	  *blob_size = 48 + (n * (5 + vsize));
+	  *blob = malloc (*blob_size);
+	  ptr = shp_blob_header (*blob, srid, minx, miny, maxx, maxy,
+				 shp_blob_class (GAIA_MULTIPOINT,
+						 shp->EffectiveDims),
+				 shp->endian_arch);
+	  gaiaExport32 (ptr, n, 1, shp->endian_arch);	/* # entities */
+	  ptr += 4;
+	  type = shp_blob_class (GAIA_POINT, shp->EffectiveDims);
+	  for (ind = 0; ind < n; ind++)
+	    {
+		*ptr = GAIA_MARK_ENTITY;	/* ENTITY signature */
+		gaiaExport32 (ptr + 1, type, 1, shp->endian_arch);
+		ptr = shp_blob_vertices (ptr + 5, &coords, ind, ind + 1);
+	    }
+	  *ptr = GAIA_MARK_END;	/* END signature */
+	  return 1;
+      }
+    if (shape != GAIA_SHP_POLYLINE && shape != GAIA_SHP_POLYLINEZ
+	&& shape != GAIA_SHP_POLYLINEM && shape != GAIA_SHP_POLYGON
+	&& shape != GAIA_SHP_POLYGONZ && shape != GAIA_SHP_POLYGONM)
+	return 0;
+/* shape polyline or polygon: checking the parts and points */
+    if (len < 8 || n < 0 || n > (len - 8) / 4)
+	return -1;
+    n1 = gaiaImport32 (bufshp + 4, GAIA_LITTLE_ENDIAN, shp->endian_arch);
+    base = 8 + (n * 4);
+    if (n1 < 0 || n1 > (len - base) / 16)
+	return -1;
+    coords.XY = bufshp + base;
+    if (shape == GAIA_SHP_POLYLINEZ || shape == GAIA_SHP_POLYGONZ)
+      {
+	  max_size = 38 + (2 * n) + (n1 * 16);	/* size [in 16 bits words !!!] ZM */
+	  min_size = 30 + (2 * n) + (n1 * 12);	/* size [in 16 bits words !!!] Z-only */
+	  if (sz < min_size)
+	      return -1;
+	  baseZ = base + (n1 * 16) + 16;
+	  baseM = baseZ + (n1 * 8) + 16;
+	  coords.Z = bufshp + baseZ;
+	  if (sz == max_size)
+	      coords.M = bufshp + baseM;
+      }
+    if (shape == GAIA_SHP_POLYLINEM || shape == GAIA_SHP_POLYGONM)
+      {
+	  max_size = 30 + (2 * n) + (n1 * 12);	/* size [in 16 bits words !!!] M */
+	  min_size = 22 + (2 * n) + (n1 * 8);	/* size [in 16 bits words !!!] no-M */
+	  if (sz < min_size)
+	      return -1;
+	  baseM = base + (n1 * 16) + 16;
+	  if (sz == max_size)
+	      coords.M = bufshp + baseM;
+      }
+    if (coords.Z != NULL && (coords.Z - bufshp) + (n1 * 8) > len)
+	return -1;
+    if (coords.M != NULL && (coords.M - bufshp) + (n1 * 8) > len)
+	return -1;
+    start = 0;
+    for (ind = 0; ind < n; ind++)
+      {
+	  /* the first part always starts from the first point */
+	  if (ind < (n - 1))
+	      end =
+		  gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
+				GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  else
+	      end = n1;
+	  if (end < start || end > n1)
+	      return -1;
+	  start = end;
+      }
+    if (n == 0)
+	return 1;		/* an empty Geometry */
+    if (shape == GAIA_SHP_POLYLINE || shape == GAIA_SHP_POLYLINEZ
+	|| shape == GAIA_SHP_POLYLINEM)
+      {
+	  /* shape polyline */
+	  shp_blob_mbr (&coords, 0, n1, &minx, &miny, &maxx, &maxy);
+	  if (n == 1 && shp->EffectiveType == GAIA_LINESTRING)
+	    {
+		/* a single LINESTRING */
+		*blob_size = 48 + (n1 * vsize);
+		*blob = malloc (*blob_size);
+		ptr = shp_blob_header (*blob, srid, minx, miny, maxx, maxy,
+				       shp_blob_class (GAIA_LINESTRING,
+						       shp->EffectiveDims),
+				       shp->endian_arch);
+		gaiaExport32 (ptr, n1, 1, shp->endian_arch);	/* # points */
+		ptr = shp_blob_vertices (ptr + 4, &coords, 0, n1);
+		*ptr = GAIA_MARK_END;	/* END signature */
+		return 1;
+	    }
+	  *blob_size = 48 + (n * 9) + (n1 * vsize);
+	  *blob = malloc (*blob_size);
+	  ptr = shp_blob_header (*blob, srid, minx, miny, maxx, maxy,
+				 shp_blob_class (GAIA_MULTILINESTRING,
+						 shp->EffectiveDims),
+				 shp->endian_arch);
+	  gaiaExport32 (ptr, n, 1, shp->endian_arch);	/* # entities */
+	  ptr += 4;
+	  type = shp_blob_class (GAIA_LINESTRING, shp->EffectiveDims);
+	  start = 0;
+	  for (ind = 0; ind < n; ind++)
+	    {
+		if (ind < (n - 1))
+		    end =
+			gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
+				      GAIA_LITTLE_ENDIAN, shp->endian_arch);
+		else
+		    end = n1;
+		*ptr = GAIA_MARK_ENTITY;	/* ENTITY signature */
+		gaiaExport32 (ptr + 1, type, 1, shp->endian_arch);
+		gaiaExport32 (ptr + 5, end - start, 1, shp->endian_arch);	/* # points */
+		ptr = shp_blob_vertices (ptr + 9, &coords, start, end);
+		start = end;
+	    }
+	  *ptr = GAIA_MARK_END;	/* END signature */
+	  return 1;
+      }
+/* shape polygon: splitting the rings */
+    rings = malloc (sizeof (struct shp_blob_ring) * n);
+    start = 0;
+    for (ind = 0; ind < n; ind++)
+      {
+	  if (ind < (n - 1))
+	      end =
+		  gaiaImport32 (bufshp + 8 + ((ind + 1) * 4),
+				GAIA_LITTLE_ENDIAN, shp->endian_arch);
+	  else
+	      end = n1;
+	  if (end == start)
+	    {
+		/* an empty ring: leaving it to the generic Geometry path */
+		free (rings);
+		return 0;
+	    }
+	  rings[ind].Start = start;
+	  rings[ind].End = end;
+	  start = end;
+      }
+    polygons = shp_blob_rings (&coords, rings, n);
+    for (ind = 0; ind < n; ind++)
+      {
+	  /* the MBR only depends on the exterior rings */
+	  if (!rings[ind].IsExterior)
+	      continue;
+	  if (rings[ind].MinX < minx)
+	      minx = rings[ind].MinX;
+	  if (rings[ind].MinY < miny)
+	      miny = rings[ind].MinY;
+	  if (rings[ind].MaxX > maxx)
+	      maxx = rings[ind].MaxX;
+	  if (rings[ind].MaxY > maxy)
+	      maxy = rings[ind].MaxY;
+      }
+    if (polygons == 1 && shp->EffectiveType == GAIA_POLYGON)
+      {
+	  /* a single POLYGON */
+	  *blob_size = 48 + (n * 4) + (n1 * vsize);
+	  *blob = malloc (*blob_size);
+	  ptr = shp_blob_header (*blob, srid, minx, miny, maxx, maxy,
+				 shp_blob_class (GAIA_POLYGON,
+						 shp->EffectiveDims),
+				 shp->endian_arch);
+	  for (ind = 0; ind < n; ind++)
+	    {
+		if (rings[ind].IsExterior)
+		    ptr = shp_blob_polygon (ptr, &coords, rings, n, ind);
+	    }
+	  *ptr = GAIA_MARK_END;	/* END signature */
+	  free (rings);
+	  return 1;
+      }
+    *blob_size = 48 + (polygons * 9) + (n * 4) + (n1 * vsize);
+    *blob = malloc (*blob_size);
+    ptr = shp_blob_header (*blob, srid, minx, miny, maxx, maxy,
+			   shp_blob_class (GAIA_MULTIPOLYGON, shp->EffectiveDims),
+			   shp->endian_arch);
+    gaiaExport32 (ptr, polygons, 1, shp->endian_arch);	/* # entities */
+    ptr += 4;
+    type = shp_blob_class (GAIA_POLYGON, shp->EffectiveDims);
+    for (ind = 0; ind < n; ind++)
+      {
+	  if (!rings[ind].IsExterior)
+	      continue;
+	  *ptr = GAIA_MARK_ENTITY;	/* ENTITY signature */
+	  gaiaExport32 (ptr + 1, type, 1, shp->endian_arch);
+	  ptr = shp_blob_polygon (ptr + 5, &coords, rings, n, ind);
+      }
+    *ptr = GAIA_MARK_END;	/* END signature */
+    free (rings);
+    return 1;
+}
+
+GAIAGEO_DECLARE int
+gaiaReadShpEntityBlob (gaiaShapefilePtr shp, int current_row, int srid,
+		       unsigned char **blob, int *blob_size)
+{
+/* trying to read an entity from shapefile, returning a BLOB Geometry */
+    int len;
+    int ret;
+    char errMsg[1024];
+    *blob = NULL;
+    *blob_size = 0;
+/* reading the DBF values */
+    if (!gaiaReadShpEntity_ex (shp, current_row, srid, 0, NULL))
+	return 0;
+    ret = shp_transcode_entity (shp, current_row, srid, blob, blob_size);
+    if (ret > 0)
+	return 1;
+    if (ret < 0)
+      {
+	  if (shp->LastError)
+	      free (shp->LastError);
+	  sprintf (errMsg, "'%s' is corrupted / has invalid format",
+		   shp->Path);
+	  len = strlen (errMsg);
+	  shp->LastError = malloc (len + 1);
+	  strcpy (shp->LastError, errMsg);
+	  return 0;
+      }
+/* some unusual record: building the Geometry */
+    if (!gaiaReadShpEntity (shp, current_row, srid))
+	return 0;
+    if (shp->Dbf->Geometry)
+      {
+	  gaiaToSpatiaLiteBlobWkb (shp->Dbf->Geometry, blob, blob_size);
+	  gaiaFreeGeomColl (shp->Dbf->Geometry);
+	  shp->Dbf->Geometry = NULL;
+      }
+    return 1;
+}
+
 GAIAGEO_DECLARE gaiaDbfPtr
 gaiaAllocDbf ()
 {
@@ -4539,6 +6049,9 @@ gaiaAllocDbf ()
     dbf->flDbf = NULL;
     dbf->Dbf = NULL;
     dbf->BufDbf = NULL;
+    dbf->MapObj = NULL;
+    dbf->DecoderObj = NULL;
+    dbf->BuffersObj = NULL;
     dbf->DbfHdsz = 0;
     dbf->DbfReclen = 0;
     dbf->DbfSize = 0;
@@ -4565,6 +6078,12 @@ gaiaFreeDbf (gaiaDbfPtr dbf)
 	iconv_close ((iconv_t) dbf->IconvObj);
     if (dbf->LastError)
 	free (dbf->LastError);
+    if (dbf->MapObj)
+	shp_unmap_files (dbf->MapObj);
+    if (dbf->DecoderObj)
+	shp_free_decoder (dbf->DecoderObj);
+    if (dbf->BuffersObj)
+	shp_free_buffers (dbf->BuffersObj);
     free (dbf);
 }
 
@@ -4674,6 +6193,10 @@ gaiaOpenDbfRead (gaiaDbfPtr dbf, const char *path, const char *charFrom,
     dbf->DbfReclen = dbf_reclen;
     dbf->Valid = 1;
     dbf->endian_arch = endian_arch;
+/* attempting to memory-map the DBF; stdio is used when this fails */
+    dbf->MapObj = shp_map_files (NULL, NULL, fl_dbf);
+/* the fast DBF decoder requires ASCII-compatible charsets */
+    dbf->DecoderObj = shp_alloc_decoder (dbf->IconvObj, dbf_list, dbf_reclen);
     return;
   unsupported_conversion:
 /* illegal charset */
@@ -4786,6 +6309,7 @@ gaiaOpenDbfWrite (gaiaDbfPtr dbf, const char *path, const char *charFrom,
 		   sys_err);
 	  goto no_file;
       }
+    dbf->BuffersObj = shp_buffer_files (NULL, NULL, fl_dbf);
 /* allocating DBF buffer */
     dbf_reclen = 1;		/* an extra byte is needed because in DBF rows first byte is a marker for deletion */
     fld = dbf->Dbf->First;
@@ -5022,25 +6546,34 @@ GAIAGEO_DECLARE int
 gaiaReadDbfEntity (gaiaDbfPtr dbf, int current_row, int *deleted)
 {
 /* trying to read an entity from DBF */
+    return gaiaReadDbfEntity_ex (dbf, current_row, deleted, NULL);
+}
+
+GAIAGEO_DECLARE int
+gaiaReadDbfEntity_ex (gaiaDbfPtr dbf, int current_row, int *deleted,
+		      const char *read_fields)
+{
+/* trying to read an entity from DBF [selected columns only] */
     int rd;
     int skpos;
     int offset;
     int len;
     char errMsg[1024];
-    gaiaDbfFieldPtr pFld;
+    const unsigned char *bufdbf;
+    struct shp_mapped_file *map_dbf = shp_mapped (dbf->MapObj, SHP_MAPPED_DBF);
 /* positioning and reading the DBF file */
     offset = dbf->DbfHdsz + (current_row * dbf->DbfReclen);
-    skpos = fseek (dbf->flDbf, offset, SEEK_SET);
+    skpos = shp_seek (dbf->flDbf, map_dbf, offset);
     if (skpos != 0)
 	goto eof;
-    rd = fread (dbf->BufDbf, sizeof (unsigned char), dbf->DbfReclen,
-		dbf->flDbf);
+    rd = shp_read (dbf->flDbf, map_dbf, dbf->BufDbf, dbf->DbfReclen,
+		   &bufdbf);
     if (rd != dbf->DbfReclen)
 	goto eof;
 /* setting up the current DBF ENTITY */
     gaiaResetDbfEntity (dbf->Dbf);
     dbf->Dbf->RowId = current_row;
-    if (*(dbf->BufDbf) == '*')
+    if (*bufdbf == '*')
       {
 	  /* deleted row */
 	  *deleted = 1;
@@ -5050,13 +6583,9 @@ gaiaReadDbfEntity (gaiaDbfPtr dbf, int current_row, int *deleted)
 	  return 1;
       }
 /* fetching the DBF values */
-    pFld = dbf->Dbf->First;
-    while (pFld)
-      {
-	  if (!parseDbfField (dbf->BufDbf, dbf->IconvObj, pFld))
-	      goto conversion_error;
-	  pFld = pFld->Next;
-      }
+    if (!shp_parse_dbf_record
+	(bufdbf, dbf->IconvObj, dbf->DecoderObj, dbf->Dbf, read_fields))
+	goto conversion_error;
     if (dbf->LastError)
 	free (dbf->LastError);
     dbf->LastError = NULL;
@@ -164,6 +164,8 @@ extern "C"
  \param err_msg on completion will contain an error message (if any)
 
  \return 0 on failure, any other value on success
+
+ \sa dump_shapefile_ex
  */
     SPATIALITE_DECLARE int dump_shapefile (sqlite3 * sqlite, char *table,
 					   char *column, char *shp_path,
@@ -171,6 +173,37 @@ extern "C"
 					   int verbose, int *rows,
 					   char *err_msg);
 
+/**
+ Dumps a full geometry-table into an external Shapefile
+
+ \param sqlite handle to current DB connection
+ \param table the name of the table to be exported
+ \param column the name of the geometry column
+ \param shp_path pathname of the Shapefile to be exported (no suffix) 
+ \param charset a valid GNU ICONV charset to be used for DBF text strings
+ \param geom_type "POINT", "LINESTRING", "POLYGON", "MULTIPOLYGON" or NULL
+ \param use_stats if TRUE the DBF fields will be sized accordingly to the
+ current layer statistics (geometry_columns_field_infos), without rescanning
+ the whole table before exporting
+ \param verbose if TRUE a short report is shown on stderr
+ \param rows on completion will contain the total number of actually exported rows
+ \param err_msg on completion will contain an error message (if any)
+
+ \return 0 on failure, any other value on success
+
+ \sa dump_shapefile
+
+ \note dump_shapefile simply calls this function by passing use_stats=FALSE.
+ \n Statistics will anyway be computed when not yet available, but outdated
+ ones will be trusted as they are: so values not fitting into the DBF fields
+ sized this way will be truncated (TEXT) or exported as NULL (numbers).
+ */
+    SPATIALITE_DECLARE int dump_shapefile_ex (sqlite3 * sqlite, char *table,
+					      char *column, char *shp_path,
+					      char *charset, char *geom_type,
+					      int use_stats, int verbose,
+					      int *rows, char *err_msg);
+
 /**
  Loads an external Shapefile into a newly created table
 
@@ -245,6 +278,48 @@ extern "C"
 					      int verbose, int spatial_index,
 					      int *rows, char *err_msg);
 
+/**
+ Loads an external Shapefile into a newly created table
+
+ \param sqlite handle to current DB connection
+ \param shp_path pathname of the Shapefile to be imported (no suffix) 
+ \param table the name of the table to be created
+ \param charset a valid GNU ICONV charset to be used for DBF text strings
+ \param srid the SRID to be set for Geometries
+ \param geo_column the name of the geometry column
+ \param gtype expected to be one of the geometry types supported by
+ load_shapefile_ex, or "AUTO".
+ \param pk_column name of the Primary Key column; if NULL or mismatching
+ then "PK_UID" will be assumed by default.
+ \param coerce2d if TRUE any Geometry will be casted to 2D [XY]
+ \param compressed if TRUE compressed Geometries will be created
+ \param verbose if TRUE a short report is shown on stderr
+ \param spatial_index if TRUE an R*Tree Spatial Index will be created
+ \param decoder_threads the number of threads decoding the Shapefile
+ while the calling thread inserts the rows: 0 means sequential loading,
+ and any negative value lets the library decide depending on the
+ available CPUs and on the number of records.
+ \param rows on completion will contain the total number of actually exported rows
+ \param err_msg on completion will contain an error message (if any)
+
+ \return 0 on failure, any other value on success
+
+ \sa load_shapefile_ex
+
+ \note load_shapefile_ex simply calls load_shapefile_ex2 by passing
+  an implicit decoder_threads=-1 argument. Decoder threads are never
+  used on Windows.
+ */
+    SPATIALITE_DECLARE int load_shapefile_ex2 (sqlite3 * sqlite,
+					       char *shp_path, char *table,
+					       char *charset, int srid,
+					       char *geo_column, char *gtype,
+					       char *pk_column, int coerce2d,
+					       int compressed, int verbose,
+					       int spatial_index,
+					       int decoder_threads, int *rows,
+					       char *err_msg);
+
 /**
  Loads an external DBF file into a newly created table
 
@@ -290,6 +365,38 @@ extern "C"
 					char *err_msg);
 
 
+/**
+ Loads an external CSV/TXT file into a newly created table
+
+ \param sqlite handle to current DB connection
+ \param text_path pathname of the CSV/TXT file to be imported
+ \param table the name of the table to be created
+ \param charset a valid GNU ICONV charset to be used for text strings
+ \param first_line_titles if TRUE the first line contains the column names
+ \param decimal_separator the decimal separator: '.' or ','
+ \param text_separator the char enclosing text strings, e.g. '"'
+ \param field_separator the char separating fields, e.g. ',' or '\\t'
+ \param verbose if TRUE a short report is shown on stderr
+ \param rows on completion will contain the total number of actually exported rows
+ \param err_msg on completion will contain an error message (if any)
+
+ \sa load_dbf
+
+ \note the column types are the same ones VirtualText would expose, and
+ an INTEGER PRIMARY KEY named "PK_UID" will be added. The preliminary
+ parsing of large files runs in parallel (see gaiaTextReaderParse), then
+ all rows are inserted by the calling thread within a single transaction.
+
+ \return 0 on failure, any other value on success
+ */
+    SPATIALITE_DECLARE int load_text (sqlite3 * sqlite, char *text_path,
+				      char *table, char *charset,
+				      int first_line_titles,
+				      char decimal_separator,
+				      char text_separator,
+				      char field_separator, int verbose,
+				      int *rows, char *err_msg);
+
 /**
  Dumps a full table into an external DBF file
 
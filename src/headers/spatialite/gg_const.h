@@ -290,6 +290,8 @@ extern "C"
 #define GAIA_NET64_START	0x68
 /** VirtualNetwork internal markers: A-Stat START */
 #define GAIA_NET64_A_STAR_START	0x69
+/** VirtualNetwork internal markers: Contraction Hierarchy START */
+#define GAIA_NET_CH_START	0x6a
 /** VirtualNetwork internal markers: END */
 #define GAIA_NET_END		0x87
 /** VirtualNetwork internal markers: HEADER */
@@ -635,6 +635,10 @@ extern "C"
 	gaiaDxfHatchPtr curr_hatch;
 /** internal parser variable */
 	int undeclared_layers;
+/** internal parser variable: hash index supporting Layer lookups */
+	void *layers_index;
+/** internal parser variable: hash index supporting Block lookups */
+	void *blocks_index;
     } gaiaDxfParser;
 /**
  Typedef for DXF Layer object
@@ -1299,6 +1299,88 @@ extern "C"
     GAIAGEO_DECLARE int gaiaReadShpEntity (gaiaShapefilePtr shp,
 					   int current_row, int srid);
 
+/**
+ Reads a feature from a Shapefile object [selected columns only]
+
+ \param shp pointer to the Shapefile object.
+ \param current_row the row number identifying the feature to be read.
+ \param srid feature's SRID 
+ \param read_geometry if FALSE the Geometry will not be decoded at all.
+ \param read_fields an array of flags, one for each DBF Field (in the same
+ order as the \e Dbf->First list): only Fields whose flag is set will be
+ decoded. NULL means that all Fields are required.
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaReadShpEntity
+
+ \note the \e Dbf->Geometry member will be NULL when the Geometry isn't
+ required, and any Field not required will be left in its initial empty
+ state (i.e. \e no \e value at all).
+
+ \remark the Shapefile object should be opened in \e read mode.
+ */
+    GAIAGEO_DECLARE int gaiaReadShpEntity_ex (gaiaShapefilePtr shp,
+					      int current_row, int srid,
+					      int read_geometry,
+					      const char *read_fields);
+
+/**
+ Reads the MBR of a feature from a Shapefile object
+
+ \param shp pointer to the Shapefile object.
+ \param current_row the row number identifying the feature to be read.
+ \param is_null on completion this variable will be set to TRUE if the
+ feature has a NULL shape (the MBR is left undefined in this case).
+ \param minx on completion this variable will contain the MBR MinX coordinate.
+ \param miny on completion this variable will contain the MBR MinY coordinate.
+ \param maxx on completion this variable will contain the MBR MaxX coordinate.
+ \param maxy on completion this variable will contain the MBR MaxY coordinate.
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaReadShpEntity
+
+ \note only the SHX entry and the SHP record header will be read: neither
+ the Geometry nor the DBF attributes will be decoded, and the Shapefile's
+ \e Dbf member will be left untouched.
+
+ \remark the Shapefile object should be opened in \e read mode.
+ */
+    GAIAGEO_DECLARE int gaiaReadShpEntityMbr (gaiaShapefilePtr shp,
+					      int current_row, int *is_null,
+					      double *minx, double *miny,
+					      double *maxx, double *maxy);
+
+/**
+ Reads a feature from a Shapefile object, directly returning its Geometry
+ as a SpatiaLite BLOB
+
+ \param shp pointer to the Shapefile object.
+ \param current_row the row number identifying the feature to be read.
+ \param srid feature's SRID
+ \param blob on completion this variable will contain a pointer to the
+ BLOB Geometry (NULL if the feature has a NULL or empty shape).
+ \param blob_size on completion this variable will contain the BLOB's size
+ (in bytes).
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaReadShpEntity, gaiaToSpatiaLiteBlobWkb
+
+ \note the BLOB is directly transcoded from the SHP record, without building
+ any intermediate Geometry object, and will be exactly the same one
+ gaiaToSpatiaLiteBlobWkb() would produce; the \e Dbf->Geometry member will
+ always be NULL.\n
+ you are responsible to free() the BLOB.
+
+ \remark the Shapefile object should be opened in \e read mode.
+ */
+    GAIAGEO_DECLARE int gaiaReadShpEntityBlob (gaiaShapefilePtr shp,
+					       int current_row, int srid,
+					       unsigned char **blob,
+					       int *blob_size);
+
 /**
  Prescans a Shapefile object gathering informations
 
@@ -1434,6 +1516,31 @@ extern "C"
     GAIAGEO_DECLARE int gaiaReadDbfEntity (gaiaDbfPtr dbf, int current_row,
 					   int *deleted);
 
+/**
+ Reads a record from a DBF File object [selected fields only]
+
+ \param dbf pointer to the DBF File object.
+ \param current_row the row number identifying the record to be read.
+ \param deleted on completion this variable will contain 0 if the record
+ just read is valid: any other value if the record just read is marked as
+ \e logically \e deleted.
+ \param read_fields an array of flags, one for each DBF Field (in the same
+ order as the DBF File \e First list): only Fields whose flag is set will
+ be decoded. NULL means that all Fields are required.
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaReadDbfEntity
+
+ \note any Field not required will be left in its initial empty state
+ (i.e. \e no \e value at all).
+
+ \remark the DBF File object should be opened in \e read mode.
+ */
+    GAIAGEO_DECLARE int gaiaReadDbfEntity_ex (gaiaDbfPtr dbf,
+					      int current_row, int *deleted,
+					      const char *read_fields);
+
 /**
  Writes a record into a DBF File object
 
@@ -1524,9 +1631,66 @@ extern "C"
  \li file consistency: checking expected formatting rules.
  \li identifying the number / type / name of fields [aka columns].
  \li identifying the actual number of lines within the file.
+ \n large memory-mapped files are split into several chunks, that will
+ then be parsed in parallel by separate threads (one for each available
+ CPU, at most eight).
  */
     GAIAGEO_DECLARE int gaiaTextReaderParse (gaiaTextReaderPtr reader);
 
+/**
+ Prescans the external file associated to a Text Reade object
+
+ \param reader pointer to Text Reader object.
+ \param chunks the number of chunks a memory-mapped file will be split
+ into, at most eight: 1 means serial parsing, and 0 (or any negative value)
+ lets the library decide depending on the available CPUs and on the file size.
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaTextReaderParse
+
+ \note gaiaTextReaderParse simply calls gaiaTextReaderParse_ex by passing
+ an implicit chunks=0 argument. Files that can't be memory-mapped are
+ always serially parsed.
+ */
+    GAIAGEO_DECLARE int gaiaTextReaderParse_ex (gaiaTextReaderPtr reader,
+						int chunks);
+
+/**
+ Loads a previously saved Row Index into a Text Reader object
+
+ \param reader pointer to Text Reader object.
+ \param index_path path of the index (sidecar) file.
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaTextReaderAlloc, gaiaTextReaderParse, gaiaTextReaderSaveIndex
+
+ \note this is a fast alternative to gaiaTextReaderParse: the index will be
+ accepted only if it was created with the same separators and titles setting,
+ and if the size and modification time of the input file are still the same
+ as when the index was saved. On failure the Text Reader object is left
+ unparsed, so gaiaTextReaderParse can then be called as usual.
+ */
+    GAIAGEO_DECLARE int gaiaTextReaderLoadIndex (gaiaTextReaderPtr reader,
+						 const char *index_path);
+
+/**
+ Saves the Row Index of a Text Reader object into a sidecar file
+
+ \param reader pointer to Text Reader object.
+ \param index_path path of the index (sidecar) file.
+
+ \return 0 on failure: any other value on success.
+
+ \sa gaiaTextReaderParse, gaiaTextReaderLoadIndex
+
+ \note the Text Reader object must have been successfully parsed; the index
+ stores the row offsets, the number of fields and the inferred column types.
+ */
+    GAIAGEO_DECLARE int gaiaTextReaderSaveIndex (gaiaTextReaderPtr reader,
+						 const char *index_path);
+
 /**
  Reads a line from a Text Reader object
  
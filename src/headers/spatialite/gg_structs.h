@@ -380,6 +380,12 @@ extern "C"
 	void *IconvObj;		/* opaque reference to ICONV converter */
 /** last error message (may be NULL) */
 	char *LastError;	/* last error message */
+/** handle to the memory-mapped DBF file (may be NULL) */
+	void *MapObj;		/* opaque reference to the memory mapping */
+/** handle to the fast DBF record decoder (may be NULL) */
+	void *DecoderObj;	/* opaque reference to the DBF record decoder */
+/** handle to the output buffers (may be NULL) */
+	void *BuffersObj;	/* opaque reference to the output buffers */
     } gaiaDbf;
 /** 
  Typedef for DBF file handler structure
@@ -446,6 +452,12 @@ extern "C"
 	int EffectiveType;	/* the effective Geometry-type, as determined by gaiaShpAnalyze() */
 /** SHP actual dims: one of GAIA_XY, GAIA_XY_Z, GAIA_XY_M, GAIA_XY_ZM */
 	int EffectiveDims;	/* the effective Dimensions [XY, XYZ, XYM, XYZM], as determined by gaiaShpAnalyze() */
+/** handle to the memory-mapped SHX/SHP/DBF files (may be NULL) */
+	void *MapObj;		/* opaque reference to the memory mappings */
+/** handle to the fast DBF record decoder (may be NULL) */
+	void *DecoderObj;	/* opaque reference to the DBF record decoder */
+/** handle to the output buffers (may be NULL) */
+	void *BuffersObj;	/* opaque reference to the output buffers */
     } gaiaShapefile;
 /**
  Typedef for SHP file handler structure
@@ -480,8 +492,8 @@ extern "C"
 
 /** Virtual Text driver: MAX number of fields */
 #define VRTTXT_FIELDS_MAX	65535
-/** Virtual Text driver: MAX block size (in bytes) */
-#define VRTTXT_BLOCK_MAX 65535
+/** Virtual Text driver: number of records between two row index checkpoints */
+#define VRTTXT_INDEX_STEP	64
 
 /** Virtual Text driver: TEXT value */
 #define VRTTXT_TEXT		1
@@ -503,7 +515,9 @@ extern "C"
 /** line length (in bytes) */
 	int len;
 /** array of field offsets (where each field starts) */
-	int field_offsets[VRTTXT_FIELDS_MAX];
+	int *field_offsets;
+/** allocated size of the field offsets array */
+	int field_offsets_sz;
 /** number of field into the record */
 	int num_fields;
 /** validity flag */
@@ -511,40 +525,48 @@ extern "C"
     };
 
 /**
- Container for Virtual Text record (line) offsets 
+ Container for Virtual Text row index checkpoint
  */
-    struct vrttxt_row
+    struct vrttxt_row_checkpoint
     {
-/* a struct storing Row offsets */
-/** Line Number */
-	int line_no;
+/* absolute position of one record every VRTTXT_INDEX_STEP */
 /** start offset */
 	off_t offset;
-/** record (line) length (in bytes) */
-	int len;
-/** number of fields into this record */
-	int num_fields;
+/** position of the record length into the encoded stream */
+	size_t pos;
     };
 
 /**
- Container for Virtual Text block of records
+ Container for Virtual Text record (line) offsets 
  */
-    struct vrttxt_row_block
+    struct vrttxt_row_index
     {
 /*
-/ for efficiency sake, individual Row offsets 
-/ are grouped in reasonably sized blocks
+/ records are contiguous, so each one starts just after the
+/ end of the previous one: only the record lengths are stored,
+/ as variable length integers (7 bits per byte), and an
+/ absolute offset is stored every VRTTXT_INDEX_STEP records
 */
-/** array of records [lines] */
-	struct vrttxt_row rows[VRTTXT_BLOCK_MAX];
-/** number of records into the array */
-	int num_rows;
-/** min Line Number */
-	int min_line_no;
-/** max Line Number */
-	int max_line_no;
-/** pointer to next item [linked list] */
-	struct vrttxt_row_block *next;
+/** encoded record lengths */
+	unsigned char *lengths;
+/** current size of the encoded stream (in bytes) */
+	size_t lengths_len;
+/** allocated size of the encoded stream (in bytes) */
+	size_t lengths_sz;
+/** array of checkpoints */
+	struct vrttxt_row_checkpoint *checkpoints;
+/** number of checkpoints */
+	int num_checkpoints;
+/** allocated size of the checkpoints array */
+	int checkpoints_sz;
+/** number of records [lines] */
+	int num_lines;
+/** last accessed record: Line Number */
+	int cache_line_no;
+/** last accessed record: start offset */
+	off_t cache_offset;
+/** last accessed record: position into the encoded stream */
+	size_t cache_pos;
     };
 
 /** 
@@ -566,7 +588,9 @@ extern "C"
     {
 /* the main TXT-Reader struct */
 /** array of columns (fields) */
-	struct vrttxt_column_header columns[VRTTXT_FIELDS_MAX];
+	struct vrttxt_column_header *columns;
+/** allocated size of the columns (fields) arrays */
+	int columns_sz;
 /** FILE handle */
 	FILE *text_file;
 /** handle to ICONV converter object */
@@ -581,12 +605,8 @@ extern "C"
 	int first_line_titles;
 /** validity flag */
 	int error;
-/** pointer to first block of records [linked list] */
-	struct vrttxt_row_block *first;
-/** pointer to last block of records [linked list] */
-	struct vrttxt_row_block *last;
-/** array of pointers to individual records [lines] */
-	struct vrttxt_row **rows;
+/** record offsets index */
+	struct vrttxt_row_index index;
 /** number of records */
 	int num_rows;
 /** current Line Number */
@@ -602,13 +622,23 @@ extern "C"
 /** current field buffer */
 	char *field_buffer;
 /** array of field offsets [current record] */
-	int field_offsets[VRTTXT_FIELDS_MAX];
+	int *field_offsets;
 /** array of field lengths [current record] */
-	int field_lens[VRTTXT_FIELDS_MAX];
+	int *field_lens;
 /** max field [current record] */
 	int max_current_field;
 /** current record [line] ready for parsing */
 	int current_line_ready;
+/** memory-mapped input file [NULL if not mapped] */
+	const char *mapped_file;
+/** size of the memory-mapped input file */
+	off_t mapped_size;
+/** current record [line] data */
+	const char *current_line;
+/** input file size (in bytes) when opened */
+	off_t file_size;
+/** input file last modification time when opened */
+	sqlite3_int64 file_mtime;
     } gaiaTextReader;
 /**
  Typedef for Virtual Text file handling structure
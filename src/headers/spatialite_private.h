@@ -306,6 +306,15 @@ extern "C"
     SPATIALITE_PRIVATE int checkPopulatedCoverage (void *p_sqlite,
 						   const char *coverage_name);
 
+    SPATIALITE_PRIVATE int create_network_hierarchy (void *p_sqlite,
+						     const char *table);
+
+    SPATIALITE_PRIVATE int create_network_image (void *p_sqlite,
+						 const char *table,
+						 int sidecar);
+
+    SPATIALITE_PRIVATE int set_network_arc_cache_size (int kbytes);
+
     SPATIALITE_PRIVATE const char *splite_lwgeom_version (void);
 
     SPATIALITE_PRIVATE void splite_lwgeom_init (void);
@@ -337,6 +346,13 @@ extern "C"
 
     SPATIALITE_PRIVATE void spatialite_splash_screen (int verbose);
 
+/* the mutexes owned by the library: see splite_library_mutex() */
+#define SPLITE_MUTEX_MBR_CACHE		0
+#define SPLITE_MUTEX_VIRTUAL_NETWORK	1
+#define SPLITE_MUTEX_COUNT		2
+
+    SPATIALITE_PRIVATE void *splite_library_mutex (int which);
+
     SPATIALITE_PRIVATE void geos_error (const char *fmt, ...);
 
     SPATIALITE_PRIVATE void geos_warning (const char *fmt, ...);
@@ -59,6 +59,11 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "config.h"
 #endif
 
+#if !defined(_WIN32) && !defined(WIN32)
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
 #include <spatialite/sqlite.h>
 #include <spatialite/debug.h>
 
@@ -359,6 +364,538 @@ getDbfField (struct auxdbf_list *aux, char *name)
 
 #ifndef OMIT_ICONV		/* ICONV enabled: supporting SHP */
 
+#define SHP_LOAD_BATCH		256	/* rows decoded at once by a decoder thread */
+#define SHP_LOAD_MAX_THREADS	8	/* max number of decoder threads */
+
+struct shp_load_row
+{
+/* a decoded Shapefile row, ready to be bound */
+    gaiaValuePtr *Values;	/* the DBF values - one for each DBF field */
+    unsigned char *Blob;	/* the Geometry BLOB - NULL for a NULL Geometry */
+    int BlobSize;
+};
+
+static int
+shp_load_decode (gaiaShapefilePtr shp, int current_row, int srid,
+		 int compressed, struct shp_load_row *row)
+{
+/* reading and decoding a Shapefile row; 0 means EOF or error */
+    int i = 0;
+    gaiaDbfFieldPtr dbf_field;
+    row->Blob = NULL;
+    row->BlobSize = 0;
+    if (!compressed)
+      {
+	  /* directly transcoding the SHP record into a BLOB Geometry */
+	  if (!gaiaReadShpEntityBlob
+	      (shp, current_row, srid, &(row->Blob), &(row->BlobSize)))
+	      return 0;
+      }
+    else if (!gaiaReadShpEntity (shp, current_row, srid))
+	return 0;
+    dbf_field = shp->Dbf->First;
+    while (dbf_field)
+      {
+	  /* taking ownership of the DBF values */
+	  row->Values[i++] = dbf_field->Value;
+	  dbf_field->Value = NULL;
+	  dbf_field = dbf_field->Next;
+      }
+    if (compressed && shp->Dbf->Geometry)
+	gaiaToCompressedBlobWkb (shp->Dbf->Geometry, &(row->Blob),
+				 &(row->BlobSize));
+    return 1;
+}
+
+static void
+shp_load_row_reset (struct shp_load_row *row, int num_fields)
+{
+/* releasing the values of a decoded row */
+    int i;
+    for (i = 0; i < num_fields; i++)
+      {
+	  if (row->Values[i])
+	      gaiaFreeValue (row->Values[i]);
+	  row->Values[i] = NULL;
+      }
+    if (row->Blob)
+	free (row->Blob);
+    row->Blob = NULL;
+    row->BlobSize = 0;
+}
+
+static int
+shp_load_insert (sqlite3_stmt * stmt, gaiaDbfListPtr dbf, const char *pk_name,
+		 int pk_type, int current_row, struct shp_load_row *row)
+{
+/* binding a decoded row and inserting it; returns the SQLite result code */
+    int i;
+    int cnt;
+    int pk_set = 0;
+    gaiaValuePtr value;
+    gaiaDbfFieldPtr dbf_field;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    i = 0;
+    dbf_field = dbf->First;
+    while (dbf_field)
+      {
+	  /* Primary Key value */
+	  value = row->Values[i++];
+	  if (strcasecmp (pk_name, dbf_field->Name) == 0)
+	    {
+		if (value == NULL)
+		    sqlite3_bind_null (stmt, 1);
+		else if (pk_type == SQLITE_TEXT)
+		    sqlite3_bind_text (stmt, 1, value->TxtValue,
+				       strlen (value->TxtValue), SQLITE_STATIC);
+		else if (pk_type == SQLITE_FLOAT)
+		    sqlite3_bind_double (stmt, 1, value->DblValue);
+		else
+		    sqlite3_bind_int64 (stmt, 1, value->IntValue);
+		pk_set = 1;
+	    }
+	  dbf_field = dbf_field->Next;
+      }
+    if (!pk_set)
+	sqlite3_bind_int (stmt, 1, current_row);
+    i = 0;
+    cnt = 0;
+    dbf_field = dbf->First;
+    while (dbf_field)
+      {
+	  /* column values */
+	  value = row->Values[i++];
+	  if (strcasecmp (pk_name, dbf_field->Name) == 0)
+	    {
+		/* skipping the Primary Key field */
+		dbf_field = dbf_field->Next;
+		continue;
+	    }
+	  if (value == NULL)
+	      sqlite3_bind_null (stmt, cnt + 2);
+	  else
+	    {
+		switch (value->Type)
+		  {
+		  case GAIA_INT_VALUE:
+		      sqlite3_bind_int64 (stmt, cnt + 2, value->IntValue);
+		      break;
+		  case GAIA_DOUBLE_VALUE:
+		      sqlite3_bind_double (stmt, cnt + 2, value->DblValue);
+		      break;
+		  case GAIA_TEXT_VALUE:
+		      sqlite3_bind_text (stmt, cnt + 2, value->TxtValue,
+					 strlen (value->TxtValue),
+					 SQLITE_STATIC);
+		      break;
+		  default:
+		      sqlite3_bind_null (stmt, cnt + 2);
+		      break;
+		  }
+	    }
+	  cnt++;
+	  dbf_field = dbf_field->Next;
+      }
+    if (row->Blob)
+      {
+	  /* the BLOB is now owned by SQLite */
+	  sqlite3_bind_blob (stmt, cnt + 2, row->Blob, row->BlobSize, free);
+	  row->Blob = NULL;
+      }
+    else
+      {
+	  /* handling a NULL-Geometry */
+	  sqlite3_bind_null (stmt, cnt + 2);
+      }
+    return sqlite3_step (stmt);
+}
+
+static void
+shp_load_error (sqlite3 * sqlite, const char *shp_error, char *err_msg)
+{
+/* reporting a load shapefile error */
+    if (shp_error != NULL)
+      {
+	  if (!err_msg)
+	      spatialite_e ("%s\n", shp_error);
+	  else
+	      sprintf (err_msg, "%s\n", shp_error);
+	  return;
+      }
+    if (!err_msg)
+	spatialite_e ("load shapefile error: <%s>\n", sqlite3_errmsg (sqlite));
+    else
+	sprintf (err_msg, "load shapefile error: <%s>\n",
+		 sqlite3_errmsg (sqlite));
+}
+
+#if !defined(_WIN32) && !defined(WIN32)	/* multi-threaded decoding */
+
+struct shp_load_batch
+{
+/* a ring buffer slot: a block of consecutive decoded rows */
+    int Batch;			/* the batch number; -1 for a free slot */
+    int Count;			/* number of decoded rows */
+    int Eof;			/* the Shapefile ends within this batch */
+    char *Error;		/* the decoding error (may be NULL) */
+    struct shp_load_row Rows[SHP_LOAD_BATCH];
+};
+
+struct shp_load_pipeline
+{
+/* the state shared by the decoder threads and by the writer */
+    pthread_mutex_t Mutex;
+    pthread_cond_t Filled;	/* some batch has been decoded */
+    pthread_cond_t Freed;	/* the writer has consumed some batch */
+    int NumSlots;
+    struct shp_load_batch *Slots;
+    gaiaValuePtr *Values;	/* storage for all rows' DBF values */
+    int NextBatch;		/* the batch the writer is waiting for */
+    int Stop;			/* no further batch is required */
+    int NumFields;
+    int Srid;
+    int Compressed;
+};
+
+struct shp_load_decoder
+{
+/* a decoder thread */
+    struct shp_load_pipeline *Pipeline;
+    gaiaShapefilePtr Shp;	/* the decoder's own Shapefile reader */
+    int First;			/* the first batch to be decoded */
+    int Step;			/* the distance between batches */
+    pthread_t Thread;
+};
+
+static void *
+shp_load_decoder_main (void *arg)
+{
+/*
+/ decoder thread: decodes batches First, First + Step, First + 2*Step ...
+/ each batch goes into the ring buffer slot Batch % NumSlots, that
+/ can be reused only after the writer has consumed its previous batch
+*/
+    struct shp_load_decoder *decoder = (struct shp_load_decoder *) arg;
+    struct shp_load_pipeline *pipe = decoder->Pipeline;
+    struct shp_load_batch *slot;
+    int batch;
+    int i;
+    int eof;
+    int len;
+    for (batch = decoder->First;; batch += decoder->Step)
+      {
+	  slot = pipe->Slots + (batch % pipe->NumSlots);
+	  pthread_mutex_lock (&(pipe->Mutex));
+	  while (!pipe->Stop && batch >= pipe->NextBatch + pipe->NumSlots)
+	      pthread_cond_wait (&(pipe->Freed), &(pipe->Mutex));
+	  if (pipe->Stop)
+	    {
+		pthread_mutex_unlock (&(pipe->Mutex));
+		break;
+	    }
+	  pthread_mutex_unlock (&(pipe->Mutex));
+	  slot->Count = 0;
+	  slot->Eof = 0;
+	  slot->Error = NULL;
+	  for (i = 0; i < SHP_LOAD_BATCH; i++)
+	    {
+		if (!shp_load_decode
+		    (decoder->Shp, (batch * SHP_LOAD_BATCH) + i, pipe->Srid,
+		     pipe->Compressed, slot->Rows + i))
+		  {
+		      if (decoder->Shp->LastError)
+			{
+			    len = strlen (decoder->Shp->LastError);
+			    slot->Error = malloc (len + 1);
+			    strcpy (slot->Error, decoder->Shp->LastError);
+			}
+		      slot->Eof = 1;
+		      break;
+		  }
+		slot->Count++;
+	    }
+	  eof = slot->Eof;
+	  pthread_mutex_lock (&(pipe->Mutex));
+	  slot->Batch = batch;
+	  pthread_cond_broadcast (&(pipe->Filled));
+	  pthread_mutex_unlock (&(pipe->Mutex));
+	  if (eof)
+	      break;
+      }
+    return NULL;
+}
+
+static int
+shp_load_threads (gaiaShapefilePtr shp, int requested)
+{
+/*
+/ determining how many decoder threads should be used; 0 means none
+/
+/ a non-negative REQUESTED count forces the number of decoder threads
+/ whatever the CPUs and the records may be [0 always meaning sequential
+/ loading]; any negative value means automatic
+*/
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int records = ((shp->ShxSize * 2) - 100) / 8;	/* each SHX row = 8 bytes */
+    int threads = cpus - 1;	/* the writer requires a CPU too */
+    if (requested >= 0)
+      {
+	  if (requested > SHP_LOAD_MAX_THREADS)
+	      return SHP_LOAD_MAX_THREADS;
+	  return requested;
+      }
+    if (threads < 1)
+	threads = 1;
+    if (threads > SHP_LOAD_MAX_THREADS)
+	threads = SHP_LOAD_MAX_THREADS;
+    if (threads > records / SHP_LOAD_BATCH)
+	threads = records / SHP_LOAD_BATCH;
+    if (cpus < 2 || threads < 1)
+	return 0;
+    return threads;
+}
+
+static int
+shp_load_pipelined (sqlite3 * sqlite, sqlite3_stmt * stmt,
+		    gaiaShapefilePtr shp, char *shp_path, char *charset,
+		    int num_threads, int srid, int compressed,
+		    const char *pk_name, int pk_type, int *current_row,
+		    char *err_msg)
+{
+/*
+/ inserting rows from shapefile: NUM_THREADS decoder threads read and
+/ decode the rows in batches, and this thread (the only one touching
+/ the DB) inserts them strictly in the Shapefile's order
+/
+/ returns -1 if the decoders cannot be started, 0 on failure
+*/
+    struct shp_load_pipeline pipe;
+    struct shp_load_decoder *decoders;
+    struct shp_load_batch *slot;
+    gaiaDbfFieldPtr dbf_field;
+    int started = 0;
+    int result = 1;
+    int batch;
+    int eof;
+    int ret;
+    int i;
+    int j;
+    decoders = malloc (sizeof (struct shp_load_decoder) * num_threads);
+    for (i = 0; i < num_threads; i++)
+      {
+	  /* each decoder thread needs its own reader */
+	  gaiaShapefilePtr reader = gaiaAllocShapefile ();
+	  gaiaOpenShpRead (reader, shp_path, charset, "UTF-8");
+	  if (!(reader->Valid))
+	    {
+		gaiaFreeShapefile (reader);
+		break;
+	    }
+	  reader->EffectiveType = shp->EffectiveType;
+	  reader->EffectiveDims = shp->EffectiveDims;
+	  decoders[i].Pipeline = &pipe;
+	  decoders[i].Shp = reader;
+	  decoders[i].First = i;
+      }
+    num_threads = i;
+    if (num_threads == 0)
+      {
+	  free (decoders);
+	  return -1;
+      }
+/* initializing the ring buffer */
+    pipe.NumFields = 0;
+    dbf_field = shp->Dbf->First;
+    while (dbf_field)
+      {
+	  pipe.NumFields++;
+	  dbf_field = dbf_field->Next;
+      }
+    pipe.NumSlots = num_threads * 2;
+    pipe.Slots = malloc (sizeof (struct shp_load_batch) * pipe.NumSlots);
+    pipe.Values =
+	calloc (pipe.NumSlots * SHP_LOAD_BATCH * (pipe.NumFields + 1),
+		sizeof (gaiaValuePtr));
+    for (i = 0; i < pipe.NumSlots; i++)
+      {
+	  slot = pipe.Slots + i;
+	  slot->Batch = -1;
+	  slot->Count = 0;
+	  slot->Eof = 0;
+	  slot->Error = NULL;
+	  for (j = 0; j < SHP_LOAD_BATCH; j++)
+	    {
+		slot->Rows[j].Values =
+		    pipe.Values +
+		    (((i * SHP_LOAD_BATCH) + j) * (pipe.NumFields + 1));
+		slot->Rows[j].Blob = NULL;
+		slot->Rows[j].BlobSize = 0;
+	    }
+      }
+    pipe.NextBatch = 0;
+    pipe.Stop = 0;
+    pipe.Srid = srid;
+    pipe.Compressed = compressed;
+    pthread_mutex_init (&(pipe.Mutex), NULL);
+    pthread_cond_init (&(pipe.Filled), NULL);
+    pthread_cond_init (&(pipe.Freed), NULL);
+    for (i = 0; i < num_threads; i++)
+      {
+	  decoders[i].Step = num_threads;
+	  if (pthread_create
+	      (&(decoders[i].Thread), NULL, shp_load_decoder_main,
+	       decoders + i) != 0)
+	      break;
+	  started++;
+      }
+    if (started < num_threads)
+      {
+	  /* some batches would never be decoded: giving up */
+	  result = -1;
+	  goto stop;
+      }
+
+    for (batch = 0;; batch++)
+      {
+	  /* consuming the decoded batches in order */
+	  slot = pipe.Slots + (batch % pipe.NumSlots);
+	  pthread_mutex_lock (&(pipe.Mutex));
+	  while (slot->Batch != batch)
+	      pthread_cond_wait (&(pipe.Filled), &(pipe.Mutex));
+	  pthread_mutex_unlock (&(pipe.Mutex));
+	  for (i = 0; i < slot->Count; i++)
+	    {
+		*current_row += 1;
+		ret =
+		    shp_load_insert (stmt, shp->Dbf, pk_name, pk_type,
+				     *current_row, slot->Rows + i);
+		if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+		    ;
+		else
+		  {
+		      shp_load_error (sqlite, NULL, err_msg);
+		      result = 0;
+		      break;
+		  }
+	    }
+	  if (result && slot->Error != NULL)
+	    {
+		shp_load_error (sqlite, slot->Error, err_msg);
+		result = 0;
+	    }
+	  eof = slot->Eof;
+	  for (i = 0; i < slot->Count; i++)
+	      shp_load_row_reset (slot->Rows + i, pipe.NumFields);
+	  if (slot->Error)
+	      free (slot->Error);
+	  slot->Error = NULL;
+	  pthread_mutex_lock (&(pipe.Mutex));
+	  slot->Batch = -1;
+	  pipe.NextBatch += 1;
+	  pthread_cond_broadcast (&(pipe.Freed));
+	  pthread_mutex_unlock (&(pipe.Mutex));
+	  if (eof || !result)
+	      break;
+      }
+
+  stop:
+/* stopping the decoder threads */
+    pthread_mutex_lock (&(pipe.Mutex));
+    pipe.Stop = 1;
+    pthread_cond_broadcast (&(pipe.Freed));
+    pthread_mutex_unlock (&(pipe.Mutex));
+    for (i = 0; i < started; i++)
+	pthread_join (decoders[i].Thread, NULL);
+    for (i = 0; i < pipe.NumSlots; i++)
+      {
+	  /* discarding any batch decoded beyond the end */
+	  slot = pipe.Slots + i;
+	  if (slot->Batch < 0)
+	      continue;
+	  for (j = 0; j < slot->Count; j++)
+	      shp_load_row_reset (slot->Rows + j, pipe.NumFields);
+	  if (slot->Error)
+	      free (slot->Error);
+      }
+    pthread_cond_destroy (&(pipe.Freed));
+    pthread_cond_destroy (&(pipe.Filled));
+    pthread_mutex_destroy (&(pipe.Mutex));
+    for (i = 0; i < num_threads; i++)
+	gaiaFreeShapefile (decoders[i].Shp);
+    free (decoders);
+    free (pipe.Values);
+    free (pipe.Slots);
+    return result;
+}
+
+#endif /* end multi-threaded decoding */
+
+static int
+shp_load_rows (sqlite3 * sqlite, sqlite3_stmt * stmt, gaiaShapefilePtr shp,
+	       char *shp_path, char *charset, int srid, int compressed,
+	       int decoder_threads, const char *pk_name, int pk_type,
+	       int *current_row, char *err_msg)
+{
+/* inserting rows from shapefile; returns 0 on failure */
+    struct shp_load_row row;
+    gaiaDbfFieldPtr dbf_field;
+    int num_fields = 0;
+    int ret;
+#if !defined(_WIN32) && !defined(WIN32)
+    int num_threads = shp_load_threads (shp, decoder_threads);
+    if (num_threads > 0)
+      {
+	  ret =
+	      shp_load_pipelined (sqlite, stmt, shp, shp_path, charset,
+				  num_threads, srid, compressed, pk_name,
+				  pk_type, current_row, err_msg);
+	  if (ret >= 0)
+	      return ret;
+      }
+#else
+    shp_path = shp_path;	/* unused arg warning suppression */
+    charset = charset;		/* unused arg warning suppression */
+    decoder_threads = decoder_threads;	/* unused arg warning suppression */
+#endif
+    dbf_field = shp->Dbf->First;
+    while (dbf_field)
+      {
+	  num_fields++;
+	  dbf_field = dbf_field->Next;
+      }
+    row.Values = calloc (num_fields + 1, sizeof (gaiaValuePtr));
+    row.Blob = NULL;
+    row.BlobSize = 0;
+    while (1)
+      {
+	  /* reading, decoding and inserting one row at each time */
+	  if (!shp_load_decode (shp, *current_row, srid, compressed, &row))
+	    {
+		if (!(shp->LastError))	/* normal SHP EOF */
+		    break;
+		shp_load_error (sqlite, shp->LastError, err_msg);
+		free (row.Values);
+		return 0;
+	    }
+	  *current_row += 1;
+	  ret =
+	      shp_load_insert (stmt, shp->Dbf, pk_name, pk_type, *current_row,
+			       &row);
+	  shp_load_row_reset (&row, num_fields);
+	  if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	      ;
+	  else
+	    {
+		shp_load_error (sqlite, NULL, err_msg);
+		free (row.Values);
+		return 0;
+	    }
+      }
+    free (row.Values);
+    return 1;
+}
+
 SPATIALITE_DECLARE int
 load_shapefile (sqlite3 * sqlite, char *shp_path, char *table, char *charset,
 		int srid, char *column, int coerce2d, int compressed,
@@ -374,6 +911,19 @@ load_shapefile_ex (sqlite3 * sqlite, char *shp_path, char *table, char *charset,
 		   int srid, char *g_column, char *gtype, char *pk_column,
 		   int coerce2d, int compressed, int verbose, int spatial_index,
 		   int *rows, char *err_msg)
+{
+    return load_shapefile_ex2 (sqlite, shp_path, table, charset, srid,
+			       g_column, gtype, pk_column, coerce2d,
+			       compressed, verbose, spatial_index, -1, rows,
+			       err_msg);
+}
+
+SPATIALITE_DECLARE int
+load_shapefile_ex2 (sqlite3 * sqlite, char *shp_path, char *table,
+		    char *charset, int srid, char *g_column, char *gtype,
+		    char *pk_column, int coerce2d, int compressed, int verbose,
+		    int spatial_index, int decoder_threads, int *rows,
+		    char *err_msg)
 {
     sqlite3_stmt *stmt = NULL;
     int ret;
@@ -393,8 +943,6 @@ load_shapefile_ex (sqlite3 * sqlite, char *shp_path, char *table, char *charset,
     int idup;
     int current_row;
     char **col_name = NULL;
-    unsigned char *blob;
-    int blob_size;
     char *geom_type;
     char *txt_dims;
     char *geo_column = g_column;
@@ -405,7 +953,6 @@ load_shapefile_ex (sqlite3 * sqlite, char *shp_path, char *table, char *charset,
     int pk_autoincr = 1;
     char *xname;
     int pk_type = SQLITE_INTEGER;
-    int pk_set;
     gaiaOutBuffer sql_statement;
     if (!geo_column)
 	geo_column = "Geometry";
@@ -1061,121 +1608,13 @@ load_shapefile_ex (sqlite3 * sqlite, char *shp_path, char *table, char *charset,
 	  goto clean_up;
       }
     current_row = 0;
-    while (1)
+    if (!shp_load_rows
+	(sqlite, stmt, shp, shp_path, charset, srid, compressed,
+	 decoder_threads, pk_name, pk_type, &current_row, err_msg))
       {
-	  /* inserting rows from shapefile */
-	  ret = gaiaReadShpEntity (shp, current_row, srid);
-	  if (!ret)
-	    {
-		if (!(shp->LastError))	/* normal SHP EOF */
-		    break;
-		if (!err_msg)
-		    spatialite_e ("%s\n", shp->LastError);
-		else
-		    sprintf (err_msg, "%s\n", shp->LastError);
-		sqlError = 1;
-		sqlite3_finalize (stmt);
-		goto clean_up;
-	    }
-	  current_row++;
-	  /* binding query params */
-	  sqlite3_reset (stmt);
-	  sqlite3_clear_bindings (stmt);
-	  pk_set = 0;
-	  cnt = 0;
-	  dbf_field = shp->Dbf->First;
-	  while (dbf_field)
-	    {
-		/* Primary Key value */
-		if (strcasecmp (pk_name, dbf_field->Name) == 0)
-		  {
-		      if (pk_type == SQLITE_TEXT)
-			  sqlite3_bind_text (stmt, 1,
-					     dbf_field->Value->TxtValue,
-					     strlen (dbf_field->Value->
-						     TxtValue), SQLITE_STATIC);
-		      else if (pk_type == SQLITE_FLOAT)
-			  sqlite3_bind_double (stmt, 1,
-					       dbf_field->Value->DblValue);
-		      else
-			  sqlite3_bind_int64 (stmt, 1,
-					      dbf_field->Value->IntValue);
-		      pk_set = 1;
-		  }
-		dbf_field = dbf_field->Next;
-	    }
-	  if (!pk_set)
-	      sqlite3_bind_int (stmt, 1, current_row);
-	  cnt = 0;
-	  dbf_field = shp->Dbf->First;
-	  while (dbf_field)
-	    {
-		/* column values */
-		if (strcasecmp (pk_name, dbf_field->Name) == 0)
-		  {
-		      /* skipping the Primary Key field */
-		      dbf_field = dbf_field->Next;
-		      continue;
-		  }
-		if (!(dbf_field->Value))
-		    sqlite3_bind_null (stmt, cnt + 2);
-		else
-		  {
-		      switch (dbf_field->Value->Type)
-			{
-			case GAIA_INT_VALUE:
-			    sqlite3_bind_int64 (stmt, cnt + 2,
-						dbf_field->Value->IntValue);
-			    break;
-			case GAIA_DOUBLE_VALUE:
-			    sqlite3_bind_double (stmt, cnt + 2,
-						 dbf_field->Value->DblValue);
-			    break;
-			case GAIA_TEXT_VALUE:
-			    sqlite3_bind_text (stmt, cnt + 2,
-					       dbf_field->Value->TxtValue,
-					       strlen (dbf_field->
-						       Value->TxtValue),
-					       SQLITE_STATIC);
-			    break;
-			default:
-			    sqlite3_bind_null (stmt, cnt + 2);
-			    break;
-			}
-		  }
-		cnt++;
-		dbf_field = dbf_field->Next;
-	    }
-	  if (shp->Dbf->Geometry)
-	    {
-		if (compressed)
-		    gaiaToCompressedBlobWkb (shp->Dbf->Geometry, &blob,
-					     &blob_size);
-		else
-		    gaiaToSpatiaLiteBlobWkb (shp->Dbf->Geometry, &blob,
-					     &blob_size);
-		sqlite3_bind_blob (stmt, cnt + 2, blob, blob_size, free);
-	    }
-	  else
-	    {
-		/* handling a NULL-Geometry */
-		sqlite3_bind_null (stmt, cnt + 2);
-	    }
-	  ret = sqlite3_step (stmt);
-	  if (ret == SQLITE_DONE || ret == SQLITE_ROW)
-	      ;
-	  else
-	    {
-		if (!err_msg)
-		    spatialite_e ("load shapefile error: <%s>\n",
-				  sqlite3_errmsg (sqlite));
-		else
-		    sprintf (err_msg, "load shapefile error: <%s>\n",
-			     sqlite3_errmsg (sqlite));
-		sqlite3_finalize (stmt);
-		sqlError = 1;
-		goto clean_up;
-	    }
+	  sqlError = 1;
+	  sqlite3_finalize (stmt);
+	  goto clean_up;
       }
     sqlite3_finalize (stmt);
   clean_up:
@@ -2577,6 +3016,16 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
 		char *charset, char *geom_type, int verbose, int *xrows,
 		char *err_msg)
 {
+/* SHAPEFILE dump - always rescanning the table */
+    return dump_shapefile_ex (sqlite, table, column, shp_path, charset,
+			      geom_type, 0, verbose, xrows, err_msg);
+}
+
+SPATIALITE_DECLARE int
+dump_shapefile_ex (sqlite3 * sqlite, char *table, char *column,
+		   char *shp_path, char *charset, char *geom_type,
+		   int use_stats, int verbose, int *xrows, char *err_msg)
+{
 /* SHAPEFILE dump */
     char *sql;
     char *dummy;
@@ -2594,7 +3043,6 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
     const void *blob_value;
     gaiaShapefilePtr shp = NULL;
     gaiaDbfListPtr dbf_list;
-    gaiaDbfListPtr dbf_write;
     gaiaDbfFieldPtr dbf_field;
     gaiaVectorLayerPtr lyr = NULL;
     gaiaLayerAttributeFieldPtr fld;
@@ -2604,6 +3052,9 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
     char *xprefix;
     char *xxtable;
     struct auxdbf_list *auxdbf = NULL;
+    gaiaDbfListPtr dbf_write = NULL;
+    gaiaDbfFieldPtr *dbf_fields = NULL;
+    int geom_col = -1;
 
     if (geom_type)
       {
@@ -2619,7 +3070,16 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
       }
 /* is the datasource a genuine registered Geometry ?? */
     list = gaiaGetVectorLayersList (sqlite, table, column,
+				    use_stats ? GAIA_VECTORS_LIST_OPTIMISTIC :
 				    GAIA_VECTORS_LIST_PESSIMISTIC);
+    if (list != NULL && use_stats && list->First != NULL
+	&& list->First->First == NULL)
+      {
+	  /* no field statistics are available: rescanning the table */
+	  gaiaFreeVectorLayersList (list);
+	  list = gaiaGetVectorLayersList (sqlite, table, column,
+					  GAIA_VECTORS_LIST_PESSIMISTIC);
+      }
     if (list == NULL)
       {
 	  /* attempting to recover an unregistered Geometry */
@@ -2979,15 +3439,27 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
 	  if (ret == SQLITE_ROW)
 	    {
 		if (n_cols == 0)
-		    n_cols = sqlite3_column_count (stmt);
+		  {
+		      /* matching once for all columns and DBF fields */
+		      n_cols = sqlite3_column_count (stmt);
+		      dbf_write = gaiaCloneDbfEntity (dbf_list);
+		      dbf_fields = malloc (sizeof (gaiaDbfFieldPtr) * n_cols);
+		      auxdbf = alloc_auxdbf (dbf_write);
+		      for (i = 0; i < n_cols; i++)
+			{
+			    dummy = (char *) sqlite3_column_name (stmt, i);
+			    if (strcasecmp ((char *) column, dummy) == 0)
+				geom_col = i;
+			    dbf_fields[i] = getDbfField (auxdbf, dummy);
+			}
+		      free_auxdbf (auxdbf);
+		      auxdbf = NULL;
+		  }
 		rows++;
-		dbf_write = gaiaCloneDbfEntity (dbf_list);
-		auxdbf = alloc_auxdbf (dbf_write);
+		gaiaResetDbfEntity (dbf_write);
 		for (i = 0; i < n_cols; i++)
 		  {
-		      if (strcasecmp
-			  ((char *) column,
-			   (char *) sqlite3_column_name (stmt, i)) == 0)
+		      if (i == geom_col)
 			{
 			    /* this one is the internal BLOB encoded GEOMETRY to be exported */
 			    if (sqlite3_column_type (stmt, i) != SQLITE_BLOB)
@@ -3004,8 +3476,7 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
 								 len);
 			      }
 			}
-		      dummy = (char *) sqlite3_column_name (stmt, i);
-		      dbf_field = getDbfField (auxdbf, dummy);
+		      dbf_field = dbf_fields[i];
 		      if (!dbf_field)
 			  continue;
 		      if (sqlite3_column_type (stmt, i) == SQLITE_NULL)
@@ -3063,17 +3534,16 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
 			      };
 			}
 		  }
-		free_auxdbf (auxdbf);
-		auxdbf = NULL;
 		if (!gaiaWriteShpEntity (shp, dbf_write))
 		    spatialite_e ("shapefile write error\n");
-		gaiaFreeDbfList (dbf_write);
 	    }
 	  else
 	      goto sql_error;
       }
-    if (auxdbf != NULL)
-	free_auxdbf (auxdbf);
+    if (dbf_write != NULL)
+	gaiaFreeDbfList (dbf_write);
+    if (dbf_fields != NULL)
+	free (dbf_fields);
     sqlite3_finalize (stmt);
     gaiaFlushShpHeaders (shp);
     gaiaFreeShapefile (shp);
@@ -3095,6 +3565,10 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
 /* some SQL error occurred */
     if (auxdbf != NULL)
 	free_auxdbf (auxdbf);
+    if (dbf_write != NULL)
+	gaiaFreeDbfList (dbf_write);
+    if (dbf_fields != NULL)
+	free (dbf_fields);
     sqlite3_finalize (stmt);
     free (xtable);
     free (xcolumn);
@@ -3116,6 +3590,7 @@ dump_shapefile (sqlite3 * sqlite, char *table, char *column, char *shp_path,
 /* shapefile can't be created/opened */
     if (auxdbf != NULL)
 	free_auxdbf (auxdbf);
+    sqlite3_finalize (stmt);
     free (xtable);
     free (xcolumn);
     gaiaFreeVectorLayersList (list);
@@ -49,6 +49,12 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <string.h>
 #include <float.h>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include "config-msvc.h"
 #else
@@ -61,6 +67,7 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <spatialite/spatialite.h>
 #include <spatialite/gaiageo.h>
 #include <spatialite/gaiaaux.h>
+#include <spatialite_private.h>
 
 #ifdef _WIN32
 #define strcasecmp	_stricmp
@@ -85,26 +92,14 @@ excessive memory fragmentation and achieve better performance
 
 - the cache is a linked-list of cache page elements
   - each cache page contains an array of 32 cache blocks
-    - each cache block contains an array of 32 cache cells
+    - each cache block contains 32 cache cells
 so a single cache page con store up to 1024 cache cells
 
-*/
+cells are stored by columns (structure-of-arrays) inside each
+block, so that the spatial filter can test several cells at once
 
-struct mbr_cache_cell
-{
-/* 
-a  cached entity 
 */
 
-/* the entity's ROWID */
-    sqlite3_int64 rowid;
-/* the MBR */
-    double minx;
-    double miny;
-    double maxx;
-    double maxy;
-};
-
 struct mbr_cache_block
 {
 /*
@@ -125,8 +120,12 @@ i.e. the combined MBR for any contained cell
     double miny;
     double maxx;
     double maxy;
-/* the cache cells array */
-    struct mbr_cache_cell cells[32];
+/* the cache cells: one array for each attribute */
+    double cell_minx[32];
+    double cell_miny[32];
+    double cell_maxx[32];
+    double cell_maxy[32];
+    sqlite3_int64 cell_rowid[32];
 };
 
 struct mbr_cache_page
@@ -172,8 +171,56 @@ implemented as a cache pages linked list
  pointer used to identify the current cache page when inserting a new cache cell
  */
     struct mbr_cache_page *current;
+/*
+ mutex protecting a cache shared by many connections 
+ (NULL for a private cache: sqlite3_mutex_enter(NULL) is a no-op)
+ */
+    sqlite3_mutex *mutex;
+/* 
+ pointer used to chain the private snapshots of a shared cache still
+ referenced by some cursor after the end of the transaction
+ */
+    struct mbr_cache *next;
+/* bumped whenever some changes are published into a shared cache */
+    sqlite3_int64 generation;
 };
 
+struct mbr_pending_change
+{
+/*
+a change to a shared cache made by an uncommitted transaction:
+it will be applied to the shared cache only on COMMIT
+*/
+    int op;
+    sqlite3_int64 rowid;
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+    struct mbr_pending_change *next;
+};
+
+#define MBRC_INSERT	1
+#define MBRC_UPDATE	2
+#define MBRC_DELETE	3
+
+struct mbr_shared_cache
+{
+/*
+a cache shared by all the connections of this process
+attached to the same DB-file, table and column
+*/
+    char *db_path;
+    char *table_name;
+    char *column_name;
+    struct mbr_cache *cache;
+    int ref_count;
+    struct mbr_shared_cache *next;
+};
+
+/* the process-wide list of shared caches */
+static struct mbr_shared_cache *shared_caches = NULL;
+
 typedef struct MbrCacheStruct
 {
 /* extends the sqlite3_vtab struct */
@@ -184,7 +231,29 @@ typedef struct MbrCacheStruct
     struct mbr_cache *cache;	/* the  MBR's cache */
     char *table_name;		/* the main table to be cached */
     char *column_name;		/* the column to be cached */
+    int shared;			/* the cache is shared by all connections */
     int error;			/* some previous error disables any operation */
+/*
+ a shared cache is never changed by an uncommitted transaction: changes
+ are kept pending until COMMIT, and this connection reads a private
+ snapshot [the shared cache plus the pending changes] meanwhile
+ */
+    struct mbr_pending_change *first_pending;
+    struct mbr_pending_change *last_pending;
+    struct mbr_cache *snapshot;
+    struct mbr_cache *retired;	/* ended snapshots still used by cursors */
+    int cursors;		/* the currently open cursors */
+    int num_pending;		/* the number of pending changes */
+/* the number of pending changes at each open SAVEPOINT */
+    int *savepoints;
+    int num_savepoints;
+    int max_savepoints;
+/*
+ changes committed by other processes are detected by checking 
+ PRAGMA data_version, then reloading the shared cache
+ */
+    sqlite3_stmt *stmt_data_version;
+    sqlite3_int64 data_version;
 } MbrCache;
 typedef MbrCache *MbrCachePtr;
 
@@ -192,6 +261,7 @@ typedef struct MbrCacheCursortStruct
 {
 /* extends the sqlite3_vtab_cursor struct */
     MbrCachePtr pVtab;		/* Virtual table of this cursor */
+    struct mbr_cache *cache;	/* the cache read by this cursor */
     int eof;			/* the EOF marker */
 /* 
 positioning parameters while performing a cache search 
@@ -199,7 +269,7 @@ positioning parameters while performing a cache search
     struct mbr_cache_page *current_page;
     int current_block_index;
     int current_cell_index;
-    struct mbr_cache_cell *current_cell;
+    struct mbr_cache_block *current_block;	/* NULL if no current cell */
 /* 
 the strategy to use:
     0 = sequential scan
@@ -303,6 +373,9 @@ cache_alloc (void)
     p->first = NULL;
     p->last = NULL;
     p->current = NULL;
+    p->mutex = NULL;
+    p->next = NULL;
+    p->generation = 0;
     return p;
 }
 
@@ -348,6 +421,8 @@ cache_destroy (struct mbr_cache *p)
 	  free (pp);
 	  pp = ppn;
       }
+    if (p->mutex)
+	sqlite3_mutex_free (p->mutex);
     free (p);
 }
 
@@ -440,12 +515,11 @@ cache_insert_cell (struct mbr_cache *p, sqlite3_int64 rowid, double minx,
     int ib = cache_get_free_block (pp);
     struct mbr_cache_block *pb = pp->blocks + ib;
     int ic = cache_get_free_cell (pb);
-    struct mbr_cache_cell *pc = pb->cells + ic;
-    pc->rowid = rowid;
-    pc->minx = minx;
-    pc->miny = miny;
-    pc->maxx = maxx;
-    pc->maxy = maxy;
+    pb->cell_rowid[ic] = rowid;
+    pb->cell_minx[ic] = minx;
+    pb->cell_miny[ic] = miny;
+    pb->cell_maxx[ic] = maxx;
+    pb->cell_maxy[ic] = maxy;
 /* marking the cache cell as used into the block bitmap */
     pb->bitmap |= cache_bitmask (ic);
 /* updating the cache block MBR */
@@ -566,14 +640,136 @@ retrieving any existing entity from the main table
     return p_cache;
 }
 
+static sqlite3_mutex *
+shared_caches_mutex (void)
+{
+/* the mutex protecting the shared caches list */
+    return (sqlite3_mutex *) splite_library_mutex (SPLITE_MUTEX_MBR_CACHE);
+}
+
+static char *
+shared_cache_strdup (const char *str)
+{
+/* duplicating a string */
+    int len = strlen (str);
+    char *p = malloc (len + 1);
+    strcpy (p, str);
+    return p;
+}
+
+static struct mbr_shared_cache *
+shared_cache_find (const char *db_path, const char *table, const char *column)
+{
+/* searching a shared cache - the caller must hold the list mutex */
+    struct mbr_shared_cache *p = shared_caches;
+    while (p)
+      {
+	  if (strcmp (p->db_path, db_path) == 0
+	      && strcasecmp (p->table_name, table) == 0
+	      && strcasecmp (p->column_name, column) == 0)
+	      return p;
+	  p = p->next;
+      }
+    return NULL;
+}
+
+static struct mbr_cache *
+cache_attach_shared (sqlite3 * handle, const char *table, const char *column)
+{
+/* 
+attaching a cache shared by all the connections of this process
+the cache is loaded only once, by the first connection requiring it
+*/
+    sqlite3_mutex *list_mutex = shared_caches_mutex ();
+    struct mbr_shared_cache *p;
+    struct mbr_cache *cache;
+    const char *db_path = sqlite3_db_filename (handle, "main");
+    if (db_path == NULL || *db_path == '\0')
+      {
+	  /* MEMORY or TEMPORARY db: there is nothing to be shared */
+	  return cache_load (handle, table, column);
+      }
+    sqlite3_mutex_enter (list_mutex);
+    p = shared_cache_find (db_path, table, column);
+    if (p)
+      {
+	  p->ref_count += 1;
+	  sqlite3_mutex_leave (list_mutex);
+	  return p->cache;
+      }
+    sqlite3_mutex_leave (list_mutex);
+
+/* loading the cache; the list isn't locked meanwhile */
+    cache = cache_load (handle, table, column);
+    if (cache == NULL)
+	return NULL;
+
+    sqlite3_mutex_enter (list_mutex);
+    p = shared_cache_find (db_path, table, column);
+    if (p)
+      {
+	  /* some other connection was faster: using its own cache */
+	  p->ref_count += 1;
+	  sqlite3_mutex_leave (list_mutex);
+	  cache_destroy (cache);
+	  return p->cache;
+      }
+    cache->mutex = sqlite3_mutex_alloc (SQLITE_MUTEX_FAST);
+    p = malloc (sizeof (struct mbr_shared_cache));
+    p->db_path = shared_cache_strdup (db_path);
+    p->table_name = shared_cache_strdup (table);
+    p->column_name = shared_cache_strdup (column);
+    p->cache = cache;
+    p->ref_count = 1;
+    p->next = shared_caches;
+    shared_caches = p;
+    sqlite3_mutex_leave (list_mutex);
+    return cache;
+}
+
+static void
+cache_detach_shared (struct mbr_cache *cache)
+{
+/* detaching a shared cache; the last connection destroys it */
+    sqlite3_mutex *list_mutex = shared_caches_mutex ();
+    struct mbr_shared_cache *p;
+    struct mbr_shared_cache *prev = NULL;
+    sqlite3_mutex_enter (list_mutex);
+    p = shared_caches;
+    while (p)
+      {
+	  if (p->cache == cache)
+	    {
+		p->ref_count -= 1;
+		if (p->ref_count > 0)
+		  {
+		      sqlite3_mutex_leave (list_mutex);
+		      return;
+		  }
+		if (prev)
+		    prev->next = p->next;
+		else
+		    shared_caches = p->next;
+		free (p->db_path);
+		free (p->table_name);
+		free (p->column_name);
+		free (p);
+		break;
+	    }
+	  prev = p;
+	  p = p->next;
+      }
+    sqlite3_mutex_leave (list_mutex);
+/* not found into the list: this one is a private MEMORY db cache */
+    cache_destroy (cache);
+}
+
 static int
-cache_find_next_cell (struct mbr_cache_page **page, int *i_block, int *i_cell,
-		      struct mbr_cache_cell **cell)
+cache_find_next_cell (struct mbr_cache_page **page, int *i_block, int *i_cell)
 {
-/* finding next cached cell */
+/* finding next cached cell, starting from the given position */
     struct mbr_cache_page *pp = *page;
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
     int sib = *i_block;
@@ -587,17 +783,10 @@ cache_find_next_cell (struct mbr_cache_page **page, int *i_block, int *i_cell,
 		  {
 		      if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
 			  continue;
-		      pc = pb->cells + ic;
-		      if (pc == *cell)
-			{
-			    /* this one is the current cell */
-			    continue;
-			}
 		      /* next cell found */
 		      *page = pp;
 		      *i_block = ib;
 		      *i_cell = ic;
-		      *cell = pc;
 		      return 1;
 		  }
 		sic = 0;
@@ -608,99 +797,205 @@ cache_find_next_cell (struct mbr_cache_page **page, int *i_block, int *i_cell,
     return 0;
 }
 
+static unsigned int
+cache_reverse_bits (unsigned int x)
+{
+/* reverses a 32 bit word: bit #0 becomes bit #31 and so on */
+    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+    x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+static unsigned int
+cache_block_match (struct mbr_cache_block *pb, double minx, double miny,
+		   double maxx, double maxy, int mode)
+{
+/* 
+testing all the cells of a block against the search frame
+
+returns a bitmap using the same layout as the allocation bitmap:
+1 - corresponding cache cell satisfies the MBR relation
+0 - corresponding cache cell doesn't satisfy the MBR relation
+(free cells are not masked out: the caller has to do this)
+
+the WITHIN relation requires:
+    cell_minx >= minx && cell_maxx <= maxx && 
+    cell_miny >= miny && cell_maxy <= maxy
+both INTERSECTS and CONTAINS share the opposite pattern:
+    cell_minx <= v1 && cell_maxx >= v2 &&
+    cell_miny <= v3 && cell_maxy >= v4
+*/
+    unsigned int hits = 0;
+    int within = 0;
+    double v1;
+    double v2;
+    double v3;
+    double v4;
+    int ic = 0;
+    if (mode == GAIA_FILTER_MBR_INTERSECTS)
+      {
+	  v1 = maxx;
+	  v2 = minx;
+	  v3 = maxy;
+	  v4 = miny;
+      }
+    else if (mode == GAIA_FILTER_MBR_CONTAINS)
+      {
+	  v1 = minx;
+	  v2 = maxx;
+	  v3 = miny;
+	  v4 = maxy;
+      }
+    else
+      {
+	  within = 1;
+	  v1 = minx;
+	  v2 = maxx;
+	  v3 = miny;
+	  v4 = maxy;
+      }
+#if defined(__AVX__)
+    {
+	/* AVX: testing 4 cells at each time */
+	__m256d q1 = _mm256_set1_pd (v1);
+	__m256d q2 = _mm256_set1_pd (v2);
+	__m256d q3 = _mm256_set1_pd (v3);
+	__m256d q4 = _mm256_set1_pd (v4);
+	__m256d t;
+	for (; ic < 32; ic += 4)
+	  {
+	      __m256d c1 = _mm256_loadu_pd (pb->cell_minx + ic);
+	      __m256d c2 = _mm256_loadu_pd (pb->cell_maxx + ic);
+	      __m256d c3 = _mm256_loadu_pd (pb->cell_miny + ic);
+	      __m256d c4 = _mm256_loadu_pd (pb->cell_maxy + ic);
+	      if (within)
+		{
+		    t = _mm256_and_pd (_mm256_cmp_pd (c1, q1, _CMP_GE_OQ),
+				       _mm256_cmp_pd (c2, q2, _CMP_LE_OQ));
+		    t = _mm256_and_pd (t, _mm256_cmp_pd (c3, q3, _CMP_GE_OQ));
+		    t = _mm256_and_pd (t, _mm256_cmp_pd (c4, q4, _CMP_LE_OQ));
+		}
+	      else
+		{
+		    t = _mm256_and_pd (_mm256_cmp_pd (c1, q1, _CMP_LE_OQ),
+				       _mm256_cmp_pd (c2, q2, _CMP_GE_OQ));
+		    t = _mm256_and_pd (t, _mm256_cmp_pd (c3, q3, _CMP_LE_OQ));
+		    t = _mm256_and_pd (t, _mm256_cmp_pd (c4, q4, _CMP_GE_OQ));
+		}
+	      hits |= (unsigned int) _mm256_movemask_pd (t) << ic;
+	  }
+    }
+#elif defined(__SSE2__)
+    {
+	/* SSE2: testing 2 cells at each time */
+	__m128d q1 = _mm_set1_pd (v1);
+	__m128d q2 = _mm_set1_pd (v2);
+	__m128d q3 = _mm_set1_pd (v3);
+	__m128d q4 = _mm_set1_pd (v4);
+	__m128d t;
+	for (; ic < 32; ic += 2)
+	  {
+	      __m128d c1 = _mm_loadu_pd (pb->cell_minx + ic);
+	      __m128d c2 = _mm_loadu_pd (pb->cell_maxx + ic);
+	      __m128d c3 = _mm_loadu_pd (pb->cell_miny + ic);
+	      __m128d c4 = _mm_loadu_pd (pb->cell_maxy + ic);
+	      if (within)
+		{
+		    t = _mm_and_pd (_mm_cmpge_pd (c1, q1),
+				    _mm_cmple_pd (c2, q2));
+		    t = _mm_and_pd (t, _mm_cmpge_pd (c3, q3));
+		    t = _mm_and_pd (t, _mm_cmple_pd (c4, q4));
+		}
+	      else
+		{
+		    t = _mm_and_pd (_mm_cmple_pd (c1, q1),
+				    _mm_cmpge_pd (c2, q2));
+		    t = _mm_and_pd (t, _mm_cmple_pd (c3, q3));
+		    t = _mm_and_pd (t, _mm_cmpge_pd (c4, q4));
+		}
+	      hits |= (unsigned int) _mm_movemask_pd (t) << ic;
+	  }
+    }
+#endif
+    for (; ic < 32; ic++)
+      {
+	  /* plain scalar code: no SIMD support */
+	  int ok;
+	  if (within)
+	      ok = pb->cell_minx[ic] >= v1 && pb->cell_maxx[ic] <= v2
+		  && pb->cell_miny[ic] >= v3 && pb->cell_maxy[ic] <= v4;
+	  else
+	      ok = pb->cell_minx[ic] <= v1 && pb->cell_maxx[ic] >= v2
+		  && pb->cell_miny[ic] <= v3 && pb->cell_maxy[ic] >= v4;
+	  if (ok)
+	      hits |= 1U << ic;
+      }
+    return cache_reverse_bits (hits);
+}
+
 static int
 cache_find_next_mbr (struct mbr_cache_page **page, int *i_block, int *i_cell,
-		     struct mbr_cache_cell **cell, double minx, double miny,
-		     double maxx, double maxy, int mode)
+		     double minx, double miny, double maxx, double maxy,
+		     int mode)
 {
-/* finding next cached cell */
+/* finding next cached cell satisfying the MBR relation, starting from the given position */
     struct mbr_cache_page *pp = *page;
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
+    unsigned int hits;
     int ib;
     int ic;
     int sib = *i_block;
     int sic = *i_cell;
-    int ok_mbr;
     while (pp)
       {
-	  ok_mbr = 0;
 	  if (pp->maxx >= minx && pp->minx <= maxx && pp->maxy >= miny
 	      && pp->miny <= maxy)
-	      ok_mbr = 1;
-	  if (ok_mbr)
 	    {
 		for (ib = sib; ib < 32; ib++)
 		  {
 		      pb = pp->blocks + ib;
-		      ok_mbr = 0;
-		      if (pb->maxx >= minx && pb->minx <= maxx
+		      if (sic < 32 && pb->bitmap != 0x00000000
+			  && pb->maxx >= minx && pb->minx <= maxx
 			  && pb->maxy >= miny && pb->miny <= maxy)
-			  ok_mbr = 1;
-		      if (ok_mbr)
 			{
-			    for (ic = sic; ic < 32; ic++)
+			    /* testing the whole block at once */
+			    hits =
+				cache_block_match (pb, minx, miny, maxx, maxy,
+						   mode) & pb->bitmap;
+			    if (sic > 0)
+				hits &= 0xffffffff >> sic;
+			    if (hits)
 			      {
-				  if ((pb->bitmap & cache_bitmask (ic)) ==
-				      0x00000000)
-				      continue;
-				  pc = pb->cells + ic;
-				  ok_mbr = 0;
-				  if (mode == GAIA_FILTER_MBR_INTERSECTS)
-				    {
-					/* MBR INTERSECTS */
-					if (pc->maxx >= minx && pc->minx <= maxx
-					    && pc->maxy >= miny
-					    && pc->miny <= maxy)
-					    ok_mbr = 1;
-				    }
-				  else if (mode == GAIA_FILTER_MBR_CONTAINS)
+				  /* next cell found */
+				  for (ic = sic; ic < 32; ic++)
 				    {
-					/* MBR CONTAINS */
-					if (minx >= pc->minx && maxx <= pc->maxx
-					    && miny >= pc->miny
-					    && maxy <= pc->maxy)
-					    ok_mbr = 1;
-				    }
-				  else
-				    {
-					/* MBR WITHIN */
-					if (pc->minx >= minx && pc->maxx <= maxx
-					    && pc->miny >= miny
-					    && pc->maxy <= maxy)
-					    ok_mbr = 1;
-				    }
-				  if (ok_mbr)
-				    {
-					if (pc == *cell)
-					  {
-					      /* this one is the current cell */
-					      continue;
-					  }
-					/* next cell found */
-					*page = pp;
-					*i_block = ib;
-					*i_cell = ic;
-					*cell = pc;
-					return 1;
+					if (hits & cache_bitmask (ic))
+					    break;
 				    }
+				  *page = pp;
+				  *i_block = ib;
+				  *i_cell = ic;
+				  return 1;
 			      }
 			}
 		      sic = 0;
 		  }
 	    }
 	  sib = 0;
+	  sic = 0;
 	  pp = pp->next;
       }
     return 0;
 }
 
-static struct mbr_cache_cell *
-cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid)
+static struct mbr_cache_block *
+cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid,
+		     int *i_cell)
 {
 /* trying to find a row by rowid from the Mbr cache */
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
     while (pp)
@@ -714,15 +1009,18 @@ cache_find_by_rowid (struct mbr_cache_page *pp, sqlite3_int64 rowid)
 			{
 			    if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
 				continue;
-			    pc = pb->cells + ic;
-			    if (pc->rowid == rowid)
-				return pc;
+			    if (pb->cell_rowid[ic] == rowid)
+			      {
+				  if (i_cell)
+				      *i_cell = ic;
+				  return pb;
+			      }
 			}
 		  }
 	    }
 	  pp = pp->next;
       }
-    return 0;
+    return NULL;
 }
 
 static void
@@ -730,7 +1028,6 @@ cache_update_page (struct mbr_cache_page *pp, int i_block)
 {
 /* updating the cache block and cache page MBR after a DELETE or UPDATE occurred */
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
 /* updating the cache block MBR */
@@ -743,15 +1040,14 @@ cache_update_page (struct mbr_cache_page *pp, int i_block)
       {
 	  if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
 	      continue;
-	  pc = pb->cells + ic;
-	  if (pb->minx > pc->minx)
-	      pb->minx = pc->minx;
-	  if (pb->miny > pc->miny)
-	      pb->miny = pc->miny;
-	  if (pb->maxx < pc->maxx)
-	      pb->maxx = pc->maxx;
-	  if (pb->maxy < pc->maxy)
-	      pb->maxy = pc->maxy;
+	  if (pb->minx > pb->cell_minx[ic])
+	      pb->minx = pb->cell_minx[ic];
+	  if (pb->miny > pb->cell_miny[ic])
+	      pb->miny = pb->cell_miny[ic];
+	  if (pb->maxx < pb->cell_maxx[ic])
+	      pb->maxx = pb->cell_maxx[ic];
+	  if (pb->maxy < pb->cell_maxy[ic])
+	      pb->maxy = pb->cell_maxy[ic];
       }
 /* updating the cache page MBR */
     pp->minx = DBL_MAX;
@@ -767,19 +1063,18 @@ cache_update_page (struct mbr_cache_page *pp, int i_block)
 	    {
 		if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
 		    continue;
-		pc = pb->cells + ic;
-		if (pp->minx > pc->minx)
-		    pp->minx = pc->minx;
-		if (pp->miny > pc->miny)
-		    pp->miny = pc->miny;
-		if (pp->maxx < pc->maxx)
-		    pp->maxx = pc->maxx;
-		if (pp->maxy < pc->maxy)
-		    pp->maxy = pc->maxy;
-		if (pp->min_rowid > pc->rowid)
-		    pp->min_rowid = pc->rowid;
-		if (pp->max_rowid < pc->rowid)
-		    pp->max_rowid = pc->rowid;
+		if (pp->minx > pb->cell_minx[ic])
+		    pp->minx = pb->cell_minx[ic];
+		if (pp->miny > pb->cell_miny[ic])
+		    pp->miny = pb->cell_miny[ic];
+		if (pp->maxx < pb->cell_maxx[ic])
+		    pp->maxx = pb->cell_maxx[ic];
+		if (pp->maxy < pb->cell_maxy[ic])
+		    pp->maxy = pb->cell_maxy[ic];
+		if (pp->min_rowid > pb->cell_rowid[ic])
+		    pp->min_rowid = pb->cell_rowid[ic];
+		if (pp->max_rowid < pb->cell_rowid[ic])
+		    pp->max_rowid = pb->cell_rowid[ic];
 	    }
       }
 }
@@ -789,7 +1084,6 @@ cache_delete_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid)
 {
 /* trying to delete a row identified by rowid from the Mbr cache */
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
     while (pp)
@@ -803,8 +1097,7 @@ cache_delete_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid)
 			{
 			    if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
 				continue;
-			    pc = pb->cells + ic;
-			    if (pc->rowid == rowid)
+			    if (pb->cell_rowid[ic] == rowid)
 			      {
 				  /* marking the cell as free */
 				  pb->bitmap &= ~(cache_bitmask (ic));
@@ -828,7 +1121,6 @@ cache_update_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid, double minx,
 {
 /* trying to update a row identified by rowid from the Mbr cache */
     struct mbr_cache_block *pb;
-    struct mbr_cache_cell *pc;
     int ib;
     int ic;
     while (pp)
@@ -842,14 +1134,13 @@ cache_update_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid, double minx,
 			{
 			    if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
 				continue;
-			    pc = pb->cells + ic;
-			    if (pc->rowid == rowid)
+			    if (pb->cell_rowid[ic] == rowid)
 			      {
 				  /* updating the cell MBR */
-				  pc->minx = minx;
-				  pc->miny = miny;
-				  pc->maxx = maxx;
-				  pc->maxy = maxy;
+				  pb->cell_minx[ic] = minx;
+				  pb->cell_miny[ic] = miny;
+				  pb->cell_maxx[ic] = maxx;
+				  pb->cell_maxy[ic] = maxy;
 				  /* updating the cache block and cache page MBR */
 				  cache_update_page (pp, ib);
 				  return 1;
@@ -862,11 +1153,210 @@ cache_update_cell (struct mbr_cache_page *pp, sqlite3_int64 rowid, double minx,
     return 0;
 }
 
+static struct mbr_cache *
+cache_clone (struct mbr_cache *p)
+{
+/* creating a private copy of some cache */
+    struct mbr_cache_page *pp;
+    struct mbr_cache_page *clone;
+    struct mbr_cache *copy = cache_alloc ();
+    pp = p->first;
+    while (pp)
+      {
+	  clone = malloc (sizeof (struct mbr_cache_page));
+	  memcpy (clone, pp, sizeof (struct mbr_cache_page));
+	  clone->next = NULL;
+	  if (copy->first == NULL)
+	      copy->first = clone;
+	  if (copy->last != NULL)
+	      copy->last->next = clone;
+	  copy->last = clone;
+	  if (pp == p->current)
+	      copy->current = clone;
+	  pp = pp->next;
+      }
+    return copy;
+}
+
+static void
+cache_apply_change (struct mbr_cache *p, struct mbr_pending_change *chg)
+{
+/* applying an INSERT, UPDATE or DELETE to some cache */
+    switch (chg->op)
+      {
+      case MBRC_INSERT:
+	  if (!cache_find_by_rowid (p->first, chg->rowid, NULL))
+	      cache_insert_cell (p, chg->rowid, chg->minx, chg->miny,
+				 chg->maxx, chg->maxy);
+	  break;
+      case MBRC_UPDATE:
+	  cache_update_cell (p->first, chg->rowid, chg->minx, chg->miny,
+			     chg->maxx, chg->maxy);
+	  break;
+      case MBRC_DELETE:
+	  cache_delete_cell (p->first, chg->rowid);
+	  break;
+      };
+}
+
+static int
+cache_cmp_rowid (const void *p1, const void *p2)
+{
+/* compares two cells by rowid [qsort and bsearch] */
+    const struct mbr_pending_change *c1 =
+	(const struct mbr_pending_change *) p1;
+    const struct mbr_pending_change *c2 =
+	(const struct mbr_pending_change *) p2;
+    if (c1->rowid < c2->rowid)
+	return -1;
+    if (c1->rowid > c2->rowid)
+	return 1;
+    return 0;
+}
+
+static struct mbr_pending_change *
+cache_sorted_cells (struct mbr_cache *p, int *count)
+{
+/* returns an array containing all the cells of some cache, sorted by rowid */
+    struct mbr_pending_change *cells;
+    struct mbr_cache_page *pp;
+    struct mbr_cache_block *pb;
+    int ib;
+    int ic;
+    int n = 0;
+    int max = 1024;
+    cells = malloc (sizeof (struct mbr_pending_change) * max);
+    pp = p->first;
+    while (pp)
+      {
+	  for (ib = 0; ib < 32; ib++)
+	    {
+		pb = pp->blocks + ib;
+		for (ic = 0; ic < 32; ic++)
+		  {
+		      if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
+			  continue;
+		      if (n == max)
+			{
+			    max *= 2;
+			    cells =
+				realloc (cells,
+					 sizeof (struct mbr_pending_change) *
+					 max);
+			}
+		      cells[n].op = 0;	/* not yet found into the cache */
+		      cells[n].rowid = pb->cell_rowid[ic];
+		      cells[n].minx = pb->cell_minx[ic];
+		      cells[n].miny = pb->cell_miny[ic];
+		      cells[n].maxx = pb->cell_maxx[ic];
+		      cells[n].maxy = pb->cell_maxy[ic];
+		      cells[n].next = NULL;
+		      n++;
+		  }
+	    }
+	  pp = pp->next;
+      }
+    qsort (cells, n, sizeof (struct mbr_pending_change), cache_cmp_rowid);
+    *count = n;
+    return cells;
+}
+
+static int
+cache_refresh (struct mbr_cache *p, sqlite3 * handle, const char *table,
+	       const char *column)
+{
+/* 
+reloading a shared cache after some external change
+the differences are applied in place, exactly as a COMMIT would do, so
+that the cursors opened by other connections are never invalidated
+returns 0 if the cache was changed meanwhile [to be retried later]
+*/
+    struct mbr_cache *fresh;
+    struct mbr_pending_change *cells;
+    struct mbr_pending_change *found;
+    struct mbr_pending_change key;
+    struct mbr_cache_page *pp;
+    struct mbr_cache_block *pb;
+    sqlite3_int64 generation;
+    int count;
+    int ib;
+    int ic;
+    int i;
+    sqlite3_mutex_enter (p->mutex);
+    generation = p->generation;
+    sqlite3_mutex_leave (p->mutex);
+    fresh = cache_load (handle, table, column);
+    if (fresh == NULL)
+	return 0;
+    cells = cache_sorted_cells (fresh, &count);
+    cache_destroy (fresh);
+    sqlite3_mutex_enter (p->mutex);
+    if (p->generation != generation)
+      {
+	  /* some COMMIT was published meanwhile */
+	  sqlite3_mutex_leave (p->mutex);
+	  free (cells);
+	  return 0;
+      }
+/* updating or deleting the cached cells */
+    pp = p->first;
+    while (pp)
+      {
+	  for (ib = 0; ib < 32; ib++)
+	    {
+		pb = pp->blocks + ib;
+		for (ic = 0; ic < 32; ic++)
+		  {
+		      if ((pb->bitmap & cache_bitmask (ic)) == 0x00000000)
+			  continue;
+		      key.rowid = pb->cell_rowid[ic];
+		      found =
+			  bsearch (&key, cells, count,
+				   sizeof (struct mbr_pending_change),
+				   cache_cmp_rowid);
+		      if (found == NULL)
+			  cache_delete_cell (pp, key.rowid);
+		      else
+			{
+			    found->op = MBRC_UPDATE;
+			    if (found->minx != pb->cell_minx[ic]
+				|| found->miny != pb->cell_miny[ic]
+				|| found->maxx != pb->cell_maxx[ic]
+				|| found->maxy != pb->cell_maxy[ic])
+				cache_update_cell (pp, found->rowid,
+						   found->minx, found->miny,
+						   found->maxx, found->maxy);
+			}
+		  }
+	    }
+	  pp = pp->next;
+      }
+/* inserting the cells not yet cached */
+    for (i = 0; i < count; i++)
+      {
+	  if (cells[i].op == 0)
+	      cache_insert_cell (p, cells[i].rowid, cells[i].minx,
+				 cells[i].miny, cells[i].maxx, cells[i].maxy);
+      }
+    p->generation += 1;
+    sqlite3_mutex_leave (p->mutex);
+    free (cells);
+    return 1;
+}
+
 static int
 mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	     sqlite3_vtab ** ppVTab, char **pzErr)
 {
-/* creates the virtual table and caches related Geometry column */
+/* 
+creates the virtual table and caches related Geometry column
+
+    CREATE VIRTUAL TABLE cache USING MbrCache(table, column [, shared])
+
+when the optional "shared" flag is set all the connections of the 
+same process opening the same DB-file will share a single cache,
+thus loading it only once (MEMORY DBs always get a private cache)
+*/
     int err;
     int ret;
     int i;
@@ -899,8 +1389,34 @@ mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     p_vt->table_name = NULL;
     p_vt->column_name = NULL;
     p_vt->cache = NULL;
-/* checking for table_name and geo_column_name */
-    if (argc == 5)
+    p_vt->shared = 0;
+    p_vt->first_pending = NULL;
+    p_vt->last_pending = NULL;
+    p_vt->snapshot = NULL;
+    p_vt->retired = NULL;
+    p_vt->cursors = 0;
+    p_vt->num_pending = 0;
+    p_vt->savepoints = NULL;
+    p_vt->num_savepoints = 0;
+    p_vt->max_savepoints = 0;
+    p_vt->stmt_data_version = NULL;
+    p_vt->data_version = 0;
+/* checking for table_name and geo_column_name [and the optional "shared" flag] */
+    if (argc == 6)
+      {
+	  if (strcasecmp (argv[5], "shared") == 0
+	      || strcasecmp (argv[5], "'shared'") == 0
+	      || strcasecmp (argv[5], "\"shared\"") == 0)
+	      p_vt->shared = 1;
+	  else
+	    {
+		*pzErr =
+		    sqlite3_mprintf
+		    ("[MbrCache module] CREATE VIRTUAL: illegal arg list {table_name, geo_column_name [, shared]}");
+		return SQLITE_ERROR;
+	    }
+      }
+    if (argc == 5 || argc == 6)
       {
 	  vtable = argv[2];
 	  len = strlen (vtable);
@@ -944,7 +1460,7 @@ mbrc_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
       {
 	  *pzErr =
 	      sqlite3_mprintf
-	      ("[MbrCache module] CREATE VIRTUAL: illegal arg list {table_name, geo_column_name}");
+	      ("[MbrCache module] CREATE VIRTUAL: illegal arg list {table_name, geo_column_name [, shared]}");
 	  return SQLITE_ERROR;
       }
 /* retrieving the base table columns */
@@ -1092,13 +1608,216 @@ mbrc_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
     return SQLITE_OK;
 }
 
+static int
+mbrc_is_shared (MbrCachePtr p_vt)
+{
+/* checks if the cache is really shared [only a shared cache owns a mutex] */
+    return (p_vt->cache != NULL && p_vt->cache->mutex != NULL);
+}
+
+static void
+mbrc_change (MbrCachePtr p_vt, struct mbr_pending_change *chg)
+{
+/* applying a change; any change to a shared cache is kept pending */
+    struct mbr_pending_change *p;
+    if (!mbrc_is_shared (p_vt))
+      {
+	  cache_apply_change (p_vt->cache, chg);
+	  return;
+      }
+    p = malloc (sizeof (struct mbr_pending_change));
+    *p = *chg;
+    p->next = NULL;
+    if (p_vt->first_pending == NULL)
+	p_vt->first_pending = p;
+    if (p_vt->last_pending != NULL)
+	p_vt->last_pending->next = p;
+    p_vt->last_pending = p;
+    p_vt->num_pending += 1;
+    if (p_vt->snapshot)
+	cache_apply_change (p_vt->snapshot, p);
+}
+
+static struct mbr_cache *
+mbrc_read_cache (MbrCachePtr p_vt)
+{
+/* 
+returns the cache to be read by a cursor: if there are pending changes
+a private snapshot is built on demand, so that this connection can see
+its own uncommitted changes
+*/
+    struct mbr_pending_change *p;
+    if (p_vt->first_pending == NULL)
+	return p_vt->cache;
+    if (p_vt->snapshot == NULL)
+      {
+	  sqlite3_mutex_enter (p_vt->cache->mutex);
+	  p_vt->snapshot = cache_clone (p_vt->cache);
+	  sqlite3_mutex_leave (p_vt->cache->mutex);
+	  p = p_vt->first_pending;
+	  while (p)
+	    {
+		cache_apply_change (p_vt->snapshot, p);
+		p = p->next;
+	    }
+      }
+    return p_vt->snapshot;
+}
+
+static void
+mbrc_free_retired (MbrCachePtr p_vt)
+{
+/* memory cleanup; destroying the ended snapshots */
+    struct mbr_cache *p = p_vt->retired;
+    struct mbr_cache *pn;
+    while (p)
+      {
+	  pn = p->next;
+	  cache_destroy (p);
+	  p = pn;
+      }
+    p_vt->retired = NULL;
+}
+
+static void
+mbrc_retire_snapshot (MbrCachePtr p_vt)
+{
+/* ending the current snapshot [it could still be read by some open cursor] */
+    if (p_vt->snapshot)
+      {
+	  p_vt->snapshot->next = p_vt->retired;
+	  p_vt->retired = p_vt->snapshot;
+	  p_vt->snapshot = NULL;
+      }
+    if (p_vt->cursors == 0)
+	mbrc_free_retired (p_vt);
+}
+
+static void
+mbrc_end_transaction (MbrCachePtr p_vt, int commit)
+{
+/* COMMIT or ROLLBACK: publishing or discarding the pending changes */
+    struct mbr_pending_change *p;
+    struct mbr_pending_change *pn;
+    if (commit && p_vt->first_pending != NULL)
+      {
+	  sqlite3_mutex_enter (p_vt->cache->mutex);
+	  p = p_vt->first_pending;
+	  while (p)
+	    {
+		cache_apply_change (p_vt->cache, p);
+		p = p->next;
+	    }
+	  p_vt->cache->generation += 1;
+	  sqlite3_mutex_leave (p_vt->cache->mutex);
+      }
+    p = p_vt->first_pending;
+    while (p)
+      {
+	  pn = p->next;
+	  free (p);
+	  p = pn;
+      }
+    p_vt->first_pending = NULL;
+    p_vt->last_pending = NULL;
+    p_vt->num_pending = 0;
+    p_vt->num_savepoints = 0;
+    mbrc_retire_snapshot (p_vt);
+}
+
+static void
+mbrc_rollback_pending (MbrCachePtr p_vt, int count)
+{
+/* ROLLBACK TO: discarding any pending change after the first COUNT ones */
+    struct mbr_pending_change *p;
+    struct mbr_pending_change *pn;
+    struct mbr_pending_change *last = NULL;
+    int i;
+    if (count >= p_vt->num_pending)
+	return;
+    p = p_vt->first_pending;
+    for (i = 0; i < count; i++)
+      {
+	  last = p;
+	  p = p->next;
+      }
+    while (p)
+      {
+	  pn = p->next;
+	  free (p);
+	  p = pn;
+      }
+    if (last)
+	last->next = NULL;
+    else
+	p_vt->first_pending = NULL;
+    p_vt->last_pending = last;
+    p_vt->num_pending = count;
+/* the snapshot will be rebuilt on demand */
+    mbrc_retire_snapshot (p_vt);
+}
+
+static sqlite3_int64
+mbrc_data_version (MbrCachePtr p_vt)
+{
+/* returns the current PRAGMA data_version, -1 on failure */
+    sqlite3_int64 version = -1;
+    int ret;
+    if (p_vt->stmt_data_version == NULL)
+      {
+	  ret =
+	      sqlite3_prepare_v2 (p_vt->db, "PRAGMA main.data_version", -1,
+				  &(p_vt->stmt_data_version), NULL);
+	  if (ret != SQLITE_OK)
+	    {
+		p_vt->stmt_data_version = NULL;
+		return -1;
+	    }
+      }
+    sqlite3_reset (p_vt->stmt_data_version);
+    if (sqlite3_step (p_vt->stmt_data_version) == SQLITE_ROW)
+	version = sqlite3_column_int64 (p_vt->stmt_data_version, 0);
+    sqlite3_reset (p_vt->stmt_data_version);
+    return version;
+}
+
+static void
+mbrc_check_external (MbrCachePtr p_vt)
+{
+/*
+reloading a shared cache if some other connection [possibly belonging to
+another process, thus never updating this cache] has committed changes
+a connection having pending changes will check again after its COMMIT
+*/
+    sqlite3_int64 version;
+    if (!mbrc_is_shared (p_vt) || p_vt->first_pending != NULL)
+	return;
+    version = mbrc_data_version (p_vt);
+    if (version < 0 || version == p_vt->data_version)
+	return;
+    if (cache_refresh
+	(p_vt->cache, p_vt->db, p_vt->table_name, p_vt->column_name))
+	p_vt->data_version = version;
+}
+
 static int
 mbrc_disconnect (sqlite3_vtab * pVTab)
 {
 /* disconnects the virtual table */
     MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    mbrc_end_transaction (p_vt, 0);
+    mbrc_free_retired (p_vt);
+    if (p_vt->savepoints)
+	free (p_vt->savepoints);
+    if (p_vt->stmt_data_version)
+	sqlite3_finalize (p_vt->stmt_data_version);
     if (p_vt->cache)
-	cache_destroy (p_vt->cache);
+      {
+	  if (p_vt->shared)
+	      cache_detach_shared (p_vt->cache);
+	  else
+	      cache_destroy (p_vt->cache);
+      }
     if (p_vt->table_name)
 	sqlite3_free (p_vt->table_name);
     if (p_vt->column_name)
@@ -1114,20 +1833,45 @@ mbrc_destroy (sqlite3_vtab * pVTab)
     return mbrc_disconnect (pVTab);
 }
 
+static struct mbr_cache *
+mbrc_get_cache (MbrCachePtr p_vt)
+{
+/* returns the MBR cache, loading it on first usage */
+    if (!(p_vt->cache))
+      {
+	  if (p_vt->shared)
+	    {
+		p_vt->data_version = mbrc_data_version (p_vt);
+		p_vt->cache =
+		    cache_attach_shared (p_vt->db, p_vt->table_name,
+					 p_vt->column_name);
+	    }
+	  else
+	      p_vt->cache =
+		  cache_load (p_vt->db, p_vt->table_name, p_vt->column_name);
+      }
+    return p_vt->cache;
+}
+
 static void
 mbrc_read_row_unfiltered (MbrCacheCursorPtr cursor)
 {
 /* trying to read the next row from the Mbr cache - unfiltered mode */
     struct mbr_cache_page *page = cursor->current_page;
-    struct mbr_cache_cell *cell = cursor->current_cell;
     int i_block = cursor->current_block_index;
     int i_cell = cursor->current_cell_index;
-    if (cache_find_next_cell (&page, &i_block, &i_cell, &cell))
+    int found;
+    if (cursor->current_block)
+	i_cell++;		/* skipping the current cell */
+    sqlite3_mutex_enter (cursor->cache->mutex);
+    found = cache_find_next_cell (&page, &i_block, &i_cell);
+    sqlite3_mutex_leave (cursor->cache->mutex);
+    if (found)
       {
 	  cursor->current_page = page;
 	  cursor->current_block_index = i_block;
 	  cursor->current_cell_index = i_cell;
-	  cursor->current_cell = cell;
+	  cursor->current_block = page->blocks + i_block;
       }
     else
 	cursor->eof = 1;
@@ -1138,17 +1882,22 @@ mbrc_read_row_filtered (MbrCacheCursorPtr cursor)
 {
 /* trying to read the next row from the Mbr cache - spatially filter mode */
     struct mbr_cache_page *page = cursor->current_page;
-    struct mbr_cache_cell *cell = cursor->current_cell;
     int i_block = cursor->current_block_index;
     int i_cell = cursor->current_cell_index;
-    if (cache_find_next_mbr
-	(&page, &i_block, &i_cell, &cell, cursor->minx, cursor->miny,
-	 cursor->maxx, cursor->maxy, cursor->mbr_mode))
+    int found;
+    if (cursor->current_block)
+	i_cell++;		/* skipping the current cell */
+    sqlite3_mutex_enter (cursor->cache->mutex);
+    found = cache_find_next_mbr
+	(&page, &i_block, &i_cell, cursor->minx, cursor->miny,
+	 cursor->maxx, cursor->maxy, cursor->mbr_mode);
+    sqlite3_mutex_leave (cursor->cache->mutex);
+    if (found)
       {
 	  cursor->current_page = page;
 	  cursor->current_block_index = i_block;
 	  cursor->current_cell_index = i_cell;
-	  cursor->current_cell = cell;
+	  cursor->current_block = page->blocks + i_block;
       }
     else
 	cursor->eof = 1;
@@ -1158,13 +1907,19 @@ static void
 mbrc_read_row_by_rowid (MbrCacheCursorPtr cursor, sqlite3_int64 rowid)
 {
 /* trying to find a row by rowid from the Mbr cache */
-    struct mbr_cache_cell *cell =
-	cache_find_by_rowid (cursor->pVtab->cache->first, rowid);
-    if (cell)
-	cursor->current_cell = cell;
+    int i_cell;
+    struct mbr_cache_block *block;
+    sqlite3_mutex_enter (cursor->cache->mutex);
+    block = cache_find_by_rowid (cursor->cache->first, rowid, &i_cell);
+    sqlite3_mutex_leave (cursor->cache->mutex);
+    if (block)
+      {
+	  cursor->current_block = block;
+	  cursor->current_cell_index = i_cell;
+      }
     else
       {
-	  cursor->current_cell = NULL;
+	  cursor->current_block = NULL;
 	  cursor->eof = 1;
       }
 }
@@ -1179,19 +1934,25 @@ mbrc_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
     if (cursor == NULL)
 	return SQLITE_ERROR;
     cursor->pVtab = p_vt;
+    cursor->cache = NULL;
+    p_vt->cursors += 1;
     if (p_vt->error)
       {
 	  cursor->eof = 1;
 	  *ppCursor = (sqlite3_vtab_cursor *) cursor;
 	  return SQLITE_OK;
       }
-    if (!(p_vt->cache))
-	p_vt->cache =
-	    cache_load (p_vt->db, p_vt->table_name, p_vt->column_name);
-    cursor->current_page = cursor->pVtab->cache->first;
+    if (!mbrc_get_cache (p_vt))
+      {
+	  cursor->eof = 1;
+	  *ppCursor = (sqlite3_vtab_cursor *) cursor;
+	  return SQLITE_OK;
+      }
+    cursor->cache = mbrc_read_cache (p_vt);
+    cursor->current_page = cursor->cache->first;
     cursor->current_block_index = 0;
     cursor->current_cell_index = 0;
-    cursor->current_cell = NULL;
+    cursor->current_block = NULL;
     cursor->eof = 0;
     *ppCursor = (sqlite3_vtab_cursor *) cursor;
     return SQLITE_OK;
@@ -1201,6 +1962,11 @@ static int
 mbrc_close (sqlite3_vtab_cursor * pCursor)
 {
 /* closing the cursor */
+    MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
+    MbrCachePtr p_vt = cursor->pVtab;
+    p_vt->cursors -= 1;
+    if (p_vt->cursors == 0)
+	mbrc_free_retired (p_vt);
     sqlite3_free (pCursor);
     return SQLITE_OK;
 }
@@ -1213,15 +1979,17 @@ mbrc_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
     MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
     if (idxStr || argc)
 	idxStr = idxStr;	/* unused arg warning suppression */
-    if (cursor->pVtab->error)
+    if (cursor->pVtab->error || cursor->pVtab->cache == NULL)
       {
 	  cursor->eof = 1;
 	  return SQLITE_OK;
       }
-    cursor->current_page = cursor->pVtab->cache->first;
+    mbrc_check_external (cursor->pVtab);
+    cursor->cache = mbrc_read_cache (cursor->pVtab);
+    cursor->current_page = cursor->cache->first;
     cursor->current_block_index = 0;
     cursor->current_cell_index = 0;
-    cursor->current_cell = NULL;
+    cursor->current_block = NULL;
     cursor->eof = 0;
     cursor->strategy = idxNum;
     if (idxNum == 0)
@@ -1311,33 +2079,37 @@ mbrc_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 {
 /* fetching value for the Nth column */
     MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
-    if (!(cursor->current_cell))
+    struct mbr_cache_block *pb = cursor->current_block;
+    int ic = cursor->current_cell_index;
+    if (!pb)
 	sqlite3_result_null (pContext);
     else
       {
+	  sqlite3_mutex_enter (cursor->cache->mutex);
 	  if (column == 0)
 	    {
 		/* the PRIMARY KEY column */
-		sqlite3_result_int64 (pContext, cursor->current_cell->rowid);
+		sqlite3_result_int64 (pContext, pb->cell_rowid[ic]);
 	    }
 	  if (column == 1)
 	    {
 		/* the MBR column */
 		char *envelope = sqlite3_mprintf ("POLYGON(("
 						  "%1.2f %1.2f, %1.2f %1.2f, %1.2f %1.2f, %1.2f %1.2f, %1.2f %1.2f))",
-						  cursor->current_cell->minx,
-						  cursor->current_cell->miny,
-						  cursor->current_cell->maxx,
-						  cursor->current_cell->miny,
-						  cursor->current_cell->maxx,
-						  cursor->current_cell->maxy,
-						  cursor->current_cell->minx,
-						  cursor->current_cell->maxy,
-						  cursor->current_cell->minx,
-						  cursor->current_cell->miny);
+						  pb->cell_minx[ic],
+						  pb->cell_miny[ic],
+						  pb->cell_maxx[ic],
+						  pb->cell_miny[ic],
+						  pb->cell_maxx[ic],
+						  pb->cell_maxy[ic],
+						  pb->cell_minx[ic],
+						  pb->cell_maxy[ic],
+						  pb->cell_minx[ic],
+						  pb->cell_miny[ic]);
 		sqlite3_result_text (pContext, envelope, strlen (envelope),
 				     sqlite3_free);
 	    }
+	  sqlite3_mutex_leave (cursor->cache->mutex);
       }
     return SQLITE_OK;
 }
@@ -1347,7 +2119,8 @@ mbrc_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
 {
 /* fetching the ROWID */
     MbrCacheCursorPtr cursor = (MbrCacheCursorPtr) pCursor;
-    *pRowid = cursor->current_cell->rowid;
+    *pRowid =
+	cursor->current_block->cell_rowid[cursor->current_cell_index];
     return SQLITE_OK;
 }
 
@@ -1356,108 +2129,66 @@ mbrc_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 	     sqlite_int64 * pRowid)
 {
 /* generic update [INSERT / UPDATE / DELETE */
-    sqlite3_int64 rowid;
     unsigned char *p_blob;
     int n_bytes;
-    double minx;
-    double miny;
-    double maxx;
-    double maxy;
     int mode;
     int illegal = 0;
+    struct mbr_pending_change chg;
     MbrCachePtr p_vtab = (MbrCachePtr) pVTab;
     if (pRowid)
 	pRowid = pRowid;	/* unused arg warning suppression */
     if (p_vtab->error)
 	return SQLITE_OK;
-    if (!(p_vtab->cache))
-	p_vtab->cache =
-	    cache_load (p_vtab->db, p_vtab->table_name, p_vtab->column_name);
+    if (!mbrc_get_cache (p_vtab))
+	return SQLITE_ERROR;
     if (argc == 1)
       {
 	  /* performing a DELETE */
 	  if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER)
 	    {
-		rowid = sqlite3_value_int64 (argv[0]);
-		cache_delete_cell (p_vtab->cache->first, rowid);
+		chg.op = MBRC_DELETE;
+		chg.rowid = sqlite3_value_int64 (argv[0]);
 	    }
 	  else
 	      illegal = 1;
       }
-    else
+    else if (argc == 4)
       {
 	  if (sqlite3_value_type (argv[0]) == SQLITE_NULL)
 	    {
 		/* performing an INSERT */
-		if (argc == 4)
-		  {
-		      if (sqlite3_value_type (argv[2]) == SQLITE_INTEGER
-			  && sqlite3_value_type (argv[3]) == SQLITE_BLOB)
-			{
-			    rowid = sqlite3_value_int64 (argv[2]);
-			    p_blob =
-				(unsigned char *) sqlite3_value_blob (argv[3]);
-			    n_bytes = sqlite3_value_bytes (argv[3]);
-			    if (gaiaParseFilterMbr
-				(p_blob, n_bytes, &minx, &miny, &maxx, &maxy,
-				 &mode))
-			      {
-				  if (mode == GAIA_FILTER_MBR_DECLARE)
-				    {
-					if (!cache_find_by_rowid
-					    (p_vtab->cache->first, rowid))
-					    cache_insert_cell (p_vtab->cache,
-							       rowid, minx,
-							       miny, maxx,
-							       maxy);
-				    }
-				  else
-				      illegal = 1;
-			      }
-			    else
-				illegal = 1;
-			}
-		      else
-			  illegal = 1;
-		  }
+		chg.op = MBRC_INSERT;
+		if (sqlite3_value_type (argv[2]) == SQLITE_INTEGER)
+		    chg.rowid = sqlite3_value_int64 (argv[2]);
 		else
 		    illegal = 1;
 	    }
 	  else
 	    {
 		/* performing an UPDATE */
-		if (argc == 4)
-		  {
-		      if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER
-			  && sqlite3_value_type (argv[3]) == SQLITE_BLOB)
-			{
-			    rowid = sqlite3_value_int64 (argv[0]);
-			    p_blob =
-				(unsigned char *) sqlite3_value_blob (argv[3]);
-			    n_bytes = sqlite3_value_bytes (argv[3]);
-			    if (gaiaParseFilterMbr
-				(p_blob, n_bytes, &minx, &miny, &maxx, &maxy,
-				 &mode))
-			      {
-				  if (mode == GAIA_FILTER_MBR_DECLARE)
-				      cache_update_cell (p_vtab->cache->first,
-							 rowid, minx, miny,
-							 maxx, maxy);
-				  else
-				      illegal = 1;
-			      }
-			    else
-				illegal = 1;
-			}
-		      else
-			  illegal = 1;
-		  }
+		chg.op = MBRC_UPDATE;
+		if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER)
+		    chg.rowid = sqlite3_value_int64 (argv[0]);
 		else
 		    illegal = 1;
 	    }
+	  if (!illegal && sqlite3_value_type (argv[3]) == SQLITE_BLOB)
+	    {
+		p_blob = (unsigned char *) sqlite3_value_blob (argv[3]);
+		n_bytes = sqlite3_value_bytes (argv[3]);
+		if (!gaiaParseFilterMbr
+		    (p_blob, n_bytes, &(chg.minx), &(chg.miny), &(chg.maxx),
+		     &(chg.maxy), &mode) || mode != GAIA_FILTER_MBR_DECLARE)
+		    illegal = 1;
+	    }
+	  else
+	      illegal = 1;
       }
+    else
+	illegal = 1;
     if (illegal)
 	return SQLITE_MISMATCH;
+    mbrc_change (p_vtab, &chg);
     return SQLITE_OK;
 }
 
@@ -1482,18 +2213,58 @@ mbrc_sync (sqlite3_vtab * pVTab)
 static int
 mbrc_commit (sqlite3_vtab * pVTab)
 {
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+/* COMMIT TRANSACTION: publishing the changes to a shared cache */
+    mbrc_end_transaction ((MbrCachePtr) pVTab, 1);
     return SQLITE_OK;
 }
 
 static int
 mbrc_rollback (sqlite3_vtab * pVTab)
 {
-/* BEGIN TRANSACTION */
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
+/* ROLLBACK TRANSACTION: discarding the changes to a shared cache */
+    mbrc_end_transaction ((MbrCachePtr) pVTab, 0);
+    return SQLITE_OK;
+}
+
+static int
+mbrc_savepoint (sqlite3_vtab * pVTab, int iSavepoint)
+{
+/* SAVEPOINT: marking the pending changes to be kept by a ROLLBACK TO */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    int i;
+    if (iSavepoint >= p_vt->max_savepoints)
+      {
+	  p_vt->max_savepoints = iSavepoint + 16;
+	  p_vt->savepoints =
+	      realloc (p_vt->savepoints, sizeof (int) * p_vt->max_savepoints);
+      }
+    for (i = p_vt->num_savepoints; i < iSavepoint; i++)
+	p_vt->savepoints[i] = p_vt->num_pending;
+    p_vt->savepoints[iSavepoint] = p_vt->num_pending;
+    p_vt->num_savepoints = iSavepoint + 1;
+    return SQLITE_OK;
+}
+
+static int
+mbrc_release (sqlite3_vtab * pVTab, int iSavepoint)
+{
+/* RELEASE: the pending changes are kept by the outer transaction */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    if (iSavepoint < p_vt->num_savepoints)
+	p_vt->num_savepoints = iSavepoint;
+    return SQLITE_OK;
+}
+
+static int
+mbrc_rollback_to (sqlite3_vtab * pVTab, int iSavepoint)
+{
+/* ROLLBACK TO: discarding the changes made after the SAVEPOINT */
+    MbrCachePtr p_vt = (MbrCachePtr) pVTab;
+    if (iSavepoint < p_vt->num_savepoints)
+      {
+	  mbrc_rollback_pending (p_vt, p_vt->savepoints[iSavepoint]);
+	  p_vt->num_savepoints = iSavepoint + 1;
+      }
     return SQLITE_OK;
 }
 
@@ -1501,7 +2272,7 @@ int
 sqlite3MbrCacheInit (sqlite3 * db)
 {
     int rc = SQLITE_OK;
-    my_mbr_module.iVersion = 1;
+    my_mbr_module.iVersion = 2;
     my_mbr_module.xCreate = &mbrc_create;
     my_mbr_module.xConnect = &mbrc_connect;
     my_mbr_module.xBestIndex = &mbrc_best_index;
@@ -1520,6 +2291,10 @@ sqlite3MbrCacheInit (sqlite3 * db)
     my_mbr_module.xCommit = &mbrc_commit;
     my_mbr_module.xRollback = &mbrc_rollback;
     my_mbr_module.xFindFunction = NULL;
+    my_mbr_module.xRename = NULL;
+    my_mbr_module.xSavepoint = &mbrc_savepoint;
+    my_mbr_module.xRelease = &mbrc_release;
+    my_mbr_module.xRollbackTo = &mbrc_rollback_to;
     sqlite3_create_module_v2 (db, "MbrCache", &my_mbr_module, NULL, 0);
     return rc;
 }
@@ -71,9 +71,11 @@ Regione Toscana - Settore Sistema Informativo Territoriale ed Ambientale
 
 #if defined(_WIN32) || defined(WIN32)
 #include <io.h>
+#include <windows.h>
 #define isatty	_isatty
 #else
 #include <unistd.h>
+#include <pthread.h>
 #endif
 
 
@@ -5596,6 +5598,106 @@ fnct_CreateRasterCoveragesTable (sqlite3_context * context, int argc,
     return;
 }
 
+static void
+fnct_CreateNetworkHierarchy (sqlite3_context * context, int argc,
+			     sqlite3_value ** argv)
+{
+/* SQL function:
+/ CreateNetworkHierarchy(TEXT network_data_table)
+/
+/ builds a Contraction Hierarchy for the VirtualNetwork based on
+/ the given NetworkData table, and stores it into "<table>_hierarchy"
+/ returns 1 on success
+/ 0 on failure
+*/
+    const char *table;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+
+    if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+	goto error;
+    table = (const char *) sqlite3_value_text (argv[0]);
+    if (!create_network_hierarchy (sqlite, table))
+	goto error;
+    updateSpatiaLiteHistory (sqlite, table, NULL,
+			     "Contraction Hierarchy successfully created");
+    sqlite3_result_int (context, 1);
+    return;
+
+  error:
+    sqlite3_result_int (context, 0);
+    return;
+}
+
+static void
+fnct_CreateNetworkImage (sqlite3_context * context, int argc,
+			 sqlite3_value ** argv)
+{
+/* SQL function:
+/ CreateNetworkImage(TEXT network_data_table)
+/ CreateNetworkImage(TEXT network_data_table, BOOL sidecar)
+/
+/ builds a binary image for the VirtualNetwork based on the given
+/ NetworkData table, and stores it into "<table>_image" or (sidecar)
+/ into the "<db-file>.<table>.vnet" file; any later change to the
+/ NetworkData table invalidates the image
+/ returns 1 on success
+/ 0 on failure
+*/
+    const char *table;
+    int sidecar = 0;
+    sqlite3 *sqlite = sqlite3_context_db_handle (context);
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+
+    if (sqlite3_value_type (argv[0]) != SQLITE_TEXT)
+	goto error;
+    table = (const char *) sqlite3_value_text (argv[0]);
+    if (argc == 2)
+      {
+	  if (sqlite3_value_type (argv[1]) != SQLITE_INTEGER)
+	      goto error;
+	  sidecar = sqlite3_value_int (argv[1]);
+      }
+    if (!create_network_image (sqlite, table, sidecar))
+	goto error;
+    updateSpatiaLiteHistory (sqlite, table, NULL,
+			     "Network binary image successfully created");
+    sqlite3_result_int (context, 1);
+    return;
+
+  error:
+    sqlite3_result_int (context, 0);
+    return;
+}
+
+static void
+fnct_SetNetworkArcCacheSize (sqlite3_context * context, int argc,
+			     sqlite3_value ** argv)
+{
+/* SQL function:
+/ SetNetworkArcCacheSize(INTEGER kbytes)
+/
+/ sets the memory budget (in KB) of the Arc Geometries cache supporting
+/ each VirtualNetwork table [0 disables any caching]
+/ returns the previous budget
+/ or NULL on invalid argument
+*/
+    int kbytes;
+    GAIA_UNUSED ();		/* LCOV_EXCL_LINE */
+    if (sqlite3_value_type (argv[0]) != SQLITE_INTEGER)
+      {
+	  sqlite3_result_null (context);
+	  return;
+      }
+    kbytes = sqlite3_value_int (argv[0]);
+    if (kbytes < 0)
+      {
+	  sqlite3_result_null (context);
+	  return;
+      }
+    sqlite3_result_int (context, set_network_arc_cache_size (kbytes));
+}
+
 static gaiaPointPtr
 simplePoint (gaiaGeomCollPtr geo)
 {
@@ -26015,6 +26117,55 @@ fnct_XB_CacheFlush (sqlite3_context * context, int argc, sqlite3_value ** argv)
 
 #endif /* end including LIBXML2 */
 
+/*
+/ the mutexes owned by the library itself, protecting the process-wide
+/ lists of shared MbrCaches and VirtualNetworks; they are allocated only
+/ once, on first usage, and are never freed
+*/
+static sqlite3_mutex *library_mutexes[SPLITE_MUTEX_COUNT];
+
+#if defined(_WIN32) || defined(WIN32)
+SPATIALITE_PRIVATE void *
+splite_library_mutex (int which)
+{
+/* returns one of the library mutexes, allocating it if required */
+    sqlite3_mutex *mutex;
+    if (which < 0 || which >= SPLITE_MUTEX_COUNT)
+	return NULL;
+    if (library_mutexes[which] != NULL)
+	return library_mutexes[which];
+    mutex = sqlite3_mutex_alloc (SQLITE_MUTEX_FAST);
+    if (InterlockedCompareExchangePointer
+	((PVOID volatile *) (library_mutexes + which), mutex, NULL) != NULL)
+      {
+	  /* some other thread was faster */
+	  sqlite3_mutex_free (mutex);
+      }
+    return library_mutexes[which];
+}
+#else
+static pthread_once_t library_mutexes_once = PTHREAD_ONCE_INIT;
+
+static void
+library_mutexes_init (void)
+{
+/* allocating the library mutexes - called exactly once */
+    int i;
+    for (i = 0; i < SPLITE_MUTEX_COUNT; i++)
+	library_mutexes[i] = sqlite3_mutex_alloc (SQLITE_MUTEX_FAST);
+}
+
+SPATIALITE_PRIVATE void *
+splite_library_mutex (int which)
+{
+/* returns one of the library mutexes, allocating them if required */
+    if (which < 0 || which >= SPLITE_MUTEX_COUNT)
+	return NULL;
+    pthread_once (&library_mutexes_once, library_mutexes_init);
+    return library_mutexes[which];
+}
+#endif
+
 SPATIALITE_DECLARE void *
 spatialite_alloc_connection ()
 {
@@ -26188,6 +26339,14 @@ register_spatialite_sql_functions (void *p_db, void *p_cache)
 			     fnct_GetLayerExtent, 0, 0);
     sqlite3_create_function (db, "CreateRasterCoveragesTable", 0, SQLITE_ANY,
 			     0, fnct_CreateRasterCoveragesTable, 0, 0);
+    sqlite3_create_function (db, "CreateNetworkHierarchy", 1, SQLITE_ANY, 0,
+			     fnct_CreateNetworkHierarchy, 0, 0);
+    sqlite3_create_function (db, "CreateNetworkImage", 1, SQLITE_ANY, 0,
+			     fnct_CreateNetworkImage, 0, 0);
+    sqlite3_create_function (db, "CreateNetworkImage", 2, SQLITE_ANY, 0,
+			     fnct_CreateNetworkImage, 0, 0);
+    sqlite3_create_function (db, "SetNetworkArcCacheSize", 1, SQLITE_ANY, 0,
+			     fnct_SetNetworkArcCacheSize, 0, 0);
     sqlite3_create_function (db, "AsText", 1, SQLITE_ANY, 0, fnct_AsText, 0, 0);
     sqlite3_create_function (db, "ST_AsText", 1, SQLITE_ANY, 0, fnct_AsText, 0,
 			     0);
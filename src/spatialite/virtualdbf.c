@@ -101,6 +101,7 @@ typedef struct VirtualDbfCursorStruct
     int eof;			/* the EOF marker */
     VirtualDbfConstraintPtr firstConstraint;
     VirtualDbfConstraintPtr lastConstraint;
+    char *readFields;		/* DBF fields to be decoded; NULL means all */
 } VirtualDbfCursor;
 
 typedef VirtualDbfCursor *VirtualDbfCursorPtr;
@@ -287,30 +288,44 @@ vdbf_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIndex)
 /* best index selection */
     int i;
     int iArg = 0;
+    int iColumn;
+    int op;
     char str[2048];
     char buf[64];
+    sqlite3_uint64 col_used = ~((sqlite3_uint64) 0);
 
     if (pVTab)
 	pVTab = pVTab;		/* unused arg warning suppression */
 
+#if SQLITE_VERSION_NUMBER >= 3010000
+    if (sqlite3_libversion_number () >= 3010000)
+	col_used = pIndex->colUsed;
+#endif
     *str = '\0';
     for (i = 0; i < pIndex->nConstraint; i++)
       {
 	  if (pIndex->aConstraint[i].usable)
 	    {
+		iColumn = pIndex->aConstraint[i].iColumn;
+		op = pIndex->aConstraint[i].op;
+		if (iColumn < 0)
+		    iColumn = 0;	/* the ROWID is an alias for PKUID */
+		if (op != SQLITE_INDEX_CONSTRAINT_EQ
+		    && op != SQLITE_INDEX_CONSTRAINT_GT
+		    && op != SQLITE_INDEX_CONSTRAINT_LE
+		    && op != SQLITE_INDEX_CONSTRAINT_LT
+		    && op != SQLITE_INDEX_CONSTRAINT_GE)
+		    continue;	/* unsupported operator: left to SQLite */
 		iArg++;
 		pIndex->aConstraintUsage[i].argvIndex = iArg;
 		pIndex->aConstraintUsage[i].omit = 1;
-		sprintf (buf, "%d:%d,", pIndex->aConstraint[i].iColumn,
-			 pIndex->aConstraint[i].op);
+		sprintf (buf, "%d:%d,", iColumn, op);
 		strcat (str, buf);
 	    }
       }
-    if (*str != '\0')
-      {
-	  pIndex->idxStr = sqlite3_mprintf ("%s", str);
-	  pIndex->needToFreeIdxStr = 1;
-      }
+/* the leading item always is the mask of the columns actually used */
+    pIndex->idxStr = sqlite3_mprintf ("%llx,%s", col_used, str);
+    pIndex->needToFreeIdxStr = 1;
 
     return SQLITE_OK;
 }
@@ -344,7 +359,9 @@ vdbf_read_row (VirtualDbfCursorPtr cursor, int *deleted_row)
 	  cursor->eof = 1;
 	  return;
       }
-    ret = gaiaReadDbfEntity (cursor->pVtab->dbf, cursor->current_row, &deleted);
+    ret =
+	gaiaReadDbfEntity_ex (cursor->pVtab->dbf, cursor->current_row,
+			      &deleted, cursor->readFields);
     if (!ret)
       {
 	  if (!(cursor->pVtab->dbf->LastError))	/* normal DBF EOF */
@@ -375,6 +392,7 @@ vdbf_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
     cursor->pVtab = (VirtualDbfPtr) pVTab;
     cursor->current_row = 0;
     cursor->eof = 0;
+    cursor->readFields = NULL;
     *ppCursor = (sqlite3_vtab_cursor *) cursor;
     while (1)
       {
@@ -404,6 +422,9 @@ vdbf_free_constraints (VirtualDbfCursorPtr cursor)
       }
     cursor->firstConstraint = NULL;
     cursor->lastConstraint = NULL;
+    if (cursor->readFields)
+	free (cursor->readFields);
+    cursor->readFields = NULL;
 }
 
 static int
@@ -462,6 +483,52 @@ vdbf_parse_constraint (const char *str, int index, int *iColumn, int *op)
     return 0;
 }
 
+static void
+vdbf_columns_used (VirtualDbfCursorPtr cursor, const char *idxStr)
+{
+/*
+/ parsing the mask of the columns actually used (leading item of idxStr)
+/ so to only decode the required DBF fields
+/ bit #63 stands for any column beyond the 63rd
+*/
+    sqlite3_uint64 col_used = 0;
+    const char *p = idxStr;
+    int nFields = 0;
+    int bit;
+    int i;
+    gaiaDbfFieldPtr pFld;
+    if (p == NULL || *p == '\0' || cursor->pVtab->dbf->Dbf == NULL)
+	return;
+    while (*p != ',' && *p != '\0')
+      {
+	  col_used <<= 4;
+	  if (*p >= '0' && *p <= '9')
+	      col_used |= *p - '0';
+	  else if (*p >= 'a' && *p <= 'f')
+	      col_used |= *p - 'a' + 10;
+	  p++;
+      }
+    pFld = cursor->pVtab->dbf->Dbf->First;
+    while (pFld)
+      {
+	  /* counting DBF fields */
+	  nFields++;
+	  pFld = pFld->Next;
+      }
+    if (nFields == 0)
+	return;
+    cursor->readFields = malloc (nFields);
+    if (cursor->readFields == NULL)
+	return;
+    for (i = 0; i < nFields; i++)
+      {
+	  bit = i + 1;
+	  if (bit > 63)
+	      bit = 63;
+	  cursor->readFields[i] = (col_used >> bit) & 1;
+      }
+}
+
 static int
 vdbf_eval_constraints (VirtualDbfCursorPtr cursor)
 {
@@ -680,10 +747,11 @@ vdbf_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 
 /* resetting any previously set filter constraint */
     vdbf_free_constraints (cursor);
+    vdbf_columns_used (cursor, idxStr);
 
     for (i = 0; i < argc; i++)
       {
-	  if (!vdbf_parse_constraint (idxStr, i, &iColumn, &op))
+	  if (!vdbf_parse_constraint (idxStr, i + 1, &iColumn, &op))
 	      continue;
 	  pC = sqlite3_malloc (sizeof (VirtualDbfConstraint));
 	  if (!pC)
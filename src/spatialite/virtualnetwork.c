@@ -57,19 +57,42 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "config.h"
 #endif
 
+#if !defined(_WIN32) && !defined(WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 #include <spatialite/sqlite.h>
 
 #include <spatialite/spatialite.h>
 #include <spatialite/gaiaaux.h>
 #include <spatialite/gaiageo.h>
+#include <spatialite/debug.h>
+#include <spatialite_private.h>
 
 static struct sqlite3_module my_net_module;
 
 #define VNET_DIJKSTRA_ALGORITHM	1
 #define VNET_A_STAR_ALGORITHM	2
+#define VNET_CH_ALGORITHM	3
+#define VNET_BI_DIJKSTRA_ALGORITHM	4
+#define VNET_BI_A_STAR_ALGORITHM	5
+
+#define VNET_ARC_CACHE_BUDGET	8192	/* KB */
+
+#define VNET_CH_WITNESS_LIMIT	500
+#define VNET_CH_SIMULATION_LIMIT	50
+#define VNET_CH_BLOCK_SIZE	1024
+
+#define VNET_IMAGE_MAGIC	"VNETIMG"
+#define VNET_IMAGE_BYTE_ORDER	0x01020304
+#define VNET_IMAGE_VERSION	1
 
 #ifdef _WIN32
 #define strcasecmp	_stricmp
+#define atoll	_atoi64
 #endif /* not WIN32 */
 
 /******************************************************************************
@@ -80,24 +103,27 @@ static struct sqlite3_module my_net_module;
 
 typedef struct NetworkArcStruct
 {
-/* an ARC */
-    const struct NetworkNodeStruct *NodeFrom;
-    const struct NetworkNodeStruct *NodeTo;
+/* an ARC: both Nodes are referenced by their internal index */
     sqlite3_int64 ArcRowid;
     double Cost;
+    int NodeFrom;
+    int NodeTo;
 } NetworkArc;
 typedef NetworkArc *NetworkArcPtr;
 
 typedef struct NetworkNodeStruct
 {
-/* a NODE */
-    int InternalIndex;
+/*
+/ a NODE: its outcoming Arcs are Arcs[FirstArc] .. Arcs[FirstArc+NumArcs-1]
+/ and its TEXT Code [if any] is stored at Codes + CodeOffset
+*/
     sqlite3_int64 Id;
-    char *Code;
     double CoordX;
     double CoordY;
+    int InternalIndex;
+    int CodeOffset;
+    int FirstArc;
     int NumArcs;
-    NetworkArcPtr Arcs;
 } NetworkNode;
 typedef NetworkNode *NetworkNodePtr;
 
@@ -117,13 +143,63 @@ typedef struct NetworkStruct
     char *GeometryColumn;
     char *NameColumn;
     double AStarHeuristicCoeff;
+/*
+/ compressed sparse row layout: Nodes are sorted by Id (or Code),
+/ the Arcs of all Nodes are stored into a single contiguous array
+/ and all TEXT Codes are interned into a single strings pool
+/ when Image is not NULL all these arrays simply point into it
+*/
     NetworkNodePtr Nodes;
+    int NumArcs;
+    int MaxArcs;
+    NetworkArcPtr Arcs;
+    char *Codes;
+    int CodesSize;
+    int MaxCodes;
+    unsigned char *Image;
+    size_t ImageSize;
+    int ImageMapped;
+/*
+/ the reverse adjacency list [never stored into an image]: the incoming
+/ Arcs of Node i are Arcs[InArcs[InIndex[i]]] .. Arcs[InArcs[InIndex[i+1]-1]]
+*/
+    int *InIndex;
+    int *InArcs;
 } Network;
 typedef Network *NetworkPtr;
 
-typedef struct ArcSolutionStruct
+typedef struct NetworkImageHeaderStruct
 {
-/* Geometry corresponding to an Arc used by Dijkstra shortest path solution */
+/*
+/ the HEADER of a NETWORK binary image [sidecar file or BLOB]
+/ it's immediately followed by the Nodes array, by the Arcs array
+/ and finally by the strings pool [Codes and table/column names];
+/ all values are stored using the native layout and byte order,
+/ so to allow using a memory-mapped image as it is
+*/
+    char Magic[8];
+    int ByteOrder;
+    int Version;
+    int Net64;
+    int AStar;
+    int NodeCode;
+    int MaxCodeLength;
+    int NumNodes;
+    int NumArcs;
+    int CodesSize;
+    int TableName;
+    int FromColumn;
+    int ToColumn;
+    int GeometryColumn;
+    int NameColumn;
+    double AStarHeuristicCoeff;
+    sqlite3_int64 Fingerprint;
+} NetworkImageHeader;
+typedef NetworkImageHeader *NetworkImageHeaderPtr;
+
+typedef struct ArcGeometryStruct
+{
+/* a cached Arc Geometry [decoded vertices] */
     sqlite3_int64 ArcRowid;
     char *FromCode;
     char *ToCode;
@@ -133,15 +209,41 @@ typedef struct ArcSolutionStruct
     double *Coords;
     int Srid;
     char *Name;
-    struct ArcSolutionStruct *Next;
+    size_t Size;		/* the memory used by this entry */
+    struct ArcGeometryStruct *HashNext;
+    struct ArcGeometryStruct *Prev;
+    struct ArcGeometryStruct *Next;
+} ArcGeometry;
+typedef ArcGeometry *ArcGeometryPtr;
+
+typedef struct DbVersionStruct
+{
+/* identifies the current state of a DB */
+    sqlite3_int64 DataVersion;
+    int TotalChanges;
+} DbVersion;
 
-} ArcSolution;
-typedef ArcSolution *ArcSolutionPtr;
+typedef struct ArcCacheStruct
+{
+/*
+/ an LRU cache of Arc Geometries keyed by ArcRowid: First is the most
+/ recently used entry, Last is the next one to be evicted
+*/
+    ArcGeometryPtr *Buckets;
+    int NumBuckets;
+    int Count;
+    size_t Used;
+    ArcGeometryPtr First;
+    ArcGeometryPtr Last;
+    DbVersion Version;		/* the DB state the cached entries belong to */
+} ArcCache;
+typedef ArcCache *ArcCachePtr;
 
 typedef struct RowSolutionStruct
 {
 /* a row into the shortest path solution */
     NetworkArcPtr Arc;
+    double Cost;
     char *Name;
     struct RowSolutionStruct *Next;
 
@@ -151,8 +253,6 @@ typedef RowSolution *RowSolutionPtr;
 typedef struct SolutionStruct
 {
 /* the shortest path solution */
-    ArcSolutionPtr FirstArc;
-    ArcSolutionPtr LastArc;
     NetworkNodePtr From;
     NetworkNodePtr To;
     RowSolutionPtr First;
@@ -160,10 +260,48 @@ typedef struct SolutionStruct
     RowSolutionPtr CurrentRow;
     sqlite3_int64 CurrentRowId;
     double TotalCost;
-    gaiaGeomCollPtr Geometry;
+    unsigned char *Geometry;	/* the solution LINESTRING [BLOB] */
+    int GeometrySize;
 } Solution;
 typedef Solution *SolutionPtr;
 
+typedef struct MatrixSolutionStruct
+{
+/*
+/ the One-to-Many / Many-to-Many solution
+/ Costs[(i * NumTo) + j] is the cost From[i] -> To[j] (DBL_MAX if unreachable)
+*/
+    int Algorithm;
+    NetworkNodePtr *From;
+    int NumFrom;
+    NetworkNodePtr *To;
+    int NumTo;
+    double *Costs;
+    int CurrentIndex;
+} MatrixSolution;
+typedef MatrixSolution *MatrixSolutionPtr;
+
+typedef struct IsochroneSolutionStruct
+{
+/*
+/ the Isochrone solution: any Node reachable from Source within Budget,
+/ in order of increasing cost; Arcs[i] is the last Arc of the Shortest
+/ Path leading to Nodes[i] (NULL for the Source itself)
+*/
+    NetworkNodePtr Source;
+    double Budget;
+    int Strict;
+    int Count;
+    int Max;
+    NetworkNodePtr *Nodes;
+    NetworkArcPtr *Arcs;
+    double *Costs;
+    int CurrentIndex;
+    int HullDone;
+    gaiaGeomCollPtr Hull;
+} IsochroneSolution;
+typedef IsochroneSolution *IsochroneSolutionPtr;
+
 /******************************************************************************
 /
 / Dijkstra and A* common structs
@@ -173,34 +311,91 @@ typedef Solution *SolutionPtr;
 typedef struct RoutingNode
 {
     int Id;
-    struct RoutingNode **To;
-    NetworkArcPtr *Link;
-    int DimTo;
     struct RoutingNode *PreviousNode;
     NetworkArcPtr Arc;
     double Distance;
     double HeuristicDistance;
     int Inspected;
+    int HeapPos;
+    int Edge;			/* the Hierarchy edge leading to this Node */
+    unsigned int Epoch;		/* the query this status belongs to */
 } RoutingNode;
 typedef RoutingNode *RoutingNodePtr;
 
+typedef struct RoutingHeapStruct
+{
+/* an indexed binary min-heap of Nodes supporting decrease-key */
+    RoutingNodePtr *Values;
+    int Count;
+    int AStar;
+} RoutingHeap;
+typedef RoutingHeap *RoutingHeapPtr;
+
 typedef struct RoutingNodes
 {
+/*
+/ the search status of a single query; the NETWORK itself is never
+/ modified, so many queries can run at once each one using its own
+/ RoutingNodes [pooled, so to be reused by the following queries]
+/
+/ a Node status is valid only if its Epoch matches the current one:
+/ starting a new query simply requires incrementing Epoch, and any
+/ Node touched by the search is lazily reset on first access
+/ Backward [allocated on demand] supports bidirectional searches
+/ Costs [if not NULL] overrides the Arc costs, DBL_MAX marking a closed Arc
+/ HeuristicCoeff is the A* coefficient matching the actual Arc costs
+*/
     RoutingNodePtr Nodes;
-    NetworkArcPtr *ArcsBuffer;
-    RoutingNodePtr *NodesBuffer;
+    RoutingNodePtr Backward;
+    RoutingHeapPtr Heap;
+    RoutingHeapPtr BackwardHeap;
+    NetworkPtr Graph;
     int Dim;
-    int DimLink;
+    unsigned int Epoch;
+    const double *Costs;
+    double HeuristicCoeff;
+    struct RoutingNodes *Next;
 } RoutingNodes;
 typedef RoutingNodes *RoutingNodesPtr;
 
-typedef struct RoutingHeapStruct
+/******************************************************************************
+/
+/ Contraction Hierarchies structs
+/
+******************************************************************************/
+
+typedef struct HierarchyShortcutStruct
 {
-    RoutingNodePtr *Values;
-    int Head;
-    int Tail;
-} RoutingHeap;
-typedef RoutingHeap *RoutingHeapPtr;
+/* a SHORTCUT replacing two consecutive arcs [either original or shortcut] */
+    int NodeFrom;
+    int NodeTo;
+    double Cost;
+    int First;
+    int Second;
+} HierarchyShortcut;
+typedef HierarchyShortcut *HierarchyShortcutPtr;
+
+typedef struct NetworkHierarchyStruct
+{
+/*
+/ a Contraction Hierarchy built on top of the NETWORK
+/
+/ edges 0 .. NumArcs-1 are the original Arcs, edges NumArcs .. are Shortcuts
+/ UpEdges lists, for each node, any edge leading to an higher ranked node
+/ DownEdges lists, for each node, any edge coming from an higher ranked node
+*/
+    int NumNodes;
+    int NumArcs;
+    int NumShortcuts;
+    int *Rank;
+    NetworkArcPtr *Arcs;
+    HierarchyShortcutPtr Shortcuts;
+    int *UpIndex;
+    int *UpEdges;
+    int *DownIndex;
+    int *DownEdges;
+} NetworkHierarchy;
+typedef NetworkHierarchy *NetworkHierarchyPtr;
 
 /******************************************************************************
 /
@@ -208,6 +403,53 @@ typedef RoutingHeap *RoutingHeapPtr;
 /
 ******************************************************************************/
 
+typedef struct SharedNetworkStruct
+{
+/*
+/ a NETWORK [and its optional Contraction Hierarchy] shared by all the
+/ VirtualNetwork tables of this process based on the same DB-file and
+/ NetworkData table; both are never modified after loading, so many
+/ threads can safely use them at the same time, each query taking
+/ its own search status from the Pool
+/ MEMORY DBs always get a private [unlisted] SharedNetwork
+*/
+    char *DbPath;
+    char *TableName;
+    sqlite3_int64 Fingerprint;
+    NetworkPtr Graph;
+    NetworkHierarchyPtr Hierarchy;
+    int RefCount;
+    int Listed;
+    sqlite3_mutex *Mutex;
+    RoutingNodesPtr Pool;
+    struct SharedNetworkStruct *Next;
+} SharedNetwork;
+typedef SharedNetwork *SharedNetworkPtr;
+
+/* the process-wide list of shared NETWORKs */
+static SharedNetworkPtr shared_networks = NULL;
+
+typedef struct CostOverrideArcStruct
+{
+/* an Arc index sorted by ArcRowid */
+    sqlite3_int64 ArcRowid;
+    int Index;
+} CostOverrideArc;
+
+typedef struct CostOverridesStruct
+{
+/* the Arc costs overridden by some table */
+    char *TableName;
+    char *RowidColumn;
+    char *CostColumn;
+    int Multiplier;		/* the table contains Multipliers, not Costs */
+    CostOverrideArc *ByRowid;	/* the Arcs sorted by ArcRowid */
+    double *Costs;		/* the actual Arc costs [DBL_MAX = closed] */
+    double HeuristicCoeff;	/* the A* coefficient fitting the actual costs */
+    DbVersion Version;		/* the DB state when last loaded */
+} CostOverrides;
+typedef CostOverrides *CostOverridesPtr;
+
 typedef struct VirtualNetworkStruct
 {
 /* extends the sqlite3_vtab struct */
@@ -215,8 +457,11 @@ typedef struct VirtualNetworkStruct
     int nRef;			/* # references: USED INTERNALLY BY SQLITE */
     char *zErrMsg;		/* error message: USE INTERNALLY BY SQLITE */
     sqlite3 *db;		/* the sqlite db holding the virtual table */
+    SharedNetworkPtr shared;	/* the [possibly shared] NETWORK */
     NetworkPtr graph;		/* the NETWORK structure */
-    RoutingNodesPtr routing;	/* the ROUTING structure */
+    NetworkHierarchyPtr hierarchy;	/* the [optional] Contraction Hierarchy */
+    CostOverridesPtr overrides;	/* the [optional] Arc cost overrides */
+    ArcCachePtr arc_cache;	/* the Arc Geometries cache */
     int currentAlgorithm;	/* the currently selected Shortest Path Algorithm */
 } VirtualNetwork;
 typedef VirtualNetwork *VirtualNetworkPtr;
@@ -226,6 +471,8 @@ typedef struct VirtualNetworkCursortStruct
 /* extends the sqlite3_vtab_cursor struct */
     VirtualNetworkPtr pVtab;	/* Virtual table of this cursor */
     SolutionPtr solution;	/* the current solution */
+    MatrixSolutionPtr matrix;	/* the current One-to-Many / Many-to-Many solution */
+    IsochroneSolutionPtr isochrone;	/* the current Isochrone solution */
     int eof;			/* the EOF marker */
 } VirtualNetworkCursor;
 typedef VirtualNetworkCursor *VirtualNetworkCursorPtr;
@@ -241,48 +488,61 @@ typedef VirtualNetworkCursor *VirtualNetworkCursorPtr;
 /
 */
 
+static RoutingHeapPtr
+routing_heap_init (int dim, int a_star)
+{
+/* allocating the Nodes priority queue */
+    RoutingHeapPtr h;
+    h = malloc (sizeof (RoutingHeap));
+    h->Values = malloc (sizeof (RoutingNodePtr) * dim);
+    h->Count = 0;
+    h->AStar = a_star;
+    return (h);
+}
+
+static void
+routing_heap_free (RoutingHeapPtr h)
+{
+/* freeing the Nodes priority queue */
+    free (h->Values);
+    free (h);
+}
+
+static RoutingNodePtr
+routing_nodes_alloc (int dim)
+{
+/* allocating an array of Nodes search status [all of them stale] */
+    int i;
+    RoutingNodePtr nodes = malloc (sizeof (RoutingNode) * dim);
+    for (i = 0; i < dim; i++)
+      {
+	  nodes[i].Id = i;
+	  nodes[i].Epoch = 0;
+      }
+    return nodes;
+}
+
 static RoutingNodesPtr
 routing_init (NetworkPtr graph)
 {
-/* allocating and initializing the ROUTING struct */
-    int i;
-    int j;
-    int cnt = 0;
+/*
+/ allocating and initializing the ROUTING struct
+/ the outcoming Arcs are directly read from the NETWORK itself
+*/
     RoutingNodesPtr nd;
-    RoutingNodePtr ndn;
-    NetworkNodePtr nn;
 /* allocating the main Nodes struct */
     nd = malloc (sizeof (RoutingNodes));
-/* allocating and initializing  Nodes array */
-    nd->Nodes = malloc (sizeof (RoutingNode) * graph->NumNodes);
+/* allocating the Nodes array */
+    nd->Nodes = routing_nodes_alloc (graph->NumNodes);
+    nd->Backward = NULL;
+    nd->Heap = routing_heap_init (graph->NumNodes, 0);
+    nd->BackwardHeap = NULL;
+    nd->Graph = graph;
     nd->Dim = graph->NumNodes;
-    nd->DimLink = 0;
-
-/* pre-alloc buffer strategy - GENSCHER 2010-01-05 */
-    for (i = 0; i < graph->NumNodes; cnt += graph->Nodes[i].NumArcs, i++);
-    nd->NodesBuffer = malloc (sizeof (RoutingNodePtr) * cnt);
-    nd->ArcsBuffer = malloc (sizeof (NetworkArcPtr) * cnt);
-
-    cnt = 0;
-    for (i = 0; i < graph->NumNodes; i++)
-      {
-	  /* initializing the Nodes array */
-	  nn = graph->Nodes + i;
-	  ndn = nd->Nodes + i;
-	  ndn->Id = nn->InternalIndex;
-	  ndn->DimTo = nn->NumArcs;
-	  ndn->To = &(nd->NodesBuffer[cnt]);
-	  ndn->Link = &(nd->ArcsBuffer[cnt]);
-	  cnt += nn->NumArcs;
-
-	  for (j = 0; j < nn->NumArcs; j++)
-	    {
-		/*  setting the outcoming Arcs for the current Node */
-		nd->DimLink++;
-		ndn->To[j] = nd->Nodes + nn->Arcs[j].NodeTo->InternalIndex;
-		ndn->Link[j] = nn->Arcs + j;
-	    }
-      }
+    nd->Epoch = 0;
+    nd->Costs = NULL;
+    nd->HeuristicCoeff = graph->AStarHeuristicCoeff;
+    nd->Next = NULL;
     return (nd);
 }
 
@@ -290,65 +550,212 @@ static void
 routing_free (RoutingNodes * e)
 {
 /* memory cleanup; freeing the ROUTING struct */
-    free (e->ArcsBuffer);
-    free (e->NodesBuffer);
     free (e->Nodes);
+    if (e->Backward)
+	free (e->Backward);
+    routing_heap_free (e->Heap);
+    if (e->BackwardHeap)
+	routing_heap_free (e->BackwardHeap);
     free (e);
 }
 
+static void
+routing_reset_node (RoutingNodePtr n)
+{
+/* resetting the search status of a single Node */
+    n->PreviousNode = NULL;
+    n->Arc = NULL;
+    n->Inspected = 0;
+    n->Distance = DBL_MAX;
+    n->HeuristicDistance = DBL_MAX;
+    n->HeapPos = -1;
+    n->Edge = -1;
+}
+
 static RoutingHeapPtr
-routing_heap_init (int dim)
+routing_begin (RoutingNodesPtr e, int a_star)
 {
-/* allocating the Nodes ordered list */
-    RoutingHeapPtr h;
-    h = malloc (sizeof (RoutingHeap));
-    h->Values = malloc (sizeof (RoutingNodePtr) * dim);
-    h->Head = 0;
-    h->Tail = 0;
-    return (h);
+/* starting a new query: the status of all Nodes becomes stale at once */
+    int i;
+    e->Epoch++;
+    if (e->Epoch == 0)
+      {
+	  /* wrapping around: explicitly invalidating all Nodes */
+	  for (i = 0; i < e->Dim; i++)
+	    {
+		e->Nodes[i].Epoch = 0;
+		if (e->Backward)
+		    e->Backward[i].Epoch = 0;
+	    }
+	  e->Epoch = 1;
+      }
+    e->Heap->Count = 0;
+    e->Heap->AStar = a_star;
+    if (e->BackwardHeap)
+	e->BackwardHeap->Count = 0;
+    return e->Heap;
+}
+
+static RoutingHeapPtr
+routing_backward (RoutingNodesPtr e)
+{
+/* returns the Backward heap, allocating the Backward status if required */
+    if (e->Backward == NULL)
+      {
+	  e->Backward = routing_nodes_alloc (e->Dim);
+	  e->BackwardHeap = routing_heap_init (e->Dim, 0);
+      }
+    return e->BackwardHeap;
+}
+
+static RoutingNodePtr
+routing_status (RoutingNodesPtr e, RoutingNodePtr states, int node)
+{
+/* returns the search status of some Node, lazily resetting a stale one */
+    RoutingNodePtr n = states + node;
+    if (n->Epoch != e->Epoch)
+      {
+	  routing_reset_node (n);
+	  n->Epoch = e->Epoch;
+      }
+    return n;
+}
+
+static double
+routing_arc_cost (RoutingNodesPtr e, NetworkArcPtr arc)
+{
+/* returns the actual cost of some Arc [possibly overridden] */
+    if (e->Costs)
+	return e->Costs[arc - e->Graph->Arcs];
+    return arc->Cost;
+}
+
+static RoutingNodesPtr
+routing_acquire (SharedNetworkPtr p)
+{
+/* taking an unused search status from the Pool [or creating a new one] */
+    RoutingNodesPtr e;
+    sqlite3_mutex_enter (p->Mutex);
+    e = p->Pool;
+    if (e)
+	p->Pool = e->Next;
+    sqlite3_mutex_leave (p->Mutex);
+    if (e == NULL)
+	e = routing_init (p->Graph);
+    e->Next = NULL;
+    return e;
 }
 
 static void
-routing_heap_free (RoutingHeapPtr h)
+routing_release (SharedNetworkPtr p, RoutingNodesPtr e)
 {
-/* freeing the Nodes ordered list */
-    free (h->Values);
-    free (h);
+/* returning a search status to the Pool */
+    sqlite3_mutex_enter (p->Mutex);
+    e->Next = p->Pool;
+    p->Pool = e;
+    sqlite3_mutex_leave (p->Mutex);
+}
+
+static RoutingNodesPtr
+vnet_routing_acquire (VirtualNetworkPtr net)
+{
+/* taking a search status, using the current Arc costs of this connection */
+    RoutingNodesPtr e = routing_acquire (net->shared);
+    e->Costs = NULL;
+    e->HeuristicCoeff = net->graph->AStarHeuristicCoeff;
+    if (net->overrides)
+      {
+	  e->Costs = net->overrides->Costs;
+	  e->HeuristicCoeff = net->overrides->HeuristicCoeff;
+      }
+    return e;
+}
+
+static double
+routing_heap_key (RoutingHeapPtr h, RoutingNodePtr n)
+{
+/* returns the value the Nodes are ordered by */
+    if (h->AStar)
+	return n->HeuristicDistance;
+    return n->Distance;
+}
+
+static void
+routing_heap_up (RoutingHeapPtr h, int pos)
+{
+/* moving a Node towards the root until the heap is ordered again */
+    RoutingNodePtr n = h->Values[pos];
+    double key = routing_heap_key (h, n);
+    while (pos > 0)
+      {
+	  int parent = (pos - 1) / 2;
+	  RoutingNodePtr p = h->Values[parent];
+	  if (routing_heap_key (h, p) <= key)
+	      break;
+	  h->Values[pos] = p;
+	  p->HeapPos = pos;
+	  pos = parent;
+      }
+    h->Values[pos] = n;
+    n->HeapPos = pos;
+}
+
+static void
+routing_heap_down (RoutingHeapPtr h, int pos)
+{
+/* moving a Node towards the leaves until the heap is ordered again */
+    RoutingNodePtr n = h->Values[pos];
+    double key = routing_heap_key (h, n);
+    while (1)
+      {
+	  int child = (pos * 2) + 1;
+	  RoutingNodePtr c;
+	  if (child >= h->Count)
+	      break;
+	  if (child + 1 < h->Count
+	      && routing_heap_key (h,
+				   h->Values[child + 1]) <
+	      routing_heap_key (h, h->Values[child]))
+	      child++;
+	  c = h->Values[child];
+	  if (key <= routing_heap_key (h, c))
+	      break;
+	  h->Values[pos] = c;
+	  c->HeapPos = pos;
+	  pos = child;
+      }
+    h->Values[pos] = n;
+    n->HeapPos = pos;
 }
 
 static void
 routing_push (RoutingHeapPtr h, RoutingNodePtr n)
 {
-/* inserting a Node into the list */
-    h->Values[h->Tail] = n;
-    h->Tail++;
+/* inserting a Node into the queue */
+    h->Values[h->Count] = n;
+    h->Count++;
+    routing_heap_up (h, h->Count - 1);
+}
+
+static void
+routing_decrease_key (RoutingHeapPtr h, RoutingNodePtr n)
+{
+/* restoring the queue order after the Node's distance has been reduced */
+    routing_heap_up (h, n->HeapPos);
 }
 
 static RoutingNodePtr
-dijkstra_pop (RoutingHeapPtr h)
+routing_pop (RoutingHeapPtr h)
 {
 /* fetching the minimum value */
-    int i;
-    RoutingNodePtr n;
-    double min = DBL_MAX;
-    int i_min = h->Head;
-    for (i = h->Head; i < h->Tail; i++)
-      {
-	  n = h->Values[i];
-	  if (n->Distance < min)
-	    {
-		min = n->Distance;
-		i_min = i;
-	    }
-      }
-    if (i_min > h->Head)
+    RoutingNodePtr n = h->Values[0];
+    h->Count--;
+    if (h->Count > 0)
       {
-	  n = h->Values[i_min];
-	  h->Values[i_min] = h->Values[h->Head];
-	  h->Values[h->Head] = n;
+	  h->Values[0] = h->Values[h->Count];
+	  routing_heap_down (h, 0);
       }
-    n = h->Values[h->Head];
-    h->Head++;
+    n->HeapPos = -1;
     return (n);
 }
 
@@ -364,63 +771,61 @@ dijkstra_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
     RoutingNodePtr n;
     RoutingNodePtr p_to;
     NetworkArcPtr p_link;
+    double cost;
+    NetworkNodePtr pN;
     int cnt;
     NetworkArcPtr *result;
     RoutingHeapPtr h;
 /* setting From/To */
     from = pfrom->InternalIndex;
     to = pto->InternalIndex;
-/* initializing the heap */
-    h = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->Arc = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-      }
+/* starting a new search: any Node status is lazily reset */
+    h = routing_begin (e, 0);
 /* pushes the From node into the Nodes list */
-    e->Nodes[from].Distance = 0.0;
-    routing_push (h, e->Nodes + from);
-    while (h->Tail != h->Head)
+    n = routing_status (e, e->Nodes, from);
+    n->Distance = 0.0;
+    routing_push (h, n);
+    while (h->Count > 0)
       {
 	  /* Dijsktra loop */
-	  n = dijkstra_pop (h);
+	  n = routing_pop (h);
 	  if (n->Id == to)
 	    {
 		/* destination reached */
 		break;
 	    }
 	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
+	  pN = e->Graph->Nodes + n->Id;
+	  p_link = e->Graph->Arcs + pN->FirstArc;
+	  for (i = 0; i < pN->NumArcs; i++, p_link++)
 	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
+		cost = routing_arc_cost (e, p_link);
+		if (cost == DBL_MAX)
+		    continue;	/* closed Arc */
+		p_to = routing_status (e, e->Nodes, p_link->NodeTo);
 		if (p_to->Inspected == 0)
 		  {
 		      if (p_to->Distance == DBL_MAX)
 			{
 			    /* inserting a new node into the list */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + cost;
 			    p_to->PreviousNode = n;
 			    p_to->Arc = p_link;
 			    routing_push (h, p_to);
 			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
+		      else if (p_to->Distance > n->Distance + cost)
 			{
 			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + cost;
 			    p_to->PreviousNode = n;
 			    p_to->Arc = p_link;
+			    routing_decrease_key (h, p_to);
 			}
 		  }
 	    }
       }
-    routing_heap_free (h);
     cnt = 0;
-    n = e->Nodes + to;
+    n = routing_status (e, e->Nodes, to);
     while (n->PreviousNode != NULL)
       {
 	  /* counting how many Arcs are into the Shortest Path solution */
@@ -430,7 +835,7 @@ dijkstra_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
 /* allocating the solution */
     result = malloc (sizeof (NetworkArcPtr) * cnt);
     k = cnt - 1;
-    n = e->Nodes + to;
+    n = routing_status (e, e->Nodes, to);
     while (n->PreviousNode != NULL)
       {
 	  /* inserting an Arc  into the solution */
@@ -450,34 +855,6 @@ dijkstra_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
 /
 */
 
-static RoutingNodePtr
-a_star_pop (RoutingHeapPtr h)
-{
-/* fetching the minimum value */
-    int i;
-    RoutingNodePtr n;
-    double min = DBL_MAX;
-    int i_min = h->Head;
-    for (i = h->Head; i < h->Tail; i++)
-      {
-	  n = h->Values[i];
-	  if (n->HeuristicDistance < min)
-	    {
-		min = n->HeuristicDistance;
-		i_min = i;
-	    }
-      }
-    if (i_min > h->Head)
-      {
-	  n = h->Values[i_min];
-	  h->Values[i_min] = h->Values[h->Head];
-	  h->Values[h->Head] = n;
-      }
-    n = h->Values[h->Head];
-    h->Head++;
-    return (n);
-}
-
 static double
 a_star_heuristic_distance (NetworkNodePtr n1, NetworkNodePtr n2, double coeff)
 {
@@ -498,59 +875,53 @@ a_star_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
     int to;
     int i;
     int k;
-    RoutingNodePtr pAux;
     RoutingNodePtr n;
     RoutingNodePtr p_to;
     NetworkNodePtr pOrg;
     NetworkNodePtr pDest;
     NetworkArcPtr p_link;
+    double cost;
+    NetworkNodePtr pN;
     int cnt;
     NetworkArcPtr *result;
     RoutingHeapPtr h;
 /* setting From/To */
     from = pfrom->InternalIndex;
     to = pto->InternalIndex;
-    pAux = e->Nodes + from;
-    pOrg = nodes + pAux->Id;
-    pAux = e->Nodes + to;
-    pDest = nodes + pAux->Id;
-/* initializing the heap */
-    h = routing_heap_init (e->DimLink);
-/* initializing the graph */
-    for (i = 0; i < e->Dim; i++)
-      {
-	  n = e->Nodes + i;
-	  n->PreviousNode = NULL;
-	  n->Arc = NULL;
-	  n->Inspected = 0;
-	  n->Distance = DBL_MAX;
-	  n->HeuristicDistance = DBL_MAX;
-      }
+    pOrg = nodes + from;
+    pDest = nodes + to;
+/* starting a new search: any Node status is lazily reset */
+    h = routing_begin (e, 1);
 /* pushes the From node into the Nodes list */
-    e->Nodes[from].Distance = 0.0;
-    e->Nodes[from].HeuristicDistance =
+    n = routing_status (e, e->Nodes, from);
+    n->Distance = 0.0;
+    n->HeuristicDistance =
 	a_star_heuristic_distance (pOrg, pDest, heuristic_coeff);
-    routing_push (h, e->Nodes + from);
-    while (h->Tail != h->Head)
+    routing_push (h, n);
+    while (h->Count > 0)
       {
 	  /* A* loop */
-	  n = a_star_pop (h);
+	  n = routing_pop (h);
 	  if (n->Id == to)
 	    {
 		/* destination reached */
 		break;
 	    }
 	  n->Inspected = 1;
-	  for (i = 0; i < n->DimTo; i++)
+	  pN = e->Graph->Nodes + n->Id;
+	  p_link = e->Graph->Arcs + pN->FirstArc;
+	  for (i = 0; i < pN->NumArcs; i++, p_link++)
 	    {
-		p_to = *(n->To + i);
-		p_link = *(n->Link + i);
+		cost = routing_arc_cost (e, p_link);
+		if (cost == DBL_MAX)
+		    continue;	/* closed Arc */
+		p_to = routing_status (e, e->Nodes, p_link->NodeTo);
 		if (p_to->Inspected == 0)
 		  {
 		      if (p_to->Distance == DBL_MAX)
 			{
 			    /* inserting a new node into the list */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + cost;
 			    pOrg = nodes + p_to->Id;
 			    p_to->HeuristicDistance =
 				p_to->Distance +
@@ -560,10 +931,10 @@ a_star_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
 			    p_to->Arc = p_link;
 			    routing_push (h, p_to);
 			}
-		      else if (p_to->Distance > n->Distance + p_link->Cost)
+		      else if (p_to->Distance > n->Distance + cost)
 			{
 			    /* updating an already inserted node */
-			    p_to->Distance = n->Distance + p_link->Cost;
+			    p_to->Distance = n->Distance + cost;
 			    pOrg = nodes + p_to->Id;
 			    p_to->HeuristicDistance =
 				p_to->Distance +
@@ -571,13 +942,13 @@ a_star_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
 							   heuristic_coeff);
 			    p_to->PreviousNode = n;
 			    p_to->Arc = p_link;
+			    routing_decrease_key (h, p_to);
 			}
 		  }
 	    }
       }
-    routing_heap_free (h);
     cnt = 0;
-    n = e->Nodes + to;
+    n = routing_status (e, e->Nodes, to);
     while (n->PreviousNode != NULL)
       {
 	  /* counting how many Arcs are into the Shortest Path solution */
@@ -587,7 +958,7 @@ a_star_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
 /* allocating the solution */
     result = malloc (sizeof (NetworkArcPtr) * cnt);
     k = cnt - 1;
-    n = e->Nodes + to;
+    n = routing_status (e, e->Nodes, to);
     while (n->PreviousNode != NULL)
       {
 	  /* inserting an Arc  into the solution */
@@ -601,1010 +972,4069 @@ a_star_shortest_path (RoutingNodesPtr e, NetworkNodePtr nodes,
 
 /* END of A* Shortest Path implementation */
 
-static int
-cmp_nodes_code (const void *p1, const void *p2)
-{
-/* compares two nodes  by CODE [for BSEARCH] */
-    NetworkNodePtr pN1 = (NetworkNodePtr) p1;
-    NetworkNodePtr pN2 = (NetworkNodePtr) p2;
-    return strcmp (pN1->Code, pN2->Code);
-}
-
-static int
-cmp_nodes_id (const void *p1, const void *p2)
-{
-/* compares two nodes  by ID [for BSEARCH] */
-    NetworkNodePtr pN1 = (NetworkNodePtr) p1;
-    NetworkNodePtr pN2 = (NetworkNodePtr) p2;
-    if (pN1->Id == pN2->Id)
-	return 0;
-    if (pN1->Id > pN2->Id)
-	return 1;
-    return -1;
-}
+/*
+/
+/  implementation of the bidirectional Dijkstra / A* Shortest Path algorithms
+/
+*/
 
-static NetworkNodePtr
-find_node_by_code (NetworkPtr graph, const char *code)
+static double
+bidirectional_potential (NetworkNodePtr nodes, int node, int from, int to,
+			 int a_star, double coeff)
 {
-/* searching a Node (by Code) into the sorted list */
-    NetworkNodePtr ret;
-    NetworkNode pN;
-    pN.Code = (char *) code;
-    ret =
-	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (NetworkNode),
-		 cmp_nodes_code);
-    return ret;
+/*
+/ the A* forward potential of some Node: (h(Node,To) - h(From,Node)) / 2
+/ the backward potential is simply its opposite, so that both searches
+/ share the same reduced costs [always zero for plain Dijkstra]
+*/
+    if (!a_star)
+	return 0.0;
+    return (a_star_heuristic_distance (nodes + node, nodes + to, coeff) -
+	    a_star_heuristic_distance (nodes + from, nodes + node,
+				       coeff)) / 2.0;
 }
 
-static NetworkNodePtr
-find_node_by_id (NetworkPtr graph, const sqlite3_int64 id)
+static NetworkArcPtr *
+bidirectional_shortest_path (RoutingNodesPtr e, NetworkNodePtr pfrom,
+			     NetworkNodePtr pto, int a_star,
+			     double heuristic_coeff, int *ll)
 {
-/* searching a Node (by Id) into the sorted list */
-    NetworkNodePtr ret;
-    NetworkNode pN;
-    pN.Id = id;
-    ret =
-	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (NetworkNode),
-		 cmp_nodes_id);
-    return ret;
-}
-
-static void
-delete_solution (SolutionPtr solution)
-{
-/* deleting the current solution */
-    ArcSolutionPtr pA;
-    ArcSolutionPtr pAn;
-    RowSolutionPtr pR;
-    RowSolutionPtr pRn;
-    if (!solution)
-	return;
-    pA = solution->FirstArc;
-    while (pA)
-      {
-	  pAn = pA->Next;
-	  if (pA->FromCode)
-	      free (pA->FromCode);
-	  if (pA->ToCode)
-	      free (pA->ToCode);
-	  if (pA->Coords)
-	      free (pA->Coords);
-	  if (pA->Name)
-	      free (pA->Name);
-	  free (pA);
-	  pA = pAn;
+/*
+/ identifying the Shortest Path - bidirectional Dijkstra / A* algorithm
+/
+/ a forward search from From [following the outcoming Arcs] and a
+/ backward search from To [following the incoming Arcs] are run at
+/ the same time, always expanding the frontier having the smallest key;
+/ the search stops as soon as the sum of both smallest keys reaches the
+/ cost of the best path found so far
+*/
+    int from;
+    int to;
+    int i;
+    int k;
+    int node;
+    int forward;
+    int meet = -1;
+    int cnt;
+    double best = DBL_MAX;
+    double key_fwd;
+    double key_bwd;
+    double dist;
+    double potential;
+    NetworkPtr graph = e->Graph;
+    NetworkArcPtr p_link;
+    NetworkNodePtr pN;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    RoutingNodePtr other;
+    RoutingNodePtr states;
+    RoutingNodePtr others;
+    RoutingHeapPtr h;
+    RoutingHeapPtr h_fwd;
+    RoutingHeapPtr h_bwd;
+    NetworkArcPtr *result;
+/* setting From/To */
+    from = pfrom->InternalIndex;
+    to = pto->InternalIndex;
+/* starting a new search: any Node status is lazily reset */
+    h_bwd = routing_backward (e);
+    h_fwd = routing_begin (e, a_star);
+    h_bwd->AStar = a_star;
+/* pushes the From node into the Forward list and the To node into the Backward list */
+    n = routing_status (e, e->Nodes, from);
+    n->Distance = 0.0;
+    n->HeuristicDistance =
+	bidirectional_potential (graph->Nodes, from, from, to, a_star,
+				 heuristic_coeff);
+    routing_push (h_fwd, n);
+    n = routing_status (e, e->Backward, to);
+    n->Distance = 0.0;
+    n->HeuristicDistance =
+	-bidirectional_potential (graph->Nodes, to, from, to, a_star,
+				  heuristic_coeff);
+    routing_push (h_bwd, n);
+    if (from == to)
+      {
+	  best = 0.0;
+	  meet = from;
       }
-    pR = solution->First;
-    while (pR)
+    while (h_fwd->Count > 0 && h_bwd->Count > 0)
       {
-	  pRn = pR->Next;
-	  if (pR->Name)
-	      free (pR->Name);
-	  free (pR);
-	  pR = pRn;
+	  /* bidirectional loop: always expanding the closest frontier */
+	  key_fwd = routing_heap_key (h_fwd, h_fwd->Values[0]);
+	  key_bwd = routing_heap_key (h_bwd, h_bwd->Values[0]);
+	  if (best != DBL_MAX && key_fwd + key_bwd >= best)
+	    {
+		/* no shorter path can be found */
+		break;
+	    }
+	  forward = (key_fwd <= key_bwd) ? 1 : 0;
+	  h = (forward) ? h_fwd : h_bwd;
+	  states = (forward) ? e->Nodes : e->Backward;
+	  others = (forward) ? e->Backward : e->Nodes;
+	  n = routing_pop (h);
+	  n->Inspected = 1;
+	  pN = graph->Nodes + n->Id;
+	  k = (forward) ? pN->NumArcs : graph->InIndex[n->Id + 1] -
+	      graph->InIndex[n->Id];
+	  for (i = 0; i < k; i++)
+	    {
+		if (forward)
+		  {
+		      p_link = graph->Arcs + pN->FirstArc + i;
+		      node = p_link->NodeTo;
+		  }
+		else
+		  {
+		      p_link =
+			  graph->Arcs + graph->InArcs[graph->InIndex[n->Id] +
+						      i];
+		      node = p_link->NodeFrom;
+		  }
+		dist = routing_arc_cost (e, p_link);
+		if (dist == DBL_MAX)
+		    continue;	/* closed Arc */
+		p_to = routing_status (e, states, node);
+		if (p_to->Inspected)
+		    continue;
+		dist += n->Distance;
+		if (p_to->Distance != DBL_MAX && p_to->Distance <= dist)
+		    continue;
+		potential =
+		    bidirectional_potential (graph->Nodes, node, from, to,
+					     a_star, heuristic_coeff);
+		p_to->HeuristicDistance =
+		    dist + ((forward) ? potential : -potential);
+		p_to->PreviousNode = n;
+		p_to->Arc = p_link;
+		if (p_to->Distance == DBL_MAX)
+		  {
+		      /* inserting a new node into the list */
+		      p_to->Distance = dist;
+		      routing_push (h, p_to);
+		  }
+		else
+		  {
+		      /* updating an already inserted node */
+		      p_to->Distance = dist;
+		      routing_decrease_key (h, p_to);
+		  }
+		other = routing_status (e, others, node);
+		if (other->Distance != DBL_MAX
+		    && p_to->Distance + other->Distance < best)
+		  {
+		      /* the two searches met each other */
+		      best = p_to->Distance + other->Distance;
+		      meet = node;
+		  }
+	    }
       }
-    if (solution->Geometry)
-	gaiaFreeGeomColl (solution->Geometry);
-    free (solution);
-}
-
-static void
-reset_solution (SolutionPtr solution)
-{
-/* resetting the current solution */
-    ArcSolutionPtr pA;
-    ArcSolutionPtr pAn;
-    RowSolutionPtr pR;
-    RowSolutionPtr pRn;
-    if (!solution)
-	return;
-    pA = solution->FirstArc;
-    while (pA)
-      {
-	  pAn = pA->Next;
-	  if (pA->FromCode)
-	      free (pA->FromCode);
-	  if (pA->ToCode)
-	      free (pA->ToCode);
-	  if (pA->Coords)
-	      free (pA->Coords);
-	  free (pA);
-	  pA = pAn;
+    cnt = 0;
+    if (meet < 0 || from == to)
+      {
+	  /* no path at all, or an empty one */
+	  *ll = 0;
+	  return malloc (sizeof (NetworkArcPtr));
       }
-    pR = solution->First;
-    while (pR)
+    n = routing_status (e, e->Nodes, meet);
+    while (n->PreviousNode != NULL)
       {
-	  pRn = pR->Next;
-	  if (pR->Name)
-	      free (pR->Name);
-	  free (pR);
-	  pR = pRn;
+	  /* counting the Arcs From -> meeting Node */
+	  cnt++;
+	  n = n->PreviousNode;
       }
-    if (solution->Geometry)
-	gaiaFreeGeomColl (solution->Geometry);
-    solution->FirstArc = NULL;
-    solution->LastArc = NULL;
-    solution->From = NULL;
-    solution->To = NULL;
-    solution->First = NULL;
-    solution->Last = NULL;
-    solution->CurrentRow = NULL;
-    solution->CurrentRowId = 0;
-    solution->TotalCost = 0.0;
-    solution->Geometry = NULL;
+    k = cnt;
+    n = routing_status (e, e->Backward, meet);
+    while (n->PreviousNode != NULL)
+      {
+	  /* counting the Arcs meeting Node -> To */
+	  cnt++;
+	  n = n->PreviousNode;
+      }
+/* allocating the solution */
+    result = malloc (sizeof (NetworkArcPtr) * cnt);
+    n = routing_status (e, e->Nodes, meet);
+    i = k - 1;
+    while (n->PreviousNode != NULL)
+      {
+	  /* inserting the Forward Arcs [in reverse order] */
+	  result[i--] = n->Arc;
+	  n = n->PreviousNode;
+      }
+    n = routing_status (e, e->Backward, meet);
+    i = k;
+    while (n->PreviousNode != NULL)
+      {
+	  /* inserting the Backward Arcs */
+	  result[i++] = n->Arc;
+	  n = n->PreviousNode;
+      }
+    *ll = cnt;
+    return (result);
 }
 
-static SolutionPtr
-alloc_solution (void)
+/* END of bidirectional Shortest Path implementation */
+
+/*
+/
+/  implementation of the Contraction Hierarchies Shortest Path algorithm
+/
+*/
+
+static NetworkArcPtr *
+network_arcs_index (NetworkPtr graph, int *count)
 {
-/* allocates and initializes the current solution */
-    SolutionPtr p = malloc (sizeof (Solution));
-    p->FirstArc = NULL;
-    p->LastArc = NULL;
-    p->From = NULL;
-    p->To = NULL;
-    p->First = NULL;
-    p->Last = NULL;
-    p->CurrentRow = NULL;
-    p->CurrentRowId = 0;
-    p->TotalCost = 0.0;
-    p->Geometry = NULL;
-    return p;
+/*
+/ returns an array referencing any Arc of the NETWORK
+/ Arcs are sorted by Node internal index, then by their position
+/ within the Node; such order uniquely identifies each Arc
+*/
+    int i;
+    NetworkArcPtr *arcs;
+    arcs = malloc (sizeof (NetworkArcPtr) * (graph->NumArcs + 1));
+    for (i = 0; i < graph->NumArcs; i++)
+	arcs[i] = graph->Arcs + i;
+    *count = graph->NumArcs;
+    return arcs;
 }
 
-static void
-add_arc_to_solution (SolutionPtr solution, NetworkArcPtr arc)
+static double
+network_arcs_checksum (NetworkArcPtr * arcs, int count)
 {
-/* inserts an Arc into the Shortest Path solution */
-    RowSolutionPtr p = malloc (sizeof (RowSolution));
-    p->Arc = arc;
-    p->Name = NULL;
-    p->Next = NULL;
-    solution->TotalCost += arc->Cost;
-    if (!(solution->First))
-	solution->First = p;
-    if (solution->Last)
-	solution->Last->Next = p;
-    solution->Last = p;
+/* computing a checksum allowing to detect a no longer matching Hierarchy */
+    int i;
+    double sum = 0.0;
+    for (i = 0; i < count; i++)
+	sum += arcs[i]->Cost * (double) ((i % 7) + 1);
+    return sum;
+}
+
+static int
+hierarchy_edge_from (NetworkHierarchyPtr ch, int edge)
+{
+/* returns the internal index of the Node an edge starts from */
+    if (edge < ch->NumArcs)
+	return ch->Arcs[edge]->NodeFrom;
+    return ch->Shortcuts[edge - ch->NumArcs].NodeFrom;
+}
+
+static int
+hierarchy_edge_to (NetworkHierarchyPtr ch, int edge)
+{
+/* returns the internal index of the Node an edge ends to */
+    if (edge < ch->NumArcs)
+	return ch->Arcs[edge]->NodeTo;
+    return ch->Shortcuts[edge - ch->NumArcs].NodeTo;
+}
+
+static double
+hierarchy_edge_cost (NetworkHierarchyPtr ch, int edge)
+{
+/* returns the cost of some edge */
+    if (edge < ch->NumArcs)
+	return ch->Arcs[edge]->Cost;
+    return ch->Shortcuts[edge - ch->NumArcs].Cost;
 }
 
 static void
-add_arc_geometry_to_solution (SolutionPtr solution, sqlite3_int64 arc_id,
-			      const char *from_code, const char *to_code,
-			      sqlite3_int64 from_id, sqlite3_int64 to_id,
-			      int points, double *coords, int srid,
-			      const char *name)
+hierarchy_free (NetworkHierarchyPtr ch)
 {
-/* inserts an Arc Geometry into the Shortest Path solution */
-    int len;
-    ArcSolutionPtr p = malloc (sizeof (ArcSolution));
-    p->ArcRowid = arc_id;
-    p->FromCode = NULL;
-    len = strlen (from_code);
-    if (len > 0)
+/* memory cleanup; freeing a Contraction Hierarchy */
+    if (!ch)
+	return;
+    if (ch->Rank)
+	free (ch->Rank);
+    if (ch->Arcs)
+	free (ch->Arcs);
+    if (ch->Shortcuts)
+	free (ch->Shortcuts);
+    if (ch->UpIndex)
+	free (ch->UpIndex);
+    if (ch->UpEdges)
+	free (ch->UpEdges);
+    if (ch->DownIndex)
+	free (ch->DownIndex);
+    if (ch->DownEdges)
+	free (ch->DownEdges);
+    free (ch);
+}
+
+static int
+hierarchy_prepare (NetworkHierarchyPtr ch)
+{
+/* building the upward adjacency lists */
+    int i;
+    int e;
+    int from;
+    int to;
+    int *up;
+    int *down;
+    int num_edges = ch->NumArcs + ch->NumShortcuts;
+    ch->UpIndex = calloc (ch->NumNodes + 1, sizeof (int));
+    ch->DownIndex = calloc (ch->NumNodes + 1, sizeof (int));
+    ch->UpEdges = malloc (sizeof (int) * (num_edges + 1));
+    ch->DownEdges = malloc (sizeof (int) * (num_edges + 1));
+    if (ch->UpIndex == NULL || ch->DownIndex == NULL || ch->UpEdges == NULL
+	|| ch->DownEdges == NULL)
+	return 0;
+/* counting how many edges are leaving/entering each node */
+    for (e = 0; e < num_edges; e++)
       {
-	  p->FromCode = malloc (len + 1);
-	  strcpy (p->FromCode, from_code);
+	  from = hierarchy_edge_from (ch, e);
+	  to = hierarchy_edge_to (ch, e);
+	  if (from == to)
+	      continue;
+	  if (ch->Rank[to] > ch->Rank[from])
+	      ch->UpIndex[from + 1] += 1;
+	  else
+	      ch->DownIndex[to + 1] += 1;
       }
-    p->ToCode = NULL;
-    len = strlen (to_code);
-    if (len > 0)
+    for (i = 0; i < ch->NumNodes; i++)
       {
-	  p->ToCode = malloc (len + 1);
-	  strcpy (p->ToCode, to_code);
+	  ch->UpIndex[i + 1] += ch->UpIndex[i];
+	  ch->DownIndex[i + 1] += ch->DownIndex[i];
       }
-    p->FromId = from_id;
-    p->ToId = to_id;
-    p->Points = points;
-    p->Coords = coords;
-    p->Srid = srid;
-    if (name == NULL)
-	p->Name = NULL;
-    else
+/* filling the adjacency lists */
+    up = malloc (sizeof (int) * ch->NumNodes);
+    down = malloc (sizeof (int) * ch->NumNodes);
+    for (i = 0; i < ch->NumNodes; i++)
       {
-	  len = strlen (name);
-	  p->Name = malloc (len + 1);
-	  strcpy (p->Name, name);
+	  up[i] = ch->UpIndex[i];
+	  down[i] = ch->DownIndex[i];
       }
-    p->Next = NULL;
-    if (!(solution->FirstArc))
-	solution->FirstArc = p;
-    if (solution->LastArc)
-	solution->LastArc->Next = p;
-    solution->LastArc = p;
+    for (e = 0; e < num_edges; e++)
+      {
+	  from = hierarchy_edge_from (ch, e);
+	  to = hierarchy_edge_to (ch, e);
+	  if (from == to)
+	      continue;
+	  if (ch->Rank[to] > ch->Rank[from])
+	      ch->UpEdges[up[from]++] = e;
+	  else
+	      ch->DownEdges[down[to]++] = e;
+      }
+    free (up);
+    free (down);
+    return 1;
 }
 
-static void
-build_solution (sqlite3 * handle, NetworkPtr graph, SolutionPtr solution,
-		NetworkArcPtr * shortest_path, int cnt)
+static int
+hierarchy_unpack (NetworkHierarchyPtr ch, int *path, int count,
+		  NetworkArcPtr ** arcs)
 {
-/* formatting the Shortest Path solution */
+/* expanding a sequence of edges into the corresponding original Arcs */
+    int *stack;
+    int depth = 0;
+    int max_depth = 64;
+    int cnt = 0;
+    int max = count + 16;
     int i;
-    char *sql;
-    int err;
-    int error = 0;
-    int ret;
-    sqlite3_int64 arc_id;
-    const unsigned char *blob;
-    int size;
-    sqlite3_int64 from_id;
-    sqlite3_int64 to_id;
-    char *from_code;
-    char *to_code;
-    char *name;
-    int tbd;
-    int ind;
-    int base = 0;
-    int block = 128;
-    int how_many;
-    sqlite3_stmt *stmt;
-    char *xfrom;
-    char *xto;
-    char *xgeom;
-    char *xname;
-    char *xtable;
-    gaiaOutBuffer sql_statement;
-    if (cnt > 0)
+    int e;
+    HierarchyShortcutPtr sc;
+    NetworkArcPtr *result = malloc (sizeof (NetworkArcPtr) * max);
+    stack = malloc (sizeof (int) * max_depth);
+    for (i = count - 1; i >= 0; i--)
       {
-	  /* building the solution */
-	  for (i = 0; i < cnt; i++)
+	  /* pushing the edges in reverse order */
+	  if (depth == max_depth)
 	    {
-		add_arc_to_solution (solution, shortest_path[i]);
+		max_depth *= 2;
+		stack = realloc (stack, sizeof (int) * max_depth);
 	    }
+	  stack[depth++] = path[i];
       }
-    tbd = cnt;
-    while (tbd > 0)
+    while (depth > 0)
       {
-	  /* requesting max 128 arcs at each time */
-	  if (tbd < block)
-	      how_many = tbd;
-	  else
-	      how_many = block;
-/* preparing the Geometry representing this solution [reading arcs] */
-	  gaiaOutBufferInitialize (&sql_statement);
-	  if (graph->NameColumn)
+	  e = stack[--depth];
+	  if (e < ch->NumArcs)
 	    {
-		/* a Name column is defined */
-		xfrom = gaiaDoubleQuotedSql (graph->FromColumn);
-		xto = gaiaDoubleQuotedSql (graph->ToColumn);
-		xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-		xname = gaiaDoubleQuotedSql (graph->NameColumn);
-		xtable = gaiaDoubleQuotedSql (graph->TableName);
-		sql =
-		    sqlite3_mprintf
-		    ("SELECT ROWID, \"%s\", \"%s\", \"%s\", \"%s\" FROM \"%s\" WHERE ROWID IN (",
-		     xfrom, xto, xgeom, xname, xtable);
-		free (xfrom);
-		free (xto);
-		free (xgeom);
-		free (xname);
-		free (xtable);
-		gaiaAppendToOutBuffer (&sql_statement, sql);
-		sqlite3_free (sql);
+		/* an original Arc */
+		if (cnt == max)
+		  {
+		      max *= 2;
+		      result = realloc (result, sizeof (NetworkArcPtr) * max);
+		  }
+		result[cnt++] = ch->Arcs[e];
+		continue;
 	    }
-	  else
+	  /* a Shortcut: replacing it by the two edges it stands for */
+	  sc = ch->Shortcuts + (e - ch->NumArcs);
+	  if (depth + 2 > max_depth)
 	    {
-		/* no Name column is defined */
-		xfrom = gaiaDoubleQuotedSql (graph->FromColumn);
-		xto = gaiaDoubleQuotedSql (graph->ToColumn);
-		xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
-		xtable = gaiaDoubleQuotedSql (graph->TableName);
-		sql =
-		    sqlite3_mprintf
-		    ("SELECT ROWID, \"%s\", \"%s\", \"%s\" FROM \"%s\" WHERE ROWID IN (",
-		     xfrom, xto, xgeom, xtable);
-		free (xfrom);
-		free (xto);
-		free (xgeom);
-		free (xtable);
-		gaiaAppendToOutBuffer (&sql_statement, sql);
-		sqlite3_free (sql);
+		max_depth *= 2;
+		stack = realloc (stack, sizeof (int) * max_depth);
 	    }
-	  for (i = 0; i < how_many; i++)
+	  stack[depth++] = sc->Second;
+	  stack[depth++] = sc->First;
+      }
+    free (stack);
+    *arcs = result;
+    return cnt;
+}
+
+static NetworkArcPtr *
+ch_shortest_path (NetworkHierarchyPtr ch, RoutingNodesPtr rt,
+		  NetworkNodePtr pfrom, NetworkNodePtr pto, int *ll)
+{
+/* identifying the Shortest Path - Contraction Hierarchies bidirectional upward search */
+    int from;
+    int to;
+    int i;
+    int k;
+    int forward;
+    int node;
+    int e;
+    int meet = -1;
+    double best = DBL_MAX;
+    double key_fwd;
+    double key_bwd;
+    double dist;
+    int cnt;
+    int *path;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    RoutingNodePtr states;
+    RoutingNodePtr others;
+    RoutingNodePtr other;
+    RoutingHeapPtr h;
+    RoutingHeapPtr h_fwd;
+    RoutingHeapPtr h_bwd;
+    int *edges;
+    int *index;
+    NetworkArcPtr *result = NULL;
+/* setting From/To */
+    from = pfrom->InternalIndex;
+    to = pto->InternalIndex;
+/* starting a new search: any Node status is lazily reset */
+    h_bwd = routing_backward (rt);
+    h_fwd = routing_begin (rt, 0);
+/* pushes the From node into the Forward list and the To node into the Backward list */
+    n = routing_status (rt, rt->Nodes, from);
+    n->Distance = 0.0;
+    routing_push (h_fwd, n);
+    n = routing_status (rt, rt->Backward, to);
+    n->Distance = 0.0;
+    routing_push (h_bwd, n);
+    while (1)
+      {
+	  /* bidirectional loop: always expanding the closest frontier */
+	  key_fwd = DBL_MAX;
+	  key_bwd = DBL_MAX;
+	  if (h_fwd->Count > 0)
+	      key_fwd = h_fwd->Values[0]->Distance;
+	  if (h_bwd->Count > 0)
+	      key_bwd = h_bwd->Values[0]->Distance;
+	  if (key_fwd >= best && key_bwd >= best)
 	    {
-		if (i == 0)
-		    gaiaAppendToOutBuffer (&sql_statement, "?");
-		else
-		    gaiaAppendToOutBuffer (&sql_statement, ",?");
+		/* no shorter path can be found */
+		break;
+	    }
+	  forward = (key_fwd <= key_bwd) ? 1 : 0;
+	  if (forward)
+	    {
+		h = h_fwd;
+		states = rt->Nodes;
+		others = rt->Backward;
+		index = ch->UpIndex;
+		edges = ch->UpEdges;
 	    }
-	  gaiaAppendToOutBuffer (&sql_statement, ")");
-	  if (sql_statement.Error == 0 && sql_statement.Buffer != NULL)
-	      ret =
-		  sqlite3_prepare_v2 (handle, sql_statement.Buffer,
-				      strlen (sql_statement.Buffer), &stmt,
-				      NULL);
 	  else
-	      ret = SQLITE_ERROR;
-	  gaiaOutBufferReset (&sql_statement);
-	  if (ret != SQLITE_OK)
 	    {
-		error = 1;
-		goto abort;
+		h = h_bwd;
+		states = rt->Backward;
+		others = rt->Nodes;
+		index = ch->DownIndex;
+		edges = ch->DownEdges;
 	    }
-	  sqlite3_reset (stmt);
-	  sqlite3_clear_bindings (stmt);
-	  ind = 1;
-	  for (i = 0; i < cnt; i++)
+	  n = routing_pop (h);
+	  n->Inspected = 1;
+	  node = n->Id;
+	  other = routing_status (rt, others, node);
+	  if (other->Distance != DBL_MAX && n->Distance + other->Distance < best)
+	    {
+		/* the two searches met each other */
+		best = n->Distance + other->Distance;
+		meet = node;
+	    }
+	  for (i = index[node]; i < index[node + 1]; i++)
 	    {
-		if (i < base)
+		e = edges[i];
+		if (forward)
+		    p_to = routing_status (rt, states, hierarchy_edge_to (ch, e));
+		else
+		    p_to =
+			routing_status (rt, states, hierarchy_edge_from (ch, e));
+		if (p_to->Inspected)
 		    continue;
-		if (i >= (base + how_many))
-		    break;
-		sqlite3_bind_int64 (stmt, ind, shortest_path[i]->ArcRowid);
-		ind++;
+		dist = n->Distance + hierarchy_edge_cost (ch, e);
+		if (p_to->Distance == DBL_MAX)
+		  {
+		      /* inserting a new node into the list */
+		      p_to->Distance = dist;
+		      p_to->Edge = e;
+		      routing_push (h, p_to);
+		  }
+		else if (p_to->Distance > dist)
+		  {
+		      /* updating an already inserted node */
+		      p_to->Distance = dist;
+		      p_to->Edge = e;
+		      routing_decrease_key (h, p_to);
+		  }
 	    }
-	  while (1)
+      }
+    cnt = 0;
+    if (meet >= 0 && from != to)
+      {
+	  /* collecting the edges: From -> meeting node -> To */
+	  node = meet;
+	  while (node != from)
 	    {
-		ret = sqlite3_step (stmt);
-		if (ret == SQLITE_DONE)
-		    break;
-		if (ret == SQLITE_ROW)
+		cnt++;
+		node = hierarchy_edge_from (ch, rt->Nodes[node].Edge);
+	    }
+	  node = meet;
+	  while (node != to)
+	    {
+		cnt++;
+		node = hierarchy_edge_to (ch, rt->Backward[node].Edge);
+	    }
+	  path = malloc (sizeof (int) * cnt);
+	  node = meet;
+	  k = 0;
+	  while (node != from)
+	    {
+		k++;
+		path[k - 1] = rt->Nodes[node].Edge;
+		node = hierarchy_edge_from (ch, rt->Nodes[node].Edge);
+	    }
+	  for (i = 0; i < k / 2; i++)
+	    {
+		/* reversing the Forward half */
+		e = path[i];
+		path[i] = path[k - 1 - i];
+		path[k - 1 - i] = e;
+	    }
+	  node = meet;
+	  while (node != to)
+	    {
+		path[k++] = rt->Backward[node].Edge;
+		node = hierarchy_edge_to (ch, rt->Backward[node].Edge);
+	    }
+	  cnt = hierarchy_unpack (ch, path, cnt, &result);
+	  free (path);
+      }
+    else
+	result = malloc (sizeof (NetworkArcPtr));
+    *ll = cnt;
+    return (result);
+}
+
+/* END of Contraction Hierarchies Shortest Path implementation */
+
+/*
+/
+/  implementation of One-to-Many / Many-to-Many cost matrices
+/
+*/
+
+static void
+dijkstra_one_to_many (RoutingNodesPtr e, NetworkNodePtr pfrom,
+		      NetworkNodePtr * targets, int num_targets, double *costs)
+{
+/*
+/ computing the costs from a single origin to many destinations;
+/ a single Dijkstra expansion is shared by all destinations, and
+/ stops as soon as every destination has been settled
+*/
+    int i;
+    int remaining = 0;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    NetworkArcPtr p_link;
+    double cost;
+    NetworkNodePtr pN;
+    RoutingHeapPtr h;
+    char *wanted;
+/* marking the destinations */
+    wanted = calloc (e->Dim, sizeof (char));
+    for (i = 0; i < num_targets; i++)
+      {
+	  if (wanted[targets[i]->InternalIndex] == 0)
+	    {
+		wanted[targets[i]->InternalIndex] = 1;
+		remaining++;
+	    }
+      }
+/* starting a new search: any Node status is lazily reset */
+    h = routing_begin (e, 0);
+/* pushes the From node into the Nodes list */
+    n = routing_status (e, e->Nodes, pfrom->InternalIndex);
+    n->Distance = 0.0;
+    routing_push (h, n);
+    while (h->Count > 0 && remaining > 0)
+      {
+	  /* Dijsktra loop */
+	  n = routing_pop (h);
+	  n->Inspected = 1;
+	  if (wanted[n->Id])
+	    {
+		/* one more destination reached */
+		wanted[n->Id] = 0;
+		remaining--;
+	    }
+	  pN = e->Graph->Nodes + n->Id;
+	  p_link = e->Graph->Arcs + pN->FirstArc;
+	  for (i = 0; i < pN->NumArcs; i++, p_link++)
+	    {
+		cost = routing_arc_cost (e, p_link);
+		if (cost == DBL_MAX)
+		    continue;	/* closed Arc */
+		p_to = routing_status (e, e->Nodes, p_link->NodeTo);
+		if (p_to->Inspected == 0)
 		  {
-		      arc_id = -1;
-		      from_id = -1;
-		      to_id = -1;
-		      from_code = NULL;
-		      to_code = NULL;
-		      blob = NULL;
-		      size = 0;
-		      name = NULL;
-		      err = 0;
-		      if (sqlite3_column_type (stmt, 0) == SQLITE_INTEGER)
-			  arc_id = sqlite3_column_int64 (stmt, 0);
-		      else
-			  err = 1;
-		      if (graph->NodeCode)
-			{
-			    /* nodes are identified by TEXT codes */
-			    if (sqlite3_column_type (stmt, 1) == SQLITE_TEXT)
-				from_code =
-				    (char *) sqlite3_column_text (stmt, 1);
-			    else
-				err = 1;
-			    if (sqlite3_column_type (stmt, 2) == SQLITE_TEXT)
-				to_code =
-				    (char *) sqlite3_column_text (stmt, 2);
-			    else
-				err = 1;
-			}
-		      else
-			{
-			    /* nodes are identified by INTEGER ids */
-			    if (sqlite3_column_type (stmt, 1) == SQLITE_INTEGER)
-				from_id = sqlite3_column_int64 (stmt, 1);
-			    else
-				err = 1;
-			    if (sqlite3_column_type (stmt, 2) == SQLITE_INTEGER)
-				to_id = sqlite3_column_int64 (stmt, 2);
-			    else
-				err = 1;
-			}
-		      if (sqlite3_column_type (stmt, 3) == SQLITE_BLOB)
-			{
-			    blob =
-				(const unsigned char *)
-				sqlite3_column_blob (stmt, 3);
-			    size = sqlite3_column_bytes (stmt, 3);
-			}
-		      else
-			  err = 1;
-		      if (graph->NameColumn)
+		      if (p_to->Distance == DBL_MAX)
 			{
-			    if (sqlite3_column_type (stmt, 4) == SQLITE_TEXT)
-				name = (char *) sqlite3_column_text (stmt, 4);
+			    /* inserting a new node into the list */
+			    p_to->Distance = n->Distance + cost;
+			    routing_push (h, p_to);
 			}
-		      if (err)
-			  error = 1;
-		      else
+		      else if (p_to->Distance > n->Distance + cost)
 			{
-			    /* saving the Arc geometry into the temporary struct */
-			    gaiaGeomCollPtr geom =
-				gaiaFromSpatiaLiteBlobWkb (blob, size);
-			    if (geom)
-			      {
-				  /* OK, we have fetched a valid Geometry */
-				  if (geom->FirstPoint == NULL
-				      && geom->FirstPolygon == NULL
-				      && geom->FirstLinestring != NULL
-				      && geom->FirstLinestring ==
-				      geom->LastLinestring)
-				    {
-					/* Geometry is LINESTRING as expected */
-					int iv;
-					int points =
-					    geom->FirstLinestring->Points;
-					double *coords =
-					    malloc (sizeof (double) *
-						    (points * 2));
-					for (iv = 0; iv < points; iv++)
-					  {
-					      double x;
-					      double y;
-					      gaiaGetPoint
-						  (geom->FirstLinestring->
-						   Coords, iv, &x, &y);
-					      *(coords + ((iv * 2) + 0)) = x;
-					      *(coords + ((iv * 2) + 1)) = y;
-					  }
-					if (from_code == NULL)
-					    from_code = "";
-					if (to_code == NULL)
-					    to_code = "";
-					add_arc_geometry_to_solution (solution,
-								      arc_id,
-								      from_code,
-								      to_code,
-								      from_id,
-								      to_id,
-								      points,
-								      coords,
-								      geom->
-								      Srid,
-								      name);
-				    }
-				  else
-				      error = 1;
-				  gaiaFreeGeomColl (geom);
-			      }
-			    else
-				error = 1;
+			    /* updating an already inserted node */
+			    p_to->Distance = n->Distance + cost;
+			    routing_decrease_key (h, p_to);
 			}
 		  }
 	    }
-	  sqlite3_finalize (stmt);
-	  tbd -= how_many;
-	  base += how_many;
       }
-  abort:
-    if (shortest_path)
-	free (shortest_path);
-    if (!error)
+    free (wanted);
+    for (i = 0; i < num_targets; i++)
       {
-	  /* building the Geometry representing the Shortest Path Solution */
-	  gaiaLinestringPtr ln;
-	  int tot_pts = 0;
-	  RowSolutionPtr pR;
-	  ArcSolutionPtr pA;
-	  int srid = -1;
-	  if (solution->FirstArc)
-	      srid = (solution->FirstArc)->Srid;
-	  pR = solution->First;
-	  while (pR)
+	  /* unsettled destinations are unreachable */
+	  n = routing_status (e, e->Nodes, targets[i]->InternalIndex);
+	  costs[i] = (n->Inspected) ? n->Distance : DBL_MAX;
+      }
+}
+
+static int
+ch_upward_search (NetworkHierarchyPtr ch, RoutingNodesPtr rt, int start,
+		  int forward, int *nodes, double *dists)
+{
+/*
+/ exhaustive upward search [either forward or backward] starting from
+/ some Node; any settled Node and its distance are returned
+*/
+    int i;
+    int e;
+    int node;
+    int cnt = 0;
+    double dist;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    RoutingNodePtr states = rt->Nodes;
+    int *index = (forward) ? ch->UpIndex : ch->DownIndex;
+    int *edges = (forward) ? ch->UpEdges : ch->DownEdges;
+    RoutingHeapPtr h = routing_begin (rt, 0);
+    n = routing_status (rt, states, start);
+    n->Distance = 0.0;
+    routing_push (h, n);
+    while (h->Count > 0)
+      {
+	  n = routing_pop (h);
+	  n->Inspected = 1;
+	  node = n->Id;
+	  nodes[cnt] = node;
+	  dists[cnt] = n->Distance;
+	  cnt++;
+	  for (i = index[node]; i < index[node + 1]; i++)
 	    {
-		pA = solution->FirstArc;
-		while (pA)
+		e = edges[i];
+		if (forward)
+		    p_to = routing_status (rt, states, hierarchy_edge_to (ch, e));
+		else
+		    p_to =
+			routing_status (rt, states, hierarchy_edge_from (ch, e));
+		if (p_to->Inspected)
+		    continue;
+		dist = n->Distance + hierarchy_edge_cost (ch, e);
+		if (p_to->Distance == DBL_MAX)
 		  {
-		      /* computing how many vertices do we need to build the LINESTRING */
-		      if (pR->Arc->ArcRowid == pA->ArcRowid)
-			{
-			    if (pR == solution->First)
-				tot_pts += pA->Points;
-			    else
-				tot_pts += (pA->Points - 1);
-			    if (pA->Srid != srid)
-				srid = -1;
-			}
-		      pA = pA->Next;
+		      /* inserting a new node into the list */
+		      p_to->Distance = dist;
+		      routing_push (h, p_to);
 		  }
-		pR = pR->Next;
-	    }
-	  /* creating the Shortest Path Geometry - LINESTRING */
-	  ln = gaiaAllocLinestring (tot_pts);
-	  solution->Geometry = gaiaAllocGeomColl ();
-	  solution->Geometry->Srid = srid;
-	  gaiaInsertLinestringInGeomColl (solution->Geometry, ln);
-	  tot_pts = 0;
-	  pR = solution->First;
-	  while (pR)
-	    {
-		/* building the LINESTRING */
-		int skip;
-		if (pR == solution->First)
-		    skip = 0;	/* for first arc we must copy any vertex */
-		else
-		    skip = 1;	/* for subsequent arcs we must skip first vertex [already inserted from previous arc] */
-		pA = solution->FirstArc;
-		while (pA)
+		else if (p_to->Distance > dist)
 		  {
-		      if (pR->Arc->ArcRowid == pA->ArcRowid)
-			{
-			    /* copying vertices from correspoinding Arc Geometry */
-			    int ini;
-			    int iv;
-			    int rev;
-			    double x;
-			    double y;
-			    if (graph->NodeCode)
-			      {
-				  /* nodes are identified by TEXT codes */
-				  if (strcmp
-				      (pR->Arc->NodeFrom->Code,
-				       pA->ToCode) == 0)
-				      rev = 1;
-				  else
-				      rev = 0;
-			      }
-			    else
-			      {
-				  /* nodes are identified by INTEGER ids */
-				  if (pR->Arc->NodeFrom->Id == pA->ToId)
-				      rev = 1;
-				  else
-				      rev = 0;
-			      }
-			    if (rev)
-			      {
-				  /* copying Arc vertices in reverse order */
-				  if (skip)
-				      ini = pA->Points - 2;
-				  else
-				      ini = pA->Points - 1;
-				  for (iv = ini; iv >= 0; iv--)
-				    {
-					x = *(pA->Coords + ((iv * 2) + 0));
-					y = *(pA->Coords + ((iv * 2) + 1));
-					gaiaSetPoint (ln->Coords, tot_pts, x,
-						      y);
-					tot_pts++;
-				    }
-			      }
-			    else
-			      {
-				  /* copying Arc vertices in normal order */
-				  if (skip)
-				      ini = 1;
-				  else
-				      ini = 0;
-				  for (iv = ini; iv < pA->Points; iv++)
-				    {
-					x = *(pA->Coords + ((iv * 2) + 0));
-					y = *(pA->Coords + ((iv * 2) + 1));
-					gaiaSetPoint (ln->Coords, tot_pts, x,
-						      y);
-					tot_pts++;
-				    }
-			      }
-			    if (pA->Name)
-			      {
-				  int len = strlen (pA->Name);
-				  pR->Name = malloc (len + 1);
-				  strcpy (pR->Name, pA->Name);
-			      }
-			    break;
-			}
-		      pA = pA->Next;
+		      /* updating an already inserted node */
+		      p_to->Distance = dist;
+		      routing_decrease_key (h, p_to);
 		  }
-		pR = pR->Next;
 	    }
       }
+    return cnt;
 }
 
 static void
-dijkstra_solve (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
-		SolutionPtr solution)
+ch_many_to_many (NetworkHierarchyPtr ch, RoutingNodesPtr rt,
+		 NetworkNodePtr * origins,
+		 int num_origins, NetworkNodePtr * targets, int num_targets,
+		 double *costs)
 {
-/* computing a Dijkstra Shortest Path solution */
+/*
+/ computing a Many-to-Many cost matrix - bucket based algorithm
+/
+/ a backward upward search is performed from each destination, leaving
+/ a (destination, distance) entry into the bucket of any settled Node;
+/ then a forward upward search is performed from each origin, and the
+/ buckets of any settled Node are scanned so to complete the matrix
+*/
+    int i;
+    int j;
+    int k;
     int cnt;
-    NetworkArcPtr *shortest_path =
-	dijkstra_shortest_path (routing, solution->From, solution->To, &cnt);
-    build_solution (handle, graph, solution, shortest_path, cnt);
+    int num_entries = 0;
+    int max_entries = 1024;
+    int *entry_node;
+    int *entry_target;
+    double *entry_dist;
+    int *bucket_index;
+    int *bucket_target;
+    double *bucket_dist;
+    int *nodes = malloc (sizeof (int) * ch->NumNodes);
+    double *dists = malloc (sizeof (double) * ch->NumNodes);
+    double *row;
+    double cost;
+    entry_node = malloc (sizeof (int) * max_entries);
+    entry_target = malloc (sizeof (int) * max_entries);
+    entry_dist = malloc (sizeof (double) * max_entries);
+    for (j = 0; j < num_targets; j++)
+      {
+	  /* filling the buckets */
+	  cnt =
+	      ch_upward_search (ch, rt, targets[j]->InternalIndex, 0, nodes,
+			    dists);
+	  if (num_entries + cnt > max_entries)
+	    {
+		while (num_entries + cnt > max_entries)
+		    max_entries *= 2;
+		entry_node = realloc (entry_node, sizeof (int) * max_entries);
+		entry_target =
+		    realloc (entry_target, sizeof (int) * max_entries);
+		entry_dist =
+		    realloc (entry_dist, sizeof (double) * max_entries);
+	    }
+	  for (k = 0; k < cnt; k++)
+	    {
+		entry_node[num_entries] = nodes[k];
+		entry_target[num_entries] = j;
+		entry_dist[num_entries] = dists[k];
+		num_entries++;
+	    }
+      }
+/* grouping the bucket entries by Node */
+    bucket_index = calloc (ch->NumNodes + 1, sizeof (int));
+    bucket_target = malloc (sizeof (int) * (num_entries + 1));
+    bucket_dist = malloc (sizeof (double) * (num_entries + 1));
+    for (k = 0; k < num_entries; k++)
+	bucket_index[entry_node[k] + 1] += 1;
+    for (i = 0; i < ch->NumNodes; i++)
+	bucket_index[i + 1] += bucket_index[i];
+    for (k = 0; k < num_entries; k++)
+      {
+	  int pos = bucket_index[entry_node[k]]++;
+	  bucket_target[pos] = entry_target[k];
+	  bucket_dist[pos] = entry_dist[k];
+      }
+    for (i = ch->NumNodes; i > 0; i--)
+	bucket_index[i] = bucket_index[i - 1];
+    bucket_index[0] = 0;
+    free (entry_node);
+    free (entry_target);
+    free (entry_dist);
+    for (i = 0; i < num_origins; i++)
+      {
+	  /* scanning the buckets */
+	  row = costs + ((size_t) i * num_targets);
+	  for (j = 0; j < num_targets; j++)
+	      row[j] = DBL_MAX;
+	  cnt =
+	      ch_upward_search (ch, rt, origins[i]->InternalIndex, 1, nodes,
+			    dists);
+	  for (k = 0; k < cnt; k++)
+	    {
+		int b;
+		int node = nodes[k];
+		for (b = bucket_index[node]; b < bucket_index[node + 1]; b++)
+		  {
+		      cost = dists[k] + bucket_dist[b];
+		      if (cost < row[bucket_target[b]])
+			  row[bucket_target[b]] = cost;
+		  }
+	    }
+      }
+    free (bucket_index);
+    free (bucket_target);
+    free (bucket_dist);
+    free (nodes);
+    free (dists);
 }
 
+/* END of One-to-Many / Many-to-Many implementation */
+
 static void
-a_star_solve (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
-	      SolutionPtr solution)
+isochrone_add_node (IsochroneSolutionPtr iso, NetworkNodePtr node,
+		    NetworkArcPtr arc, double cost)
 {
-/* computing an A* Shortest Path solution */
-    int cnt;
-    NetworkArcPtr *shortest_path =
-	a_star_shortest_path (routing, graph->Nodes, solution->From,
-			      solution->To, graph->AStarHeuristicCoeff, &cnt);
-    build_solution (handle, graph, solution, shortest_path, cnt);
+/* inserting a reachable Node into the Isochrone solution */
+    if (iso->Count == iso->Max)
+      {
+	  iso->Max = (iso->Max == 0) ? 1024 : iso->Max * 2;
+	  iso->Nodes = realloc (iso->Nodes, sizeof (NetworkNodePtr) * iso->Max);
+	  iso->Arcs = realloc (iso->Arcs, sizeof (NetworkArcPtr) * iso->Max);
+	  iso->Costs = realloc (iso->Costs, sizeof (double) * iso->Max);
+      }
+    iso->Nodes[iso->Count] = node;
+    iso->Arcs[iso->Count] = arc;
+    iso->Costs[iso->Count] = cost;
+    iso->Count++;
+}
+
+static int
+isochrone_within_budget (IsochroneSolutionPtr iso, double cost)
+{
+/* checks if some cost fits into the Isochrone budget */
+    if (iso->Strict)
+	return (cost < iso->Budget) ? 1 : 0;
+    return (cost <= iso->Budget) ? 1 : 0;
 }
 
 static void
-network_free (NetworkPtr p)
+dijkstra_within_cost (RoutingNodesPtr e, NetworkPtr graph,
+		      IsochroneSolutionPtr iso)
 {
-/* memory cleanup; freeing any allocation for the network struct */
-    NetworkNodePtr pN;
+/*
+/ identifying any Node reachable within a given cost - Dijkstra's algorithm
+/ the expansion never goes beyond the budget, and each settled Node is
+/ directly appended to the solution
+*/
     int i;
-    if (!p)
+    int from;
+    double dist;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    NetworkArcPtr p_link;
+    double cost;
+    NetworkNodePtr pN;
+    RoutingHeapPtr h;
+    from = iso->Source->InternalIndex;
+    if (!isochrone_within_budget (iso, 0.0))
 	return;
-    for (i = 0; i < p->NumNodes; i++)
+/* starting a new search: any Node status is lazily reset */
+    h = routing_begin (e, 0);
+/* pushes the From node into the Nodes list */
+    n = routing_status (e, e->Nodes, from);
+    n->Distance = 0.0;
+    routing_push (h, n);
+    while (h->Count > 0)
       {
-	  pN = p->Nodes + i;
-	  if (pN->Code)
-	      free (pN->Code);
-	  if (pN->Arcs)
-	      free (pN->Arcs);
+	  /* Dijsktra loop */
+	  n = routing_pop (h);
+	  n->Inspected = 1;
+	  isochrone_add_node (iso, graph->Nodes + n->Id, n->Arc, n->Distance);
+	  pN = e->Graph->Nodes + n->Id;
+	  p_link = e->Graph->Arcs + pN->FirstArc;
+	  for (i = 0; i < pN->NumArcs; i++, p_link++)
+	    {
+		cost = routing_arc_cost (e, p_link);
+		if (cost == DBL_MAX)
+		    continue;	/* closed Arc */
+		p_to = routing_status (e, e->Nodes, p_link->NodeTo);
+		if (p_to->Inspected)
+		    continue;
+		dist = n->Distance + cost;
+		if (!isochrone_within_budget (iso, dist))
+		    continue;
+		if (p_to->Distance == DBL_MAX)
+		  {
+		      /* inserting a new node into the list */
+		      p_to->Distance = dist;
+		      p_to->PreviousNode = n;
+		      p_to->Arc = p_link;
+		      routing_push (h, p_to);
+		  }
+		else if (p_to->Distance > dist)
+		  {
+		      /* updating an already inserted node */
+		      p_to->Distance = dist;
+		      p_to->PreviousNode = n;
+		      p_to->Arc = p_link;
+		      routing_decrease_key (h, p_to);
+		  }
+	    }
       }
-    if (p->Nodes)
-	free (p->Nodes);
-    if (p->TableName)
-	free (p->TableName);
-    if (p->FromColumn)
-	free (p->FromColumn);
-    if (p->ToColumn)
-	free (p->ToColumn);
-    if (p->GeometryColumn)
-	free (p->GeometryColumn);
-    if (p->NameColumn)
-	free (p->NameColumn);
-    free (p);
 }
 
-static NetworkPtr
-network_init (const unsigned char *blob, int size)
+static const char *
+network_node_code (NetworkPtr graph, const NetworkNode * node)
 {
-/* parsing the HEADER block */
-    NetworkPtr graph;
-    int net64;
-    int aStar = 0;
-    int nodes;
-    int node_code;
-    int max_code_length;
-    int endian_arch = gaiaEndianArch ();
-    const char *table;
-    const char *from;
-    const char *to;
-    const char *geom;
-    const char *name = NULL;
-    double a_star_coeff = 1.0;
-    int len;
-    const unsigned char *ptr;
-    if (size < 9)
-	return NULL;
-    if (*(blob + 0) == GAIA_NET_START)	/* signature - legacy format using 32bit ints */
-	net64 = 0;
-    else if (*(blob + 0) == GAIA_NET64_START)	/* signature - format using 64bit ints */
-	net64 = 1;
-    else if (*(blob + 0) == GAIA_NET64_A_STAR_START)	/* signature - format using 64bit ints AND supporting A* */
+/* returns the TEXT Code of some Node from the interned strings pool */
+    if (node->CodeOffset < 0)
+	return "";
+    return graph->Codes + node->CodeOffset;
+}
+
+static int
+cmp_nodes_id (const void *p1, const void *p2)
+{
+/* compares two nodes  by ID [for BSEARCH] */
+    NetworkNodePtr pN1 = (NetworkNodePtr) p1;
+    NetworkNodePtr pN2 = (NetworkNodePtr) p2;
+    if (pN1->Id == pN2->Id)
+	return 0;
+    if (pN1->Id > pN2->Id)
+	return 1;
+    return -1;
+}
+
+static NetworkNodePtr
+find_node_by_code (NetworkPtr graph, const char *code)
+{
+/* searching a Node (by Code) into the sorted list */
+    int lo = 0;
+    int hi = graph->NumNodes - 1;
+    int mid;
+    int cmp;
+    while (lo <= hi)
       {
-	  net64 = 1;
-	  aStar = 1;
+	  mid = lo + ((hi - lo) / 2);
+	  cmp = strcmp (network_node_code (graph, graph->Nodes + mid), code);
+	  if (cmp == 0)
+	      return graph->Nodes + mid;
+	  if (cmp < 0)
+	      lo = mid + 1;
+	  else
+	      hi = mid - 1;
       }
-    else
-	return NULL;
-    if (*(blob + 1) != GAIA_NET_HEADER)	/* signature */
-	return NULL;
-    nodes = gaiaImport32 (blob + 2, 1, endian_arch);	/* # nodes */
-    if (nodes <= 0)
-	return NULL;
-    if (*(blob + 6) == GAIA_NET_CODE)	/* Nodes identified by a TEXT code */
-	node_code = 1;
-    else if (*(blob + 6) == GAIA_NET_ID)	/* Nodes indentified by an INTEGER id */
-	node_code = 0;
-    else
-	return NULL;
+    return NULL;
+}
+
+static NetworkNodePtr
+find_node_by_id (NetworkPtr graph, const sqlite3_int64 id)
+{
+/* searching a Node (by Id) into the sorted list */
+    NetworkNodePtr ret;
+    NetworkNode pN;
+    pN.Id = id;
+    ret =
+	bsearch (&pN, graph->Nodes, graph->NumNodes, sizeof (NetworkNode),
+		 cmp_nodes_id);
+    return ret;
+}
+
+static void
+delete_solution (SolutionPtr solution)
+{
+/* deleting the current solution */
+    RowSolutionPtr pR;
+    RowSolutionPtr pRn;
+    if (!solution)
+	return;
+    pR = solution->First;
+    while (pR)
+      {
+	  pRn = pR->Next;
+	  if (pR->Name)
+	      free (pR->Name);
+	  free (pR);
+	  pR = pRn;
+      }
+    if (solution->Geometry)
+	free (solution->Geometry);
+    free (solution);
+}
+
+static void
+reset_solution (SolutionPtr solution)
+{
+/* resetting the current solution */
+    RowSolutionPtr pR;
+    RowSolutionPtr pRn;
+    if (!solution)
+	return;
+    pR = solution->First;
+    while (pR)
+      {
+	  pRn = pR->Next;
+	  if (pR->Name)
+	      free (pR->Name);
+	  free (pR);
+	  pR = pRn;
+      }
+    if (solution->Geometry)
+	free (solution->Geometry);
+    solution->From = NULL;
+    solution->To = NULL;
+    solution->First = NULL;
+    solution->Last = NULL;
+    solution->CurrentRow = NULL;
+    solution->CurrentRowId = 0;
+    solution->TotalCost = 0.0;
+    solution->Geometry = NULL;
+    solution->GeometrySize = 0;
+}
+
+static SolutionPtr
+alloc_solution (void)
+{
+/* allocates and initializes the current solution */
+    SolutionPtr p = malloc (sizeof (Solution));
+    p->From = NULL;
+    p->To = NULL;
+    p->First = NULL;
+    p->Last = NULL;
+    p->CurrentRow = NULL;
+    p->CurrentRowId = 0;
+    p->TotalCost = 0.0;
+    p->Geometry = NULL;
+    p->GeometrySize = 0;
+    return p;
+}
+
+static void
+add_arc_to_solution (SolutionPtr solution, NetworkArcPtr arc, double cost)
+{
+/* inserts an Arc into the Shortest Path solution */
+    RowSolutionPtr p = malloc (sizeof (RowSolution));
+    p->Arc = arc;
+    p->Cost = cost;
+    p->Name = NULL;
+    p->Next = NULL;
+    solution->TotalCost += cost;
+    if (!(solution->First))
+	solution->First = p;
+    if (solution->Last)
+	solution->Last->Next = p;
+    solution->Last = p;
+}
+
+static sqlite3_mutex *
+shared_networks_mutex (void)
+{
+/* the mutex protecting the process-wide VirtualNetwork state */
+    return (sqlite3_mutex *)
+	splite_library_mutex (SPLITE_MUTEX_VIRTUAL_NETWORK);
+}
+
+static int
+db_version_changed (sqlite3 * handle, DbVersion * version)
+{
+/*
+/ checks if the DB has been changed since the last call:
+/ data_version detects changes by other connections, total_changes
+/ any change made by this same connection
+*/
+    sqlite3_stmt *stmt;
+    sqlite3_int64 data_version = -1;
+    int total_changes = sqlite3_total_changes (handle);
+    int ret = sqlite3_prepare_v2 (handle, "PRAGMA data_version", -1, &stmt,
+				  NULL);
+    if (ret == SQLITE_OK)
+      {
+	  if (sqlite3_step (stmt) == SQLITE_ROW)
+	      data_version = sqlite3_column_int64 (stmt, 0);
+	  sqlite3_finalize (stmt);
+      }
+    if (data_version == version->DataVersion
+	&& total_changes == version->TotalChanges && data_version >= 0)
+	return 0;
+    version->DataVersion = data_version;
+    version->TotalChanges = total_changes;
+    return 1;
+}
+
+static int
+arc_cache_budget (int kbytes)
+{
+/* returns [and optionally sets] the Arc Geometries cache budget (KB) */
+    static int budget = VNET_ARC_CACHE_BUDGET;
+    int old;
+    sqlite3_mutex *mutex = shared_networks_mutex ();
+    sqlite3_mutex_enter (mutex);
+    old = budget;
+    if (kbytes >= 0)
+	budget = kbytes;
+    sqlite3_mutex_leave (mutex);
+    return old;
+}
+
+SPATIALITE_PRIVATE int
+set_network_arc_cache_size (int kbytes)
+{
+/* 
+/ sets the memory budget (KB) of the VirtualNetwork Arc Geometries caches
+/ [a negative value simply queries the current one]
+/ returns the previous budget
+*/
+    return arc_cache_budget (kbytes);
+}
+
+static void
+arc_geometry_free (ArcGeometryPtr p)
+{
+/* memory cleanup; freeing a cached Arc Geometry */
+    if (p->FromCode)
+	free (p->FromCode);
+    if (p->ToCode)
+	free (p->ToCode);
+    if (p->Coords)
+	free (p->Coords);
+    if (p->Name)
+	free (p->Name);
+    free (p);
+}
+
+static ArcCachePtr
+arc_cache_alloc (void)
+{
+/* allocating an empty Arc Geometries cache */
+    int i;
+    ArcCachePtr p = malloc (sizeof (ArcCache));
+    p->NumBuckets = 1024;
+    p->Buckets = malloc (sizeof (ArcGeometryPtr) * p->NumBuckets);
+    for (i = 0; i < p->NumBuckets; i++)
+	p->Buckets[i] = NULL;
+    p->Count = 0;
+    p->Used = 0;
+    p->First = NULL;
+    p->Last = NULL;
+    p->Version.DataVersion = -1;
+    p->Version.TotalChanges = -1;
+    return p;
+}
+
+static void
+arc_cache_flush (ArcCachePtr p)
+{
+/* removing any cached Arc Geometry */
+    int i;
+    ArcGeometryPtr g;
+    ArcGeometryPtr gn;
+    g = p->First;
+    while (g)
+      {
+	  gn = g->Next;
+	  arc_geometry_free (g);
+	  g = gn;
+      }
+    for (i = 0; i < p->NumBuckets; i++)
+	p->Buckets[i] = NULL;
+    p->Count = 0;
+    p->Used = 0;
+    p->First = NULL;
+    p->Last = NULL;
+}
+
+static void
+arc_cache_free (ArcCachePtr p)
+{
+/* memory cleanup; freeing the Arc Geometries cache */
+    if (!p)
+	return;
+    arc_cache_flush (p);
+    free (p->Buckets);
+    free (p);
+}
+
+static int
+arc_cache_bucket (ArcCachePtr p, sqlite3_int64 arc_rowid)
+{
+/* hashing an ArcRowid */
+    sqlite3_uint64 h = (sqlite3_uint64) arc_rowid;
+    h ^= h >> 32;
+    h *= 2654435761u;
+    return (int) (h & (sqlite3_uint64) (p->NumBuckets - 1));
+}
+
+static ArcGeometryPtr
+arc_cache_find (ArcCachePtr p, sqlite3_int64 arc_rowid)
+{
+/* searching a cached Arc Geometry */
+    ArcGeometryPtr g = p->Buckets[arc_cache_bucket (p, arc_rowid)];
+    while (g)
+      {
+	  if (g->ArcRowid == arc_rowid)
+	      return g;
+	  g = g->HashNext;
+      }
+    return NULL;
+}
+
+static void
+arc_cache_unlink (ArcCachePtr p, ArcGeometryPtr g)
+{
+/* removing an Arc Geometry from the LRU list */
+    if (g->Prev)
+	g->Prev->Next = g->Next;
+    else
+	p->First = g->Next;
+    if (g->Next)
+	g->Next->Prev = g->Prev;
+    else
+	p->Last = g->Prev;
+    g->Prev = NULL;
+    g->Next = NULL;
+}
+
+static void
+arc_cache_push (ArcCachePtr p, ArcGeometryPtr g)
+{
+/* inserting an Arc Geometry as the most recently used one */
+    g->Prev = NULL;
+    g->Next = p->First;
+    if (p->First)
+	p->First->Prev = g;
+    p->First = g;
+    if (p->Last == NULL)
+	p->Last = g;
+}
+
+static void
+arc_cache_touch (ArcCachePtr p, ArcGeometryPtr g)
+{
+/* marking an Arc Geometry as the most recently used one */
+    if (p->First == g)
+	return;
+    arc_cache_unlink (p, g);
+    arc_cache_push (p, g);
+}
+
+static void
+arc_cache_rehash (ArcCachePtr p)
+{
+/* doubling the hash buckets */
+    int i;
+    ArcGeometryPtr g;
+    free (p->Buckets);
+    p->NumBuckets *= 2;
+    p->Buckets = malloc (sizeof (ArcGeometryPtr) * p->NumBuckets);
+    for (i = 0; i < p->NumBuckets; i++)
+	p->Buckets[i] = NULL;
+    g = p->First;
+    while (g)
+      {
+	  int b = arc_cache_bucket (p, g->ArcRowid);
+	  g->HashNext = p->Buckets[b];
+	  p->Buckets[b] = g;
+	  g = g->Next;
+      }
+}
+
+static void
+arc_cache_insert (ArcCachePtr p, ArcGeometryPtr g)
+{
+/* inserting a new Arc Geometry into the cache */
+    int b;
+    if (p->Count >= p->NumBuckets * 2)
+	arc_cache_rehash (p);
+    b = arc_cache_bucket (p, g->ArcRowid);
+    g->HashNext = p->Buckets[b];
+    p->Buckets[b] = g;
+    arc_cache_push (p, g);
+    p->Count++;
+    p->Used += g->Size;
+}
+
+static void
+arc_cache_evict (ArcCachePtr p, ArcGeometryPtr g)
+{
+/* removing an Arc Geometry from the cache */
+    ArcGeometryPtr *pp = p->Buckets + arc_cache_bucket (p, g->ArcRowid);
+    while (*pp != g)
+	pp = &((*pp)->HashNext);
+    *pp = g->HashNext;
+    arc_cache_unlink (p, g);
+    p->Count--;
+    p->Used -= g->Size;
+    arc_geometry_free (g);
+}
+
+static void
+arc_cache_trim (ArcCachePtr p)
+{
+/* evicting the least recently used Arc Geometries exceeding the budget */
+    size_t budget = (size_t) arc_cache_budget (-1) * 1024;
+    while (p->Last && p->Used > budget)
+	arc_cache_evict (p, p->Last);
+}
+
+static char *
+arc_cache_strdup (const char *str, size_t * size)
+{
+/* duplicating an [optional] string, accounting for its memory */
+    char *dup;
+    int len;
+    if (str == NULL || *str == '\0')
+	return NULL;
+    len = strlen (str);
+    dup = malloc (len + 1);
+    strcpy (dup, str);
+    *size += len + 1;
+    return dup;
+}
+
+static int
+arc_cache_add (ArcCachePtr cache, sqlite3_int64 arc_id, const char *from_code,
+	       const char *to_code, sqlite3_int64 from_id,
+	       sqlite3_int64 to_id, const unsigned char *blob, int size,
+	       const char *name)
+{
+/* decoding an Arc Geometry and inserting it into the cache */
+    int iv;
+    int points;
+    double x;
+    double y;
+    ArcGeometryPtr p;
+    gaiaLinestringPtr ln;
+    gaiaGeomCollPtr geom;
+    if (arc_cache_find (cache, arc_id))
+	return 1;		/* already cached */
+    geom = gaiaFromSpatiaLiteBlobWkb (blob, size);
+    if (geom == NULL)
+	return 0;
+    ln = geom->FirstLinestring;
+    if (geom->FirstPoint != NULL || geom->FirstPolygon != NULL || ln == NULL
+	|| ln != geom->LastLinestring)
+      {
+	  /* Geometry isn't a LINESTRING as expected */
+	  gaiaFreeGeomColl (geom);
+	  return 0;
+      }
+    points = ln->Points;
+    p = malloc (sizeof (ArcGeometry));
+    p->Size = sizeof (ArcGeometry) + (sizeof (double) * points * 2);
+    p->ArcRowid = arc_id;
+    p->FromCode = arc_cache_strdup (from_code, &(p->Size));
+    p->ToCode = arc_cache_strdup (to_code, &(p->Size));
+    p->FromId = from_id;
+    p->ToId = to_id;
+    p->Points = points;
+    p->Coords = malloc (sizeof (double) * (points * 2));
+    for (iv = 0; iv < points; iv++)
+      {
+	  gaiaGetPoint (ln->Coords, iv, &x, &y);
+	  p->Coords[iv * 2] = x;
+	  p->Coords[(iv * 2) + 1] = y;
+      }
+    p->Srid = geom->Srid;
+    p->Name = arc_cache_strdup (name, &(p->Size));
+    p->HashNext = NULL;
+    p->Prev = NULL;
+    p->Next = NULL;
+    gaiaFreeGeomColl (geom);
+    arc_cache_insert (cache, p);
+    return 1;
+}
+
+static int
+arc_cache_load (sqlite3 * handle, NetworkPtr graph, ArcCachePtr cache,
+		sqlite3_int64 * arcs, int cnt)
+{
+/* fetching the missing Arc Geometries [max 128 arcs at each time] */
+    int i;
+    char *sql;
+    int err;
+    int error = 0;
+    int ret;
+    sqlite3_int64 arc_id;
+    const unsigned char *blob;
+    int size;
+    sqlite3_int64 from_id;
+    sqlite3_int64 to_id;
+    char *from_code;
+    char *to_code;
+    char *name;
+    int base;
+    int block = 128;
+    int how_many;
+    sqlite3_stmt *stmt;
+    char *xfrom;
+    char *xto;
+    char *xgeom;
+    char *xname;
+    char *xtable;
+    gaiaOutBuffer sql_statement;
+    for (base = 0; base < cnt; base += how_many)
+      {
+	  /* requesting max 128 arcs at each time */
+	  how_many = cnt - base;
+	  if (how_many > block)
+	      how_many = block;
+	  gaiaOutBufferInitialize (&sql_statement);
+	  xfrom = gaiaDoubleQuotedSql (graph->FromColumn);
+	  xto = gaiaDoubleQuotedSql (graph->ToColumn);
+	  xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
+	  xtable = gaiaDoubleQuotedSql (graph->TableName);
+	  if (graph->NameColumn)
+	    {
+		/* a Name column is defined */
+		xname = gaiaDoubleQuotedSql (graph->NameColumn);
+		sql =
+		    sqlite3_mprintf
+		    ("SELECT ROWID, \"%s\", \"%s\", \"%s\", \"%s\" FROM \"%s\" WHERE ROWID IN (",
+		     xfrom, xto, xgeom, xname, xtable);
+		free (xname);
+	    }
+	  else
+	    {
+		/* no Name column is defined */
+		sql =
+		    sqlite3_mprintf
+		    ("SELECT ROWID, \"%s\", \"%s\", \"%s\" FROM \"%s\" WHERE ROWID IN (",
+		     xfrom, xto, xgeom, xtable);
+	    }
+	  free (xfrom);
+	  free (xto);
+	  free (xgeom);
+	  free (xtable);
+	  gaiaAppendToOutBuffer (&sql_statement, sql);
+	  sqlite3_free (sql);
+	  for (i = 0; i < how_many; i++)
+	    {
+		if (i == 0)
+		    gaiaAppendToOutBuffer (&sql_statement, "?");
+		else
+		    gaiaAppendToOutBuffer (&sql_statement, ",?");
+	    }
+	  gaiaAppendToOutBuffer (&sql_statement, ")");
+	  if (sql_statement.Error == 0 && sql_statement.Buffer != NULL)
+	      ret =
+		  sqlite3_prepare_v2 (handle, sql_statement.Buffer,
+				      strlen (sql_statement.Buffer), &stmt,
+				      NULL);
+	  else
+	      ret = SQLITE_ERROR;
+	  gaiaOutBufferReset (&sql_statement);
+	  if (ret != SQLITE_OK)
+	      return 0;
+	  for (i = 0; i < how_many; i++)
+	      sqlite3_bind_int64 (stmt, i + 1, arcs[base + i]);
+	  while (1)
+	    {
+		ret = sqlite3_step (stmt);
+		if (ret == SQLITE_DONE)
+		    break;
+		if (ret != SQLITE_ROW)
+		  {
+		      error = 1;
+		      break;
+		  }
+		arc_id = -1;
+		from_id = -1;
+		to_id = -1;
+		from_code = NULL;
+		to_code = NULL;
+		blob = NULL;
+		size = 0;
+		name = NULL;
+		err = 0;
+		if (sqlite3_column_type (stmt, 0) == SQLITE_INTEGER)
+		    arc_id = sqlite3_column_int64 (stmt, 0);
+		else
+		    err = 1;
+		if (graph->NodeCode)
+		  {
+		      /* nodes are identified by TEXT codes */
+		      if (sqlite3_column_type (stmt, 1) == SQLITE_TEXT)
+			  from_code = (char *) sqlite3_column_text (stmt, 1);
+		      else
+			  err = 1;
+		      if (sqlite3_column_type (stmt, 2) == SQLITE_TEXT)
+			  to_code = (char *) sqlite3_column_text (stmt, 2);
+		      else
+			  err = 1;
+		  }
+		else
+		  {
+		      /* nodes are identified by INTEGER ids */
+		      if (sqlite3_column_type (stmt, 1) == SQLITE_INTEGER)
+			  from_id = sqlite3_column_int64 (stmt, 1);
+		      else
+			  err = 1;
+		      if (sqlite3_column_type (stmt, 2) == SQLITE_INTEGER)
+			  to_id = sqlite3_column_int64 (stmt, 2);
+		      else
+			  err = 1;
+		  }
+		if (sqlite3_column_type (stmt, 3) == SQLITE_BLOB)
+		  {
+		      blob = (const unsigned char *) sqlite3_column_blob (stmt, 3);
+		      size = sqlite3_column_bytes (stmt, 3);
+		  }
+		else
+		    err = 1;
+		if (graph->NameColumn)
+		  {
+		      if (sqlite3_column_type (stmt, 4) == SQLITE_TEXT)
+			  name = (char *) sqlite3_column_text (stmt, 4);
+		  }
+		if (err)
+		    error = 1;
+		else if (!arc_cache_add
+			 (cache, arc_id, from_code, to_code, from_id, to_id,
+			  blob, size, name))
+		    error = 1;
+	    }
+	  sqlite3_finalize (stmt);
+      }
+    return error ? 0 : 1;
+}
+
+static void
+solution_geometry (NetworkPtr graph, SolutionPtr solution,
+		   NetworkArcPtr * shortest_path, ArcGeometryPtr * geoms,
+		   int cnt)
+{
+/*
+/ building the Geometry representing the Shortest Path Solution:
+/ the cached Arc vertices are directly stitched into a LINESTRING BLOB
+*/
+    int i;
+    int iv;
+    int ini;
+    int rev;
+    int tot_pts = 0;
+    int srid = -1;
+    int size;
+    double x;
+    double y;
+    double minx = DBL_MAX;
+    double miny = DBL_MAX;
+    double maxx = -DBL_MAX;
+    double maxy = -DBL_MAX;
+    unsigned char *blob;
+    unsigned char *p;
+    int endian_arch = gaiaEndianArch ();
+    if (cnt > 0)
+	srid = geoms[0]->Srid;
+    for (i = 0; i < cnt; i++)
+      {
+	  /* computing how many vertices do we need to build the LINESTRING */
+	  if (i == 0)
+	      tot_pts += geoms[i]->Points;
+	  else
+	      tot_pts += (geoms[i]->Points - 1);
+	  if (geoms[i]->Srid != srid)
+	      srid = -1;
+      }
+    size = 48 + (tot_pts * 16);
+    blob = malloc (size);
+    *blob = GAIA_MARK_START;
+    *(blob + 1) = GAIA_LITTLE_ENDIAN;
+    gaiaExport32 (blob + 2, srid, 1, endian_arch);
+    *(blob + 38) = GAIA_MARK_MBR;
+    gaiaExport32 (blob + 39, GAIA_LINESTRING, 1, endian_arch);
+    gaiaExport32 (blob + 43, tot_pts, 1, endian_arch);
+    p = blob + 47;
+    for (i = 0; i < cnt; i++)
+      {
+	  /* copying vertices from the corresponding Arc Geometry */
+	  ArcGeometryPtr g = geoms[i];
+	  NetworkNodePtr from = graph->Nodes + shortest_path[i]->NodeFrom;
+	  if (graph->NodeCode)
+	    {
+		/* nodes are identified by TEXT codes */
+		const char *to_code = (g->ToCode) ? g->ToCode : "";
+		rev = strcmp (network_node_code (graph, from), to_code) == 0;
+	    }
+	  else
+	    {
+		/* nodes are identified by INTEGER ids */
+		rev = from->Id == g->ToId;
+	    }
+	  /* for subsequent arcs we must skip first vertex [already inserted from previous arc] */
+	  ini = (i == 0) ? 0 : 1;
+	  for (; ini < g->Points; ini++)
+	    {
+		iv = (rev) ? g->Points - 1 - ini : ini;
+		x = g->Coords[iv * 2];
+		y = g->Coords[(iv * 2) + 1];
+		if (x < minx)
+		    minx = x;
+		if (x > maxx)
+		    maxx = x;
+		if (y < miny)
+		    miny = y;
+		if (y > maxy)
+		    maxy = y;
+		gaiaExport64 (p, x, 1, endian_arch);
+		gaiaExport64 (p + 8, y, 1, endian_arch);
+		p += 16;
+	    }
+      }
+    *p = GAIA_MARK_END;
+    gaiaExport64 (blob + 6, minx, 1, endian_arch);
+    gaiaExport64 (blob + 14, miny, 1, endian_arch);
+    gaiaExport64 (blob + 22, maxx, 1, endian_arch);
+    gaiaExport64 (blob + 30, maxy, 1, endian_arch);
+    solution->Geometry = blob;
+    solution->GeometrySize = size;
+}
+
+static void
+build_solution (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
+		ArcCachePtr cache, SolutionPtr solution,
+		NetworkArcPtr * shortest_path, int cnt)
+{
+/* formatting the Shortest Path solution */
+    int i;
+    int error = 0;
+    int missing = 0;
+    sqlite3_int64 *arcs = NULL;
+    ArcGeometryPtr *geoms = NULL;
+    ArcGeometryPtr g;
+    RowSolutionPtr pR;
+    if (db_version_changed (handle, &(cache->Version)))
+      {
+	  /* the cached Arc Geometries could be no longer valid */
+	  arc_cache_flush (cache);
+      }
+    if (cnt > 0)
+      {
+	  /* building the solution */
+	  arcs = malloc (sizeof (sqlite3_int64) * cnt);
+	  for (i = 0; i < cnt; i++)
+	    {
+		add_arc_to_solution (solution, shortest_path[i],
+				     routing_arc_cost (routing,
+						       shortest_path[i]));
+		g = arc_cache_find (cache, shortest_path[i]->ArcRowid);
+		if (g)
+		    arc_cache_touch (cache, g);
+		else
+		    arcs[missing++] = shortest_path[i]->ArcRowid;
+	    }
+	  if (missing > 0)
+	    {
+		/* reading the Arc Geometries not yet cached */
+		if (!arc_cache_load (handle, graph, cache, arcs, missing))
+		    error = 1;
+	    }
+	  free (arcs);
+	  geoms = malloc (sizeof (ArcGeometryPtr) * cnt);
+	  for (i = 0; i < cnt; i++)
+	    {
+		geoms[i] = arc_cache_find (cache, shortest_path[i]->ArcRowid);
+		if (geoms[i] == NULL)
+		    error = 1;
+	    }
+      }
+    if (!error)
+      {
+	  /* building the Geometry and copying the Arc Names */
+	  solution_geometry (graph, solution, shortest_path, geoms, cnt);
+	  pR = solution->First;
+	  for (i = 0; i < cnt && pR; i++, pR = pR->Next)
+	    {
+		if (geoms[i]->Name)
+		  {
+		      int len = strlen (geoms[i]->Name);
+		      pR->Name = malloc (len + 1);
+		      strcpy (pR->Name, geoms[i]->Name);
+		  }
+	    }
+      }
+    if (geoms)
+	free (geoms);
+    if (shortest_path)
+	free (shortest_path);
+/* the Arcs used by this solution have been safely copied */
+    arc_cache_trim (cache);
+}
+
+static void
+dijkstra_solve (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
+		ArcCachePtr cache, SolutionPtr solution)
+{
+/* computing a Dijkstra Shortest Path solution */
+    int cnt;
+    NetworkArcPtr *shortest_path =
+	dijkstra_shortest_path (routing, solution->From, solution->To, &cnt);
+    build_solution (handle, graph, routing, cache, solution, shortest_path,
+		    cnt);
+}
+
+static void
+a_star_solve (sqlite3 * handle, NetworkPtr graph, RoutingNodesPtr routing,
+	      ArcCachePtr cache, SolutionPtr solution)
+{
+/* computing an A* Shortest Path solution */
+    int cnt;
+    NetworkArcPtr *shortest_path =
+	a_star_shortest_path (routing, graph->Nodes, solution->From,
+			      solution->To, routing->HeuristicCoeff, &cnt);
+    build_solution (handle, graph, routing, cache, solution, shortest_path,
+		    cnt);
+}
+
+static void
+bidirectional_solve (sqlite3 * handle, NetworkPtr graph,
+		     RoutingNodesPtr routing, int a_star, ArcCachePtr cache,
+		     SolutionPtr solution)
+{
+/* computing a bidirectional Dijkstra / A* Shortest Path solution */
+    int cnt;
+    NetworkArcPtr *shortest_path =
+	bidirectional_shortest_path (routing, solution->From, solution->To,
+				     a_star, routing->HeuristicCoeff, &cnt);
+    build_solution (handle, graph, routing, cache, solution, shortest_path,
+		    cnt);
+}
+
+static void
+ch_solve (sqlite3 * handle, NetworkPtr graph, NetworkHierarchyPtr ch,
+	  RoutingNodesPtr routing, ArcCachePtr cache, SolutionPtr solution)
+{
+/* computing a Contraction Hierarchies Shortest Path solution */
+    int cnt;
+    NetworkArcPtr *shortest_path =
+	ch_shortest_path (ch, routing, solution->From, solution->To, &cnt);
+    build_solution (handle, graph, routing, cache, solution, shortest_path,
+		    cnt);
+}
+
+static void
+delete_matrix (MatrixSolutionPtr matrix)
+{
+/* deleting the current One-to-Many / Many-to-Many solution */
+    if (!matrix)
+	return;
+    if (matrix->From)
+	free (matrix->From);
+    if (matrix->To)
+	free (matrix->To);
+    if (matrix->Costs)
+	free (matrix->Costs);
+    free (matrix);
+}
+
+static int
+is_node_list (NetworkPtr graph, sqlite3_value * value)
+{
+/*
+/ checks if some NodeFrom / NodeTo value references a list of Nodes:
+/ - a comma separated list, e.g. '1,2,3' or 'A,B,C'
+/ - a table reference, e.g. '@origins' or '@origins(node_id)'
+/ - for networks using integer Ids, any TEXT value as well
+*/
+    const char *str;
+    if (sqlite3_value_type (value) != SQLITE_TEXT)
+	return 0;
+    if (!(graph->NodeCode))
+	return 1;
+    str = (const char *) sqlite3_value_text (value);
+    if (*str == '@' || strchr (str, ',') != NULL)
+	return 1;
+    return 0;
+}
+
+static void
+add_node_to_list (NetworkNodePtr node, NetworkNodePtr ** list, int *count,
+		  int *max)
+{
+/* appending a Node to some dynamic list; unknown Nodes are simply ignored */
+    if (node == NULL)
+	return;
+    if (*count == *max)
+      {
+	  *max = (*max == 0) ? 64 : *max * 2;
+	  *list = realloc (*list, sizeof (NetworkNodePtr) * *max);
+      }
+    (*list)[*count] = node;
+    *count += 1;
+}
+
+static NetworkNodePtr
+find_node_by_token (NetworkPtr graph, const char *token)
+{
+/* searching a Node by its textual Id or Code */
+    const char *p = token;
+    if (graph->NodeCode)
+	return find_node_by_code (graph, token);
+    if (*p == '-' || *p == '+')
+	p++;
+    if (*p == '\0')
+	return NULL;
+    while (*p != '\0')
+      {
+	  if (*p < '0' || *p > '9')
+	      return NULL;
+	  p++;
+      }
+    return find_node_by_id (graph, atoll (token));
+}
+
+static int
+parse_node_table (sqlite3 * handle, NetworkPtr graph, const char *ref,
+		  NetworkNodePtr ** list, int *count, int *max)
+{
+/* reading a list of Nodes from some table: @table or @table(column) */
+    char *table;
+    char *column = NULL;
+    char *p;
+    char *xtable;
+    char *xcolumn;
+    char *sql;
+    sqlite3_stmt *stmt;
+    int ret;
+    table = malloc (strlen (ref) + 1);
+    strcpy (table, ref);
+    p = strchr (table, '(');
+    if (p != NULL)
+      {
+	  /* an explicit column name */
+	  char *end = strrchr (p, ')');
+	  if (end == NULL || end[1] != '\0')
+	    {
+		free (table);
+		return 0;
+	    }
+	  *end = '\0';
+	  *p = '\0';
+	  column = p + 1;
+      }
+    xtable = gaiaDoubleQuotedSql (table);
+    if (column == NULL)
+	sql = sqlite3_mprintf ("SELECT * FROM \"%s\"", xtable);
+    else
+      {
+	  xcolumn = gaiaDoubleQuotedSql (column);
+	  sql = sqlite3_mprintf ("SELECT \"%s\" FROM \"%s\"", xcolumn, xtable);
+	  free (xcolumn);
+      }
+    free (xtable);
+    free (table);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret != SQLITE_ROW)
+	    {
+		sqlite3_finalize (stmt);
+		return 0;
+	    }
+	  if (graph->NodeCode)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_TEXT)
+		    add_node_to_list (find_node_by_code
+				      (graph,
+				       (const char *) sqlite3_column_text (stmt,
+									   0)),
+				      list, count, max);
+	    }
+	  else
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_INTEGER)
+		    add_node_to_list (find_node_by_id
+				      (graph, sqlite3_column_int64 (stmt, 0)),
+				      list, count, max);
+	    }
+      }
+    sqlite3_finalize (stmt);
+    return 1;
+}
+
+static int
+parse_node_list (sqlite3 * handle, NetworkPtr graph, sqlite3_value * value,
+		 NetworkNodePtr ** list, int *count)
+{
+/* building the list of Nodes corresponding to some NodeFrom / NodeTo value */
+    int max = 0;
+    char *buf;
+    char *token;
+    char *p;
+    char *end;
+    *list = NULL;
+    *count = 0;
+    if (!is_node_list (graph, value))
+      {
+	  /* a single Node */
+	  if (graph->NodeCode)
+	    {
+		if (sqlite3_value_type (value) == SQLITE_TEXT)
+		    add_node_to_list (find_node_by_code
+				      (graph,
+				       (const char *) sqlite3_value_text (value)),
+				      list, count, &max);
+	    }
+	  else
+	    {
+		if (sqlite3_value_type (value) == SQLITE_INTEGER)
+		    add_node_to_list (find_node_by_id
+				      (graph, sqlite3_value_int64 (value)),
+				      list, count, &max);
+	    }
+	  return 1;
+      }
+    p = (char *) sqlite3_value_text (value);
+    if (*p == '@')
+	return parse_node_table (handle, graph, p + 1, list, count, &max);
+/* a comma separated list */
+    buf = malloc (strlen (p) + 1);
+    strcpy (buf, p);
+    token = buf;
+    while (token != NULL)
+      {
+	  p = strchr (token, ',');
+	  if (p != NULL)
+	      *p++ = '\0';
+	  while (*token == ' ')
+	      token++;
+	  end = token + strlen (token);
+	  while (end > token && *(end - 1) == ' ')
+	      *--end = '\0';
+	  if (*token != '\0')
+	      add_node_to_list (find_node_by_token (graph, token), list,
+				count, &max);
+	  token = p;
+      }
+    free (buf);
+    return 1;
+}
+
+static MatrixSolutionPtr
+matrix_solve (VirtualNetworkPtr net, sqlite3_value * from,
+	      sqlite3_value * to)
+{
+/* computing a One-to-Many / Many-to-Many solution */
+    int i;
+    RoutingNodesPtr routing;
+    MatrixSolutionPtr matrix = malloc (sizeof (MatrixSolution));
+    matrix->From = NULL;
+    matrix->To = NULL;
+    matrix->Costs = NULL;
+    matrix->NumFrom = 0;
+    matrix->NumTo = 0;
+    matrix->CurrentIndex = 0;
+    if (!parse_node_list
+	(net->db, net->graph, from, &(matrix->From), &(matrix->NumFrom))
+	|| !parse_node_list (net->db, net->graph, to, &(matrix->To),
+			     &(matrix->NumTo)))
+      {
+	  delete_matrix (matrix);
+	  return NULL;
+      }
+    if (net->currentAlgorithm == VNET_CH_ALGORITHM && net->hierarchy)
+	matrix->Algorithm = VNET_CH_ALGORITHM;
+    else
+	matrix->Algorithm = VNET_DIJKSTRA_ALGORITHM;
+    if (matrix->NumFrom == 0 || matrix->NumTo == 0)
+	return matrix;
+    matrix->Costs =
+	malloc (sizeof (double) * (size_t) matrix->NumFrom * matrix->NumTo);
+    routing = vnet_routing_acquire (net);
+    if (matrix->Algorithm == VNET_CH_ALGORITHM)
+	ch_many_to_many (net->hierarchy, routing, matrix->From,
+			 matrix->NumFrom, matrix->To, matrix->NumTo,
+			 matrix->Costs);
+    else
+      {
+	  /* a single One-to-Many expansion for each origin */
+	  for (i = 0; i < matrix->NumFrom; i++)
+	      dijkstra_one_to_many (routing, matrix->From[i], matrix->To,
+				    matrix->NumTo,
+				    matrix->Costs +
+				    ((size_t) i * matrix->NumTo));
+      }
+    routing_release (net->shared, routing);
+    return matrix;
+}
+
+static void
+delete_isochrone (IsochroneSolutionPtr iso)
+{
+/* deleting the current Isochrone solution */
+    if (!iso)
+	return;
+    if (iso->Nodes)
+	free (iso->Nodes);
+    if (iso->Arcs)
+	free (iso->Arcs);
+    if (iso->Costs)
+	free (iso->Costs);
+    if (iso->Hull)
+	gaiaFreeGeomColl (iso->Hull);
+    free (iso);
+}
+
+static IsochroneSolutionPtr
+isochrone_solve (VirtualNetworkPtr net, sqlite3_value * from,
+		 sqlite3_value * budget, int strict)
+{
+/* computing an Isochrone solution */
+    IsochroneSolutionPtr iso = malloc (sizeof (IsochroneSolution));
+    iso->Source = NULL;
+    iso->Budget = 0.0;
+    iso->Strict = strict;
+    iso->Count = 0;
+    iso->Max = 0;
+    iso->Nodes = NULL;
+    iso->Arcs = NULL;
+    iso->Costs = NULL;
+    iso->CurrentIndex = 0;
+    iso->HullDone = 0;
+    iso->Hull = NULL;
+    if (net->graph->NodeCode)
+      {
+	  /* Nodes are identified by TEXT Codes */
+	  if (sqlite3_value_type (from) == SQLITE_TEXT)
+	      iso->Source =
+		  find_node_by_code (net->graph,
+				     (const char *) sqlite3_value_text (from));
+      }
+    else
+      {
+	  /* Nodes are identified by INT Ids */
+	  if (sqlite3_value_type (from) == SQLITE_INTEGER)
+	      iso->Source =
+		  find_node_by_id (net->graph, sqlite3_value_int64 (from));
+      }
+    if (sqlite3_value_type (budget) == SQLITE_FLOAT
+	|| sqlite3_value_type (budget) == SQLITE_INTEGER)
+	iso->Budget = sqlite3_value_double (budget);
+    else
+	iso->Source = NULL;
+    if (iso->Source)
+      {
+	  RoutingNodesPtr routing = vnet_routing_acquire (net);
+	  dijkstra_within_cost (routing, net->graph, iso);
+	  routing_release (net->shared, routing);
+      }
+    return iso;
+}
+
+static void
+isochrone_add_vertices (gaiaGeomCollPtr points, gaiaGeomCollPtr geom)
+{
+/* copying all Linestring vertices into the Isochrone points collection */
+    int iv;
+    double x;
+    double y;
+    double z;
+    double m;
+    gaiaLinestringPtr ln = geom->FirstLinestring;
+    while (ln)
+      {
+	  for (iv = 0; iv < ln->Points; iv++)
+	    {
+		if (ln->DimensionModel == GAIA_XY_Z)
+		  {
+		      gaiaGetPointXYZ (ln->Coords, iv, &x, &y, &z);
+		  }
+		else if (ln->DimensionModel == GAIA_XY_M)
+		  {
+		      gaiaGetPointXYM (ln->Coords, iv, &x, &y, &m);
+		  }
+		else if (ln->DimensionModel == GAIA_XY_Z_M)
+		  {
+		      gaiaGetPointXYZM (ln->Coords, iv, &x, &y, &z, &m);
+		  }
+		else
+		  {
+		      gaiaGetPoint (ln->Coords, iv, &x, &y);
+		  }
+		gaiaAddPointToGeomColl (points, x, y);
+	    }
+	  ln = ln->Next;
+      }
+}
+
+static gaiaGeomCollPtr
+isochrone_hull (sqlite3 * handle, NetworkPtr graph, IsochroneSolutionPtr iso)
+{
+/*
+/ building the Concave Hull enclosing the reachable area; all vertices
+/ of the Arcs belonging to the Shortest Path tree are considered
+*/
+    gaiaGeomCollPtr points;
+    gaiaGeomCollPtr hull = NULL;
+    gaiaOutBuffer sql_statement;
+    sqlite3_stmt *stmt;
+    char *xgeom;
+    char *xtable;
+    char *sql;
+    int ret;
+    int i;
+    int base = 1;
+    int block = 128;
+    int how_many;
+    int ind;
+    if (iso->Count < 3)
+	return NULL;
+    points = gaiaAllocGeomColl ();
+    xgeom = gaiaDoubleQuotedSql (graph->GeometryColumn);
+    xtable = gaiaDoubleQuotedSql (graph->TableName);
+    while (base < iso->Count)
+      {
+	  /* requesting max 128 arcs at each time */
+	  how_many = iso->Count - base;
+	  if (how_many > block)
+	      how_many = block;
+	  gaiaOutBufferInitialize (&sql_statement);
+	  sql =
+	      sqlite3_mprintf ("SELECT \"%s\" FROM \"%s\" WHERE ROWID IN (",
+			       xgeom, xtable);
+	  gaiaAppendToOutBuffer (&sql_statement, sql);
+	  sqlite3_free (sql);
+	  for (i = 0; i < how_many; i++)
+	    {
+		if (i == 0)
+		    gaiaAppendToOutBuffer (&sql_statement, "?");
+		else
+		    gaiaAppendToOutBuffer (&sql_statement, ",?");
+	    }
+	  gaiaAppendToOutBuffer (&sql_statement, ")");
+	  if (sql_statement.Error == 0 && sql_statement.Buffer != NULL)
+	      ret =
+		  sqlite3_prepare_v2 (handle, sql_statement.Buffer,
+				      strlen (sql_statement.Buffer), &stmt,
+				      NULL);
+	  else
+	      ret = SQLITE_ERROR;
+	  gaiaOutBufferReset (&sql_statement);
+	  if (ret != SQLITE_OK)
+	      goto stop;
+	  ind = 1;
+	  for (i = base; i < base + how_many; i++)
+	      sqlite3_bind_int64 (stmt, ind++, iso->Arcs[i]->ArcRowid);
+	  while (1)
+	    {
+		ret = sqlite3_step (stmt);
+		if (ret == SQLITE_DONE)
+		    break;
+		if (ret != SQLITE_ROW)
+		  {
+		      sqlite3_finalize (stmt);
+		      goto stop;
+		  }
+		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
+		  {
+		      gaiaGeomCollPtr geom =
+			  gaiaFromSpatiaLiteBlobWkb ((const unsigned char *)
+						     sqlite3_column_blob (stmt,
+									  0),
+						     sqlite3_column_bytes (stmt,
+									   0));
+		      if (geom)
+			{
+			    points->Srid = geom->Srid;
+			    isochrone_add_vertices (points, geom);
+			    gaiaFreeGeomColl (geom);
+			}
+		  }
+	    }
+	  sqlite3_finalize (stmt);
+	  base += how_many;
+      }
+#ifndef OMIT_GEOS		/* only if GEOS is supported */
+#ifdef GEOS_TRUNK		/* GEOS experimental features */
+    hull = gaiaConcaveHull (points, 3.0, 0.0, 0);
+    if (hull)
+	hull->Srid = points->Srid;
+#endif /* end GEOS experimental features */
+#endif /* end GEOS conditional */
+  stop:
+    free (xgeom);
+    free (xtable);
+    gaiaFreeGeomColl (points);
+    return hull;
+}
+
+static void
+network_image_release (unsigned char *image, size_t size, int mapped)
+{
+/* releasing a NETWORK binary image */
+#if !defined(_WIN32) && !defined(WIN32)
+    if (mapped)
+      {
+	  munmap (image, size);
+	  return;
+      }
+#else
+    size = size;		/* unused arg warning suppression */
+    mapped = mapped;		/* unused arg warning suppression */
+#endif
+    free (image);
+}
+
+static int
+network_intern_code (NetworkPtr graph, const char *code)
+{
+/* storing a TEXT Code into the strings pool; returns its offset */
+    int len = strlen (code) + 1;
+    int offset = graph->CodesSize;
+    if (graph->CodesSize + len > graph->MaxCodes)
+      {
+	  while (graph->CodesSize + len > graph->MaxCodes)
+	      graph->MaxCodes =
+		  (graph->MaxCodes == 0) ? 4096 : graph->MaxCodes * 2;
+	  graph->Codes = realloc (graph->Codes, graph->MaxCodes);
+      }
+    memcpy (graph->Codes + offset, code, len);
+    graph->CodesSize += len;
+    return offset;
+}
+
+static void
+network_finalize (NetworkPtr graph)
+{
+/*
+/ ensuring that the Arcs are sorted by Node internal index
+/ [NETWORK Blocks are not strictly required to list the Nodes in order]
+*/
+    int i;
+    int pos = 0;
+    int sorted = 1;
+    NetworkArcPtr arcs;
+    NetworkNodePtr pN;
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  pN = graph->Nodes + i;
+	  if (pN->NumArcs > 0 && pN->FirstArc != pos)
+	      sorted = 0;
+	  pos += pN->NumArcs;
+      }
+    if (sorted)
+	return;
+    arcs = malloc (sizeof (NetworkArc) * (graph->NumArcs + 1));
+    pos = 0;
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  pN = graph->Nodes + i;
+	  memcpy (arcs + pos, graph->Arcs + pN->FirstArc,
+		  sizeof (NetworkArc) * pN->NumArcs);
+	  pN->FirstArc = pos;
+	  pos += pN->NumArcs;
+      }
+    free (graph->Arcs);
+    graph->Arcs = arcs;
+    graph->MaxArcs = graph->NumArcs;
+}
+
+static void
+network_free (NetworkPtr p)
+{
+/* memory cleanup; freeing any allocation for the network struct */
+    if (!p)
+	return;
+    if (p->Image)
+	network_image_release (p->Image, p->ImageSize, p->ImageMapped);
+    else
+      {
+	  if (p->Nodes)
+	      free (p->Nodes);
+	  if (p->Arcs)
+	      free (p->Arcs);
+	  if (p->Codes)
+	      free (p->Codes);
+      }
+    if (p->InIndex)
+	free (p->InIndex);
+    if (p->InArcs)
+	free (p->InArcs);
+    if (p->TableName)
+	free (p->TableName);
+    if (p->FromColumn)
+	free (p->FromColumn);
+    if (p->ToColumn)
+	free (p->ToColumn);
+    if (p->GeometryColumn)
+	free (p->GeometryColumn);
+    if (p->NameColumn)
+	free (p->NameColumn);
+    free (p);
+}
+
+static NetworkPtr
+network_init (const unsigned char *blob, int size)
+{
+/* parsing the HEADER block */
+    NetworkPtr graph;
+    int net64;
+    int aStar = 0;
+    int nodes;
+    int node_code;
+    int max_code_length;
+    int endian_arch = gaiaEndianArch ();
+    const char *table;
+    const char *from;
+    const char *to;
+    const char *geom;
+    const char *name = NULL;
+    double a_star_coeff = 1.0;
+    int len;
+    int i;
+    const unsigned char *ptr;
+    if (size < 9)
+	return NULL;
+    if (*(blob + 0) == GAIA_NET_START)	/* signature - legacy format using 32bit ints */
+	net64 = 0;
+    else if (*(blob + 0) == GAIA_NET64_START)	/* signature - format using 64bit ints */
+	net64 = 1;
+    else if (*(blob + 0) == GAIA_NET64_A_STAR_START)	/* signature - format using 64bit ints AND supporting A* */
+      {
+	  net64 = 1;
+	  aStar = 1;
+      }
+    else
+	return NULL;
+    if (*(blob + 1) != GAIA_NET_HEADER)	/* signature */
+	return NULL;
+    nodes = gaiaImport32 (blob + 2, 1, endian_arch);	/* # nodes */
+    if (nodes <= 0)
+	return NULL;
+    if (*(blob + 6) == GAIA_NET_CODE)	/* Nodes identified by a TEXT code */
+	node_code = 1;
+    else if (*(blob + 6) == GAIA_NET_ID)	/* Nodes indentified by an INTEGER id */
+	node_code = 0;
+    else
+	return NULL;
     max_code_length = *(blob + 7);	/* Max TEXT Code length */
     if (*(blob + 8) != GAIA_NET_TABLE)	/* signature for TABLE NAME */
 	return NULL;
-    ptr = blob + 9;
-    len = gaiaImport16 (ptr, 1, endian_arch);	/* TABLE NAME is varlen */
-    ptr += 2;
-    table = (char *) ptr;
-    ptr += len;
-    if (*ptr != GAIA_NET_FROM)	/* signature for FromNode COLUMN */
+    ptr = blob + 9;
+    len = gaiaImport16 (ptr, 1, endian_arch);	/* TABLE NAME is varlen */
+    ptr += 2;
+    table = (char *) ptr;
+    ptr += len;
+    if (*ptr != GAIA_NET_FROM)	/* signature for FromNode COLUMN */
+	return NULL;
+    ptr++;
+    len = gaiaImport16 (ptr, 1, endian_arch);	/* FromNode COLUMN is varlen */
+    ptr += 2;
+    from = (char *) ptr;
+    ptr += len;
+    if (*ptr != GAIA_NET_TO)	/* signature for ToNode COLUMN */
+	return NULL;
+    ptr++;
+    len = gaiaImport16 (ptr, 1, endian_arch);	/* ToNode COLUMN is varlen */
+    ptr += 2;
+    to = (char *) ptr;
+    ptr += len;
+    if (*ptr != GAIA_NET_GEOM)	/* signature for Geometry COLUMN */
+	return NULL;
+    ptr++;
+    len = gaiaImport16 (ptr, 1, endian_arch);	/* Geometry COLUMN is varlen */
+    ptr += 2;
+    geom = (char *) ptr;
+    ptr += len;
+    if (net64)
+      {
+	  if (*ptr != GAIA_NET_NAME)	/* signature for Name COLUMN - may be empty */
+	      return NULL;
+	  ptr++;
+	  len = gaiaImport16 (ptr, 1, endian_arch);	/* Name COLUMN is varlen */
+	  ptr += 2;
+	  name = (char *) ptr;
+	  ptr += len;
+      }
+    if (net64 && aStar)
+      {
+	  if (*ptr != GAIA_NET_A_STAR_COEFF)	/* signature for A* Heuristic Coeff */
+	      return NULL;
+	  ptr++;
+	  a_star_coeff = gaiaImport64 (ptr, 1, endian_arch);
+	  ptr += 8;
+      }
+    if (*ptr != GAIA_NET_END)	/* signature */
+	return NULL;
+    graph = malloc (sizeof (Network));
+    graph->Net64 = net64;
+    graph->AStar = aStar;
+    graph->EndianArch = endian_arch;
+    graph->CurrentIndex = 0;
+    graph->NodeCode = node_code;
+    graph->MaxCodeLength = max_code_length;
+    graph->NumNodes = nodes;
+    graph->Nodes = malloc (sizeof (NetworkNode) * nodes);
+    for (i = 0; i < nodes; i++)
+      {
+	  /* initializing the Nodes */
+	  NetworkNodePtr pN = graph->Nodes + i;
+	  pN->Id = -1;
+	  pN->CoordX = DBL_MAX;
+	  pN->CoordY = DBL_MAX;
+	  pN->InternalIndex = i;
+	  pN->CodeOffset = -1;
+	  pN->FirstArc = 0;
+	  pN->NumArcs = 0;
+      }
+    graph->NumArcs = 0;
+    graph->MaxArcs = 0;
+    graph->Arcs = NULL;
+    graph->Codes = NULL;
+    graph->CodesSize = 0;
+    graph->MaxCodes = 0;
+    graph->Image = NULL;
+    graph->ImageSize = 0;
+    graph->ImageMapped = 0;
+    graph->InIndex = NULL;
+    graph->InArcs = NULL;
+    len = strlen (table);
+    graph->TableName = malloc (len + 1);
+    strcpy (graph->TableName, table);
+    len = strlen (from);
+    graph->FromColumn = malloc (len + 1);
+    strcpy (graph->FromColumn, from);
+    len = strlen (to);
+    graph->ToColumn = malloc (len + 1);
+    strcpy (graph->ToColumn, to);
+    len = strlen (geom);
+    graph->GeometryColumn = malloc (len + 1);
+    strcpy (graph->GeometryColumn, geom);
+    if (!net64)
+      {
+	  /* Name column is not supported */
+	  graph->NameColumn = NULL;
+      }
+    else
+      {
+	  len = strlen (name);
+	  if (len <= 1)
+	      graph->NameColumn = NULL;
+	  else
+	    {
+		graph->NameColumn = malloc (len + 1);
+		strcpy (graph->NameColumn, name);
+	    }
+      }
+    graph->AStarHeuristicCoeff = a_star_coeff;
+    return graph;
+}
+
+static int
+network_block (NetworkPtr graph, const unsigned char *blob, int size)
+{
+/* parsing a NETWORK Block */
+    const unsigned char *in = blob;
+    int nodes;
+    int i;
+    int ia;
+    int index;
+    char code[256];
+    double x;
+    double y;
+    sqlite3_int64 nodeId = -1;
+    int arcs;
+    NetworkNodePtr pN;
+    NetworkArcPtr pA;
+    sqlite3_int64 arcId;
+    int nodeToIdx;
+    double cost;
+    if (size < 3)
+	goto error;
+    if (*in++ != GAIA_NET_BLOCK)	/* signature */
+	goto error;
+    nodes = gaiaImport16 (in, 1, graph->EndianArch);	/* # Nodes */
+    in += 2;
+    for (i = 0; i < nodes; i++)
+      {
+	  /* parsing each node */
+	  if ((size - (in - blob)) < 5)
+	      goto error;
+	  if (*in++ != GAIA_NET_NODE)	/* signature */
+	      goto error;
+	  index = gaiaImport32 (in, 1, graph->EndianArch);	/* node internal index */
+	  in += 4;
+	  if (index < 0 || index >= graph->NumNodes)
+	      goto error;
+	  if (graph->NodeCode)
+	    {
+		/* Nodes are identified by a TEXT Code */
+		if ((size - (in - blob)) < graph->MaxCodeLength)
+		    goto error;
+		memcpy (code, in, graph->MaxCodeLength);
+		in += graph->MaxCodeLength;
+	    }
+	  else
+	    {
+		/* Nodes are identified by an INTEGER Id */
+		if (graph->Net64)
+		  {
+		      if ((size - (in - blob)) < 8)
+			  goto error;
+		      nodeId = gaiaImportI64 (in, 1, graph->EndianArch);	/* the Node ID: 64bit */
+		      in += 8;
+		  }
+		else
+		  {
+		      if ((size - (in - blob)) < 4)
+			  goto error;
+		      nodeId = gaiaImport32 (in, 1, graph->EndianArch);	/* the Node ID: 32bit */
+		      in += 4;
+		  }
+	    }
+	  if (graph->AStar)
+	    {
+		/* fetching node's X,Y coords */
+		if ((size - (in - blob)) < 8)
+		    goto error;
+		x = gaiaImport64 (in, 1, graph->EndianArch);	/* X coord */
+		in += 8;
+		if ((size - (in - blob)) < 8)
+		    goto error;
+		y = gaiaImport64 (in, 1, graph->EndianArch);	/* Y coord */
+		in += 8;
+	    }
+	  else
+	    {
+		x = DBL_MAX;
+		y = DBL_MAX;
+	    }
+	  if ((size - (in - blob)) < 2)
+	      goto error;
+	  arcs = gaiaImport16 (in, 1, graph->EndianArch);	/* # Arcs */
+	  in += 2;
+	  if (arcs < 0)
+	      goto error;
+	  /* initializing the Node */
+	  pN = graph->Nodes + index;
+	  pN->InternalIndex = index;
+	  if (graph->NodeCode)
+	    {
+		/* Nodes are identified by a TEXT Code */
+		pN->Id = -1;
+		code[graph->MaxCodeLength] = '\0';
+		pN->CodeOffset = network_intern_code (graph, code);
+	    }
+	  else
+	    {
+		/* Nodes are identified by an INTEGER Id */
+		pN->Id = nodeId;
+		pN->CodeOffset = -1;
+	    }
+	  pN->CoordX = x;
+	  pN->CoordY = y;
+	  pN->FirstArc = graph->NumArcs;
+	  pN->NumArcs = arcs;
+	  if (arcs)
+	    {
+		/* parsing the Arcs */
+		if (graph->NumArcs + arcs > graph->MaxArcs)
+		  {
+		      while (graph->NumArcs + arcs > graph->MaxArcs)
+			  graph->MaxArcs =
+			      (graph->MaxArcs == 0) ? 1024 : graph->MaxArcs * 2;
+		      graph->Arcs =
+			  realloc (graph->Arcs,
+				   sizeof (NetworkArc) * graph->MaxArcs);
+		  }
+		for (ia = 0; ia < arcs; ia++)
+		  {
+		      /* parsing each Arc */
+		      if (graph->Net64)
+			{
+			    if ((size - (in - blob)) < 22)
+				goto error;
+			}
+		      else
+			{
+			    if ((size - (in - blob)) < 18)
+				goto error;
+			}
+		      if (*in++ != GAIA_NET_ARC)	/* signature */
+			  goto error;
+		      if (graph->Net64)
+			{
+			    arcId = gaiaImportI64 (in, 1, graph->EndianArch);	/* # Arc ROWID: 64bit */
+			    in += 8;
+			}
+		      else
+			{
+			    arcId = gaiaImport32 (in, 1, graph->EndianArch);	/* # Arc ROWID: 32bit */
+			    in += 4;
+			}
+		      nodeToIdx = gaiaImport32 (in, 1, graph->EndianArch);	/* # NodeTo internal index */
+		      in += 4;
+		      cost = gaiaImport64 (in, 1, graph->EndianArch);	/* # Cost */
+		      in += 8;
+		      if (*in++ != GAIA_NET_END)	/* signature */
+			  goto error;
+		      pA = graph->Arcs + graph->NumArcs + ia;
+		      /* initializing the Arc */
+		      if (nodeToIdx < 0 || nodeToIdx >= graph->NumNodes)
+			  goto error;
+		      pA->NodeFrom = index;
+		      pA->NodeTo = nodeToIdx;
+		      pA->ArcRowid = arcId;
+		      pA->Cost = cost;
+		  }
+		graph->NumArcs += arcs;
+	    }
+	  if ((size - (in - blob)) < 1)
+	      goto error;
+	  if (*in++ != GAIA_NET_END)	/* signature */
+	      goto error;
+      }
+    return 1;
+  error:
+    return 0;
+}
+
+static NetworkPtr
+load_network_data (sqlite3 * handle, const char *table)
+{
+/* loads the NETWORK struct by parsing the NetworkData table */
+    NetworkPtr graph = NULL;
+    sqlite3_stmt *stmt;
+    char *sql;
+    int ret;
+    int header = 1;
+    const unsigned char *blob;
+    int size;
+    char *xname;
+    xname = gaiaDoubleQuotedSql (table);
+    sql = sqlite3_mprintf ("SELECT NetworkData FROM \"%s\" ORDER BY Id", xname);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto abort;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret == SQLITE_ROW)
+	    {
+		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
+		  {
+		      blob =
+			  (const unsigned char *) sqlite3_column_blob (stmt, 0);
+		      size = sqlite3_column_bytes (stmt, 0);
+		      if (header)
+			{
+			    /* parsing the HEADER block */
+			    graph = network_init (blob, size);
+			    header = 0;
+			}
+		      else
+			{
+			    /* parsing ordinary Blocks */
+			    if (!graph)
+			      {
+				  sqlite3_finalize (stmt);
+				  goto abort;
+			      }
+			    if (!network_block (graph, blob, size))
+			      {
+				  sqlite3_finalize (stmt);
+				  goto abort;
+			      }
+			}
+		  }
+		else
+		  {
+		      sqlite3_finalize (stmt);
+		      goto abort;
+		  }
+	    }
+	  else
+	    {
+		sqlite3_finalize (stmt);
+		goto abort;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    if (graph)
+	network_finalize (graph);
+    return graph;
+  abort:
+    network_free (graph);
+    return NULL;
+}
+
+static int
+network_fingerprint_update (sqlite3 * handle, const char *sql,
+			    sqlite3_uint64 * hash)
+{
+/* adding all BLOBs returned by some query to a FNV-1a 64bit hash */
+    sqlite3_stmt *stmt;
+    int ret;
+    int i;
+    int size;
+    const unsigned char *blob;
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret != SQLITE_ROW)
+	    {
+		sqlite3_finalize (stmt);
+		return 0;
+	    }
+	  blob = (const unsigned char *) sqlite3_column_blob (stmt, 0);
+	  size = sqlite3_column_bytes (stmt, 0);
+	  for (i = 0; i < 4; i++)
+	    {
+		/* hashing the Block length */
+		*hash ^= (size >> (i * 8)) & 0xff;
+		*hash *= 0x100000001b3ULL;
+	    }
+	  for (i = 0; i < size; i++)
+	    {
+		*hash ^= blob[i];
+		*hash *= 0x100000001b3ULL;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    return 1;
+}
+
+static int
+network_fingerprint (sqlite3 * handle, const char *table,
+		     sqlite3_int64 * fingerprint)
+{
+/*
+/ computing a FNV-1a 64bit hash of the whole NetworkData table:
+/ a binary image is considered to be valid only if its own
+/ fingerprint exactly matches the current one
+*/
+    char *sql;
+    char *xname;
+    int ret;
+    sqlite3_uint64 hash = 0xcbf29ce484222325ULL;
+    xname = gaiaDoubleQuotedSql (table);
+    sql = sqlite3_mprintf ("SELECT NetworkData FROM \"%s\" ORDER BY Id", xname);
+    free (xname);
+    ret = network_fingerprint_update (handle, sql, &hash);
+    sqlite3_free (sql);
+    if (!ret)
+	return 0;
+    *fingerprint = (sqlite3_int64) hash;
+    return 1;
+}
+
+static int
+network_fingerprint_stored (sqlite3 * handle, const char *table,
+			    const char *kind, const char *source,
+			    sqlite3_int64 * fingerprint)
+{
+/*
+/ retrieving the fingerprint stored into "<table>_fingerprint" at
+/ build time; it's valid only if the triggers invalidating it on
+/ any change of the source table are still in place
+*/
+    char *name;
+    char *xname;
+    char *sql;
+    int ret;
+    int ok = 0;
+    sqlite3_stmt *stmt;
+    name = sqlite3_mprintf ("%s_fingerprint", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql = sqlite3_mprintf ("SELECT Fingerprint FROM \"%s\" WHERE Kind = %Q "
+			   "AND (SELECT Count(*) FROM sqlite_master WHERE "
+			   "type = 'trigger' AND Lower(name) IN (Lower('%q_fp_insert'), "
+			   "Lower('%q_fp_update'), Lower('%q_fp_delete'))) = 3",
+			   xname, kind, source, source, source);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_ROW && sqlite3_column_type (stmt, 0) == SQLITE_INTEGER)
+      {
+	  *fingerprint = sqlite3_column_int64 (stmt, 0);
+	  ok = 1;
+      }
+    sqlite3_finalize (stmt);
+    return ok;
+}
+
+static int
+network_fingerprint_install (sqlite3 * handle, const char *table,
+			     const char *kind, const char *source,
+			     sqlite3_int64 fingerprint)
+{
+/*
+/ storing a fingerprint into "<table>_fingerprint"; the triggers
+/ installed on the source table will delete it on any change
+*/
+    static const char *events[3] = { "INSERT", "UPDATE", "DELETE" };
+    static const char *suffixes[3] = { "insert", "update", "delete" };
+    char *name;
+    char *xname;
+    char *xsource;
+    char *xtrigger;
+    char *sql;
+    int ret;
+    int i;
+    sqlite3_stmt *stmt;
+    name = sqlite3_mprintf ("%s_fingerprint", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql = sqlite3_mprintf ("CREATE TABLE IF NOT EXISTS \"%s\" ("
+			   "Kind TEXT NOT NULL PRIMARY KEY, "
+			   "Fingerprint INTEGER NOT NULL)", xname);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+    xsource = gaiaDoubleQuotedSql (source);
+    for (i = 0; i < 3; i++)
+      {
+	  name = sqlite3_mprintf ("%s_fp_%s", source, suffixes[i]);
+	  xtrigger = gaiaDoubleQuotedSql (name);
+	  sqlite3_free (name);
+	  sql = sqlite3_mprintf ("CREATE TRIGGER IF NOT EXISTS \"%s\" "
+				 "AFTER %s ON \"%s\" FOR EACH ROW BEGIN "
+				 "DELETE FROM \"%s\" WHERE Kind = %Q; END",
+				 xtrigger, events[i], xsource, xname, kind);
+	  free (xtrigger);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	    {
+		free (xsource);
+		goto error;
+	    }
+      }
+    free (xsource);
+    sql = sqlite3_mprintf ("INSERT OR REPLACE INTO \"%s\" (Kind, Fingerprint) "
+			   "VALUES (%Q, ?)", xname, kind);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    sqlite3_bind_int64 (stmt, 1, fingerprint);
+    ret = sqlite3_step (stmt);
+    sqlite3_finalize (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+    return 0;
+  error:
+    free (xname);
+    return 0;
+}
+
+static int
+network_image_string (NetworkPtr graph, const char *str)
+{
+/* interning a table/column name into the strings pool; -1 if NULL */
+    if (str == NULL)
+	return -1;
+    return network_intern_code (graph, str);
+}
+
+static unsigned char *
+network_image_build (NetworkPtr graph, sqlite3_int64 fingerprint,
+		     size_t * size)
+{
+/* builds a binary image corresponding to some NETWORK struct */
+    NetworkImageHeader hdr;
+    unsigned char *image;
+    unsigned char *p;
+    size_t nodes_size = sizeof (NetworkNode) * graph->NumNodes;
+    size_t arcs_size = sizeof (NetworkArc) * graph->NumArcs;
+    memset (&hdr, 0, sizeof (NetworkImageHeader));
+    memcpy (hdr.Magic, VNET_IMAGE_MAGIC, 8);
+    hdr.ByteOrder = VNET_IMAGE_BYTE_ORDER;
+    hdr.Version = VNET_IMAGE_VERSION;
+    hdr.Net64 = graph->Net64;
+    hdr.AStar = graph->AStar;
+    hdr.NodeCode = graph->NodeCode;
+    hdr.MaxCodeLength = graph->MaxCodeLength;
+    hdr.NumNodes = graph->NumNodes;
+    hdr.NumArcs = graph->NumArcs;
+/* the names are appended to the strings pool */
+    hdr.TableName = network_image_string (graph, graph->TableName);
+    hdr.FromColumn = network_image_string (graph, graph->FromColumn);
+    hdr.ToColumn = network_image_string (graph, graph->ToColumn);
+    hdr.GeometryColumn = network_image_string (graph, graph->GeometryColumn);
+    hdr.NameColumn = network_image_string (graph, graph->NameColumn);
+    hdr.CodesSize = graph->CodesSize;
+    hdr.AStarHeuristicCoeff = graph->AStarHeuristicCoeff;
+    hdr.Fingerprint = fingerprint;
+    *size = sizeof (NetworkImageHeader) + nodes_size + arcs_size +
+	graph->CodesSize;
+    image = malloc (*size);
+    if (image == NULL)
+	return NULL;
+    p = image;
+    memcpy (p, &hdr, sizeof (NetworkImageHeader));
+    p += sizeof (NetworkImageHeader);
+    memcpy (p, graph->Nodes, nodes_size);
+    p += nodes_size;
+    if (arcs_size > 0)
+	memcpy (p, graph->Arcs, arcs_size);
+    p += arcs_size;
+    if (graph->CodesSize > 0)
+	memcpy (p, graph->Codes, graph->CodesSize);
+    return image;
+}
+
+static char *
+network_image_name (const char *pool, int size, int offset)
+{
+/* copying a table/column name from the strings pool */
+    char *name;
+    int len;
+    if (offset < 0 || offset >= size)
+	return NULL;
+    len = strlen (pool + offset);
+    name = malloc (len + 1);
+    strcpy (name, pool + offset);
+    return name;
+}
+
+static NetworkPtr
+network_from_image (unsigned char *image, size_t size, int mapped,
+		    sqlite3_int64 fingerprint)
+{
+/*
+/ validating a binary image and then building a NETWORK struct
+/ directly pointing into it; returns NULL if the image is invalid
+/ or stale [the image is never released by this function]
+*/
+    NetworkImageHeader hdr;
+    NetworkPtr graph;
+    NetworkNodePtr nodes;
+    NetworkArcPtr arcs;
+    char *pool;
+    int i;
+    if (size < sizeof (NetworkImageHeader))
+	return NULL;
+    memcpy (&hdr, image, sizeof (NetworkImageHeader));
+    if (memcmp (hdr.Magic, VNET_IMAGE_MAGIC, 8) != 0)
+	return NULL;
+    if (hdr.ByteOrder != VNET_IMAGE_BYTE_ORDER
+	|| hdr.Version != VNET_IMAGE_VERSION)
+	return NULL;
+    if (hdr.Fingerprint != fingerprint)
+	return NULL;
+    if (hdr.NumNodes <= 0 || hdr.NumArcs < 0 || hdr.CodesSize <= 0)
+	return NULL;
+    if (size != sizeof (NetworkImageHeader) +
+	(sizeof (NetworkNode) * (size_t) hdr.NumNodes) +
+	(sizeof (NetworkArc) * (size_t) hdr.NumArcs) + hdr.CodesSize)
+	return NULL;
+    nodes = (NetworkNodePtr) (image + sizeof (NetworkImageHeader));
+    arcs = (NetworkArcPtr) (nodes + hdr.NumNodes);
+    pool = (char *) (arcs + hdr.NumArcs);
+    if (pool[hdr.CodesSize - 1] != '\0')
+	return NULL;
+    if (hdr.TableName < 0 || hdr.TableName >= hdr.CodesSize
+	|| hdr.FromColumn < 0 || hdr.FromColumn >= hdr.CodesSize
+	|| hdr.ToColumn < 0 || hdr.ToColumn >= hdr.CodesSize
+	|| hdr.GeometryColumn < 0 || hdr.GeometryColumn >= hdr.CodesSize
+	|| hdr.NameColumn < -1 || hdr.NameColumn >= hdr.CodesSize)
+	return NULL;
+    for (i = 0; i < hdr.NumNodes; i++)
+      {
+	  /* checking the Nodes */
+	  NetworkNodePtr pN = nodes + i;
+	  if (pN->InternalIndex != i)
+	      return NULL;
+	  if (pN->NumArcs < 0 || pN->FirstArc < 0
+	      || pN->FirstArc > hdr.NumArcs - pN->NumArcs)
+	      return NULL;
+	  if (pN->CodeOffset < -1 || pN->CodeOffset >= hdr.CodesSize)
+	      return NULL;
+      }
+    for (i = 0; i < hdr.NumArcs; i++)
+      {
+	  /* checking the Arcs */
+	  NetworkArcPtr pA = arcs + i;
+	  if (pA->NodeFrom < 0 || pA->NodeFrom >= hdr.NumNodes
+	      || pA->NodeTo < 0 || pA->NodeTo >= hdr.NumNodes)
+	      return NULL;
+      }
+    graph = malloc (sizeof (Network));
+    graph->Net64 = hdr.Net64;
+    graph->AStar = hdr.AStar;
+    graph->EndianArch = gaiaEndianArch ();
+    graph->MaxCodeLength = hdr.MaxCodeLength;
+    graph->CurrentIndex = 0;
+    graph->NodeCode = hdr.NodeCode;
+    graph->NumNodes = hdr.NumNodes;
+    graph->TableName = network_image_name (pool, hdr.CodesSize, hdr.TableName);
+    graph->FromColumn =
+	network_image_name (pool, hdr.CodesSize, hdr.FromColumn);
+    graph->ToColumn = network_image_name (pool, hdr.CodesSize, hdr.ToColumn);
+    graph->GeometryColumn =
+	network_image_name (pool, hdr.CodesSize, hdr.GeometryColumn);
+    graph->NameColumn =
+	network_image_name (pool, hdr.CodesSize, hdr.NameColumn);
+    graph->AStarHeuristicCoeff = hdr.AStarHeuristicCoeff;
+    graph->Nodes = nodes;
+    graph->NumArcs = hdr.NumArcs;
+    graph->MaxArcs = hdr.NumArcs;
+    graph->Arcs = arcs;
+    graph->Codes = pool;
+    graph->CodesSize = hdr.CodesSize;
+    graph->MaxCodes = hdr.CodesSize;
+    graph->Image = image;
+    graph->ImageSize = size;
+    graph->ImageMapped = mapped;
+    graph->InIndex = NULL;
+    graph->InArcs = NULL;
+    return graph;
+}
+
+static char *
+network_image_path (sqlite3 * handle, const char *table)
+{
+/* the sidecar file: "<db-file>.<table>.vnet"; NULL for MEMORY DBs */
+    const char *db_path = sqlite3_db_filename (handle, "main");
+    if (db_path == NULL || *db_path == '\0')
+	return NULL;
+    return sqlite3_mprintf ("%s.%s.vnet", db_path, table);
+}
+
+static unsigned char *
+network_image_read_file (const char *path, size_t * size, int *mapped)
+{
+/* reading a sidecar file; memory-mapped whenever possible */
+    FILE *in;
+    long len;
+    unsigned char *image;
+#if !defined(_WIN32) && !defined(WIN32)
+    struct stat st;
+    void *map;
+    int fd = open (path, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    if (fstat (fd, &st) == 0 && st.st_size > 0)
+      {
+	  map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	  if (map != MAP_FAILED)
+	    {
+		close (fd);
+		*size = st.st_size;
+		*mapped = 1;
+		return map;
+	    }
+      }
+    close (fd);
+#endif
+/* falling back to plain stdio */
+    in = fopen (path, "rb");
+    if (in == NULL)
 	return NULL;
-    ptr++;
-    len = gaiaImport16 (ptr, 1, endian_arch);	/* FromNode COLUMN is varlen */
-    ptr += 2;
-    from = (char *) ptr;
-    ptr += len;
-    if (*ptr != GAIA_NET_TO)	/* signature for ToNode COLUMN */
+    if (fseek (in, 0, SEEK_END) != 0 || (len = ftell (in)) <= 0
+	|| fseek (in, 0, SEEK_SET) != 0)
+      {
+	  fclose (in);
+	  return NULL;
+      }
+    image = malloc (len);
+    if (image == NULL || fread (image, 1, len, in) != (size_t) len)
+      {
+	  free (image);
+	  fclose (in);
+	  return NULL;
+      }
+    fclose (in);
+    *size = len;
+    *mapped = 0;
+    return image;
+}
+
+static unsigned char *
+network_image_read_blob (sqlite3 * handle, const char *table, size_t * size)
+{
+/* reading a binary image stored into the "<table>_image" table */
+    sqlite3_stmt *stmt;
+    char *name;
+    char *xname;
+    char *sql;
+    int ret;
+    unsigned char *image = NULL;
+    name = sqlite3_mprintf ("%s_image", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql = sqlite3_mprintf ("SELECT ImageData FROM \"%s\" WHERE Id = 1",
+			   xname);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
 	return NULL;
-    ptr++;
-    len = gaiaImport16 (ptr, 1, endian_arch);	/* ToNode COLUMN is varlen */
-    ptr += 2;
-    to = (char *) ptr;
-    ptr += len;
-    if (*ptr != GAIA_NET_GEOM)	/* signature for Geometry COLUMN */
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_ROW && sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
+      {
+	  /* copying into a properly aligned buffer */
+	  *size = sqlite3_column_bytes (stmt, 0);
+	  image = malloc (*size);
+	  if (image)
+	      memcpy (image, sqlite3_column_blob (stmt, 0), *size);
+      }
+    sqlite3_finalize (stmt);
+    return image;
+}
+
+static NetworkPtr
+load_network (sqlite3 * handle, const char *table)
+{
+/*
+/ loads the NETWORK struct: a valid binary image [sidecar file
+/ first, then "<table>_image"] is always preferred to parsing
+/ the NetworkData table; an image is valid only if it matches
+/ the fingerprint stored at build time
+*/
+    NetworkPtr graph;
+    unsigned char *image;
+    size_t size;
+    int mapped = 0;
+    sqlite3_int64 fingerprint;
+    char *path;
+    int candidate;
+    if (!network_fingerprint_stored
+	(handle, table, "network", table, &fingerprint))
+      {
+	  /* no valid fingerprint: any image could be stale */
+	  return load_network_data (handle, table);
+      }
+    for (candidate = 0; candidate < 2; candidate++)
+      {
+	  image = NULL;
+	  if (candidate == 0)
+	    {
+		path = network_image_path (handle, table);
+		if (path)
+		  {
+		      image = network_image_read_file (path, &size, &mapped);
+		      sqlite3_free (path);
+		  }
+	    }
+	  else
+	    {
+		image = network_image_read_blob (handle, table, &size);
+		mapped = 0;
+	    }
+	  if (image == NULL)
+	      continue;
+	  graph = network_from_image (image, size, mapped, fingerprint);
+	  if (graph)
+	      return graph;
+	  network_image_release (image, size, mapped);
+      }
+    return load_network_data (handle, table);
+}
+
+static int
+network_image_write_file (const char *path, const unsigned char *image,
+			  size_t size)
+{
+/* writing a sidecar file [a temporary file is renamed at the end] */
+    FILE *out;
+    char *tmp = sqlite3_mprintf ("%s.tmp", path);
+    out = fopen (tmp, "wb");
+    if (out == NULL)
+      {
+	  sqlite3_free (tmp);
+	  return 0;
+      }
+    if (fwrite (image, 1, size, out) != size)
+      {
+	  fclose (out);
+	  remove (tmp);
+	  sqlite3_free (tmp);
+	  return 0;
+      }
+    if (fclose (out) != 0)
+      {
+	  remove (tmp);
+	  sqlite3_free (tmp);
+	  return 0;
+      }
+#if defined(_WIN32) || defined(WIN32)
+    remove (path);
+#endif
+    if (rename (tmp, path) != 0)
+      {
+	  remove (tmp);
+	  sqlite3_free (tmp);
+	  return 0;
+      }
+    sqlite3_free (tmp);
+    return 1;
+}
+
+static int
+network_image_store (sqlite3 * handle, const char *table,
+		     const unsigned char *image, size_t size)
+{
+/* creating the "<table>_image" table and storing the binary image */
+    char *name;
+    char *xname;
+    char *sql;
+    char *err_msg = NULL;
+    int ret;
+    sqlite3_stmt *stmt;
+    name = sqlite3_mprintf ("%s_image", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql = sqlite3_mprintf ("DROP TABLE IF EXISTS \"%s\"", xname);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+    sql = sqlite3_mprintf ("CREATE TABLE \"%s\" (Id INTEGER PRIMARY KEY, "
+			   "ImageData BLOB NOT NULL)", xname);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+    sql = sqlite3_mprintf ("INSERT INTO \"%s\" (Id, ImageData) "
+			   "VALUES (1, ?)", xname);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("CreateNetworkImage: %s\n", sqlite3_errmsg (handle));
+	  return 0;
+      }
+    sqlite3_bind_blob (stmt, 1, image, size, SQLITE_STATIC);
+    ret = sqlite3_step (stmt);
+    sqlite3_finalize (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+    spatialite_e ("CreateNetworkImage: %s\n", sqlite3_errmsg (handle));
+    return 0;
+  error:
+    spatialite_e ("CreateNetworkImage: %s\n", err_msg);
+    sqlite3_free (err_msg);
+    free (xname);
+    return 0;
+}
+
+SPATIALITE_PRIVATE int
+create_network_image (void *p_sqlite, const char *table, int sidecar)
+{
+/*
+/ builds a binary image for the NETWORK stored into some NetworkData
+/ table, then saves it either into the "<db-file>.<table>.vnet"
+/ sidecar file or into the "<table>_image" table; the fingerprint
+/ of the NetworkData table goes into "<table>_fingerprint"
+/ returns 1 on success, 0 on failure
+*/
+    sqlite3 *handle = (sqlite3 *) p_sqlite;
+    NetworkPtr graph;
+    unsigned char *image;
+    size_t size;
+    sqlite3_int64 fingerprint;
+    char *path;
+    int ret = 0;
+    if (!network_fingerprint (handle, table, &fingerprint))
+	return 0;
+    graph = load_network_data (handle, table);
+    if (graph == NULL)
+	return 0;
+    image = network_image_build (graph, fingerprint, &size);
+    network_free (graph);
+    if (image == NULL)
+	return 0;
+    if (sidecar)
+      {
+	  path = network_image_path (handle, table);
+	  if (path)
+	    {
+		ret = network_image_write_file (path, image, size);
+		sqlite3_free (path);
+	    }
+      }
+    else
+	ret = network_image_store (handle, table, image, size);
+    free (image);
+    if (ret)
+	ret =
+	    network_fingerprint_install (handle, table, "network", table,
+					 fingerprint);
+    return ret;
+}
+
+static int
+hierarchy_header (NetworkHierarchyPtr ch, const unsigned char *blob, int size,
+		  double *checksum, int endian_arch)
+{
+/* parsing the Contraction Hierarchy HEADER block */
+    if (size != 23)
+	return 0;
+    if (*(blob + 0) != GAIA_NET_CH_START)	/* signature */
+	return 0;
+    if (*(blob + 1) != GAIA_NET_HEADER)	/* signature */
+	return 0;
+    ch->NumNodes = gaiaImport32 (blob + 2, 1, endian_arch);	/* # nodes */
+    ch->NumArcs = gaiaImport32 (blob + 6, 1, endian_arch);	/* # arcs */
+    ch->NumShortcuts = gaiaImport32 (blob + 10, 1, endian_arch);	/* # shortcuts */
+    *checksum = gaiaImport64 (blob + 14, 1, endian_arch);	/* arcs checksum */
+    if (*(blob + 22) != GAIA_NET_END)	/* signature */
+	return 0;
+    if (ch->NumNodes <= 0 || ch->NumArcs < 0 || ch->NumShortcuts < 0)
+	return 0;
+    return 1;
+}
+
+static int
+hierarchy_block (NetworkHierarchyPtr ch, const unsigned char *blob, int size,
+		 int *num_ranks, int *num_shortcuts, int endian_arch)
+{
+/* parsing a Contraction Hierarchy Block */
+    const unsigned char *in = blob;
+    int items;
+    int i;
+    int index;
+    int rank;
+    HierarchyShortcutPtr sc;
+    if (size < 3)
+	return 0;
+    if (*in++ != GAIA_NET_BLOCK)	/* signature */
+	return 0;
+    items = gaiaImport16 (in, 1, endian_arch);	/* # items */
+    in += 2;
+    for (i = 0; i < items; i++)
+      {
+	  if ((size - (in - blob)) < 1)
+	      return 0;
+	  if (*in == GAIA_NET_NODE)
+	    {
+		/* a Node rank */
+		if ((size - (in - blob)) < 10)
+		    return 0;
+		in++;
+		index = gaiaImport32 (in, 1, endian_arch);	/* node internal index */
+		in += 4;
+		rank = gaiaImport32 (in, 1, endian_arch);	/* node rank */
+		in += 4;
+		if (*in++ != GAIA_NET_END)	/* signature */
+		    return 0;
+		if (index < 0 || index >= ch->NumNodes)
+		    return 0;
+		if (ch->Rank[index] >= 0)
+		    return 0;
+		ch->Rank[index] = rank;
+		*num_ranks += 1;
+	    }
+	  else if (*in == GAIA_NET_ARC)
+	    {
+		/* a Shortcut */
+		if ((size - (in - blob)) < 26)
+		    return 0;
+		if (*num_shortcuts >= ch->NumShortcuts)
+		    return 0;
+		in++;
+		sc = ch->Shortcuts + *num_shortcuts;
+		sc->NodeFrom = gaiaImport32 (in, 1, endian_arch);	/* NodeFrom internal index */
+		in += 4;
+		sc->NodeTo = gaiaImport32 (in, 1, endian_arch);	/* NodeTo internal index */
+		in += 4;
+		sc->Cost = gaiaImport64 (in, 1, endian_arch);	/* Cost */
+		in += 8;
+		sc->First = gaiaImport32 (in, 1, endian_arch);	/* first replaced edge */
+		in += 4;
+		sc->Second = gaiaImport32 (in, 1, endian_arch);	/* second replaced edge */
+		in += 4;
+		if (*in++ != GAIA_NET_END)	/* signature */
+		    return 0;
+		if (sc->NodeFrom < 0 || sc->NodeFrom >= ch->NumNodes)
+		    return 0;
+		if (sc->NodeTo < 0 || sc->NodeTo >= ch->NumNodes)
+		    return 0;
+		/* a Shortcut can only replace edges preceding it */
+		if (sc->First < 0 || sc->First >= ch->NumArcs + *num_shortcuts)
+		    return 0;
+		if (sc->Second < 0
+		    || sc->Second >= ch->NumArcs + *num_shortcuts)
+		    return 0;
+		*num_shortcuts += 1;
+	    }
+	  else
+	      return 0;
+      }
+    return 1;
+}
+
+static NetworkHierarchyPtr
+load_hierarchy (sqlite3 * handle, const char *table, NetworkPtr graph)
+{
+/* 
+/ loads the [optional] Contraction Hierarchy stored into "<table>_hierarchy"
+/ returns NULL if there is no Hierarchy or if it doesn't match the NETWORK
+*/
+    NetworkHierarchyPtr ch = NULL;
+    sqlite3_stmt *stmt;
+    char *sql;
+    char *name;
+    char *xname;
+    int ret;
+    int i;
+    int header = 1;
+    int num_arcs;
+    int num_ranks = 0;
+    int num_shortcuts = 0;
+    double checksum;
+    NetworkArcPtr *arcs;
+    const unsigned char *blob;
+    int size;
+    int endian_arch = gaiaEndianArch ();
+    name = sqlite3_mprintf ("%s_hierarchy", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql =
+	sqlite3_mprintf ("SELECT HierarchyData FROM \"%s\" ORDER BY Id",
+			 xname);
+    free (xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
 	return NULL;
-    ptr++;
-    len = gaiaImport16 (ptr, 1, endian_arch);	/* Geometry COLUMN is varlen */
-    ptr += 2;
-    geom = (char *) ptr;
-    ptr += len;
-    if (net64)
+    ch = calloc (1, sizeof (NetworkHierarchy));
+    while (1)
+      {
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;
+	  if (ret != SQLITE_ROW)
+	      goto abort;
+	  if (sqlite3_column_type (stmt, 0) != SQLITE_BLOB)
+	      goto abort;
+	  blob = (const unsigned char *) sqlite3_column_blob (stmt, 0);
+	  size = sqlite3_column_bytes (stmt, 0);
+	  if (header)
+	    {
+		/* parsing the HEADER block */
+		if (!hierarchy_header (ch, blob, size, &checksum, endian_arch))
+		    goto abort;
+		arcs = network_arcs_index (graph, &num_arcs);
+		ch->Arcs = arcs;
+		if (ch->NumNodes != graph->NumNodes || ch->NumArcs != num_arcs)
+		    goto abort;
+		if (network_arcs_checksum (arcs, num_arcs) != checksum)
+		    goto abort;
+		ch->Rank = malloc (sizeof (int) * ch->NumNodes);
+		for (i = 0; i < ch->NumNodes; i++)
+		    ch->Rank[i] = -1;
+		ch->Shortcuts =
+		    malloc (sizeof (HierarchyShortcut) *
+			    (ch->NumShortcuts + 1));
+		header = 0;
+	    }
+	  else
+	    {
+		/* parsing ordinary Blocks */
+		if (!hierarchy_block
+		    (ch, blob, size, &num_ranks, &num_shortcuts, endian_arch))
+		    goto abort;
+	    }
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+    if (header)
+	goto abort;
+    if (num_ranks != ch->NumNodes || num_shortcuts != ch->NumShortcuts)
+	goto abort;
+    if (!hierarchy_prepare (ch))
+	goto abort;
+    return ch;
+  abort:
+    if (stmt)
+	sqlite3_finalize (stmt);
+    hierarchy_free (ch);
+    return NULL;
+}
+
+static char *
+shared_network_strdup (const char *str)
+{
+/* duplicating a string */
+    int len = strlen (str);
+    char *p = malloc (len + 1);
+    strcpy (p, str);
+    return p;
+}
+
+static int
+hierarchy_fingerprint (sqlite3 * handle, const char *table,
+		       sqlite3_int64 * fingerprint)
+{
+/* computing a FNV-1a 64bit hash of the whole "<table>_hierarchy" table */
+    char *sql;
+    char *name;
+    char *xname;
+    int ret;
+    sqlite3_uint64 hash = 0xcbf29ce484222325ULL;
+    name = sqlite3_mprintf ("%s_hierarchy", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql =
+	sqlite3_mprintf ("SELECT HierarchyData FROM \"%s\" ORDER BY Id",
+			 xname);
+    free (xname);
+    ret = network_fingerprint_update (handle, sql, &hash);
+    sqlite3_free (sql);
+    if (!ret)
+	return 0;
+    *fingerprint = (sqlite3_int64) hash;
+    return 1;
+}
+
+static void
+shared_network_mix (sqlite3_uint64 * hash, sqlite3_int64 value)
+{
+/* adding a 64bit value to a FNV-1a 64bit hash */
+    int i;
+    for (i = 0; i < 8; i++)
+      {
+	  *hash ^= ((sqlite3_uint64) value >> (i * 8)) & 0xff;
+	  *hash *= 0x100000001b3ULL;
+      }
+}
+
+static int
+shared_network_stamp (sqlite3 * handle, const char *table,
+		      sqlite3_int64 * stamp)
+{
+/*
+/ cheaply identifying the current state of both the NetworkData table
+/ and the [optional] "<table>_hierarchy" table: their fingerprints
+/ stored at build time, plus the count and the max Id of NetworkData
+/ returns 0 if any required fingerprint is missing
+*/
+    char *sql;
+    char *name;
+    char *xname;
+    int ret;
+    int has_hierarchy = 0;
+    sqlite3_int64 fingerprint;
+    sqlite3_stmt *stmt;
+    sqlite3_uint64 hash = 0xcbf29ce484222325ULL;
+    xname = gaiaDoubleQuotedSql (table);
+    name = sqlite3_mprintf ("%s_hierarchy", table);
+    sql = sqlite3_mprintf ("SELECT (SELECT Count(*) FROM \"%s\"), "
+			   "(SELECT Max(Id) FROM \"%s\"), "
+			   "(SELECT Count(*) FROM sqlite_master WHERE "
+			   "type = 'table' AND Lower(name) = Lower(%Q))",
+			   xname, xname, name);
+    free (xname);
+    sqlite3_free (name);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    ret = sqlite3_step (stmt);
+    if (ret != SQLITE_ROW)
+      {
+	  sqlite3_finalize (stmt);
+	  return 0;
+      }
+    shared_network_mix (&hash, sqlite3_column_int64 (stmt, 0));
+    shared_network_mix (&hash, sqlite3_column_int64 (stmt, 1));
+    has_hierarchy = sqlite3_column_int (stmt, 2);
+    sqlite3_finalize (stmt);
+    if (!network_fingerprint_stored
+	(handle, table, "network", table, &fingerprint))
+	return 0;
+    shared_network_mix (&hash, fingerprint);
+    if (has_hierarchy)
+      {
+	  name = sqlite3_mprintf ("%s_hierarchy", table);
+	  ret =
+	      network_fingerprint_stored (handle, table, "hierarchy", name,
+					  &fingerprint);
+	  sqlite3_free (name);
+	  if (!ret)
+	      return 0;
+	  shared_network_mix (&hash, fingerprint);
+      }
+    *stamp = (sqlite3_int64) hash;
+    return 1;
+}
+
+static int
+shared_network_restamp (sqlite3 * handle, const char *table,
+			sqlite3_int64 * stamp)
+{
+/*
+/ hashing the whole NetworkData and "<table>_hierarchy" tables and
+/ storing their fingerprints; only needed when a NETWORK is (re)loaded
+/ and its fingerprints are missing
+*/
+    char *name;
+    int ret;
+    sqlite3_int64 fingerprint;
+    if (!network_fingerprint (handle, table, &fingerprint))
+	return 0;
+    if (!network_fingerprint_install
+	(handle, table, "network", table, fingerprint))
+	return 0;
+    if (hierarchy_fingerprint (handle, table, &fingerprint))
+      {
+	  name = sqlite3_mprintf ("%s_hierarchy", table);
+	  ret =
+	      network_fingerprint_install (handle, table, "hierarchy", name,
+					   fingerprint);
+	  sqlite3_free (name);
+	  if (!ret)
+	      return 0;
+      }
+    return shared_network_stamp (handle, table, stamp);
+}
+
+static void
+network_reverse_index (NetworkPtr graph)
+{
+/* building the reverse adjacency list [incoming Arcs of each Node] */
+    int i;
+    int *pos;
+    graph->InIndex = malloc (sizeof (int) * (graph->NumNodes + 1));
+    graph->InArcs = malloc (sizeof (int) * (graph->NumArcs + 1));
+    for (i = 0; i <= graph->NumNodes; i++)
+	graph->InIndex[i] = 0;
+    for (i = 0; i < graph->NumArcs; i++)
+	graph->InIndex[graph->Arcs[i].NodeTo + 1] += 1;
+    for (i = 0; i < graph->NumNodes; i++)
+	graph->InIndex[i + 1] += graph->InIndex[i];
+    pos = malloc (sizeof (int) * (graph->NumNodes + 1));
+    for (i = 0; i < graph->NumNodes; i++)
+	pos[i] = graph->InIndex[i];
+    for (i = 0; i < graph->NumArcs; i++)
+	graph->InArcs[pos[graph->Arcs[i].NodeTo]++] = i;
+    free (pos);
+}
+
+static SharedNetworkPtr
+shared_network_load (sqlite3 * handle, const char *table)
+{
+/* loading a NETWORK and its [optional] Contraction Hierarchy */
+    SharedNetworkPtr p;
+    NetworkPtr graph = load_network (handle, table);
+    if (graph == NULL)
+	return NULL;
+    network_reverse_index (graph);
+    p = malloc (sizeof (SharedNetwork));
+    p->DbPath = NULL;
+    p->TableName = NULL;
+    p->Fingerprint = 0;
+    p->Graph = graph;
+    p->Hierarchy = load_hierarchy (handle, table, graph);
+    p->RefCount = 1;
+    p->Listed = 0;
+    p->Mutex = sqlite3_mutex_alloc (SQLITE_MUTEX_FAST);
+    p->Pool = NULL;
+    p->Next = NULL;
+    return p;
+}
+
+static void
+shared_network_free (SharedNetworkPtr p)
+{
+/* memory cleanup; freeing a SharedNetwork and its search status Pool */
+    RoutingNodesPtr e;
+    RoutingNodesPtr en;
+    e = p->Pool;
+    while (e)
       {
-	  if (*ptr != GAIA_NET_NAME)	/* signature for Name COLUMN - may be empty */
-	      return NULL;
-	  ptr++;
-	  len = gaiaImport16 (ptr, 1, endian_arch);	/* Name COLUMN is varlen */
-	  ptr += 2;
-	  name = (char *) ptr;
-	  ptr += len;
+	  en = e->Next;
+	  routing_free (e);
+	  e = en;
       }
-    if (net64 && aStar)
+    if (p->Hierarchy)
+	hierarchy_free (p->Hierarchy);
+    network_free (p->Graph);
+    if (p->Mutex)
+	sqlite3_mutex_free (p->Mutex);
+    if (p->DbPath)
+	free (p->DbPath);
+    if (p->TableName)
+	free (p->TableName);
+    free (p);
+}
+
+static SharedNetworkPtr
+shared_network_find (const char *db_path, const char *table)
+{
+/* searching a shared NETWORK - the caller must hold the list mutex */
+    SharedNetworkPtr p = shared_networks;
+    while (p)
       {
-	  if (*ptr != GAIA_NET_A_STAR_COEFF)	/* signature for A* Heuristic Coeff */
-	      return NULL;
-	  ptr++;
-	  a_star_coeff = gaiaImport64 (ptr, 1, endian_arch);
-	  ptr += 8;
+	  if (strcmp (p->DbPath, db_path) == 0
+	      && strcasecmp (p->TableName, table) == 0)
+	      return p;
+	  p = p->Next;
       }
-    if (*ptr != GAIA_NET_END)	/* signature */
+    return NULL;
+}
+
+static void
+shared_network_unlist (SharedNetworkPtr p)
+{
+/* removing a NETWORK from the shared list - the caller must hold the list mutex */
+    SharedNetworkPtr prev = NULL;
+    SharedNetworkPtr pN = shared_networks;
+    while (pN)
+      {
+	  if (pN == p)
+	    {
+		if (prev)
+		    prev->Next = p->Next;
+		else
+		    shared_networks = p->Next;
+		break;
+	    }
+	  prev = pN;
+	  pN = pN->Next;
+      }
+    p->Listed = 0;
+}
+
+static SharedNetworkPtr
+network_attach (sqlite3 * handle, const char *table, int create)
+{
+/*
+/ attaching a NETWORK shared by all the connections of this process
+/ the NETWORK is loaded only once, by the first connection requiring it
+/ [and reloaded if the NetworkData or the Hierarchy table have changed]
+/ missing fingerprints are only stored by CREATE VIRTUAL TABLE; a
+/ NETWORK lacking them is always privately loaded
+*/
+    sqlite3_mutex *list_mutex = shared_networks_mutex ();
+    SharedNetworkPtr p;
+    SharedNetworkPtr loaded;
+    sqlite3_int64 fingerprint;
+    const char *db_path = sqlite3_db_filename (handle, "main");
+    if (db_path == NULL || *db_path == '\0')
+      {
+	  /* MEMORY or TEMPORARY db: there is nothing to be shared */
+	  return shared_network_load (handle, table);
+      }
+    if (!shared_network_stamp (handle, table, &fingerprint))
+      {
+	  if (!create || !shared_network_restamp (handle, table, &fingerprint))
+	      return shared_network_load (handle, table);
+      }
+    sqlite3_mutex_enter (list_mutex);
+    p = shared_network_find (db_path, table);
+    if (p && p->Fingerprint == fingerprint)
+      {
+	  p->RefCount += 1;
+	  sqlite3_mutex_leave (list_mutex);
+	  return p;
+      }
+    sqlite3_mutex_leave (list_mutex);
+
+/* loading the NETWORK; the list isn't locked meanwhile */
+    loaded = shared_network_load (handle, table);
+    if (loaded == NULL)
 	return NULL;
-    graph = malloc (sizeof (Network));
-    graph->Net64 = net64;
-    graph->AStar = aStar;
-    graph->EndianArch = endian_arch;
-    graph->CurrentIndex = 0;
-    graph->NodeCode = node_code;
-    graph->MaxCodeLength = max_code_length;
-    graph->NumNodes = nodes;
-    graph->Nodes = malloc (sizeof (NetworkNode) * nodes);
-    len = strlen (table);
-    graph->TableName = malloc (len + 1);
-    strcpy (graph->TableName, table);
-    len = strlen (from);
-    graph->FromColumn = malloc (len + 1);
-    strcpy (graph->FromColumn, from);
-    len = strlen (to);
-    graph->ToColumn = malloc (len + 1);
-    strcpy (graph->ToColumn, to);
-    len = strlen (geom);
-    graph->GeometryColumn = malloc (len + 1);
-    strcpy (graph->GeometryColumn, geom);
-    if (!net64)
+    loaded->DbPath = shared_network_strdup (db_path);
+    loaded->TableName = shared_network_strdup (table);
+    loaded->Fingerprint = fingerprint;
+
+    sqlite3_mutex_enter (list_mutex);
+    p = shared_network_find (db_path, table);
+    if (p && p->Fingerprint == fingerprint)
       {
-	  /* Name column is not supported */
-	  graph->NameColumn = NULL;
+	  /* some other connection was faster: using its own NETWORK */
+	  p->RefCount += 1;
+	  sqlite3_mutex_leave (list_mutex);
+	  shared_network_free (loaded);
+	  return p;
       }
-    else
+    if (p)
       {
-	  len = strlen (name);
-	  if (len <= 1)
-	      graph->NameColumn = NULL;
-	  else
-	    {
-		graph->NameColumn = malloc (len + 1);
-		strcpy (graph->NameColumn, name);
-	    }
+	  /* a stale NETWORK: it will be freed by its last user */
+	  shared_network_unlist (p);
       }
-    graph->AStarHeuristicCoeff = a_star_coeff;
-    return graph;
+    loaded->Listed = 1;
+    loaded->Next = shared_networks;
+    shared_networks = loaded;
+    sqlite3_mutex_leave (list_mutex);
+    return loaded;
+}
+
+static void
+network_detach (SharedNetworkPtr p)
+{
+/* detaching a shared NETWORK; the last user destroys it */
+    sqlite3_mutex *list_mutex = shared_networks_mutex ();
+    sqlite3_mutex_enter (list_mutex);
+    p->RefCount -= 1;
+    if (p->RefCount > 0)
+      {
+	  sqlite3_mutex_leave (list_mutex);
+	  return;
+      }
+    if (p->Listed)
+	shared_network_unlist (p);
+    sqlite3_mutex_leave (list_mutex);
+    shared_network_free (p);
 }
 
+/*
+/
+/  implementation of the Arc cost overrides
+/
+/ an [optional] table supporting at least two columns:
+/ - ArcRowid: the ROWID of the Arc [any Arc sharing it, if bidirectional]
+/ - Cost: the actual cost of the Arc, or else
+/ - Multiplier: a factor applied to the Arc cost stored into the NETWORK
+/ a NULL, negative or infinite value means that the Arc is closed
+/
+/ the overridden costs are kept into a per-connection array, reloaded
+/ as soon as the DB has been changed [by any connection]
+/
+*/
+
 static int
-network_block (NetworkPtr graph, const unsigned char *blob, int size)
+cmp_override_arcs (const void *p1, const void *p2)
 {
-/* parsing a NETWORK Block */
-    const unsigned char *in = blob;
-    int nodes;
+/* compares two Arcs by ArcRowid [Index breaking ties] */
+    const CostOverrideArc *a1 = (const CostOverrideArc *) p1;
+    const CostOverrideArc *a2 = (const CostOverrideArc *) p2;
+    if (a1->ArcRowid == a2->ArcRowid)
+	return a1->Index - a2->Index;
+    if (a1->ArcRowid > a2->ArcRowid)
+	return 1;
+    return -1;
+}
+
+static void
+cost_overrides_free (CostOverridesPtr p)
+{
+/* memory cleanup; freeing the Arc cost overrides */
+    if (!p)
+	return;
+    if (p->TableName)
+	free (p->TableName);
+    if (p->RowidColumn)
+	free (p->RowidColumn);
+    if (p->CostColumn)
+	free (p->CostColumn);
+    if (p->ByRowid)
+	free (p->ByRowid);
+    if (p->Costs)
+	free (p->Costs);
+    free (p);
+}
+
+static CostOverridesPtr
+cost_overrides_create (sqlite3 * handle, NetworkPtr graph, const char *table)
+{
+/* checking the overrides table layout and preparing the overrides */
+    CostOverridesPtr p;
+    char *sql;
+    char *xtable;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
     int i;
-    int ia;
-    int index;
-    char code[256];
-    double x;
-    double y;
-    sqlite3_int64 nodeId = -1;
-    int arcs;
-    NetworkNodePtr pN;
-    NetworkArcPtr pA;
-    int len;
-    sqlite3_int64 arcId;
-    int nodeToIdx;
-    double cost;
-    if (size < 3)
-	goto error;
-    if (*in++ != GAIA_NET_BLOCK)	/* signature */
-	goto error;
-    nodes = gaiaImport16 (in, 1, graph->EndianArch);	/* # Nodes */
-    in += 2;
-    for (i = 0; i < nodes; i++)
-      {
-	  /* parsing each node */
-	  if ((size - (in - blob)) < 5)
-	      goto error;
-	  if (*in++ != GAIA_NET_NODE)	/* signature */
-	      goto error;
-	  index = gaiaImport32 (in, 1, graph->EndianArch);	/* node internal index */
-	  in += 4;
-	  if (index < 0 || index >= graph->NumNodes)
-	      goto error;
-	  if (graph->NodeCode)
-	    {
-		/* Nodes are identified by a TEXT Code */
-		if ((size - (in - blob)) < graph->MaxCodeLength)
-		    goto error;
-		memcpy (code, in, graph->MaxCodeLength);
-		in += graph->MaxCodeLength;
-	    }
-	  else
-	    {
-		/* Nodes are identified by an INTEGER Id */
-		if (graph->Net64)
-		  {
-		      if ((size - (in - blob)) < 8)
-			  goto error;
-		      nodeId = gaiaImportI64 (in, 1, graph->EndianArch);	/* the Node ID: 64bit */
-		      in += 8;
-		  }
-		else
-		  {
-		      if ((size - (in - blob)) < 4)
-			  goto error;
-		      nodeId = gaiaImport32 (in, 1, graph->EndianArch);	/* the Node ID: 32bit */
-		      in += 4;
-		  }
-	    }
-	  if (graph->AStar)
-	    {
-		/* fetching node's X,Y coords */
-		if ((size - (in - blob)) < 8)
-		    goto error;
-		x = gaiaImport64 (in, 1, graph->EndianArch);	/* X coord */
-		in += 8;
-		if ((size - (in - blob)) < 8)
-		    goto error;
-		y = gaiaImport64 (in, 1, graph->EndianArch);	/* Y coord */
-		in += 8;
-	    }
-	  else
-	    {
-		x = DBL_MAX;
-		y = DBL_MAX;
-	    }
-	  if ((size - (in - blob)) < 2)
-	      goto error;
-	  arcs = gaiaImport16 (in, 1, graph->EndianArch);	/* # Arcs */
-	  in += 2;
-	  if (arcs < 0)
-	      goto error;
-	  /* initializing the Node */
-	  pN = graph->Nodes + index;
-	  pN->InternalIndex = index;
-	  if (graph->NodeCode)
-	    {
-		/* Nodes are identified by a TEXT Code */
-		pN->Id = -1;
-		len = strlen (code);
-		pN->Code = malloc (len + 1);
-		strcpy (pN->Code, code);
-	    }
-	  else
-	    {
-		/* Nodes are identified by an INTEGER Id */
-		pN->Id = nodeId;
-		pN->Code = NULL;
-	    }
-	  pN->CoordX = x;
-	  pN->CoordY = y;
-	  pN->NumArcs = arcs;
-	  if (arcs)
-	    {
-		/* parsing the Arcs */
-		pN->Arcs = malloc (sizeof (NetworkArc) * arcs);
-		for (ia = 0; ia < arcs; ia++)
-		  {
-		      /* parsing each Arc */
-		      if (graph->Net64)
-			{
-			    if ((size - (in - blob)) < 22)
-				goto error;
-			}
-		      else
-			{
-			    if ((size - (in - blob)) < 18)
-				goto error;
-			}
-		      if (*in++ != GAIA_NET_ARC)	/* signature */
-			  goto error;
-		      if (graph->Net64)
-			{
-			    arcId = gaiaImportI64 (in, 1, graph->EndianArch);	/* # Arc ROWID: 64bit */
-			    in += 8;
-			}
-		      else
-			{
-			    arcId = gaiaImport32 (in, 1, graph->EndianArch);	/* # Arc ROWID: 32bit */
-			    in += 4;
-			}
-		      nodeToIdx = gaiaImport32 (in, 1, graph->EndianArch);	/* # NodeTo internal index */
-		      in += 4;
-		      cost = gaiaImport64 (in, 1, graph->EndianArch);	/* # Cost */
-		      in += 8;
-		      if (*in++ != GAIA_NET_END)	/* signature */
-			  goto error;
-		      pA = pN->Arcs + ia;
-		      /* initializing the Arc */
-		      if (nodeToIdx < 0 || nodeToIdx >= graph->NumNodes)
-			  goto error;
-		      pA->NodeFrom = pN;
-		      pA->NodeTo = graph->Nodes + nodeToIdx;
-		      pA->ArcRowid = arcId;
-		      pA->Cost = cost;
-		  }
+    char *rowid_col = NULL;
+    char *cost_col = NULL;
+    int multiplier = 0;
+    xtable = gaiaDoubleQuotedSql (table);
+    sql = sqlite3_mprintf ("PRAGMA table_info(\"%s\")", xtable);
+    free (xtable);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return NULL;
+    for (i = 1; i <= rows; i++)
+      {
+	  const char *col_name = results[(i * columns) + 1];
+	  if ((strcasecmp (col_name, "ArcRowid") == 0
+	       || strcasecmp (col_name, "arc_rowid") == 0)
+	      && rowid_col == NULL)
+	      rowid_col = shared_network_strdup (col_name);
+	  if (strcasecmp (col_name, "Cost") == 0 && cost_col == NULL)
+	      cost_col = shared_network_strdup (col_name);
+      }
+    for (i = 1; i <= rows; i++)
+      {
+	  const char *col_name = results[(i * columns) + 1];
+	  if (strcasecmp (col_name, "Multiplier") == 0 && cost_col == NULL)
+	    {
+		cost_col = shared_network_strdup (col_name);
+		multiplier = 1;
 	    }
+      }
+    sqlite3_free_table (results);
+    if (rowid_col == NULL || cost_col == NULL)
+      {
+	  /* not a valid overrides table */
+	  if (rowid_col)
+	      free (rowid_col);
+	  if (cost_col)
+	      free (cost_col);
+	  return NULL;
+      }
+    p = malloc (sizeof (CostOverrides));
+    p->TableName = shared_network_strdup (table);
+    p->RowidColumn = rowid_col;
+    p->CostColumn = cost_col;
+    p->Multiplier = multiplier;
+/* sorting the Arcs by ArcRowid */
+    p->ByRowid = malloc (sizeof (CostOverrideArc) * (graph->NumArcs + 1));
+    for (i = 0; i < graph->NumArcs; i++)
+      {
+	  p->ByRowid[i].ArcRowid = graph->Arcs[i].ArcRowid;
+	  p->ByRowid[i].Index = i;
+      }
+    qsort (p->ByRowid, graph->NumArcs, sizeof (CostOverrideArc),
+	   cmp_override_arcs);
+    p->Costs = malloc (sizeof (double) * (graph->NumArcs + 1));
+    p->HeuristicCoeff = graph->AStarHeuristicCoeff;
+    p->Version.DataVersion = -1;
+    p->Version.TotalChanges = -1;
+    return p;
+}
+
+static int
+cost_overrides_find (CostOverridesPtr p, int num_arcs, sqlite3_int64 rowid)
+{
+/* returns the first Arc having the given ArcRowid [binary search] */
+    int lo = 0;
+    int hi = num_arcs;
+    while (lo < hi)
+      {
+	  int mid = lo + ((hi - lo) / 2);
+	  if (p->ByRowid[mid].ArcRowid < rowid)
+	      lo = mid + 1;
 	  else
-	      pN->Arcs = NULL;
-	  if ((size - (in - blob)) < 1)
-	      goto error;
-	  if (*in++ != GAIA_NET_END)	/* signature */
-	      goto error;
+	      hi = mid;
       }
-    return 1;
-  error:
-    return 0;
+    if (lo < num_arcs && p->ByRowid[lo].ArcRowid == rowid)
+	return lo;
+    return -1;
 }
 
-static NetworkPtr
-load_network (sqlite3 * handle, const char *table)
+static void
+cost_overrides_heuristic (NetworkPtr graph, CostOverridesPtr p)
 {
-/* loads the NETWORK struct */
-    NetworkPtr graph = NULL;
+/*
+/ adjusting the A* heuristic coefficient to the overridden costs
+/
+/ the NETWORK coefficient never exceeds Cost / Length for any Arc; an
+/ Arc whose cost has been lowered could break this condition, so making
+/ the heuristic to overestimate and A* to return a wrong path.
+/ the straight distance between the two Nodes never exceeds the Arc
+/ Length, so it can safely replace it here
+*/
+    int i;
+    double coeff = graph->AStarHeuristicCoeff;
+    for (i = 0; i < graph->NumArcs; i++)
+      {
+	  NetworkArcPtr arc = graph->Arcs + i;
+	  double dist;
+	  if (p->Costs[i] >= arc->Cost)
+	      continue;
+	  dist =
+	      a_star_heuristic_distance (graph->Nodes + arc->NodeFrom,
+					 graph->Nodes + arc->NodeTo, 1.0);
+	  if (dist > 0.0 && p->Costs[i] / dist < coeff)
+	      coeff = p->Costs[i] / dist;
+      }
+    p->HeuristicCoeff = coeff;
+}
+
+static int
+cost_overrides_refresh (sqlite3 * handle, NetworkPtr graph,
+			CostOverridesPtr p)
+{
+/* (re)loading the overridden Arc costs, if the DB has been changed */
     sqlite3_stmt *stmt;
     char *sql;
+    char *xtable;
+    char *xrowid;
+    char *xcost;
     int ret;
-    int header = 1;
-    const unsigned char *blob;
-    int size;
-    char *xname;
-    xname = gaiaDoubleQuotedSql (table);
-    sql = sqlite3_mprintf ("SELECT NetworkData FROM \"%s\" ORDER BY Id", xname);
-    free (xname);
+    int i;
+    if (!db_version_changed (handle, &(p->Version)))
+	return 1;
+/* restoring the NETWORK costs */
+    for (i = 0; i < graph->NumArcs; i++)
+	p->Costs[i] = graph->Arcs[i].Cost;
+    xtable = gaiaDoubleQuotedSql (p->TableName);
+    xrowid = gaiaDoubleQuotedSql (p->RowidColumn);
+    xcost = gaiaDoubleQuotedSql (p->CostColumn);
+    sql = sqlite3_mprintf ("SELECT \"%s\", \"%s\" FROM \"%s\"", xrowid,
+			   xcost, xtable);
+    free (xtable);
+    free (xrowid);
+    free (xcost);
     ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
     sqlite3_free (sql);
     if (ret != SQLITE_OK)
-	goto abort;
+      {
+	  p->Version.DataVersion = -1;
+	  return 0;
+      }
     while (1)
       {
+	  sqlite3_int64 rowid;
+	  double value;
+	  int closed;
 	  ret = sqlite3_step (stmt);
 	  if (ret == SQLITE_DONE)
 	      break;
-	  if (ret == SQLITE_ROW)
+	  if (ret != SQLITE_ROW)
 	    {
-		if (sqlite3_column_type (stmt, 0) == SQLITE_BLOB)
-		  {
-		      blob =
-			  (const unsigned char *) sqlite3_column_blob (stmt, 0);
-		      size = sqlite3_column_bytes (stmt, 0);
-		      if (header)
-			{
-			    /* parsing the HEADER block */
-			    graph = network_init (blob, size);
-			    header = 0;
-			}
-		      else
-			{
-			    /* parsing ordinary Blocks */
-			    if (!graph)
-			      {
-				  sqlite3_finalize (stmt);
-				  goto abort;
-			      }
-			    if (!network_block (graph, blob, size))
-			      {
-				  sqlite3_finalize (stmt);
-				  goto abort;
-			      }
-			}
-		  }
-		else
-		  {
-		      sqlite3_finalize (stmt);
-		      goto abort;
-		  }
+		sqlite3_finalize (stmt);
+		p->Version.DataVersion = -1;
+		return 0;
 	    }
+	  if (sqlite3_column_type (stmt, 0) != SQLITE_INTEGER)
+	      continue;
+	  rowid = sqlite3_column_int64 (stmt, 0);
+	  i = cost_overrides_find (p, graph->NumArcs, rowid);
+	  if (i < 0)
+	      continue;
+	  closed = 0;
+	  value = 0.0;
+	  if (sqlite3_column_type (stmt, 1) == SQLITE_INTEGER
+	      || sqlite3_column_type (stmt, 1) == SQLITE_FLOAT)
+	      value = sqlite3_column_double (stmt, 1);
 	  else
+	      closed = 1;
+	  for (; i < graph->NumArcs && p->ByRowid[i].ArcRowid == rowid; i++)
 	    {
-		sqlite3_finalize (stmt);
-		goto abort;
+		/* updating any Arc sharing this ArcRowid */
+		int index = p->ByRowid[i].Index;
+		double cost = value;
+		if (p->Multiplier)
+		    cost *= graph->Arcs[index].Cost;
+		if (closed || cost < 0.0 || cost >= DBL_MAX || cost != cost)
+		    cost = DBL_MAX;
+		p->Costs[index] = cost;
 	    }
       }
     sqlite3_finalize (stmt);
-    return graph;
-  abort:
-    network_free (graph);
-    return NULL;
+    cost_overrides_heuristic (graph, p);
+    return 1;
 }
 
+/* END of Arc cost overrides implementation */
+
 static int
-vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
-	     sqlite3_vtab ** ppVTab, char **pzErr)
+vnet_init (sqlite3 * db, void *pAux, int argc, const char *const *argv,
+	   sqlite3_vtab ** ppVTab, char **pzErr, int create)
 {
-/* creates the virtual table connected to some shapefile */
+/* initializing the virtual table [common to both CREATE and CONNECT] */
     VirtualNetworkPtr p_vt;
     int err;
     int ret;
@@ -1613,6 +5043,7 @@ vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     int n_columns;
     char *vtable = NULL;
     char *table = NULL;
+    char *overrides = NULL;
     const char *col_name = NULL;
     char **results;
     char *err_msg = NULL;
@@ -1620,20 +5051,21 @@ vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     int ok_id;
     int ok_data;
     char *xname;
-    NetworkPtr graph = NULL;
     if (pAux)
 	pAux = pAux;		/* unused arg warning suppression */
 /* checking for table_name and geo_column_name */
-    if (argc == 4)
+    if (argc == 4 || argc == 5)
       {
 	  vtable = gaiaDequotedSql (argv[2]);
 	  table = gaiaDequotedSql (argv[3]);
+	  if (argc == 5)
+	      overrides = gaiaDequotedSql (argv[4]);
       }
     else
       {
 	  *pzErr =
 	      sqlite3_mprintf
-	      ("[VirtualNetwork module] CREATE VIRTUAL: illegal arg list {NETWORK-DATAtable}\n");
+	      ("[VirtualNetwork module] CREATE VIRTUAL: illegal arg list {NETWORK-DATAtable [, COST-OVERRIDEStable]}\n");
 	  goto error;
       }
 /* retrieving the base table columns */
@@ -1680,8 +5112,8 @@ vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     p_vt = (VirtualNetworkPtr) sqlite3_malloc (sizeof (VirtualNetwork));
     if (!p_vt)
 	return SQLITE_NOMEM;
-    graph = load_network (db, table);
-    if (!graph)
+    p_vt->shared = network_attach (db, table, create);
+    if (!p_vt->shared)
       {
 	  /* something is going the wrong way */
 	  *pzErr =
@@ -1690,9 +5122,31 @@ vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  goto error;
       }
     p_vt->db = db;
-    p_vt->graph = graph;
+    p_vt->graph = p_vt->shared->Graph;
     p_vt->currentAlgorithm = VNET_DIJKSTRA_ALGORITHM;
-    p_vt->routing = NULL;
+    p_vt->hierarchy = p_vt->shared->Hierarchy;
+    p_vt->overrides = NULL;
+    p_vt->arc_cache = arc_cache_alloc ();
+    if (overrides)
+      {
+	  /* the Hierarchy doesn't know about the overridden costs */
+	  p_vt->hierarchy = NULL;
+	  p_vt->overrides =
+	      cost_overrides_create (db, p_vt->graph, overrides);
+	  if (p_vt->overrides == NULL)
+	    {
+		*pzErr =
+		    sqlite3_mprintf
+		    ("[VirtualNetwork module] invalid COST-OVERRIDES table \"%s\"\n",
+		     overrides);
+		arc_cache_free (p_vt->arc_cache);
+		network_detach (p_vt->shared);
+		sqlite3_free (p_vt);
+		goto error;
+	    }
+      }
+    if (p_vt->hierarchy)
+	p_vt->currentAlgorithm = VNET_CH_ALGORITHM;
     p_vt->pModule = &my_net_module;
     p_vt->nRef = 0;
     p_vt->zErrMsg = NULL;
@@ -1742,37 +5196,53 @@ vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
       }
     sqlite3_free (sql);
     *ppVTab = (sqlite3_vtab *) p_vt;
-    p_vt->routing = routing_init (p_vt->graph);
     free (table);
     free (vtable);
+    if (overrides)
+	free (overrides);
     return SQLITE_OK;
   error:
     if (table)
 	free (table);
     if (vtable)
 	free (vtable);
+    if (overrides)
+	free (overrides);
     return SQLITE_ERROR;
 }
 
+static int
+vnet_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
+	     sqlite3_vtab ** ppVTab, char **pzErr)
+{
+/* creates the virtual table; missing fingerprints will be stored */
+    return vnet_init (db, pAux, argc, argv, ppVTab, pzErr, 1);
+}
+
 static int
 vnet_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	      sqlite3_vtab ** ppVTab, char **pzErr)
 {
-/* connects the virtual table to some shapefile - simply aliases vshp_create() */
-    return vnet_create (db, pAux, argc, argv, ppVTab, pzErr);
+/* connects the virtual table to some shapefile */
+    return vnet_init (db, pAux, argc, argv, ppVTab, pzErr, 0);
 }
 
 static int
 vnet_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 {
-/* best index selection */
-    int i;
-    int errors = 0;
+/*
+/ best index selection
+/ any further constraint [e.g. LIMIT, or a filter on Cost when
+/ querying a Shortest Path] is not consumed, so to be evaluated by SQLite
+*/
     int err = 1;
+    int i;
     int from = 0;
     int to = 0;
+    int cost = 0;
     int i_from = -1;
     int i_to = -1;
+    int i_cost = -1;
     if (pVTab)
 	pVTab = pVTab;		/* unused arg warning suppression */
     for (i = 0; i < pIdxInfo->nConstraint; i++)
@@ -1791,26 +5261,38 @@ vnet_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIdxInfo)
 		      to++;
 		      i_to = i;
 		  }
-		else
-		    errors++;
+		else if (p->iColumn == 4
+			 && (p->op == SQLITE_INDEX_CONSTRAINT_LE
+			     || p->op == SQLITE_INDEX_CONSTRAINT_LT))
+		  {
+		      cost++;
+		      i_cost = i;
+		  }
 	    }
       }
-    if (from == 1 && to == 1 && errors == 0)
+    if (from == 1 && to == 0 && cost == 1)
       {
-	  /* this one is a valid Shortest Path query */
-	  if (i_from < i_to)
-	      pIdxInfo->idxNum = 1;	/* first arg is FROM */
+	  /* this one is a valid Isochrone query */
+	  if (pIdxInfo->aConstraint[i_cost].op == SQLITE_INDEX_CONSTRAINT_LT)
+	      pIdxInfo->idxNum = 4;	/* Cost < budget */
 	  else
-	      pIdxInfo->idxNum = 2;	/* first arg is TO */
+	      pIdxInfo->idxNum = 3;	/* Cost <= budget */
 	  pIdxInfo->estimatedCost = 1.0;
-	  for (i = 0; i < pIdxInfo->nConstraint; i++)
-	    {
-		if (pIdxInfo->aConstraint[i].usable)
-		  {
-		      pIdxInfo->aConstraintUsage[i].argvIndex = i + 1;
-		      pIdxInfo->aConstraintUsage[i].omit = 1;
-		  }
-	    }
+	  pIdxInfo->aConstraintUsage[i_from].argvIndex = 1;
+	  pIdxInfo->aConstraintUsage[i_from].omit = 1;
+	  pIdxInfo->aConstraintUsage[i_cost].argvIndex = 2;
+	  pIdxInfo->aConstraintUsage[i_cost].omit = 1;
+	  err = 0;
+      }
+    if (from == 1 && to == 1)
+      {
+	  /* this one is a valid Shortest Path query */
+	  pIdxInfo->idxNum = 1;	/* first arg is FROM */
+	  pIdxInfo->estimatedCost = 1.0;
+	  pIdxInfo->aConstraintUsage[i_from].argvIndex = 1;
+	  pIdxInfo->aConstraintUsage[i_from].omit = 1;
+	  pIdxInfo->aConstraintUsage[i_to].argvIndex = 2;
+	  pIdxInfo->aConstraintUsage[i_to].omit = 1;
 	  err = 0;
       }
     if (err)
@@ -1826,10 +5308,11 @@ vnet_disconnect (sqlite3_vtab * pVTab)
 {
 /* disconnects the virtual table */
     VirtualNetworkPtr p_vt = (VirtualNetworkPtr) pVTab;
-    if (p_vt->routing)
-	routing_free (p_vt->routing);
-    if (p_vt->graph)
-	network_free (p_vt->graph);
+    if (p_vt->overrides)
+	cost_overrides_free (p_vt->overrides);
+    arc_cache_free (p_vt->arc_cache);
+    if (p_vt->shared)
+	network_detach (p_vt->shared);
     sqlite3_free (p_vt);
     return SQLITE_OK;
 }
@@ -1863,6 +5346,8 @@ vnet_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
 	return SQLITE_ERROR;
     cursor->pVtab = (VirtualNetworkPtr) pVTab;
     cursor->solution = alloc_solution ();
+    cursor->matrix = NULL;
+    cursor->isochrone = NULL;
     cursor->eof = 0;
     *ppCursor = (sqlite3_vtab_cursor *) cursor;
     return SQLITE_OK;
@@ -1874,6 +5359,8 @@ vnet_close (sqlite3_vtab_cursor * pCursor)
 /* closing the cursor */
     VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
     delete_solution (cursor->solution);
+    delete_matrix (cursor->matrix);
+    delete_isochrone (cursor->isochrone);
     sqlite3_free (pCursor);
     return SQLITE_OK;
 }
@@ -1890,7 +5377,37 @@ vnet_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	idxStr = idxStr;	/* unused arg warning suppression */
     node_code = net->graph->NodeCode;
     reset_solution (cursor->solution);
+    delete_matrix (cursor->matrix);
+    cursor->matrix = NULL;
+    delete_isochrone (cursor->isochrone);
+    cursor->isochrone = NULL;
     cursor->eof = 1;
+    if (net->overrides)
+      {
+	  /* refreshing the Arc cost overrides */
+	  if (!cost_overrides_refresh (net->db, net->graph, net->overrides))
+	      return SQLITE_ERROR;
+      }
+    if ((idxNum == 3 || idxNum == 4) && argc == 2)
+      {
+	  /* Isochrone query: any Node reachable within the given cost */
+	  cursor->isochrone =
+	      isochrone_solve (net, argv[0], argv[1], (idxNum == 4) ? 1 : 0);
+	  cursor->eof = 0;
+	  return SQLITE_OK;
+      }
+    if (idxNum == 1 && argc == 2
+	&& (is_node_list (net->graph, argv[0])
+	    || is_node_list (net->graph, argv[1])))
+      {
+	  /* One-to-Many / Many-to-Many query */
+	  cursor->matrix = matrix_solve (net, argv[0], argv[1]);
+	  if (cursor->matrix == NULL)
+	      return SQLITE_ERROR;
+	  if (cursor->matrix->NumFrom > 0 && cursor->matrix->NumTo > 0)
+	      cursor->eof = 0;
+	  return SQLITE_OK;
+      }
     if (idxNum == 1 && argc == 2)
       {
 	  /* retrieving the Shortest Path From/To params */
@@ -1921,99 +5438,262 @@ vnet_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 					 sqlite3_value_int (argv[1]));
 	    }
       }
-    if (idxNum == 2 && argc == 2)
+    if (cursor->solution->From && cursor->solution->To)
       {
-	  /* retrieving the Shortest Path To/From params */
-	  if (node_code)
-	    {
-		/* Nodes are identified by TEXT Codes */
-		if (sqlite3_value_type (argv[0]) == SQLITE_TEXT)
-		    cursor->solution->To =
-			find_node_by_code (net->graph,
-					   (char *)
-					   sqlite3_value_text (argv[0]));
-		if (sqlite3_value_type (argv[1]) == SQLITE_TEXT)
-		    cursor->solution->From =
-			find_node_by_code (net->graph,
-					   (char *)
-					   sqlite3_value_text (argv[1]));
-	    }
+	  RoutingNodesPtr routing = vnet_routing_acquire (net);
+	  cursor->eof = 0;
+	  if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
+	      a_star_solve (net->db, net->graph, routing, net->arc_cache,
+			    cursor->solution);
+	  else if (net->currentAlgorithm == VNET_CH_ALGORITHM)
+	      ch_solve (net->db, net->graph, net->hierarchy, routing,
+			net->arc_cache, cursor->solution);
+	  else if (net->currentAlgorithm == VNET_BI_DIJKSTRA_ALGORITHM)
+	      bidirectional_solve (net->db, net->graph, routing, 0,
+				   net->arc_cache, cursor->solution);
+	  else if (net->currentAlgorithm == VNET_BI_A_STAR_ALGORITHM)
+	      bidirectional_solve (net->db, net->graph, routing, 1,
+				   net->arc_cache, cursor->solution);
+	  else
+	      dijkstra_solve (net->db, net->graph, routing, net->arc_cache,
+			      cursor->solution);
+	  routing_release (net->shared, routing);
+	  return SQLITE_OK;
+      }
+    cursor->eof = 0;
+    return SQLITE_OK;
+}
+
+static int
+vnet_next (sqlite3_vtab_cursor * pCursor)
+{
+/* fetching a next row from cursor */
+    VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
+    if (cursor->isochrone)
+      {
+	  /* Isochrone: one row for each reachable Node */
+	  cursor->isochrone->CurrentIndex++;
+	  if (cursor->isochrone->CurrentIndex > cursor->isochrone->Count)
+	      cursor->eof = 1;
+	  return SQLITE_OK;
+      }
+    if (cursor->matrix)
+      {
+	  /* One-to-Many / Many-to-Many: one row for each From/To pair */
+	  cursor->matrix->CurrentIndex++;
+	  if (cursor->matrix->CurrentIndex >=
+	      cursor->matrix->NumFrom * cursor->matrix->NumTo)
+	      cursor->eof = 1;
+	  return SQLITE_OK;
+      }
+    if (cursor->solution->CurrentRowId == 0)
+	cursor->solution->CurrentRow = cursor->solution->First;
+    else
+	cursor->solution->CurrentRow = cursor->solution->CurrentRow->Next;
+    if (!(cursor->solution->CurrentRow))
+      {
+	  cursor->eof = 1;
+	  return SQLITE_OK;
+      }
+    (cursor->solution->CurrentRowId)++;
+    vnet_read_row (cursor);
+    return SQLITE_OK;
+}
+
+static int
+vnet_eof (sqlite3_vtab_cursor * pCursor)
+{
+/* cursor EOF */
+    VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
+    return cursor->eof;
+}
+
+static const char *
+vnet_algorithm_name (int algorithm)
+{
+/* returns the name of some Shortest Path Algorithm */
+    switch (algorithm)
+      {
+      case VNET_A_STAR_ALGORITHM:
+	  return "A*";
+      case VNET_CH_ALGORITHM:
+	  return "CH";
+      case VNET_BI_DIJKSTRA_ALGORITHM:
+	  return "BiDijkstra";
+      case VNET_BI_A_STAR_ALGORITHM:
+	  return "BiA*";
+      }
+    return "Dijkstra";
+}
+
+static int
+vnet_matrix_column (VirtualNetworkCursorPtr cursor, sqlite3_context * pContext,
+		    int column)
+{
+/* fetching value for the Nth column - One-to-Many / Many-to-Many solution */
+    VirtualNetworkPtr net = (VirtualNetworkPtr) cursor->pVtab;
+    MatrixSolutionPtr matrix = cursor->matrix;
+    NetworkNodePtr node;
+    const char *algorithm;
+    double cost;
+    if (column == 0)
+      {
+	  /* the used Algorithm */
+	  if (matrix->Algorithm == VNET_CH_ALGORITHM)
+	      algorithm = "CH";
+	  else
+	      algorithm = "Dijkstra";
+	  sqlite3_result_text (pContext, algorithm, strlen (algorithm),
+			       SQLITE_STATIC);
+      }
+    if (column == 2 || column == 3)
+      {
+	  /* the NodeFrom / NodeTo columns */
+	  if (column == 2)
+	      node = matrix->From[matrix->CurrentIndex / matrix->NumTo];
 	  else
+	      node = matrix->To[matrix->CurrentIndex % matrix->NumTo];
+	  if (net->graph->NodeCode)
+	      sqlite3_result_text (pContext,
+				   network_node_code (net->graph, node), -1,
+				   SQLITE_STATIC);
+	  else
+	      sqlite3_result_int64 (pContext, node->Id);
+      }
+    if (column == 4)
+      {
+	  /* the Cost column; NULL if the destination is unreachable */
+	  cost = matrix->Costs[matrix->CurrentIndex];
+	  if (cost == DBL_MAX)
+	      sqlite3_result_null (pContext);
+	  else
+	      sqlite3_result_double (pContext, cost);
+      }
+    if (column == 1 || column > 4)
+      {
+	  /* ArcRowid, Geometry and Name are meaningless */
+	  sqlite3_result_null (pContext);
+      }
+    return SQLITE_OK;
+}
+
+static void
+vnet_result_node (sqlite3_context * pContext, NetworkPtr graph,
+		  const NetworkNode * node)
+{
+/* returning a Node as a column value */
+    if (node == NULL)
+	sqlite3_result_null (pContext);
+    else if (graph->NodeCode)
+	sqlite3_result_text (pContext, network_node_code (graph, node), -1,
+			     SQLITE_STATIC);
+    else
+	sqlite3_result_int64 (pContext, node->Id);
+}
+
+static int
+vnet_isochrone_column (VirtualNetworkCursorPtr cursor,
+		       sqlite3_context * pContext, int column)
+{
+/*
+/ fetching value for the Nth column - Isochrone solution
+/ the first row summarizes the solution, and its Geometry is the
+/ Concave Hull of the reachable area [only built when requested]
+*/
+    VirtualNetworkPtr net = (VirtualNetworkPtr) cursor->pVtab;
+    IsochroneSolutionPtr iso = cursor->isochrone;
+    int idx = iso->CurrentIndex - 1;
+    const char *algorithm = "Dijkstra";
+    if (column == 0)
+      {
+	  /* the used Algorithm */
+	  sqlite3_result_text (pContext, algorithm, strlen (algorithm),
+			       SQLITE_STATIC);
+	  return SQLITE_OK;
+      }
+    if (iso->Source == NULL)
+      {
+	  /* empty [uninitialized] solution */
+	  sqlite3_result_null (pContext);
+	  return SQLITE_OK;
+      }
+    if (idx < 0)
+      {
+	  /* special case: this one is the solution summary */
+	  if (column == 2)
+	      vnet_result_node (pContext, net->graph, iso->Source);
+	  else if (column == 4)
+	      sqlite3_result_double (pContext, iso->Budget);
+	  else if (column == 5)
 	    {
-		/* Nodes are identified by INT Ids */
-		if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER)
-		    cursor->solution->To =
-			find_node_by_id (net->graph,
-					 sqlite3_value_int (argv[0]));
-		if (sqlite3_value_type (argv[1]) == SQLITE_INTEGER)
-		    cursor->solution->From =
-			find_node_by_id (net->graph,
-					 sqlite3_value_int (argv[1]));
+		/* the Geometry column */
+		if (!(iso->HullDone))
+		  {
+		      iso->Hull = isochrone_hull (net->db, net->graph, iso);
+		      iso->HullDone = 1;
+		  }
+		if (!(iso->Hull))
+		    sqlite3_result_null (pContext);
+		else
+		  {
+		      /* builds the BLOB geometry to be returned */
+		      int len;
+		      unsigned char *p_result = NULL;
+		      gaiaToSpatiaLiteBlobWkb (iso->Hull, &p_result, &len);
+		      sqlite3_result_blob (pContext, p_result, len, free);
+		  }
 	    }
+	  else
+	      sqlite3_result_null (pContext);
+	  return SQLITE_OK;
       }
-    if (cursor->solution->From && cursor->solution->To)
+/* ordinary case: this one is a reachable Node */
+    if (column == 1)
       {
-	  cursor->eof = 0;
-	  if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
-	      a_star_solve (net->db, net->graph, net->routing,
-			    cursor->solution);
+	  /* the ArcRowId column: the last Arc leading to this Node */
+	  if (iso->Arcs[idx] == NULL)
+	      sqlite3_result_null (pContext);
 	  else
-	      dijkstra_solve (net->db, net->graph, net->routing,
-			      cursor->solution);
-	  return SQLITE_OK;
+	      sqlite3_result_int64 (pContext, iso->Arcs[idx]->ArcRowid);
       }
-    cursor->eof = 0;
-    return SQLITE_OK;
-}
-
-static int
-vnet_next (sqlite3_vtab_cursor * pCursor)
-{
-/* fetching a next row from cursor */
-    VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
-    if (cursor->solution->CurrentRowId == 0)
-	cursor->solution->CurrentRow = cursor->solution->First;
-    else
-	cursor->solution->CurrentRow = cursor->solution->CurrentRow->Next;
-    if (!(cursor->solution->CurrentRow))
+    else if (column == 2)
       {
-	  cursor->eof = 1;
-	  return SQLITE_OK;
+	  /* the NodeFrom column */
+	  if (iso->Arcs[idx] == NULL)
+	      vnet_result_node (pContext, net->graph, iso->Nodes[idx]);
+	  else
+	      vnet_result_node (pContext, net->graph,
+				net->graph->Nodes + iso->Arcs[idx]->NodeFrom);
       }
-    (cursor->solution->CurrentRowId)++;
-    vnet_read_row (cursor);
+    else if (column == 3)
+	vnet_result_node (pContext, net->graph, iso->Nodes[idx]);
+    else if (column == 4)
+	sqlite3_result_double (pContext, iso->Costs[idx]);
+    else
+	sqlite3_result_null (pContext);
     return SQLITE_OK;
 }
 
-static int
-vnet_eof (sqlite3_vtab_cursor * pCursor)
-{
-/* cursor EOF */
-    VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
-    return cursor->eof;
-}
-
 static int
 vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 	     int column)
 {
 /* fetching value for the Nth column */
     RowSolutionPtr row;
-    int node_code = 0;
     const char *algorithm;
     VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
     VirtualNetworkPtr net = (VirtualNetworkPtr) cursor->pVtab;
-    node_code = net->graph->NodeCode;
+    if (cursor->matrix)
+	return vnet_matrix_column (cursor, pContext, column);
+    if (cursor->isochrone)
+	return vnet_isochrone_column (cursor, pContext, column);
     if (cursor->solution->CurrentRow == 0)
       {
 	  /* special case: this one is the solution summary */
 	  if (column == 0)
 	    {
 		/* the currently used Algorithm */
-		if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
-		    algorithm = "A*";
-		else
-		    algorithm = "Dijkstra";
+		algorithm = vnet_algorithm_name (net->currentAlgorithm);
 		sqlite3_result_text (pContext, algorithm, strlen (algorithm),
 				     SQLITE_STATIC);
 	    }
@@ -2032,22 +5712,12 @@ vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 	  if (column == 2)
 	    {
 		/* the NodeFrom column */
-		if (node_code)
-		    sqlite3_result_text (pContext, cursor->solution->From->Code,
-					 strlen (cursor->solution->From->Code),
-					 SQLITE_STATIC);
-		else
-		    sqlite3_result_int64 (pContext, cursor->solution->From->Id);
+		vnet_result_node (pContext, net->graph, cursor->solution->From);
 	    }
 	  if (column == 3)
 	    {
 		/* the NodeTo column */
-		if (node_code)
-		    sqlite3_result_text (pContext, cursor->solution->To->Code,
-					 strlen (cursor->solution->To->Code),
-					 SQLITE_STATIC);
-		else
-		    sqlite3_result_int64 (pContext, cursor->solution->To->Id);
+		vnet_result_node (pContext, net->graph, cursor->solution->To);
 	    }
 	  if (column == 4)
 	    {
@@ -2060,14 +5730,9 @@ vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 		if (!(cursor->solution->Geometry))
 		    sqlite3_result_null (pContext);
 		else
-		  {
-		      /* builds the BLOB geometry to be returned */
-		      int len;
-		      unsigned char *p_result = NULL;
-		      gaiaToSpatiaLiteBlobWkb (cursor->solution->Geometry,
-					       &p_result, &len);
-		      sqlite3_result_blob (pContext, p_result, len, free);
-		  }
+		    sqlite3_result_blob (pContext, cursor->solution->Geometry,
+					 cursor->solution->GeometrySize,
+					 SQLITE_TRANSIENT);
 	    }
 	  if (column == 6)
 	    {
@@ -2082,10 +5747,7 @@ vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 	  if (column == 0)
 	    {
 		/* the currently used Algorithm */
-		if (net->currentAlgorithm == VNET_A_STAR_ALGORITHM)
-		    algorithm = "A*";
-		else
-		    algorithm = "Dijkstra";
+		algorithm = vnet_algorithm_name (net->currentAlgorithm);
 		sqlite3_result_text (pContext, algorithm, strlen (algorithm),
 				     SQLITE_STATIC);
 	    }
@@ -2097,27 +5759,19 @@ vnet_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 	  if (column == 2)
 	    {
 		/* the NodeFrom column */
-		if (node_code)
-		    sqlite3_result_text (pContext, row->Arc->NodeFrom->Code,
-					 strlen (row->Arc->NodeFrom->Code),
-					 SQLITE_STATIC);
-		else
-		    sqlite3_result_int64 (pContext, row->Arc->NodeFrom->Id);
+		vnet_result_node (pContext, net->graph,
+				  net->graph->Nodes + row->Arc->NodeFrom);
 	    }
 	  if (column == 3)
 	    {
 		/* the NodeTo column */
-		if (node_code)
-		    sqlite3_result_text (pContext, row->Arc->NodeTo->Code,
-					 strlen (row->Arc->NodeTo->Code),
-					 SQLITE_STATIC);
-		else
-		    sqlite3_result_int64 (pContext, row->Arc->NodeTo->Id);
+		vnet_result_node (pContext, net->graph,
+				  net->graph->Nodes + row->Arc->NodeTo);
 	    }
 	  if (column == 4)
 	    {
 		/* the Cost column */
-		sqlite3_result_double (pContext, row->Arc->Cost);
+		sqlite3_result_double (pContext, row->Cost);
 	    }
 	  if (column == 5)
 	    {
@@ -2142,6 +5796,16 @@ vnet_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
 {
 /* fetching the ROWID */
     VirtualNetworkCursorPtr cursor = (VirtualNetworkCursorPtr) pCursor;
+    if (cursor->matrix)
+      {
+	  *pRowid = cursor->matrix->CurrentIndex;
+	  return SQLITE_OK;
+      }
+    if (cursor->isochrone)
+      {
+	  *pRowid = cursor->isochrone->CurrentIndex;
+	  return SQLITE_OK;
+      }
     *pRowid = cursor->solution->CurrentRowId;
     return SQLITE_OK;
 }
@@ -2182,8 +5846,25 @@ vnet_update (sqlite3_vtab * pVTab, int argc, sqlite3_value ** argv,
 			    if (strcmp ((char *) algorithm, "a*") == 0)
 				p_vtab->currentAlgorithm =
 				    VNET_A_STAR_ALGORITHM;
+			    if (strcasecmp ((char *) algorithm, "CH") == 0)
+				p_vtab->currentAlgorithm = VNET_CH_ALGORITHM;
+			    if (strcasecmp ((char *) algorithm, "BiDijkstra")
+				== 0)
+				p_vtab->currentAlgorithm =
+				    VNET_BI_DIJKSTRA_ALGORITHM;
+			    if (strcasecmp ((char *) algorithm, "BiA*") == 0)
+				p_vtab->currentAlgorithm =
+				    VNET_BI_A_STAR_ALGORITHM;
 			}
-		      if (p_vtab->graph->AStar == 0)
+		      if (p_vtab->currentAlgorithm == VNET_A_STAR_ALGORITHM
+			  && p_vtab->graph->AStar == 0)
+			  p_vtab->currentAlgorithm = VNET_DIJKSTRA_ALGORITHM;
+		      if (p_vtab->currentAlgorithm == VNET_BI_A_STAR_ALGORITHM
+			  && p_vtab->graph->AStar == 0)
+			  p_vtab->currentAlgorithm =
+			      VNET_BI_DIJKSTRA_ALGORITHM;
+		      if (p_vtab->currentAlgorithm == VNET_CH_ALGORITHM
+			  && p_vtab->hierarchy == NULL)
 			  p_vtab->currentAlgorithm = VNET_DIJKSTRA_ALGORITHM;
 		  }
 		return SQLITE_OK;
@@ -2228,6 +5909,629 @@ vnet_rollback (sqlite3_vtab * pVTab)
     return SQLITE_OK;
 }
 
+/*
+/
+/  Contraction Hierarchies preprocessing
+/
+*/
+
+typedef struct ContractionNodeStruct
+{
+/* a NODE during the contraction process */
+    int *Out;
+    int NumOut;
+    int MaxOut;
+    int *In;
+    int NumIn;
+    int MaxIn;
+    int Contracted;
+    int Deleted;
+    int Level;
+} ContractionNode;
+typedef ContractionNode *ContractionNodePtr;
+
+typedef struct ContractionStruct
+{
+/* the Contraction Hierarchies builder */
+    int NumNodes;
+    int NumArcs;
+    ContractionNodePtr Nodes;
+    HierarchyShortcutPtr Edges;
+    int NumEdges;
+    int MaxEdges;
+    RoutingNodePtr Witness;
+    RoutingHeapPtr WitnessHeap;
+    int *Touched;
+    int NumTouched;
+    int *BestIn;
+    int *BestOut;
+    int MaxBest;
+    char *Target;
+} Contraction;
+typedef Contraction *ContractionPtr;
+
+static void
+contraction_add_edge (ContractionPtr ctr, int from, int to, double cost,
+		      int first, int second)
+{
+/* adding an edge [either an original Arc or a Shortcut] */
+    HierarchyShortcutPtr edge;
+    ContractionNodePtr pN;
+    int e = ctr->NumEdges;
+    if (ctr->NumEdges == ctr->MaxEdges)
+      {
+	  ctr->MaxEdges *= 2;
+	  ctr->Edges =
+	      realloc (ctr->Edges, sizeof (HierarchyShortcut) * ctr->MaxEdges);
+      }
+    edge = ctr->Edges + e;
+    edge->NodeFrom = from;
+    edge->NodeTo = to;
+    edge->Cost = cost;
+    edge->First = first;
+    edge->Second = second;
+    ctr->NumEdges++;
+    if (from == to)
+	return;			/* loops will never be part of a Shortest Path */
+    pN = ctr->Nodes + from;
+    if (pN->NumOut == pN->MaxOut)
+      {
+	  pN->MaxOut = (pN->MaxOut == 0) ? 4 : pN->MaxOut * 2;
+	  pN->Out = realloc (pN->Out, sizeof (int) * pN->MaxOut);
+      }
+    pN->Out[pN->NumOut++] = e;
+    pN = ctr->Nodes + to;
+    if (pN->NumIn == pN->MaxIn)
+      {
+	  pN->MaxIn = (pN->MaxIn == 0) ? 4 : pN->MaxIn * 2;
+	  pN->In = realloc (pN->In, sizeof (int) * pN->MaxIn);
+      }
+    pN->In[pN->NumIn++] = e;
+}
+
+static void
+contraction_compact (ContractionPtr ctr, int *list, int *count, int incoming)
+{
+/* removing from an adjacency list any edge connected to a contracted Node */
+    int i;
+    int j = 0;
+    int other;
+    HierarchyShortcutPtr edge;
+    for (i = 0; i < *count; i++)
+      {
+	  edge = ctr->Edges + list[i];
+	  other = incoming ? edge->NodeFrom : edge->NodeTo;
+	  if (ctr->Nodes[other].Contracted)
+	      continue;
+	  list[j++] = list[i];
+      }
+    *count = j;
+}
+
+static int
+contraction_best_edges (ContractionPtr ctr, int *list, int count, int *best,
+			int incoming)
+{
+/*
+/ copies into best[] only the cheapest edge connecting each pair of nodes
+/ [parallel edges and superseded shortcuts are simply ignored]
+*/
+    int i;
+    int j;
+    int cnt = 0;
+    int n1;
+    int n2;
+    int ok;
+    HierarchyShortcutPtr e1;
+    HierarchyShortcutPtr e2;
+    for (i = 0; i < count; i++)
+      {
+	  e1 = ctr->Edges + list[i];
+	  n1 = incoming ? e1->NodeFrom : e1->NodeTo;
+	  ok = 1;
+	  for (j = 0; j < count; j++)
+	    {
+		if (j == i)
+		    continue;
+		e2 = ctr->Edges + list[j];
+		n2 = incoming ? e2->NodeFrom : e2->NodeTo;
+		if (n1 != n2)
+		    continue;
+		if (e2->Cost < e1->Cost
+		    || (e2->Cost == e1->Cost && list[j] < list[i]))
+		  {
+		      ok = 0;
+		      break;
+		  }
+	    }
+	  if (ok)
+	      best[cnt++] = list[i];
+      }
+    return cnt;
+}
+
+static void
+contraction_witness (ContractionPtr ctr, int from, int excluded, double limit,
+		     int targets, int max_settled)
+{
+/*
+/ local Dijkstra search starting from a Node and avoiding the Node being
+/ contracted; stops as soon as all targets have been settled, the limit
+/ cost is exceeded or too many Nodes have been settled
+*/
+    int i;
+    int settled = 0;
+    RoutingNodePtr n;
+    RoutingNodePtr p_to;
+    ContractionNodePtr pN;
+    HierarchyShortcutPtr edge;
+    double dist;
+    RoutingHeapPtr h = ctr->WitnessHeap;
+    h->Count = 0;
+    n = ctr->Witness + from;
+    n->Distance = 0.0;
+    ctr->Touched[ctr->NumTouched++] = from;
+    routing_push (h, n);
+    while (h->Count > 0)
+      {
+	  n = routing_pop (h);
+	  if (n->Distance > limit)
+	      break;
+	  if (++settled > max_settled)
+	      break;
+	  n->Inspected = 1;
+	  if (ctr->Target[n->Id])
+	    {
+		targets--;
+		if (targets == 0)
+		    break;
+	    }
+	  pN = ctr->Nodes + n->Id;
+	  for (i = 0; i < pN->NumOut; i++)
+	    {
+		edge = ctr->Edges + pN->Out[i];
+		if (edge->NodeTo == excluded)
+		    continue;
+		if (ctr->Nodes[edge->NodeTo].Contracted)
+		    continue;
+		p_to = ctr->Witness + edge->NodeTo;
+		if (p_to->Inspected)
+		    continue;
+		dist = n->Distance + edge->Cost;
+		if (p_to->Distance == DBL_MAX)
+		  {
+		      ctr->Touched[ctr->NumTouched++] = p_to->Id;
+		      p_to->Distance = dist;
+		      routing_push (h, p_to);
+		  }
+		else if (p_to->Distance > dist)
+		  {
+		      p_to->Distance = dist;
+		      routing_decrease_key (h, p_to);
+		  }
+	    }
+      }
+}
+
+static void
+contraction_witness_reset (ContractionPtr ctr)
+{
+/* resetting the Nodes touched by the last witness search */
+    int i;
+    for (i = 0; i < ctr->NumTouched; i++)
+	routing_reset_node (ctr->Witness + ctr->Touched[i]);
+    ctr->NumTouched = 0;
+}
+
+static int
+contraction_node (ContractionPtr ctr, int node, int create, int *removed)
+{
+/*
+/ contracts a Node [or simply simulates its contraction if create is FALSE]
+/ returns the number of the required Shortcuts
+*/
+    int i;
+    int j;
+    int cnt = 0;
+    int num_in;
+    int num_out;
+    double limit;
+    double via;
+    HierarchyShortcutPtr e_in;
+    HierarchyShortcutPtr e_out;
+    ContractionNodePtr pN = ctr->Nodes + node;
+    contraction_compact (ctr, pN->In, &(pN->NumIn), 1);
+    contraction_compact (ctr, pN->Out, &(pN->NumOut), 0);
+    if (pN->NumIn > ctr->MaxBest || pN->NumOut > ctr->MaxBest)
+      {
+	  ctr->MaxBest =
+	      (pN->NumIn > pN->NumOut) ? pN->NumIn * 2 : pN->NumOut * 2;
+	  ctr->BestIn = realloc (ctr->BestIn, sizeof (int) * ctr->MaxBest);
+	  ctr->BestOut = realloc (ctr->BestOut, sizeof (int) * ctr->MaxBest);
+      }
+    num_in = contraction_best_edges (ctr, pN->In, pN->NumIn, ctr->BestIn, 1);
+    num_out =
+	contraction_best_edges (ctr, pN->Out, pN->NumOut, ctr->BestOut, 0);
+    for (i = 0; i < num_in; i++)
+      {
+	  int in_edge = ctr->BestIn[i];
+	  int targets = 0;
+	  e_in = ctr->Edges + in_edge;
+	  limit = -1.0;
+	  for (j = 0; j < num_out; j++)
+	    {
+		e_out = ctr->Edges + ctr->BestOut[j];
+		if (e_out->NodeTo == e_in->NodeFrom)
+		    continue;
+		if (e_in->Cost + e_out->Cost > limit)
+		    limit = e_in->Cost + e_out->Cost;
+		ctr->Target[e_out->NodeTo] = 1;
+		targets++;
+	    }
+	  if (limit < 0.0)
+	      continue;
+	  contraction_witness (ctr, e_in->NodeFrom, node, limit, targets,
+			       create ? VNET_CH_WITNESS_LIMIT :
+			       VNET_CH_SIMULATION_LIMIT);
+	  for (j = 0; j < num_out; j++)
+	    {
+		e_out = ctr->Edges + ctr->BestOut[j];
+		ctr->Target[e_out->NodeTo] = 0;
+	    }
+	  for (j = 0; j < num_out; j++)
+	    {
+		int out_edge = ctr->BestOut[j];
+		/* the edges array could be reallocated by contraction_add_edge() */
+		e_in = ctr->Edges + in_edge;
+		e_out = ctr->Edges + out_edge;
+		if (e_out->NodeTo == e_in->NodeFrom)
+		    continue;
+		via = e_in->Cost + e_out->Cost;
+		if (ctr->Witness[e_out->NodeTo].Distance <= via)
+		    continue;	/* a witness path exists: no Shortcut is needed */
+		cnt++;
+		if (create)
+		    contraction_add_edge (ctr, e_in->NodeFrom, e_out->NodeTo,
+					  via, in_edge, out_edge);
+	    }
+	  contraction_witness_reset (ctr);
+      }
+    *removed = num_in + num_out;
+    return cnt;
+}
+
+static double
+contraction_priority (ContractionPtr ctr, int node)
+{
+/*
+/ the contraction priority of a Node: edge difference, deleted neighbours
+/ and hierarchy level [favouring an uniform contraction]
+*/
+    int removed;
+    int added = contraction_node (ctr, node, 0, &removed);
+    ContractionNodePtr pN = ctr->Nodes + node;
+    return (double) ((2 * (added - removed)) + pN->Deleted + pN->Level);
+}
+
+static void
+contraction_neighbour (ContractionNodePtr pN, ContractionNodePtr contracted)
+{
+/* a neighbour of this Node has just been contracted */
+    pN->Deleted += 1;
+    if (pN->Level < contracted->Level + 1)
+	pN->Level = contracted->Level + 1;
+}
+
+static void
+contraction_update (ContractionPtr ctr, RoutingHeapPtr heap, RoutingNodePtr n)
+{
+/* recomputing the priority of a not yet contracted Node */
+    if (n->HeapPos < 0)
+	return;
+    n->Distance = contraction_priority (ctr, n->Id);
+    routing_heap_up (heap, n->HeapPos);
+    routing_heap_down (heap, n->HeapPos);
+}
+
+static void
+contraction_free (ContractionPtr ctr)
+{
+/* memory cleanup; freeing the Contraction Hierarchies builder */
+    int i;
+    ContractionNodePtr pN;
+    for (i = 0; i < ctr->NumNodes; i++)
+      {
+	  pN = ctr->Nodes + i;
+	  if (pN->Out)
+	      free (pN->Out);
+	  if (pN->In)
+	      free (pN->In);
+      }
+    free (ctr->Nodes);
+    free (ctr->Edges);
+    free (ctr->Witness);
+    routing_heap_free (ctr->WitnessHeap);
+    free (ctr->Touched);
+    if (ctr->BestIn)
+	free (ctr->BestIn);
+    if (ctr->BestOut)
+	free (ctr->BestOut);
+    free (ctr->Target);
+}
+
+static int
+hierarchy_store_block (sqlite3_stmt * stmt, int id, unsigned char *blob,
+		       int size)
+{
+/* inserting a Contraction Hierarchy block */
+    int ret;
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int (stmt, 1, id);
+    sqlite3_bind_blob (stmt, 2, blob, size, SQLITE_STATIC);
+    ret = sqlite3_step (stmt);
+    if (ret == SQLITE_DONE || ret == SQLITE_ROW)
+	return 1;
+    spatialite_e ("CreateNetworkHierarchy: %s\n",
+		  sqlite3_errmsg (sqlite3_db_handle (stmt)));
+    return 0;
+}
+
+static int
+hierarchy_store (sqlite3 * handle, const char *table, ContractionPtr ctr,
+		 int *rank, double checksum)
+{
+/* creating the "<table>_hierarchy" table and storing the Hierarchy */
+    char *name;
+    char *xname;
+    char *sql;
+    char *err_msg = NULL;
+    int ret;
+    int i;
+    int id = 0;
+    int items;
+    int endian_arch = gaiaEndianArch ();
+    unsigned char *blob;
+    unsigned char *p;
+    sqlite3_stmt *stmt = NULL;
+    HierarchyShortcutPtr sc;
+    int num_shortcuts = ctr->NumEdges - ctr->NumArcs;
+    name = sqlite3_mprintf ("%s_hierarchy", table);
+    xname = gaiaDoubleQuotedSql (name);
+    sqlite3_free (name);
+    sql = sqlite3_mprintf ("DROP TABLE IF EXISTS \"%s\"", xname);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+    sql = sqlite3_mprintf ("CREATE TABLE \"%s\" (Id INTEGER PRIMARY KEY, "
+			   "HierarchyData BLOB NOT NULL)", xname);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	goto error;
+    sql = sqlite3_mprintf ("INSERT INTO \"%s\" (Id, HierarchyData) "
+			   "VALUES (?, ?)", xname);
+    ret = sqlite3_prepare_v2 (handle, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  spatialite_e ("CreateNetworkHierarchy: %s\n",
+			sqlite3_errmsg (handle));
+	  free (xname);
+	  return 0;
+      }
+    free (xname);
+    xname = NULL;
+    blob = malloc (3 + (VNET_CH_BLOCK_SIZE * 26));
+/* the HEADER block */
+    p = blob;
+    *p++ = GAIA_NET_CH_START;
+    *p++ = GAIA_NET_HEADER;
+    gaiaExport32 (p, ctr->NumNodes, 1, endian_arch);
+    p += 4;
+    gaiaExport32 (p, ctr->NumArcs, 1, endian_arch);
+    p += 4;
+    gaiaExport32 (p, num_shortcuts, 1, endian_arch);
+    p += 4;
+    gaiaExport64 (p, checksum, 1, endian_arch);
+    p += 8;
+    *p++ = GAIA_NET_END;
+    if (!hierarchy_store_block (stmt, id++, blob, p - blob))
+	goto stop;
+/* Node ranks */
+    for (i = 0; i < ctr->NumNodes; i += VNET_CH_BLOCK_SIZE)
+      {
+	  int j;
+	  items = ctr->NumNodes - i;
+	  if (items > VNET_CH_BLOCK_SIZE)
+	      items = VNET_CH_BLOCK_SIZE;
+	  p = blob;
+	  *p++ = GAIA_NET_BLOCK;
+	  gaiaExport16 (p, items, 1, endian_arch);
+	  p += 2;
+	  for (j = i; j < i + items; j++)
+	    {
+		*p++ = GAIA_NET_NODE;
+		gaiaExport32 (p, j, 1, endian_arch);
+		p += 4;
+		gaiaExport32 (p, rank[j], 1, endian_arch);
+		p += 4;
+		*p++ = GAIA_NET_END;
+	    }
+	  if (!hierarchy_store_block (stmt, id++, blob, p - blob))
+	      goto stop;
+      }
+/* Shortcuts [strictly preserving their creation order] */
+    for (i = 0; i < num_shortcuts; i += VNET_CH_BLOCK_SIZE)
+      {
+	  int j;
+	  items = num_shortcuts - i;
+	  if (items > VNET_CH_BLOCK_SIZE)
+	      items = VNET_CH_BLOCK_SIZE;
+	  p = blob;
+	  *p++ = GAIA_NET_BLOCK;
+	  gaiaExport16 (p, items, 1, endian_arch);
+	  p += 2;
+	  for (j = i; j < i + items; j++)
+	    {
+		sc = ctr->Edges + ctr->NumArcs + j;
+		*p++ = GAIA_NET_ARC;
+		gaiaExport32 (p, sc->NodeFrom, 1, endian_arch);
+		p += 4;
+		gaiaExport32 (p, sc->NodeTo, 1, endian_arch);
+		p += 4;
+		gaiaExport64 (p, sc->Cost, 1, endian_arch);
+		p += 8;
+		gaiaExport32 (p, sc->First, 1, endian_arch);
+		p += 4;
+		gaiaExport32 (p, sc->Second, 1, endian_arch);
+		p += 4;
+		*p++ = GAIA_NET_END;
+	    }
+	  if (!hierarchy_store_block (stmt, id++, blob, p - blob))
+	      goto stop;
+      }
+    free (blob);
+    sqlite3_finalize (stmt);
+    return 1;
+  stop:
+    free (blob);
+    sqlite3_finalize (stmt);
+    return 0;
+  error:
+    spatialite_e ("CreateNetworkHierarchy: %s\n", err_msg);
+    sqlite3_free (err_msg);
+    if (xname)
+	free (xname);
+    return 0;
+}
+
+SPATIALITE_PRIVATE int
+create_network_hierarchy (void *p_sqlite, const char *table)
+{
+/*
+/ builds a Contraction Hierarchy for the NETWORK stored into some
+/ NetworkData table, then saves it into the "<table>_hierarchy" table
+/ returns 1 on success, 0 on failure
+*/
+    sqlite3 *handle = (sqlite3 *) p_sqlite;
+    NetworkPtr graph;
+    NetworkArcPtr *arcs;
+    Contraction ctr;
+    RoutingNodePtr order;
+    RoutingHeapPtr heap;
+    RoutingNodePtr n;
+    ContractionNodePtr pN;
+    HierarchyShortcutPtr edge;
+    int *rank;
+    int num_arcs;
+    int next_rank = 0;
+    int removed;
+    int i;
+    int ret;
+    double priority;
+    double checksum;
+    sqlite3_int64 fingerprint;
+    char *name;
+    graph = load_network (handle, table);
+    if (graph == NULL)
+	return 0;
+    arcs = network_arcs_index (graph, &num_arcs);
+    checksum = network_arcs_checksum (arcs, num_arcs);
+/* initializing the builder: edges 0 .. num_arcs-1 are the original Arcs */
+    ctr.NumNodes = graph->NumNodes;
+    ctr.NumArcs = num_arcs;
+    ctr.Nodes = calloc (graph->NumNodes, sizeof (ContractionNode));
+    ctr.NumEdges = 0;
+    ctr.MaxEdges = (num_arcs * 2) + 16;
+    ctr.Edges = malloc (sizeof (HierarchyShortcut) * ctr.MaxEdges);
+    ctr.Witness = malloc (sizeof (RoutingNode) * graph->NumNodes);
+    ctr.WitnessHeap = routing_heap_init (graph->NumNodes, 0);
+    ctr.Touched = malloc (sizeof (int) * graph->NumNodes);
+    ctr.NumTouched = 0;
+    ctr.BestIn = NULL;
+    ctr.BestOut = NULL;
+    ctr.MaxBest = 0;
+    ctr.Target = calloc (graph->NumNodes, sizeof (char));
+    for (i = 0; i < num_arcs; i++)
+	contraction_add_edge (&ctr, arcs[i]->NodeFrom,
+			      arcs[i]->NodeTo, arcs[i]->Cost,
+			      -1, -1);
+    free (arcs);
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  ctr.Witness[i].Id = i;
+	  routing_reset_node (ctr.Witness + i);
+      }
+/* initial Node ordering */
+    rank = malloc (sizeof (int) * graph->NumNodes);
+    order = malloc (sizeof (RoutingNode) * graph->NumNodes);
+    heap = routing_heap_init (graph->NumNodes, 0);
+    for (i = 0; i < graph->NumNodes; i++)
+      {
+	  n = order + i;
+	  n->Id = i;
+	  routing_reset_node (n);
+	  n->Distance = contraction_priority (&ctr, i);
+	  routing_push (heap, n);
+      }
+    while (heap->Count > 0)
+      {
+	  /* contracting the Node of lowest priority [lazy updates] */
+	  n = routing_pop (heap);
+	  priority = contraction_priority (&ctr, n->Id);
+	  if (heap->Count > 0 && priority > heap->Values[0]->Distance)
+	    {
+		/* priority has changed: reinserting the Node */
+		n->Distance = priority;
+		routing_push (heap, n);
+		continue;
+	    }
+	  contraction_node (&ctr, n->Id, 1, &removed);
+	  pN = ctr.Nodes + n->Id;
+	  pN->Contracted = 1;
+	  rank[n->Id] = next_rank++;
+	  for (i = 0; i < pN->NumOut; i++)
+	    {
+		edge = ctr.Edges + pN->Out[i];
+		contraction_neighbour (ctr.Nodes + edge->NodeTo, pN);
+	    }
+	  for (i = 0; i < pN->NumIn; i++)
+	    {
+		edge = ctr.Edges + pN->In[i];
+		contraction_neighbour (ctr.Nodes + edge->NodeFrom, pN);
+	    }
+	  /* updating the priority of any neighbour */
+	  for (i = 0; i < pN->NumOut; i++)
+	    {
+		edge = ctr.Edges + pN->Out[i];
+		contraction_update (&ctr, heap, order + edge->NodeTo);
+	    }
+	  for (i = 0; i < pN->NumIn; i++)
+	    {
+		edge = ctr.Edges + pN->In[i];
+		contraction_update (&ctr, heap, order + edge->NodeFrom);
+	    }
+      }
+    routing_heap_free (heap);
+    free (order);
+    ret = hierarchy_store (handle, table, &ctr, rank, checksum);
+    free (rank);
+    contraction_free (&ctr);
+    network_free (graph);
+    if (ret && hierarchy_fingerprint (handle, table, &fingerprint))
+      {
+	  /* storing the fingerprint identifying this Hierarchy */
+	  name = sqlite3_mprintf ("%s_hierarchy", table);
+	  ret =
+	      network_fingerprint_install (handle, table, "hierarchy", name,
+					   fingerprint);
+	  sqlite3_free (name);
+      }
+    return ret;
+}
+
 int
 sqlite3VirtualNetworkInit (sqlite3 * db)
 {
@@ -70,6 +70,21 @@ the terms of any one of the MPL, the GPL or the LGPL.
 
 static struct sqlite3_module my_shape_module;
 
+#define VSHP_RTREE_NODE_SIZE	16	/* max # children of an R-Tree node */
+#define VSHP_RTREE_MAX_LEVELS	32
+
+typedef struct VirtualShapeRTreeStruct
+{
+/* a static packed R-Tree indexing the Shapefile entities by MBR */
+    int NumItems;		/* # indexed entities (leaves) */
+    int NumBoxes;		/* # leaves + # internal nodes */
+    double *Boxes;		/* MinX, MinY, MaxX, MaxY of each box */
+    int *Index;			/* leaf: the row ID; node: its first child box */
+    int NumLevels;		/* # tree levels (leaves are level #0) */
+    int LevelEnd[VSHP_RTREE_MAX_LEVELS];	/* first box beyond each level */
+} VirtualShapeRTree;
+typedef VirtualShapeRTree *VirtualShapeRTreePtr;
+
 typedef struct VirtualShapeStruct
 {
 /* extends the sqlite3_vtab struct */
@@ -79,6 +94,8 @@ typedef struct VirtualShapeStruct
     sqlite3 *db;		/* the sqlite db holding the virtual table */
     gaiaShapefilePtr Shp;	/* the Shapefile struct */
     int Srid;			/* the Shapefile SRID */
+    int nColumns;		/* # declared columns (search_frame excluded) */
+    VirtualShapeRTreePtr RTree;	/* optional in-memory Spatial Index */
 } VirtualShape;
 typedef VirtualShape *VirtualShapePtr;
 
@@ -106,6 +123,17 @@ typedef struct VirtualShapeCursorStruct
     int eof;			/* the EOF marker */
     VirtualShapeConstraintPtr firstConstraint;
     VirtualShapeConstraintPtr lastConstraint;
+    long last_row;		/* stop before this row ID; -1 if unbounded */
+    int filterMbr;		/* TRUE if a search_frame has been set */
+    double filterMinX;		/* the search_frame MBR */
+    double filterMinY;
+    double filterMaxX;
+    double filterMaxY;
+    int *rtreeRows;		/* row IDs found by the Spatial Index */
+    int rtreeCount;
+    int rtreeNext;
+    int readGeometry;		/* FALSE if the Geometry isn't required */
+    char *readFields;		/* DBF fields to be decoded; NULL means all */
 } VirtualShapeCursor;
 typedef VirtualShapeCursor *VirtualShapeCursorPtr;
 
@@ -161,6 +189,331 @@ vshp_has_metadata (sqlite3 * db, int *geotype)
     return 0;
 }
 
+struct vshp_rtree_item
+{
+/* an auxiliary struct used while building the R-Tree */
+    unsigned int Hilbert;
+    int Row;
+    double MinX;
+    double MinY;
+    double MaxX;
+    double MaxY;
+};
+
+static unsigned int
+vshp_hilbert (unsigned int x, unsigned int y)
+{
+/* position of a cell along the Hilbert curve filling a 65536 x 65536 grid */
+    unsigned int s;
+    unsigned int rx;
+    unsigned int ry;
+    unsigned int t;
+    unsigned int d = 0;
+    for (s = 32768; s > 0; s /= 2)
+      {
+	  rx = (x & s) > 0;
+	  ry = (y & s) > 0;
+	  d += s * s * ((3 * rx) ^ ry);
+	  if (ry == 0)
+	    {
+		/* rotating the quadrant */
+		if (rx == 1)
+		  {
+		      x = 65535 - x;
+		      y = 65535 - y;
+		  }
+		t = x;
+		x = y;
+		y = t;
+	    }
+      }
+    return d;
+}
+
+static int
+vshp_cmp_rtree_items (const void *p1, const void *p2)
+{
+/* compares two R-Tree items [sorting by Hilbert value, then by row] */
+    const struct vshp_rtree_item *i1 = (const struct vshp_rtree_item *) p1;
+    const struct vshp_rtree_item *i2 = (const struct vshp_rtree_item *) p2;
+    if (i1->Hilbert != i2->Hilbert)
+	return (i1->Hilbert < i2->Hilbert) ? -1 : 1;
+    return (i1->Row < i2->Row) ? -1 : (i1->Row > i2->Row);
+}
+
+static int
+vshp_cmp_rows (const void *p1, const void *p2)
+{
+/* compares two row IDs */
+    int r1 = *((const int *) p1);
+    int r2 = *((const int *) p2);
+    return (r1 < r2) ? -1 : (r1 > r2);
+}
+
+static void
+vshp_free_rtree (VirtualShapeRTreePtr tree)
+{
+/* memory cleanup - destroying the R-Tree */
+    if (tree == NULL)
+	return;
+    if (tree->Boxes)
+	free (tree->Boxes);
+    if (tree->Index)
+	free (tree->Index);
+    free (tree);
+}
+
+static VirtualShapeRTreePtr
+vshp_build_rtree (gaiaShapefilePtr shp)
+{
+/*
+/ building a static packed R-Tree from the MBRs stored into the SHP
+/ record headers: entities are sorted along a Hilbert curve, then
+/ each group of VSHP_RTREE_NODE_SIZE boxes gets a parent box, up to
+/ the root
+/ returns NULL on failure
+*/
+    VirtualShapeRTreePtr tree;
+    struct vshp_rtree_item *items = NULL;
+    struct vshp_rtree_item *item;
+    int max_items = 0;
+    int n = 0;
+    int row;
+    int is_null;
+    int i;
+    int j;
+    int end;
+    int lv;
+    int pos;
+    int level_size;
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+    double ext_minx = 0.0;
+    double ext_miny = 0.0;
+    double ext_maxx = 0.0;
+    double ext_maxy = 0.0;
+    double scale_x;
+    double scale_y;
+    double *box;
+    double *child;
+
+/* fetching all the entities' MBRs */
+    for (row = 0;; row++)
+      {
+	  if (!gaiaReadShpEntityMbr
+	      (shp, row, &is_null, &minx, &miny, &maxx, &maxy))
+	    {
+		if (shp->LastError)
+		  {
+		      /* an error occurred */
+		      spatialite_e ("%s\n", shp->LastError);
+		      if (items)
+			  free (items);
+		      return NULL;
+		  }
+		break;
+	    }
+	  if (is_null)
+	      continue;
+	  if (n == max_items)
+	    {
+		/* growing the items array */
+		struct vshp_rtree_item *new_items;
+		max_items = (max_items == 0) ? 1024 : max_items * 2;
+		new_items =
+		    realloc (items,
+			     sizeof (struct vshp_rtree_item) * max_items);
+		if (new_items == NULL)
+		  {
+		      if (items)
+			  free (items);
+		      return NULL;
+		  }
+		items = new_items;
+	    }
+	  item = items + n++;
+	  item->Row = row;
+	  item->MinX = minx;
+	  item->MinY = miny;
+	  item->MaxX = maxx;
+	  item->MaxY = maxy;
+	  if (n == 1 || minx < ext_minx)
+	      ext_minx = minx;
+	  if (n == 1 || miny < ext_miny)
+	      ext_miny = miny;
+	  if (n == 1 || maxx > ext_maxx)
+	      ext_maxx = maxx;
+	  if (n == 1 || maxy > ext_maxy)
+	      ext_maxy = maxy;
+      }
+
+/* sorting the entities along the Hilbert curve */
+    scale_x = (ext_maxx > ext_minx) ? 65535.0 / (ext_maxx - ext_minx) : 0.0;
+    scale_y = (ext_maxy > ext_miny) ? 65535.0 / (ext_maxy - ext_miny) : 0.0;
+    for (i = 0; i < n; i++)
+      {
+	  item = items + i;
+	  item->Hilbert =
+	      vshp_hilbert ((unsigned
+			     int) ((((item->MinX + item->MaxX) / 2.0) -
+				    ext_minx) * scale_x),
+			    (unsigned
+			     int) ((((item->MinY + item->MaxY) / 2.0) -
+				    ext_miny) * scale_y));
+      }
+    if (n > 1)
+	qsort (items, n, sizeof (struct vshp_rtree_item),
+	       vshp_cmp_rtree_items);
+
+/* computing the tree layout */
+    tree = malloc (sizeof (VirtualShapeRTree));
+    if (tree == NULL)
+      {
+	  if (items)
+	      free (items);
+	  return NULL;
+      }
+    tree->NumItems = n;
+    tree->NumBoxes = n;
+    tree->NumLevels = 1;
+    tree->LevelEnd[0] = n;
+    level_size = n;
+    while (level_size > 1)
+      {
+	  level_size =
+	      (level_size + VSHP_RTREE_NODE_SIZE - 1) / VSHP_RTREE_NODE_SIZE;
+	  tree->NumBoxes += level_size;
+	  tree->LevelEnd[tree->NumLevels++] = tree->NumBoxes;
+      }
+    tree->Boxes = malloc (sizeof (double) * 4 * (tree->NumBoxes + 1));
+    tree->Index = malloc (sizeof (int) * (tree->NumBoxes + 1));
+    if (tree->Boxes == NULL || tree->Index == NULL)
+      {
+	  vshp_free_rtree (tree);
+	  if (items)
+	      free (items);
+	  return NULL;
+      }
+
+/* storing the leaves */
+    for (i = 0; i < n; i++)
+      {
+	  item = items + i;
+	  box = tree->Boxes + (i * 4);
+	  box[0] = item->MinX;
+	  box[1] = item->MinY;
+	  box[2] = item->MaxX;
+	  box[3] = item->MaxY;
+	  tree->Index[i] = item->Row;
+      }
+    if (items)
+	free (items);
+
+/* building the internal nodes, one level at a time */
+    pos = n;
+    for (lv = 1; lv < tree->NumLevels; lv++)
+      {
+	  i = (lv == 1) ? 0 : tree->LevelEnd[lv - 2];
+	  end = tree->LevelEnd[lv - 1];
+	  for (; i < end; i += VSHP_RTREE_NODE_SIZE)
+	    {
+		box = tree->Boxes + (pos * 4);
+		child = tree->Boxes + (i * 4);
+		box[0] = child[0];
+		box[1] = child[1];
+		box[2] = child[2];
+		box[3] = child[3];
+		for (j = i + 1; j < end && j < i + VSHP_RTREE_NODE_SIZE; j++)
+		  {
+		      child = tree->Boxes + (j * 4);
+		      if (child[0] < box[0])
+			  box[0] = child[0];
+		      if (child[1] < box[1])
+			  box[1] = child[1];
+		      if (child[2] > box[2])
+			  box[2] = child[2];
+		      if (child[3] > box[3])
+			  box[3] = child[3];
+		  }
+		tree->Index[pos++] = i;
+	    }
+      }
+    return tree;
+}
+
+static int
+vshp_search_rtree (VirtualShapeRTreePtr tree, double minx, double miny,
+		   double maxx, double maxy, int **rows, int *count)
+{
+/*
+/ searching the R-Tree for all entities whose MBR intersects the given frame
+/ on success ROWS will contain the row IDs in ascending order
+*/
+    int stack_pos[VSHP_RTREE_NODE_SIZE * VSHP_RTREE_MAX_LEVELS];
+    int stack_lv[VSHP_RTREE_NODE_SIZE * VSHP_RTREE_MAX_LEVELS];
+    int top = 0;
+    int pos;
+    int lv;
+    int i;
+    int end;
+    int max_rows = 0;
+    int *found = NULL;
+    int n = 0;
+    double *box;
+
+    *rows = NULL;
+    *count = 0;
+    if (tree->NumItems == 0)
+	return 1;
+    stack_pos[top] = tree->NumBoxes - 1;
+    stack_lv[top++] = tree->NumLevels - 1;
+    while (top > 0)
+      {
+	  top--;
+	  pos = stack_pos[top];
+	  lv = stack_lv[top];
+	  box = tree->Boxes + (pos * 4);
+	  if (box[0] > maxx || box[2] < minx || box[1] > maxy
+	      || box[3] < miny)
+	      continue;
+	  if (lv > 0)
+	    {
+		/* descending into the children */
+		end = tree->Index[pos] + VSHP_RTREE_NODE_SIZE;
+		if (end > tree->LevelEnd[lv - 1])
+		    end = tree->LevelEnd[lv - 1];
+		for (i = tree->Index[pos]; i < end; i++)
+		  {
+		      stack_pos[top] = i;
+		      stack_lv[top++] = lv - 1;
+		  }
+		continue;
+	    }
+	  if (n == max_rows)
+	    {
+		/* growing the rows array */
+		int *new_found;
+		max_rows = (max_rows == 0) ? 256 : max_rows * 2;
+		new_found = realloc (found, sizeof (int) * max_rows);
+		if (new_found == NULL)
+		  {
+		      if (found)
+			  free (found);
+		      return 0;
+		  }
+		found = new_found;
+	    }
+	  found[n++] = tree->Index[pos];
+      }
+    if (n > 1)
+	qsort (found, n, sizeof (int), vshp_cmp_rows);
+    *rows = found;
+    *count = n;
+    return 1;
+}
+
 static int
 vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	     sqlite3_vtab ** ppVTab, char **pzErr)
@@ -183,11 +536,12 @@ vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     char *xname;
     char **col_name = NULL;
     int geotype;
+    int spatial_index = 0;
     gaiaOutBuffer sql_statement;
     if (pAux)
 	pAux = pAux;		/* unused arg warning suppression */
 /* checking for shapefile PATH */
-    if (argc == 6)
+    if (argc == 6 || argc == 7)
       {
 	  pPath = argv[3];
 	  len = strlen (pPath);
@@ -219,10 +573,22 @@ vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	      srid = -1;
       }
     else
+	spatial_index = -1;
+    if (argc == 7)
+      {
+	  /* the optional SpatialIndex keyword */
+	  if (strcasecmp (argv[6], "SpatialIndex") == 0
+	      || strcasecmp (argv[6], "'SpatialIndex'") == 0
+	      || strcasecmp (argv[6], "\"SpatialIndex\"") == 0)
+	      spatial_index = 1;
+	  else
+	      spatial_index = -1;
+      }
+    if (spatial_index < 0)
       {
 	  *pzErr =
 	      sqlite3_mprintf
-	      ("[VirtualShape module] CREATE VIRTUAL: illegal arg list {shp_path, encoding, srid}");
+	      ("[VirtualShape module] CREATE VIRTUAL: illegal arg list {shp_path, encoding, srid [, SpatialIndex]}");
 	  return SQLITE_ERROR;
       }
     p_vt = (VirtualShapePtr) sqlite3_malloc (sizeof (VirtualShape));
@@ -234,6 +600,8 @@ vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     p_vt->db = db;
     p_vt->Shp = gaiaAllocShapefile ();
     p_vt->Srid = srid;
+    p_vt->nColumns = 2;
+    p_vt->RTree = NULL;
 /* trying to open files etc in order to ensure we actually have a genuine shapefile */
     gaiaOpenShpRead (p_vt->Shp, path, encoding, "UTF-8");
     if (!(p_vt->Shp->Valid))
@@ -263,6 +631,11 @@ vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  /* fixing anyway the Geometry type for LINESTRING/MULTILINESTRING or POLYGON/MULTIPOLYGON */
 	  gaiaShpAnalyze (p_vt->Shp);
       }
+    if (spatial_index)
+      {
+	  /* building the in-memory Spatial Index */
+	  p_vt->RTree = vshp_build_rtree (p_vt->Shp);
+      }
 /* preparing the COLUMNs for this VIRTUAL TABLE */
     gaiaOutBufferInitialize (&sql_statement);
     xname = gaiaDoubleQuotedSql (argv[2]);
@@ -298,6 +671,8 @@ vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	      dup = 1;
 	  if (strcasecmp (xname, "\"Geometry\"") == 0)
 	      dup = 1;
+	  if (strcasecmp (xname, "\"search_frame\"") == 0)
+	      dup = 1;
 	  if (dup)
 	    {
 		free (xname);
@@ -323,7 +698,9 @@ vshp_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  cnt++;
 	  pFld = pFld->Next;
       }
-    gaiaAppendToOutBuffer (&sql_statement, ")");
+    p_vt->nColumns = 2 + col_cnt;
+/* the hidden column supporting spatial filtering */
+    gaiaAppendToOutBuffer (&sql_statement, ", search_frame BLOB HIDDEN)");
     if (col_name)
       {
 	  /* releasing memory allocation for column names */
@@ -559,30 +936,61 @@ vshp_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIndex)
 /* best index selection */
     int i;
     int iArg = 0;
+    int iColumn;
+    int op;
+    int rowid_eq = 0;
+    int spatial = 0;
     char str[2048];
     char buf[64];
+    sqlite3_uint64 col_used = ~((sqlite3_uint64) 0);
+    VirtualShapePtr p_vt = (VirtualShapePtr) pVTab;
 
-    if (pVTab)
-	pVTab = pVTab;		/* unused arg warning suppression */
-
+#if SQLITE_VERSION_NUMBER >= 3010000
+    if (sqlite3_libversion_number () >= 3010000)
+	col_used = pIndex->colUsed;
+#endif
     *str = '\0';
     for (i = 0; i < pIndex->nConstraint; i++)
       {
 	  if (pIndex->aConstraint[i].usable)
 	    {
+		iColumn = pIndex->aConstraint[i].iColumn;
+		op = pIndex->aConstraint[i].op;
+		if (iColumn < 0)
+		    iColumn = 0;	/* the ROWID is an alias for PKUID */
+		if (iColumn == p_vt->nColumns)
+		  {
+		      /* the search_frame hidden column */
+		      if (op != SQLITE_INDEX_CONSTRAINT_EQ)
+			  continue;
+		      spatial = 1;
+		  }
+		else if (iColumn == 1)
+		    continue;	/* the Geometry can't be compared */
+		else if (op != SQLITE_INDEX_CONSTRAINT_EQ
+			 && op != SQLITE_INDEX_CONSTRAINT_GT
+			 && op != SQLITE_INDEX_CONSTRAINT_LE
+			 && op != SQLITE_INDEX_CONSTRAINT_LT
+			 && op != SQLITE_INDEX_CONSTRAINT_GE)
+		    continue;	/* unsupported operator: left to SQLite */
+		if (iColumn == 0 && op == SQLITE_INDEX_CONSTRAINT_EQ)
+		    rowid_eq = 1;
 		iArg++;
 		pIndex->aConstraintUsage[i].argvIndex = iArg;
 		pIndex->aConstraintUsage[i].omit = 1;
-		sprintf (buf, "%d:%d,", pIndex->aConstraint[i].iColumn,
-			 pIndex->aConstraint[i].op);
+		sprintf (buf, "%d:%d,", iColumn, op);
 		strcat (str, buf);
 	    }
       }
-    if (*str != '\0')
-      {
-	  pIndex->idxStr = sqlite3_mprintf ("%s", str);
-	  pIndex->needToFreeIdxStr = 1;
-      }
+/* the leading item always is the mask of the columns actually used */
+    pIndex->idxStr = sqlite3_mprintf ("%llx,%s", col_used, str);
+    pIndex->needToFreeIdxStr = 1;
+    if (rowid_eq)
+	pIndex->estimatedCost = 1.0;
+    else if (spatial)
+	pIndex->estimatedCost = 10000.0;
+    else
+	pIndex->estimatedCost = 1000000.0;
 
     return SQLITE_OK;
 }
@@ -594,6 +1002,7 @@ vshp_disconnect (sqlite3_vtab * pVTab)
     VirtualShapePtr p_vt = (VirtualShapePtr) pVTab;
     if (p_vt->Shp)
 	gaiaFreeShapefile (p_vt->Shp);
+    vshp_free_rtree (p_vt->RTree);
     sqlite3_free (p_vt);
     return SQLITE_OK;
 }
@@ -605,6 +1014,68 @@ vshp_destroy (sqlite3_vtab * pVTab)
     return vshp_disconnect (pVTab);
 }
 
+static int
+vshp_seek_row (VirtualShapeCursorPtr cursor)
+{
+/*
+/ positioning the cursor on the next row possibly satisfying the
+/ ROWID range and the search_frame; entities are skipped by only
+/ checking the MBR stored into the SHP record header (or into the
+/ in-memory Spatial Index), so that they are never decoded
+/ returns 0 on EOF
+*/
+    int row;
+    int is_null;
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+    gaiaShapefilePtr shp = cursor->pVtab->Shp;
+    if (cursor->rtreeRows != NULL)
+      {
+	  /* fetching the next row found by the Spatial Index */
+	  while (1)
+	    {
+		if (cursor->rtreeNext >= cursor->rtreeCount)
+		    return 0;
+		row = cursor->rtreeRows[cursor->rtreeNext++];
+		if (row >= cursor->current_row)
+		    break;
+	    }
+	  cursor->current_row = row;
+      }
+    else if (cursor->filterMbr)
+      {
+	  /* scanning the SHP record headers */
+	  while (1)
+	    {
+		if (cursor->last_row >= 0
+		    && cursor->current_row >= cursor->last_row)
+		    return 0;
+		if (!gaiaReadShpEntityMbr
+		    (shp, cursor->current_row, &is_null, &minx, &miny, &maxx,
+		     &maxy))
+		  {
+		      if (shp->LastError)
+			{
+			    /* an error occurred */
+			    spatialite_e ("%s\n", shp->LastError);
+			}
+		      return 0;
+		  }
+		if (!is_null && minx <= cursor->filterMaxX
+		    && maxx >= cursor->filterMinX
+		    && miny <= cursor->filterMaxY
+		    && maxy >= cursor->filterMinY)
+		    break;
+		cursor->current_row++;
+	    }
+      }
+    if (cursor->last_row >= 0 && cursor->current_row >= cursor->last_row)
+	return 0;
+    return 1;
+}
+
 static void
 vshp_read_row (VirtualShapeCursorPtr cursor)
 {
@@ -621,9 +1092,15 @@ vshp_read_row (VirtualShapeCursorPtr cursor)
 	  free (cursor->blobGeometry);
 	  cursor->blobGeometry = NULL;
       }
+    if (!vshp_seek_row (cursor))
+      {
+	  cursor->eof = 1;
+	  return;
+      }
     ret =
-	gaiaReadShpEntity (cursor->pVtab->Shp, cursor->current_row,
-			   cursor->pVtab->Srid);
+	gaiaReadShpEntity_ex (cursor->pVtab->Shp, cursor->current_row,
+			      cursor->pVtab->Srid, cursor->readGeometry,
+			      cursor->readFields);
     if (!ret)
       {
 	  if (!(cursor->pVtab->Shp->LastError))	/* normal SHP EOF */
@@ -661,6 +1138,13 @@ vshp_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
     cursor->blobGeometry = NULL;
     cursor->blobSize = 0;
     cursor->eof = 0;
+    cursor->last_row = -1;
+    cursor->filterMbr = 0;
+    cursor->rtreeRows = NULL;
+    cursor->rtreeCount = 0;
+    cursor->rtreeNext = 0;
+    cursor->readGeometry = 1;
+    cursor->readFields = NULL;
     *ppCursor = (sqlite3_vtab_cursor *) cursor;
     vshp_read_row (cursor);
     return SQLITE_OK;
@@ -683,6 +1167,17 @@ vshp_free_constraints (VirtualShapeCursorPtr cursor)
       }
     cursor->firstConstraint = NULL;
     cursor->lastConstraint = NULL;
+    if (cursor->rtreeRows)
+	free (cursor->rtreeRows);
+    cursor->rtreeRows = NULL;
+    cursor->rtreeCount = 0;
+    cursor->rtreeNext = 0;
+    cursor->filterMbr = 0;
+    cursor->last_row = -1;
+    if (cursor->readFields)
+	free (cursor->readFields);
+    cursor->readFields = NULL;
+    cursor->readGeometry = 1;
 }
 
 static int
@@ -743,6 +1238,45 @@ vshp_parse_constraint (const char *str, int index, int *iColumn, int *op)
     return 0;
 }
 
+static void
+vshp_columns_used (VirtualShapeCursorPtr cursor, const char *idxStr)
+{
+/*
+/ parsing the mask of the columns actually used (leading item of idxStr)
+/ so to only decode the required DBF fields, and the Geometry if needed
+/ bit #63 stands for any column beyond the 63rd
+*/
+    sqlite3_uint64 col_used = 0;
+    const char *p = idxStr;
+    int nFields = cursor->pVtab->nColumns - 2;
+    int bit;
+    int i;
+    if (p == NULL || *p == '\0')
+	return;
+    while (*p != ',' && *p != '\0')
+      {
+	  col_used <<= 4;
+	  if (*p >= '0' && *p <= '9')
+	      col_used |= *p - '0';
+	  else if (*p >= 'a' && *p <= 'f')
+	      col_used |= *p - 'a' + 10;
+	  p++;
+      }
+    cursor->readGeometry = (col_used & 2) ? 1 : 0;
+    if (nFields <= 0)
+	return;
+    cursor->readFields = malloc (nFields);
+    if (cursor->readFields == NULL)
+	return;
+    for (i = 0; i < nFields; i++)
+      {
+	  bit = i + 2;
+	  if (bit > 63)
+	      bit = 63;
+	  cursor->readFields[i] = (col_used >> bit) & 1;
+      }
+}
+
 static int
 vshp_eval_constraints (VirtualShapeCursorPtr cursor)
 {
@@ -949,18 +1483,83 @@ vshp_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
     int iColumn;
     int op;
     int len;
+    int no_rows = 0;
+    sqlite3_int64 first_row = 0;
+    sqlite3_int64 last_row = -1;
+    sqlite3_int64 value;
     VirtualShapeConstraintPtr pC;
     VirtualShapeCursorPtr cursor = (VirtualShapeCursorPtr) pCursor;
+    VirtualShapePtr p_vt = cursor->pVtab;
     if (idxNum)
 	idxNum = idxNum;	/* unused arg warning suppression */
 
 /* resetting any previously set filter constraint */
     vshp_free_constraints (cursor);
+    vshp_columns_used (cursor, idxStr);
 
     for (i = 0; i < argc; i++)
       {
-	  if (!vshp_parse_constraint (idxStr, i, &iColumn, &op))
+	  if (!vshp_parse_constraint (idxStr, i + 1, &iColumn, &op))
 	      continue;
+	  if (iColumn == p_vt->nColumns)
+	    {
+		/* the search_frame: any Geometry, only its MBR is used */
+		const unsigned char *blob;
+		unsigned int size;
+		if (sqlite3_value_type (argv[i]) != SQLITE_BLOB)
+		  {
+		      no_rows = 1;
+		      continue;
+		  }
+		blob = sqlite3_value_blob (argv[i]);
+		size = sqlite3_value_bytes (argv[i]);
+		if (!gaiaGetMbrMinX (blob, size, &(cursor->filterMinX))
+		    || !gaiaGetMbrMinY (blob, size, &(cursor->filterMinY))
+		    || !gaiaGetMbrMaxX (blob, size, &(cursor->filterMaxX))
+		    || !gaiaGetMbrMaxY (blob, size, &(cursor->filterMaxY)))
+		  {
+		      no_rows = 1;
+		      continue;
+		  }
+		if (cursor->filterMbr)
+		  {
+		      /* more than a single search_frame: no row could match */
+		      no_rows = 1;
+		  }
+		cursor->filterMbr = 1;
+		continue;
+	    }
+	  if (iColumn == 0
+	      && sqlite3_value_type (argv[i]) == SQLITE_INTEGER)
+	    {
+		/* narrowing the range of rows to be scanned; PKUID = row ID + 1 */
+		value = sqlite3_value_int64 (argv[i]);
+		switch (op)
+		  {
+		  case SQLITE_INDEX_CONSTRAINT_EQ:
+		      if (value - 1 > first_row)
+			  first_row = value - 1;
+		      if (last_row < 0 || value < last_row)
+			  last_row = value;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_GT:
+		      if (value > first_row)
+			  first_row = value;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_GE:
+		      if (value - 1 > first_row)
+			  first_row = value - 1;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_LT:
+		      if (last_row < 0 || value - 1 < last_row)
+			  last_row = (value < 1) ? 0 : value - 1;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_LE:
+		      if (last_row < 0 || value < last_row)
+			  last_row = (value < 0) ? 0 : value;
+		      break;
+		  };
+	    }
 	  pC = sqlite3_malloc (sizeof (VirtualShapeConstraint));
 	  if (!pC)
 	      continue;
@@ -1002,6 +1601,33 @@ vshp_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
     cursor->blobGeometry = NULL;
     cursor->blobSize = 0;
     cursor->eof = 0;
+    if (last_row >= 0 && first_row >= last_row)
+	no_rows = 1;
+    if (first_row > 0x7fffffff)
+	no_rows = 1;
+    if (no_rows)
+      {
+	  cursor->eof = 1;
+	  return SQLITE_OK;
+      }
+/* seeking the first row directly through the SHX offsets */
+    cursor->current_row = (long) first_row;
+    if (last_row >= 0 && last_row <= 0x7fffffff)
+	cursor->last_row = (long) last_row;
+    if (cursor->filterMbr && p_vt->RTree != NULL)
+      {
+	  /* querying the in-memory Spatial Index */
+	  if (!vshp_search_rtree
+	      (p_vt->RTree, cursor->filterMinX, cursor->filterMinY,
+	       cursor->filterMaxX, cursor->filterMaxY, &(cursor->rtreeRows),
+	       &(cursor->rtreeCount)))
+	      return SQLITE_NOMEM;
+	  if (cursor->rtreeRows == NULL)
+	    {
+		cursor->eof = 1;
+		return SQLITE_OK;
+	    }
+      }
     while (1)
       {
 	  vshp_read_row (cursor);
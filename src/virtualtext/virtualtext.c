@@ -52,18 +52,31 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #if defined(_WIN32) && !defined(__MINGW32__)
 #include "config-msvc.h"
 #else
 #include "config.h"
 #endif
 
+#if !defined(_WIN32) && !defined(WIN32)
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#include <sys/stat.h>
+
 #include <spatialite/sqlite.h>
 #include <spatialite/debug.h>
 
 #include <spatialite/spatialite.h>
 #include <spatialite/gaiaaux.h>
 #include <spatialite/gaiageo.h>
+#include <spatialite.h>
 
 #ifdef _WIN32
 #define strcasecmp	_stricmp
@@ -73,6 +86,16 @@ the terms of any one of the MPL, the GPL or the LGPL.
 
 struct sqlite3_module virtualtext_module;
 
+typedef struct VirtualTextCacheStruct
+{
+/* a typed Column cache [INTEGER and DOUBLE Columns only] */
+    int ready;			/* TRUE once the whole Column has been cached */
+    unsigned char *nulls;	/* NULL values bitmap [one bit for each row] */
+    sqlite3_int64 *int_values;	/* INTEGER values */
+    double *dbl_values;		/* DOUBLE values */
+} VirtualTextCache;
+typedef VirtualTextCache *VirtualTextCachePtr;
+
 typedef struct VirtualTextStruct
 {
 /* extends the sqlite3_vtab struct */
@@ -81,6 +104,7 @@ typedef struct VirtualTextStruct
     char *zErrMsg;		/* error message: USED INTERNALLY BY SQLITE */
     sqlite3 *db;		/* the sqlite db holding the virtual table */
     gaiaTextReaderPtr reader;	/* the TextReader object */
+    VirtualTextCachePtr cache;	/* the typed Column caches [NULL if disabled] */
 } VirtualText;
 typedef VirtualText *VirtualTextPtr;
 
@@ -93,6 +117,7 @@ typedef struct VirtualTextConstraintStruct
     sqlite3_int64 intValue;	/* Int64 comparison value */
     double dblValue;		/* Double comparison value */
     char *txtValue;		/* Text comparison value */
+    int cached;			/* TRUE if the row itself isn't required */
     struct VirtualTextConstraintStruct *next;
 } VirtualTextConstraint;
 typedef VirtualTextConstraint *VirtualTextConstraintPtr;
@@ -102,6 +127,7 @@ typedef struct VirtualTextCursortStruct
 /* extends the sqlite3_vtab_cursor struct */
     VirtualTextPtr pVtab;	/* Virtual table of this cursor */
     long current_row;		/* the current row ID */
+    long last_row;		/* stop before this row ID; -1 if unbounded */
     int eof;			/* the EOF marker */
     VirtualTextConstraintPtr firstConstraint;
     VirtualTextConstraintPtr lastConstraint;
@@ -169,18 +195,24 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     char text_separator = '"';
     char decimal_separator = '.';
     char first_line_titles = 1;
+    int use_index = 0;
+    int use_cache = 0;
+    int parsed = 0;
+    char *index_path = NULL;
     int i;
-    char sql[65535];
+    char *sql;
+    gaiaOutBuffer sql_statement;
     int seed;
     int dup;
     int idup;
-    char dummyName[4096];
+    char *dummyName;
     char **col_name = NULL;
+    int ret;
     VirtualTextPtr p_vt;
     if (pAux)
 	pAux = pAux;		/* unused arg warning suppression */
 /* checking for TEXTfile PATH */
-    if (argc >= 5 && argc <= 9)
+    if (argc >= 5 && argc <= 11)
       {
 	  vtable = argv[1];
 	  pPath = argv[3];
@@ -229,7 +261,7 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 		if (strcasecmp (argv[7], "NONE") == 0)
 		    text_separator = '\0';
 	    }
-	  if (argc == 9)
+	  if (argc >= 9)
 	    {
 		if (strlen (argv[8]) == 3)
 		  {
@@ -239,13 +271,24 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 			  field_separator = *(argv[8] + 1);
 		  }
 	    }
+	  if (argc >= 10)
+	    {
+		if (*(argv[9]) == '1' || *(argv[9]) == 'y' || *(argv[9]) == 'Y')
+		    use_index = 1;
+	    }
+	  if (argc == 11)
+	    {
+		if (*(argv[10]) == '1' || *(argv[10]) == 'y'
+		    || *(argv[10]) == 'Y')
+		    use_cache = 1;
+	    }
       }
     else
       {
 	  *pzErr =
 	      sqlite3_mprintf
 	      ("[VirtualText module] CREATE VIRTUAL: illegal arg list\n"
-	       "\t\t{ text_path, encoding [, first_row_as_titles [, [decimal_separator [, text_separator, [field_separator] ] ] ] }\n");
+	       "\t\t{ text_path, encoding [, first_row_as_titles [, [decimal_separator [, text_separator, [field_separator [, use_index [, use_cache] ] ] ] ] ] }\n");
 	  return SQLITE_ERROR;
       }
     p_vt = (VirtualTextPtr) sqlite3_malloc (sizeof (VirtualText));
@@ -255,24 +298,42 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     p_vt->nRef = 0;
     p_vt->zErrMsg = NULL;
     p_vt->db = db;
+    p_vt->cache = NULL;
     text = gaiaTextReaderAlloc (path, field_separator,
 				text_separator, decimal_separator,
 				first_line_titles, encoding);
     if (text)
       {
-	  if (gaiaTextReaderParse (text) == 0)
+	  if (use_index)
+	    {
+		/* using a sidecar Row Index file, if any */
+		index_path = sqlite3_mprintf ("%s.vtx", path);
+		if (gaiaTextReaderLoadIndex (text, index_path))
+		    parsed = 1;
+	    }
+	  if (!parsed)
 	    {
-		gaiaTextReaderDestroy (text);
-		text = NULL;
+		if (gaiaTextReaderParse (text) == 0)
+		  {
+		      gaiaTextReaderDestroy (text);
+		      text = NULL;
+		  }
+		else if (use_index)
+		    gaiaTextReaderSaveIndex (text, index_path);
 	    }
+	  if (index_path != NULL)
+	      sqlite3_free (index_path);
       }
     if (!text)
       {
 	  /* something is going the wrong way; creating a stupid default table */
 	  spatialite_e ("VirtualText: invalid data source\n");
-	  sprintf (sql, "CREATE TABLE %s (ROWNO INTEGER)", vtable);
-	  if (sqlite3_declare_vtab (db, sql) != SQLITE_OK)
+	  sql = sqlite3_mprintf ("CREATE TABLE %s (ROWNO INTEGER)", vtable);
+	  ret = sqlite3_declare_vtab (db, sql);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
 	    {
+		sqlite3_free (p_vt);
 		*pzErr =
 		    sqlite3_mprintf
 		    ("[VirtualText module] cannot build a table from TEXT file\n");
@@ -283,14 +344,26 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  return SQLITE_OK;
       }
     p_vt->reader = text;
+    if (use_cache && text->max_fields > 0)
+      {
+	  /* the typed Column caches will be built on first use */
+	  p_vt->cache =
+	      sqlite3_malloc (sizeof (VirtualTextCache) * text->max_fields);
+	  if (p_vt->cache != NULL)
+	      memset (p_vt->cache, 0,
+		      sizeof (VirtualTextCache) * text->max_fields);
+      }
 /* preparing the COLUMNs for this VIRTUAL TABLE */
-    sprintf (sql, "CREATE TABLE %s (ROWNO INTEGER", vtable);
+    gaiaOutBufferInitialize (&sql_statement);
+    sql = sqlite3_mprintf ("CREATE TABLE %s (ROWNO INTEGER", vtable);
+    gaiaAppendToOutBuffer (&sql_statement, sql);
+    sqlite3_free (sql);
     col_name = malloc (sizeof (char *) * text->max_fields);
     seed = 0;
     for (i = 0; i < text->max_fields; i++)
       {
-	  strcat (sql, ", ");
-	  sprintf (dummyName, "\"%s\"", text->columns[i].name);
+	  gaiaAppendToOutBuffer (&sql_statement, ", ");
+	  dummyName = sqlite3_mprintf ("\"%s\"", text->columns[i].name);
 	  dup = 0;
 	  for (idup = 0; idup < i; idup++)
 	    {
@@ -300,34 +373,45 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	  if (strcasecmp (dummyName, "ROWNO") == 0)
 	      dup = 1;
 	  if (dup)
-	      sprintf (dummyName, "DUPCOL_%d", seed++);
-	  len = strlen (dummyName);
-	  *(col_name + i) = malloc (len + 1);
-	  strcpy (*(col_name + i), dummyName);
-	  strcat (sql, dummyName);
+	    {
+		sqlite3_free (dummyName);
+		dummyName = sqlite3_mprintf ("DUPCOL_%d", seed++);
+	    }
+	  *(col_name + i) = dummyName;
+	  gaiaAppendToOutBuffer (&sql_statement, dummyName);
 	  if (text->columns[i].type == VRTTXT_INTEGER)
-	      strcat (sql, " INTEGER");
+	      gaiaAppendToOutBuffer (&sql_statement, " INTEGER");
 	  else if (text->columns[i].type == VRTTXT_DOUBLE)
-	      strcat (sql, " DOUBLE");
+	      gaiaAppendToOutBuffer (&sql_statement, " DOUBLE");
 	  else
-	      strcat (sql, " TEXT");
+	      gaiaAppendToOutBuffer (&sql_statement, " TEXT");
       }
-    strcat (sql, ")");
+    gaiaAppendToOutBuffer (&sql_statement, ")");
     if (col_name)
       {
 	  /* releasing memory allocation for column names */
 	  for (i = 0; i < text->max_fields; i++)
-	      free (*(col_name + i));
+	      sqlite3_free (*(col_name + i));
 	  free (col_name);
       }
-    if (sqlite3_declare_vtab (db, sql) != SQLITE_OK)
+    if (sql_statement.Error || sql_statement.Buffer == NULL)
+	ret = SQLITE_NOMEM;
+    else
+	ret = sqlite3_declare_vtab (db, sql_statement.Buffer);
+    if (ret != SQLITE_OK)
       {
 	  *pzErr =
 	      sqlite3_mprintf
 	      ("[VirtualText module] CREATE VIRTUAL: invalid SQL statement \"%s\"",
-	       sql);
+	       sql_statement.Buffer);
+	  gaiaOutBufferReset (&sql_statement);
+	  gaiaTextReaderDestroy (text);
+	  if (p_vt->cache != NULL)
+	      sqlite3_free (p_vt->cache);
+	  sqlite3_free (p_vt);
 	  return SQLITE_ERROR;
       }
+    gaiaOutBufferReset (&sql_statement);
     *ppVTab = (sqlite3_vtab *) p_vt;
     return SQLITE_OK;
 }
@@ -346,6 +430,10 @@ vtxt_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIndex)
 /* best index selection */
     int i;
     int iArg = 0;
+    int iColumn;
+    int op;
+    int rowid_eq = 0;
+    int rowid_range = 0;
     char str[2048];
     char buf[64];
 
@@ -357,11 +445,26 @@ vtxt_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIndex)
       {
 	  if (pIndex->aConstraint[i].usable)
 	    {
+		iColumn = pIndex->aConstraint[i].iColumn;
+		op = pIndex->aConstraint[i].op;
+		if (iColumn < 0)
+		    iColumn = 0;	/* the ROWID is an alias for ROWNO */
+		if (op != SQLITE_INDEX_CONSTRAINT_EQ
+		    && op != SQLITE_INDEX_CONSTRAINT_GT
+		    && op != SQLITE_INDEX_CONSTRAINT_LE
+		    && op != SQLITE_INDEX_CONSTRAINT_LT
+		    && op != SQLITE_INDEX_CONSTRAINT_GE)
+		    continue;	/* unsupported operator: left to SQLite */
+		sprintf (buf, "%d:%d,", iColumn, op);
+		if (strlen (str) + strlen (buf) >= sizeof (str))
+		    continue;	/* too many constraints: left to SQLite */
+		if (iColumn == 0 && op == SQLITE_INDEX_CONSTRAINT_EQ)
+		    rowid_eq = 1;
+		else if (iColumn == 0)
+		    rowid_range = 1;
 		iArg++;
 		pIndex->aConstraintUsage[i].argvIndex = iArg;
 		pIndex->aConstraintUsage[i].omit = 1;
-		sprintf (buf, "%d:%d,", pIndex->aConstraint[i].iColumn,
-			 pIndex->aConstraint[i].op);
 		strcat (str, buf);
 	    }
       }
@@ -370,15 +473,45 @@ vtxt_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIndex)
 	  pIndex->idxStr = sqlite3_mprintf ("%s", str);
 	  pIndex->needToFreeIdxStr = 1;
       }
+/* ROWNO seeks are directly supported by the Row Index */
+    if (rowid_eq)
+	pIndex->estimatedCost = 1.0;
+    else if (rowid_range)
+	pIndex->estimatedCost = 10000.0;
+    else
+	pIndex->estimatedCost = 1000000.0;
 
     return SQLITE_OK;
 }
 
+static void
+vtxt_free_cache (VirtualTextPtr p_vt)
+{
+/* memory cleanup - the typed Column caches */
+    int i;
+    VirtualTextCachePtr col;
+    if (p_vt->cache == NULL)
+	return;
+    for (i = 0; i < p_vt->reader->max_fields; i++)
+      {
+	  col = p_vt->cache + i;
+	  if (col->nulls)
+	      free (col->nulls);
+	  if (col->int_values)
+	      free (col->int_values);
+	  if (col->dbl_values)
+	      free (col->dbl_values);
+      }
+    sqlite3_free (p_vt->cache);
+    p_vt->cache = NULL;
+}
+
 static int
 vtxt_disconnect (sqlite3_vtab * pVTab)
 {
 /* disconnects the virtual table */
     VirtualTextPtr p_vt = (VirtualTextPtr) pVTab;
+    vtxt_free_cache (p_vt);
     if (p_vt->reader)
 	gaiaTextReaderDestroy (p_vt->reader);
     sqlite3_free (p_vt);
@@ -403,6 +536,7 @@ vtxt_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
 	return SQLITE_NOMEM;
     cursor->pVtab = (VirtualTextPtr) pVTab;
     cursor->current_row = 0;
+    cursor->last_row = -1;
     cursor->eof = 0;
     cursor->firstConstraint = NULL;
     cursor->lastConstraint = NULL;
@@ -496,9 +630,13 @@ vtxt_parse_constraint (const char *str, int index, int *iColumn, int *op)
 }
 
 static int
-vtxt_eval_constraints (VirtualTextCursorPtr cursor)
+vtxt_eval_constraints (VirtualTextCursorPtr cursor, int cached)
 {
-/* evaluating Filter constraints */
+/*
+/ evaluating Filter constraints
+/ - cached = TRUE: only the ones not requiring to read the current row
+/ - cached = FALSE: all other ones [the current row must be ready]
+*/
     int nCol;
     int i;
     char buf[4096];
@@ -511,13 +649,22 @@ vtxt_eval_constraints (VirtualTextCursorPtr cursor)
     int is_dbl = 0;
     int is_txt = 0;
     gaiaTextReaderPtr text = cursor->pVtab->reader;
+    VirtualTextCachePtr col;
     VirtualTextConstraintPtr pC;
-    if (text->current_line_ready == 0)
-	return SQLITE_ERROR;
+    if (!cached && text->current_line_ready == 0)
+	return 0;
     pC = cursor->firstConstraint;
     while (pC)
       {
 	  int ok = 0;
+	  if (pC->cached != cached)
+	    {
+		pC = pC->next;
+		continue;
+	    }
+	  is_int = 0;
+	  is_dbl = 0;
+	  is_txt = 0;
 	  if (pC->iColumn == 0)
 	    {
 		/* the ROWNO column */
@@ -525,12 +672,28 @@ vtxt_eval_constraints (VirtualTextCursorPtr cursor)
 		is_int = 1;
 		goto eval;
 	    }
+	  if (pC->cached)
+	    {
+		/* the typed Column cache */
+		col = cursor->pVtab->cache + (pC->iColumn - 1);
+		if (col->nulls[cursor->current_row / 8] &
+		    (1 << (cursor->current_row % 8)))
+		    ;
+		else if (col->int_values != NULL)
+		  {
+		      int_value = col->int_values[cursor->current_row];
+		      is_int = 1;
+		  }
+		else
+		  {
+		      dbl_value = col->dbl_values[cursor->current_row];
+		      is_dbl = 1;
+		  }
+		goto eval;
+	    }
 	  nCol = 1;
 	  for (i = 0; i < text->max_fields; i++)
 	    {
-		is_int = 0;
-		is_dbl = 0;
-		is_txt = 0;
 		if (nCol == pC->iColumn)
 		  {
 
@@ -724,6 +887,151 @@ vtxt_eval_constraints (VirtualTextCursorPtr cursor)
     return 1;
 }
 
+static void
+vtxt_build_cache (VirtualTextCursorPtr cursor)
+{
+/* building the typed caches of any numeric Column used by some constraint */
+    int i;
+    int row;
+    int type;
+    int count = 0;
+    int nulls_sz;
+    char buf[4096];
+    const char *value;
+    char *required;
+    VirtualTextCachePtr col;
+    VirtualTextConstraintPtr pC;
+    VirtualTextPtr p_vt = cursor->pVtab;
+    gaiaTextReaderPtr text = p_vt->reader;
+    if (p_vt->cache == NULL)
+	return;
+    required = malloc (text->max_fields);
+    if (required == NULL)
+	return;
+    memset (required, 0, text->max_fields);
+    nulls_sz = (text->num_rows / 8) + 1;
+    pC = cursor->firstConstraint;
+    while (pC)
+      {
+	  i = pC->iColumn - 1;
+	  if (i >= 0 && i < text->max_fields && !(p_vt->cache[i].ready)
+	      && !required[i]
+	      && (text->columns[i].type == VRTTXT_INTEGER
+		  || text->columns[i].type == VRTTXT_DOUBLE))
+	    {
+		/* allocating a new Column cache */
+		col = p_vt->cache + i;
+		col->nulls = malloc (nulls_sz);
+		if (text->columns[i].type == VRTTXT_INTEGER)
+		    col->int_values =
+			malloc (sizeof (sqlite3_int64) * (text->num_rows + 1));
+		else
+		    col->dbl_values =
+			malloc (sizeof (double) * (text->num_rows + 1));
+		if (col->nulls != NULL
+		    && (col->int_values != NULL || col->dbl_values != NULL))
+		  {
+		      memset (col->nulls, 0, nulls_sz);
+		      required[i] = 1;
+		      count++;
+		  }
+	    }
+	  pC = pC->next;
+      }
+    if (count == 0)
+	goto stop;
+/* a single scan: fetching and converting the values just once */
+    for (row = 0; row < text->num_rows; row++)
+      {
+	  if (!gaiaTextReaderGetRow (text, row))
+	      goto stop;
+	  for (i = 0; i < text->max_fields; i++)
+	    {
+		if (!required[i])
+		    continue;
+		col = p_vt->cache + i;
+		if (!gaiaTextReaderFetchField (text, i, &type, &value)
+		    || value == NULL || strlen (value) >= sizeof (buf))
+		    type = VRTTXT_NULL;
+		if (type == VRTTXT_INTEGER)
+		  {
+		      strcpy (buf, value);
+		      text_clean_integer (buf);
+#if defined(_WIN32) || defined(__MINGW32__)
+/* CAVEAT - M$ runtime has non-standard functions for 64 bits */
+		      col->int_values[row] = _atoi64 (buf);
+#else
+		      col->int_values[row] = atoll (buf);
+#endif
+		  }
+		else if (type == VRTTXT_DOUBLE)
+		  {
+		      strcpy (buf, value);
+		      text_clean_double (buf);
+		      col->dbl_values[row] = atof (buf);
+		  }
+		else
+		    col->nulls[row / 8] |= (1 << (row % 8));
+	    }
+      }
+    for (i = 0; i < text->max_fields; i++)
+      {
+	  if (required[i])
+	    {
+		p_vt->cache[i].ready = 1;
+		required[i] = 0;
+	    }
+      }
+  stop:
+    for (i = 0; i < text->max_fields; i++)
+      {
+	  if (p_vt->cache[i].ready)
+	      continue;
+	  /* discarding any incomplete Column cache */
+	  col = p_vt->cache + i;
+	  if (col->nulls)
+	      free (col->nulls);
+	  if (col->int_values)
+	      free (col->int_values);
+	  if (col->dbl_values)
+	      free (col->dbl_values);
+	  col->nulls = NULL;
+	  col->int_values = NULL;
+	  col->dbl_values = NULL;
+      }
+    free (required);
+    text->current_line_ready = 0;
+}
+
+static void
+vtxt_seek (VirtualTextCursorPtr cursor)
+{
+/* positioning the cursor on the first matching row, starting from the current one */
+    gaiaTextReaderPtr text = cursor->pVtab->reader;
+    while (1)
+      {
+	  if (text == NULL || cursor->current_row >= text->num_rows
+	      || (cursor->last_row >= 0
+		  && cursor->current_row >= cursor->last_row))
+	    {
+		cursor->eof = 1;
+		break;
+	    }
+	  if (vtxt_eval_constraints (cursor, 1))
+	    {
+		/* reading the row only when really required */
+		if (!gaiaTextReaderGetRow (text, cursor->current_row))
+		  {
+		      cursor->eof = 1;
+		      break;
+		  }
+		if (vtxt_eval_constraints (cursor, 0))
+		    break;
+	    }
+	  cursor->current_row++;
+      }
+}
+
 static int
 vtxt_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	     int argc, sqlite3_value ** argv)
@@ -733,19 +1041,64 @@ vtxt_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
     int iColumn;
     int op;
     int len;
+    sqlite3_int64 first_row = 0;
+    sqlite3_int64 last_row = -1;
+    sqlite3_int64 value;
     VirtualTextConstraintPtr pC;
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
-    gaiaTextReaderPtr text = cursor->pVtab->reader;
+    VirtualTextPtr p_vt = cursor->pVtab;
     if (idxNum)
 	idxNum = idxNum;	/* unused arg warning suppression */
 
 /* resetting any previously set filter constraint */
     vtxt_free_constraints (cursor);
+    cursor->current_row = 0;
+    cursor->last_row = -1;
+    cursor->eof = 0;
+    if (p_vt->reader == NULL)
+      {
+	  cursor->eof = 1;
+	  return SQLITE_OK;
+      }
 
     for (i = 0; i < argc; i++)
       {
 	  if (!vtxt_parse_constraint (idxStr, i, &iColumn, &op))
 	      continue;
+	  if (iColumn == 0 && sqlite3_value_type (argv[i]) == SQLITE_INTEGER)
+	    {
+		/* narrowing the range of rows to be scanned */
+		value = sqlite3_value_int64 (argv[i]);
+		if (value > 0x7fffffff)
+		    value = 0x7fffffff;
+		if (value < -1)
+		    value = -1;
+		switch (op)
+		  {
+		  case SQLITE_INDEX_CONSTRAINT_EQ:
+		      if (value > first_row)
+			  first_row = value;
+		      if (last_row < 0 || value + 1 < last_row)
+			  last_row = (value < 0) ? 0 : value + 1;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_GT:
+		      if (value + 1 > first_row)
+			  first_row = value + 1;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_GE:
+		      if (value > first_row)
+			  first_row = value;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_LT:
+		      if (last_row < 0 || value < last_row)
+			  last_row = (value < 0) ? 0 : value;
+		      break;
+		  case SQLITE_INDEX_CONSTRAINT_LE:
+		      if (last_row < 0 || value + 1 < last_row)
+			  last_row = (value < 0) ? 0 : value + 1;
+		      break;
+		  };
+	    }
 	  pC = sqlite3_malloc (sizeof (VirtualTextConstraint));
 	  if (!pC)
 	      continue;
@@ -753,6 +1106,7 @@ vtxt_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  pC->op = op;
 	  pC->valueType = '\0';
 	  pC->txtValue = NULL;
+	  pC->cached = 0;
 	  pC->next = NULL;
 
 	  if (sqlite3_value_type (argv[i]) == SQLITE_INTEGER)
@@ -781,19 +1135,32 @@ vtxt_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	  cursor->lastConstraint = pC;
       }
 
-    cursor->current_row = 0;
-    cursor->eof = 0;
-    while (1)
+/* the typed Column caches, if enabled, are built on first use */
+    vtxt_build_cache (cursor);
+    pC = cursor->firstConstraint;
+    while (pC)
       {
-	  if (!gaiaTextReaderGetRow (text, cursor->current_row))
-	    {
-		cursor->eof = 1;
-		break;
-	    }
-	  if (vtxt_eval_constraints (cursor))
-	      break;
-	  cursor->current_row++;
+	  if (pC->iColumn <= 0)
+	      pC->cached = 1;
+	  else if (p_vt->cache != NULL
+		   && pC->iColumn <= p_vt->reader->max_fields
+		   && p_vt->cache[pC->iColumn - 1].ready)
+	      pC->cached = 1;
+	  pC = pC->next;
+      }
+
+/* seeking the first row directly through the Row Index */
+    if (last_row > p_vt->reader->num_rows)
+	last_row = -1;
+    if ((last_row >= 0 && first_row >= last_row)
+	|| first_row >= p_vt->reader->num_rows)
+      {
+	  cursor->eof = 1;
+	  return SQLITE_OK;
       }
+    cursor->current_row = (long) first_row;
+    cursor->last_row = (long) last_row;
+    vtxt_seek (cursor);
     return SQLITE_OK;
 }
 
@@ -802,23 +1169,8 @@ vtxt_next (sqlite3_vtab_cursor * pCursor)
 {
 /* fetching next row from cursor */
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
-    gaiaTextReaderPtr text = cursor->pVtab->reader;
-    if (!text)
-	cursor->eof = 1;
-    else
-      {
-	  while (1)
-	    {
-		cursor->current_row++;
-		if (!gaiaTextReaderGetRow (text, cursor->current_row))
-		  {
-		      cursor->eof = 1;
-		      break;
-		  }
-		if (vtxt_eval_constraints (cursor))
-		    break;
-	    }
-      }
+    cursor->current_row++;
+    vtxt_seek (cursor);
     return SQLITE_OK;
 }
 
@@ -842,14 +1194,31 @@ vtxt_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
     const char *value;
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
     gaiaTextReaderPtr text = cursor->pVtab->reader;
+    VirtualTextCachePtr col;
     if (column == 0)
       {
 	  /* the ROWNO column */
 	  sqlite3_result_int (pContext, cursor->current_row);
 	  return SQLITE_OK;
       }
-    if (text->current_line_ready == 0)
+    if (text == NULL || text->current_line_ready == 0)
 	return SQLITE_ERROR;
+    if (cursor->pVtab->cache != NULL && column <= text->max_fields
+	&& cursor->pVtab->cache[column - 1].ready)
+      {
+	  /* the typed Column cache */
+	  col = cursor->pVtab->cache + (column - 1);
+	  if (col->nulls[cursor->current_row / 8] &
+	      (1 << (cursor->current_row % 8)))
+	      sqlite3_result_null (pContext);
+	  else if (col->int_values != NULL)
+	      sqlite3_result_int64 (pContext,
+				    col->int_values[cursor->current_row]);
+	  else
+	      sqlite3_result_double (pContext,
+				     col->dbl_values[cursor->current_row]);
+	  return SQLITE_OK;
+      }
     for (i = 0; i < text->max_fields; i++)
       {
 	  if (nCol == column)
@@ -981,26 +1350,175 @@ virtualtext_extension_init (sqlite3 * db)
 **
 */
 
-static struct vrttxt_row_block *
-vrttxt_block_alloc ()
+static void
+vrttxt_index_init (struct vrttxt_row_index *index)
 {
-/* allocating a rows Block */
-    struct vrttxt_row_block *p = malloc (sizeof (struct vrttxt_row_block));
-    if (!p)
-	return NULL;
-    p->num_rows = 0;
-    p->min_line_no = -1;
-    p->max_line_no = -1;
-    p->next = NULL;
-    return p;
+/* initializing the Row offsets index */
+    index->lengths = NULL;
+    index->lengths_len = 0;
+    index->lengths_sz = 0;
+    index->checkpoints = NULL;
+    index->num_checkpoints = 0;
+    index->checkpoints_sz = 0;
+    index->num_lines = 0;
+    index->cache_line_no = -1;
+    index->cache_offset = 0;
+    index->cache_pos = 0;
 }
 
 static void
-vrttxt_block_destroy (struct vrttxt_row_block *p)
+vrttxt_index_cleanup (struct vrttxt_row_index *index)
+{
+/* memory cleanup - destroying the Row offsets index */
+    if (index->lengths)
+	free (index->lengths);
+    if (index->checkpoints)
+	free (index->checkpoints);
+    vrttxt_index_init (index);
+}
+
+static int
+vrttxt_index_push (struct vrttxt_row_index *index, off_t offset, int len)
+{
+/* appending a Line (immediately following the previous one) to the index */
+    unsigned int value = (unsigned int) len;
+    unsigned char byte;
+    if ((index->num_lines % VRTTXT_INDEX_STEP) == 0)
+      {
+	  /* inserting a Checkpoint */
+	  struct vrttxt_row_checkpoint *cp;
+	  if (index->num_checkpoints >= index->checkpoints_sz)
+	    {
+		int new_sz =
+		    (index->checkpoints_sz == 0) ? 64 : index->checkpoints_sz * 2;
+		cp = realloc (index->checkpoints,
+			      sizeof (struct vrttxt_row_checkpoint) * new_sz);
+		if (cp == NULL)
+		    return 0;
+		index->checkpoints = cp;
+		index->checkpoints_sz = new_sz;
+	    }
+	  cp = index->checkpoints + index->num_checkpoints;
+	  cp->offset = offset;
+	  cp->pos = index->lengths_len;
+	  index->num_checkpoints++;
+      }
+    if (index->lengths_len + 5 > index->lengths_sz)
+      {
+	  /* expanding the encoded stream */
+	  size_t new_sz =
+	      (index->lengths_sz == 0) ? 4096 : index->lengths_sz * 2;
+	  unsigned char *new_buf = realloc (index->lengths, new_sz);
+	  if (new_buf == NULL)
+	      return 0;
+	  index->lengths = new_buf;
+	  index->lengths_sz = new_sz;
+      }
+    do
+      {
+	  /* encoding the Line length */
+	  byte = value & 0x7f;
+	  value >>= 7;
+	  if (value)
+	      byte |= 0x80;
+	  index->lengths[index->lengths_len++] = byte;
+      }
+    while (value);
+    index->num_lines++;
+    return 1;
+}
+
+static int
+vrttxt_index_decode (const struct vrttxt_row_index *index, size_t * pos)
+{
+/* decoding a Line length from the encoded stream */
+    unsigned int value = 0;
+    int shift = 0;
+    unsigned char byte;
+    while (*pos < index->lengths_len && shift < 32)
+      {
+	  byte = index->lengths[(*pos)++];
+	  value |= (unsigned int) (byte & 0x7f) << shift;
+	  shift += 7;
+	  if ((byte & 0x80) == 0)
+	      break;
+      }
+    return (int) (value & 0x7fffffff);
+}
+
+static int
+vrttxt_index_lookup (struct vrttxt_row_index *index, int line_no,
+		     off_t * offset, int *len)
+{
+/* retrieving the start offset and length of some Line */
+    struct vrttxt_row_checkpoint *cp;
+    int no;
+    off_t off;
+    size_t pos;
+    if (line_no < 0 || line_no >= index->num_lines)
+	return 0;
+    if (index->cache_line_no >= 0 && index->cache_line_no <= line_no
+	&& line_no - index->cache_line_no < VRTTXT_INDEX_STEP)
+      {
+	  /* resuming from the last accessed Line */
+	  no = index->cache_line_no;
+	  off = index->cache_offset;
+	  pos = index->cache_pos;
+      }
+    else
+      {
+	  /* starting from the nearest Checkpoint */
+	  cp = index->checkpoints + (line_no / VRTTXT_INDEX_STEP);
+	  no = (line_no / VRTTXT_INDEX_STEP) * VRTTXT_INDEX_STEP;
+	  off = cp->offset;
+	  pos = cp->pos;
+      }
+    while (no < line_no)
+      {
+	  /* skipping the preceding Lines */
+	  off += vrttxt_index_decode (index, &pos) + 1;
+	  no++;
+      }
+    index->cache_line_no = no;
+    index->cache_offset = off;
+    index->cache_pos = pos;
+    *offset = off;
+    *len = vrttxt_index_decode (index, &pos);
+    return 1;
+}
+
+static int
+vrttxt_grow_columns (gaiaTextReaderPtr txt, int num_fields)
 {
-/* destroying a rows Block */
-    if (p)
-	free (p);
+/* ensuring that the Column arrays could store num_fields items */
+    int col;
+    int new_sz;
+    void *p;
+    if (num_fields <= txt->columns_sz)
+	return 1;
+    new_sz = (txt->columns_sz == 0) ? 16 : txt->columns_sz;
+    while (new_sz < num_fields)
+	new_sz *= 2;
+    p = realloc (txt->columns, sizeof (struct vrttxt_column_header) * new_sz);
+    if (p == NULL)
+	return 0;
+    txt->columns = p;
+    for (col = txt->columns_sz; col < new_sz; col++)
+      {
+	  /* initializing column headers */
+	  txt->columns[col].name = NULL;
+	  txt->columns[col].type = VRTTXT_NULL;
+      }
+    txt->columns_sz = new_sz;
+    p = realloc (txt->field_offsets, sizeof (int) * new_sz);
+    if (p == NULL)
+	return 0;
+    txt->field_offsets = p;
+    p = realloc (txt->field_lens, sizeof (int) * new_sz);
+    if (p == NULL)
+	return 0;
+    txt->field_lens = p;
+    return 1;
 }
 
 GAIAGEO_DECLARE void
@@ -1008,46 +1526,78 @@ gaiaTextReaderDestroy (gaiaTextReaderPtr reader)
 {
 /* destroying the main TXT-Reader */
     int col;
-    struct vrttxt_row_block *blk;
-    struct vrttxt_row_block *blkN;
     if (reader)
       {
-	  blk = reader->first;
-	  while (blk)
-	    {
-		/* destroying the row offset Blocks */
-		blkN = blk->next;
-		vrttxt_block_destroy (blk);
-		blk = blkN;
-	    }
+	  /* destroying the row offsets index */
+	  vrttxt_index_cleanup (&(reader->index));
 	  /* freeing the input buffers */
 	  if (reader->line_buffer)
 	      free (reader->line_buffer);
 	  if (reader->field_buffer)
 	      free (reader->field_buffer);
-	  /* freeing the row offsets array */
-	  if (reader->rows)
-	      free (reader->rows);
+	  /* freeing the current record arrays */
+	  if (reader->field_offsets)
+	      free (reader->field_offsets);
+	  if (reader->field_lens)
+	      free (reader->field_lens);
 	  /* closing the input file */
+#if !defined(_WIN32) && !defined(WIN32)
+	  if (reader->mapped_file != NULL)
+	      munmap ((void *) (reader->mapped_file),
+		      (size_t) (reader->mapped_size));
+#endif
 	  fclose (reader->text_file);
-	  for (col = 0; col < VRTTXT_FIELDS_MAX; col++)
+	  for (col = 0; col < reader->columns_sz; col++)
 	    {
 		/* destroying column headers */
 		if (reader->columns[col].name != NULL)
 		    free (reader->columns[col].name);
 	    }
+	  if (reader->columns)
+	      free (reader->columns);
 	  gaiaFreeUTF8Converter (reader->toUtf8);
 	  free (reader);
       }
 }
 
+static void
+vrttxt_map_file (gaiaTextReaderPtr txt)
+{
+/*
+/ attempting to memory-map the whole input file
+/ if this fails (or isn't supported at all) the plain
+/ stdio based parser will be used
+*/
+#if !defined(_WIN32) && !defined(WIN32)
+    struct stat st;
+    void *base;
+    int fd = fileno (txt->text_file);
+    if (fstat (fd, &st) != 0)
+	return;
+    if (!S_ISREG (st.st_mode) || st.st_size <= 0)
+	return;
+    if ((off_t) ((size_t) (st.st_size)) != st.st_size)
+	return;			/* too big for the address space */
+    base = mmap (NULL, (size_t) (st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+	return;
+#ifdef MADV_SEQUENTIAL
+    madvise (base, (size_t) (st.st_size), MADV_SEQUENTIAL);
+#endif
+    txt->mapped_file = base;
+    txt->mapped_size = st.st_size;
+#else
+    txt = txt;			/* unused arg warning suppression */
+#endif
+}
+
 GAIAGEO_DECLARE gaiaTextReaderPtr
 gaiaTextReaderAlloc (const char *path, char field_separator,
 		     char text_separator, char decimal_separator,
 		     int first_line_titles, const char *encoding)
 {
 /* allocating the main TXT-Reader */
-    int col;
+    struct stat st;
     gaiaTextReaderPtr reader;
     FILE *in = fopen (path, "rb");	/* opening the input file */
     if (in == NULL)
@@ -1072,14 +1622,26 @@ gaiaTextReaderAlloc (const char *path, char field_separator,
 	  return NULL;
       }
     reader->error = 0;
-    reader->first = NULL;
-    reader->last = NULL;
-    reader->rows = NULL;
+    vrttxt_index_init (&(reader->index));
+    reader->columns = NULL;
+    reader->columns_sz = 0;
+    reader->field_offsets = NULL;
+    reader->field_lens = NULL;
     reader->num_rows = 0;
     reader->line_no = 0;
     reader->max_fields = 0;
     reader->max_current_field = 0;
     reader->current_line_ready = 0;
+    reader->mapped_file = NULL;
+    reader->mapped_size = 0;
+    reader->current_line = NULL;
+    reader->file_size = 0;
+    reader->file_mtime = 0;
+    if (fstat (fileno (in), &st) == 0)
+      {
+	  reader->file_size = st.st_size;
+	  reader->file_mtime = st.st_mtime;
+      }
     reader->current_buf_sz = 1024;
     reader->line_buffer = malloc (1024);
     reader->field_buffer = malloc (1024);
@@ -1089,12 +1651,7 @@ gaiaTextReaderAlloc (const char *path, char field_separator,
 	  gaiaTextReaderDestroy (reader);
 	  return NULL;
       }
-    for (col = 0; col < VRTTXT_FIELDS_MAX; col++)
-      {
-	  /* initializing column headers */
-	  reader->columns[col].name = NULL;
-	  reader->columns[col].type = VRTTXT_NULL;
-      }
+    vrttxt_map_file (reader);
     return reader;
 }
 
@@ -1124,6 +1681,20 @@ vrttxt_add_field (struct vrttxt_line *line, off_t offset)
 	  line->error = 1;
 	  return;
       }
+    if (line->num_fields >= line->field_offsets_sz)
+      {
+	  /* expanding the Field offsets array */
+	  int new_sz =
+	      (line->field_offsets_sz == 0) ? 64 : line->field_offsets_sz * 2;
+	  int *new_arr = realloc (line->field_offsets, sizeof (int) * new_sz);
+	  if (new_arr == NULL)
+	    {
+		line->error = 1;
+		return;
+	    }
+	  line->field_offsets = new_arr;
+	  line->field_offsets_sz = new_sz;
+      }
     line->field_offsets[line->num_fields] = offset - line->offset;
     line->num_fields++;
 }
@@ -1236,7 +1807,8 @@ vrttxt_set_column_title (gaiaTextReaderPtr txt, int col_no, const char *name)
     char *utf8text;
     char *str = (char *) name;
     int len = strlen (str);
-    if (str[0] == txt->text_separator && str[len - 1] == txt->text_separator)
+    if (len > 0 && str[0] == txt->text_separator
+	&& str[len - 1] == txt->text_separator)
       {
 	  /* cleaning the enclosing quotes */
 	  str[len - 1] = '\0';
@@ -1286,127 +1858,226 @@ vrttxt_set_column_title (gaiaTextReaderPtr txt, int col_no, const char *name)
     return 1;
 }
 
+/*
+/ preliminary parsing
+/
+/ a Parser collects the Line offsets and the Column types: a large
+/ memory-mapped input file is split into several chunks (each one
+/ starting just after a LF char) that are then parsed in parallel by
+/ separate threads, and finally merged in order
+/
+/ the quoting state at the start of each chunk isn't known in advance:
+/ so each chunk is first scanned twice (assuming an unmasked and a
+/ masked start), then the actual states are resolved chunk by chunk;
+/ a chunk starting in the masked state simply skips everything up to
+/ the first unmasked LF (that Line belongs to the previous chunk)
+*/
+
+#define VRTTXT_CHUNK_MIN	(4 * 1024 * 1024)	/* min chunk size */
+#define VRTTXT_MAX_THREADS	8	/* max number of parser threads */
+
+struct vrttxt_parser
+{
+/* a Parser [for the whole file or for a single chunk] */
+    gaiaTextReaderPtr txt;	/* the TXT-Reader [separators only] */
+    struct vrttxt_row_index index;	/* the Line offsets */
+    struct vrttxt_line line;	/* the current Line */
+    int *types;			/* the Column types */
+    int types_sz;
+    int max_fields;
+    int first_line;		/* TRUE until the first Line has been parsed */
+    char *field_buffer;		/* the current Field value */
+    int field_buffer_sz;
+    int error;
+    off_t begin;		/* the chunk range [memory-mapped file] */
+    off_t limit;
+    int start_masked;		/* the quoting state at the chunk start */
+    int end_masked[2];		/* the state at the chunk end [by start state] */
+#if !defined(_WIN32) && !defined(WIN32)
+    pthread_t thread;
+    int started;
+#endif
+};
+
 static void
-vrttxt_add_line (gaiaTextReaderPtr txt, struct vrttxt_line *line)
+vrttxt_parser_init (struct vrttxt_parser *parser, gaiaTextReaderPtr txt)
 {
-/* appending a Line offset to the main TXT-Reader */
-    struct vrttxt_row_block *p_block;
-    struct vrttxt_row *p_row;
-    int ind;
-    int off;
-    int len;
-    int value_type;
-    int column_type;
-    int first_line = 0;
-    if (txt->line_no == 0)
-	first_line = 1;
-    if (line->error)
-      {
-	  txt->error = 1;
-	  txt->line_no++;
-	  return;
-      }
-    if (line->num_fields == 0)
-      {
-	  txt->line_no++;
-	  return;
+/* initializing a Parser */
+    parser->txt = txt;
+    vrttxt_index_init (&(parser->index));
+    parser->line.field_offsets = NULL;
+    parser->line.field_offsets_sz = 0;
+    vrttxt_line_init (&(parser->line), 0);
+    parser->types = NULL;
+    parser->types_sz = 0;
+    parser->max_fields = 0;
+    parser->first_line = 1;
+    parser->field_buffer = NULL;
+    parser->field_buffer_sz = 0;
+    parser->error = 0;
+    parser->begin = 0;
+    parser->limit = 0;
+    parser->start_masked = 0;
+    parser->end_masked[0] = 0;
+    parser->end_masked[1] = 1;
+#if !defined(_WIN32) && !defined(WIN32)
+    parser->started = 0;
+#endif
+}
+
+static void
+vrttxt_parser_cleanup (struct vrttxt_parser *parser)
+{
+/* memory cleanup - destroying a Parser */
+    vrttxt_index_cleanup (&(parser->index));
+    if (parser->line.field_offsets)
+	free (parser->line.field_offsets);
+    parser->line.field_offsets = NULL;
+    parser->line.field_offsets_sz = 0;
+    if (parser->types)
+	free (parser->types);
+    parser->types = NULL;
+    parser->types_sz = 0;
+    if (parser->field_buffer)
+	free (parser->field_buffer);
+    parser->field_buffer = NULL;
+    parser->field_buffer_sz = 0;
+}
+
+static int
+vrttxt_parser_grow (struct vrttxt_parser *parser, int num_fields, int len)
+{
+/* ensuring that the Column types and the Field buffer are big enough */
+    if (num_fields > parser->types_sz)
+      {
+	  /* expanding the Column types array */
+	  int i;
+	  int new_sz = (parser->types_sz == 0) ? 16 : parser->types_sz;
+	  int *new_arr;
+	  while (new_sz < num_fields)
+	      new_sz *= 2;
+	  new_arr = realloc (parser->types, sizeof (int) * new_sz);
+	  if (new_arr == NULL)
+	      return 0;
+	  for (i = parser->types_sz; i < new_sz; i++)
+	      new_arr[i] = VRTTXT_NULL;
+	  parser->types = new_arr;
+	  parser->types_sz = new_sz;
       }
-    p_block = txt->last;
-    if (p_block == NULL)
+    if (len >= parser->field_buffer_sz)
       {
-	  /* the offset Blocks list is empty: allocating the first Block */
-	  p_block = vrttxt_block_alloc ();
-	  if (!p_block)
-	    {
-		txt->error = 1;
-		txt->line_no++;
-		return;
-	    }
-	  if (txt->first == NULL)
-	      txt->first = p_block;
-	  if (txt->last != NULL)
-	      txt->last->next = p_block;
-	  txt->last = p_block;
+	  /* expanding the Field buffer */
+	  int new_sz = (len < 1024) ? 1024 : len + 1;
+	  char *new_buf = malloc (new_sz);
+	  if (new_buf == NULL)
+	      return 0;
+	  if (parser->field_buffer)
+	      free (parser->field_buffer);
+	  parser->field_buffer = new_buf;
+	  parser->field_buffer_sz = new_sz;
+      }
+    return 1;
+}
+
+static int
+vrttxt_merge_type (int column_type, int value_type)
+{
+/* merging two Column types [NULL < INTEGER < DOUBLE < TEXT] */
+    if (column_type == VRTTXT_TEXT || value_type == VRTTXT_TEXT)
+	return VRTTXT_TEXT;
+    if (column_type == VRTTXT_DOUBLE || value_type == VRTTXT_DOUBLE)
+	return VRTTXT_DOUBLE;
+    if (column_type == VRTTXT_INTEGER || value_type == VRTTXT_INTEGER)
+	return VRTTXT_INTEGER;
+    return VRTTXT_NULL;
+}
+
+static void
+vrttxt_add_line (struct vrttxt_parser *parser, const char *line_data)
+{
+/* appending the current Line to the Parser */
+    struct vrttxt_line *line = &(parser->line);
+    int ind;
+    int off;
+    int len;
+    int value_type;
+    int first_line = parser->first_line;
+    parser->first_line = 0;
+    if (line->error)
+      {
+	  parser->error = 1;
+	  return;
       }
-    else if (p_block->num_rows >= VRTTXT_BLOCK_MAX)
+    if (!vrttxt_index_push (&(parser->index), line->offset, line->len))
       {
-	  /* the current offset Block is full: expanding the list */
-	  p_block = vrttxt_block_alloc ();
-	  if (!p_block)
-	    {
-		txt->error = 1;
-		txt->line_no++;
-		return;
-	    }
-	  if (txt->first == NULL)
-	      txt->first = p_block;
-	  if (txt->last != NULL)
-	      txt->last->next = p_block;
-	  txt->last = p_block;
-      }
-/* inserting the Row offset into the offset Block */
-    p_row = p_block->rows + p_block->num_rows;
-    p_block->num_rows++;
-    p_row->line_no = txt->line_no;
-    if (p_block->min_line_no < 0)
-	p_block->min_line_no = p_row->line_no;
-    if (p_block->max_line_no < p_row->line_no)
-	p_block->max_line_no = p_row->line_no;
-    txt->line_no++;
-    p_row->offset = line->offset;
-    p_row->len = line->len;
-    p_row->num_fields = line->num_fields;
-    if (line->num_fields > txt->max_fields)
-	txt->max_fields = line->num_fields;
+	  parser->error = 1;
+	  return;
+      }
+    if (!vrttxt_parser_grow (parser, line->num_fields, line->len))
+      {
+	  parser->error = 1;
+	  return;
+      }
+    if (line->num_fields > parser->max_fields)
+	parser->max_fields = line->num_fields;
+    if (first_line && parser->txt->first_line_titles)
+	return;			/* Column names: they'll be read later */
     off = 0;
-    for (ind = 0; ind < p_row->num_fields; ind++)
+    for (ind = 0; ind < line->num_fields; ind++)
       {
-	  /* setting the corresponding Column (aka Field) header */
+	  /* checking the corresponding Column type */
 	  len = line->field_offsets[ind] - off;
 	  if (len == 0)
-	      *(txt->field_buffer) = '\0';
+	      *(parser->field_buffer) = '\0';
 	  else
 	    {
 		/* retrieving the current Field Value */
-		memcpy (txt->field_buffer, txt->line_buffer + off, len);
-		*(txt->field_buffer + len) = '\0';
-	    }
-	  if (txt->first_line_titles && first_line)
-	    {
-		/* first line: the current value is the Column Name */
-		if (!vrttxt_set_column_title (txt, ind, txt->field_buffer))
-		    txt->error = 1;
-	    }
-	  else
-	    {
-		/* plain Field Value */
-		value_type =
-		    vrttxt_check_type (txt->field_buffer,
-				       txt->decimal_separator);
-		column_type = txt->columns[ind].type;
-		switch (value_type)
-		  {
-		      /* checking the Column type */
-		  case VRTTXT_INTEGER:
-		      if (column_type == VRTTXT_NULL)
-			  txt->columns[ind].type = VRTTXT_INTEGER;
-		      break;
-		  case VRTTXT_DOUBLE:
-		      if (column_type == VRTTXT_NULL
-			  || column_type == VRTTXT_INTEGER)
-			  txt->columns[ind].type = VRTTXT_DOUBLE;
-		      break;
-		  case VRTTXT_TEXT:
-		      txt->columns[ind].type = VRTTXT_TEXT;
-		      break;
-		  default:
-		      break;
-		  };
+		memcpy (parser->field_buffer, line_data + off, len);
+		*(parser->field_buffer + len) = '\0';
+		/* skipping trailing CRs, if any */
+		len = strlen (parser->field_buffer);
+		while (len > 0 && *(parser->field_buffer + len - 1) == '\r')
+		    *(parser->field_buffer + --len) = '\0';
 	    }
+	  value_type =
+	      vrttxt_check_type (parser->field_buffer,
+				 parser->txt->decimal_separator);
+	  parser->types[ind] =
+	      vrttxt_merge_type (parser->types[ind], value_type);
 	  off = line->field_offsets[ind] + 1;
       }
 }
 
+static int
+vrttxt_parser_merge (struct vrttxt_parser *parser,
+		     struct vrttxt_parser *chunk)
+{
+/* appending the Lines and the Column types of a chunk to the main Parser */
+    int i;
+    int len;
+    off_t offset = 0;
+    size_t pos = 0;
+    if (chunk->error)
+	return 0;
+    if (chunk->index.num_lines > 0)
+	offset = chunk->index.checkpoints[0].offset;
+    for (i = 0; i < chunk->index.num_lines; i++)
+      {
+	  /* Lines are contiguous: re-encoding them one by one */
+	  len = vrttxt_index_decode (&(chunk->index), &pos);
+	  if (!vrttxt_index_push (&(parser->index), offset, len))
+	      return 0;
+	  offset += len + 1;
+      }
+    if (!vrttxt_parser_grow (parser, chunk->max_fields, 0))
+	return 0;
+    for (i = 0; i < chunk->max_fields; i++)
+	parser->types[i] = vrttxt_merge_type (parser->types[i], chunk->types[i]);
+    if (chunk->max_fields > parser->max_fields)
+	parser->max_fields = chunk->max_fields;
+    return 1;
+}
+
 static void
 vrttxt_line_push (gaiaTextReaderPtr txt, char c)
 {
@@ -1458,71 +2129,17 @@ vrttxt_line_push (gaiaTextReaderPtr txt, char c)
     *(txt->line_buffer + txt->current_buf_off) = '\0';
 }
 
-static void
-vrttxt_build_line_array (gaiaTextReaderPtr txt)
-{
-/* creating the final Line offsets array */
-    struct vrttxt_row_block *p_block;
-    int i;
-    int cnt = 0;
-    int first_line = 1;
-    if (txt->rows)
-	free (txt->rows);
-    txt->rows = NULL;
-    txt->num_rows = 0;
-    p_block = txt->first;
-    while (p_block)
-      {
-	  /* counting how many lines are there */
-	  if (p_block == txt->first && txt->first_line_titles)
-	      txt->num_rows += p_block->num_rows - 1;
-	  else
-	      txt->num_rows += p_block->num_rows;
-	  p_block = p_block->next;
-      }
-    txt->rows = malloc (sizeof (struct vrttxt_row *) * txt->num_rows);
-    if (txt->rows == NULL)
-      {
-	  /* insufficient memory */
-	  txt->error = 1;
-	  return;
-      }
-    p_block = txt->first;
-    while (p_block)
-      {
-	  for (i = 0; i < p_block->num_rows; i++)
-	    {
-		/* setting Line references into the array */
-		if (first_line && txt->first_line_titles)
-		  {
-		      first_line = 0;
-		      continue;	/* skipping the first line (column names) */
-		  }
-		*(txt->rows + cnt++) = p_block->rows + i;
-	    }
-	  p_block = p_block->next;
-      }
-}
-
-GAIAGEO_DECLARE int
-gaiaTextReaderParse (gaiaTextReaderPtr txt)
+static int
+vrttxt_parse_stdio (gaiaTextReaderPtr txt, struct vrttxt_parser *parser)
 {
-/* 
-/ preliminary parsing
-/ - reading the input file until EOF
-/ - then feeding the Row offsets structs
-/   to be used for any subsequent access
-*/
-    char name[64];
-    int ind;
-    int i2;
+/* preliminary parsing: reading the input file char by char */
+    struct vrttxt_line *line = &(parser->line);
     int c;
     int masked = 0;
     int token_start = 1;
     int row_offset = 0;
     off_t offset = 0;
-    struct vrttxt_line line;
-    vrttxt_line_init (&line, 0);
+    vrttxt_line_init (line, 0);
     txt->current_buf_off = 0;
 
     while ((c = getc (txt->text_file)) != EOF)
@@ -1567,12 +2184,12 @@ gaiaTextReaderParse (gaiaTextReaderPtr txt)
 		      offset++;
 		      continue;
 		  }
-		vrttxt_add_field (&line, offset);
-		vrttxt_line_end (&line, offset);
-		vrttxt_add_line (txt, &line);
-		if (txt->error)
+		vrttxt_add_field (line, offset);
+		vrttxt_line_end (line, offset);
+		vrttxt_add_line (parser, txt->line_buffer);
+		if (parser->error)
 		    return 0;
-		vrttxt_line_init (&line, offset + 1);
+		vrttxt_line_init (line, offset + 1);
 		txt->current_buf_off = 0;
 		token_start = 1;
 		row_offset = 0;
@@ -1594,7 +2211,7 @@ gaiaTextReaderParse (gaiaTextReaderPtr txt)
 		if (txt->error)
 		    return 0;
 		row_offset++;
-		vrttxt_add_field (&line, offset);
+		vrttxt_add_field (line, offset);
 		token_start = 1;
 		offset++;
 		continue;
@@ -1607,11 +2224,363 @@ gaiaTextReaderParse (gaiaTextReaderPtr txt)
       }
     if (txt->error)
 	return 0;
+    return 1;
+}
+
+/*
+/ fast scanning of memory-mapped input files
+/
+/ only the field separator, the text separator and the CR/LF chars
+/ are meaningful for the parser: any run of other chars is skipped
+/ at once (16 bytes at each time when SSE2 is available)
+*/
+
+struct vrttxt_scanner
+{
+/* the set of chars to be checked by the parser */
+    char specials[4];
+    unsigned char is_special[256];
+};
+
+static void
+vrttxt_scanner_init (gaiaTextReaderPtr txt, struct vrttxt_scanner *scanner)
+{
+/* initializing the Scanner */
+    int i;
+    scanner->specials[0] = txt->field_separator;
+    scanner->specials[1] = txt->text_separator;
+    scanner->specials[2] = '\r';
+    scanner->specials[3] = '\n';
+    memset (scanner->is_special, 0, sizeof (scanner->is_special));
+    for (i = 0; i < 4; i++)
+	scanner->is_special[(unsigned char) (scanner->specials[i])] = 1;
+}
+
+static const char *
+vrttxt_scan (const struct vrttxt_scanner *scanner, const char *p,
+	     const char *end)
+{
+/* returning the first special char found within p..end [or end] */
+#if defined(__SSE2__)
+    __m128i sep = _mm_set1_epi8 (scanner->specials[0]);
+    __m128i quote = _mm_set1_epi8 (scanner->specials[1]);
+    __m128i cr = _mm_set1_epi8 ('\r');
+    __m128i lf = _mm_set1_epi8 ('\n');
+    while (end - p >= 16)
+      {
+	  __m128i blk = _mm_loadu_si128 ((const __m128i *) p);
+	  __m128i hits =
+	      _mm_or_si128 (_mm_or_si128
+			    (_mm_cmpeq_epi8 (blk, sep),
+			     _mm_cmpeq_epi8 (blk, quote)),
+			    _mm_or_si128 (_mm_cmpeq_epi8 (blk, cr),
+					  _mm_cmpeq_epi8 (blk, lf)));
+	  unsigned int mask = (unsigned int) _mm_movemask_epi8 (hits);
+	  if (mask != 0)
+	    {
+#if defined(__GNUC__)
+		return p + __builtin_ctz (mask);
+#else
+		while ((mask & 1) == 0)
+		  {
+		      mask >>= 1;
+		      p++;
+		  }
+		return p;
+#endif
+	    }
+	  p += 16;
+      }
+#endif
+    while (p < end && !scanner->is_special[(unsigned char) *p])
+	p++;
+    return p;
+}
+
+static int
+vrttxt_grow_buffers (gaiaTextReaderPtr txt, int len)
+{
+/* ensuring that a whole Line could fit into the buffers */
+    char *new_buf;
+    if (len < txt->current_buf_sz)
+	return 1;
+    new_buf = malloc (len + 1);
+    if (new_buf == NULL)
+	return 0;
+    free (txt->line_buffer);
+    txt->line_buffer = new_buf;
+    new_buf = malloc (len + 1);
+    if (new_buf == NULL)
+	return 0;
+    free (txt->field_buffer);
+    txt->field_buffer = new_buf;
+    txt->current_buf_sz = len + 1;
+    return 1;
+}
+
+static int
+vrttxt_chunk_state (gaiaTextReaderPtr txt,
+		    const struct vrttxt_scanner *scanner, const char *p,
+		    const char *end, int masked)
+{
+/* returning the quoting state at the end of a chunk */
+    const char *q;
+    int token_start = !masked;
+    while (p < end)
+      {
+	  q = vrttxt_scan (scanner, p, end);
+	  if (q != p)
+	      token_start = 0;
+	  if (q >= end)
+	      break;
+	  p = q + 1;
+	  if (*q == txt->text_separator)
+	    {
+		if (masked)
+		    masked = 0;
+		else
+		  {
+		      if (token_start)
+			  masked = 1;
+		  }
+		continue;
+	    }
+	  token_start = !masked && (*q == txt->field_separator || *q == '\n');
+      }
+    return masked;
+}
+
+static void *
+vrttxt_state_main (void *arg)
+{
+/* computing the ending states of a chunk [thread entry point] */
+    struct vrttxt_parser *parser = (struct vrttxt_parser *) arg;
+    gaiaTextReaderPtr txt = parser->txt;
+    struct vrttxt_scanner scanner;
+    const char *begin = txt->mapped_file + parser->begin;
+    const char *end = txt->mapped_file + parser->limit;
+    vrttxt_scanner_init (txt, &scanner);
+    parser->end_masked[0] = vrttxt_chunk_state (txt, &scanner, begin, end, 0);
+    if (parser->begin > 0)
+	parser->end_masked[1] =
+	    vrttxt_chunk_state (txt, &scanner, begin, end, 1);
+    return NULL;
+}
+
+static void *
+vrttxt_chunk_main (void *arg)
+{
+/* parsing a chunk of the memory-mapped input file [thread entry point] */
+    struct vrttxt_parser *parser = (struct vrttxt_parser *) arg;
+    gaiaTextReaderPtr txt = parser->txt;
+    struct vrttxt_line *line = &(parser->line);
+    struct vrttxt_scanner scanner;
+    const char *base = txt->mapped_file;
+    const char *end = base + txt->mapped_size;
+    const char *p = base + parser->begin;
+    const char *q;
+    char c;
+    int masked = parser->start_masked;
+    int token_start = !masked;
+    int skipping = masked;	/* still within a Line of the previous chunk */
+    off_t offset;
+    vrttxt_scanner_init (txt, &scanner);
+    vrttxt_line_init (line, parser->begin);
+
+    while (p < end)
+      {
+	  q = vrttxt_scan (&scanner, p, end);
+	  if (q != p)
+	      token_start = 0;
+	  if (q >= end)
+	      break;
+	  c = *q;
+	  offset = q - base;
+	  p = q + 1;
+	  if (c == txt->text_separator)
+	    {
+		if (masked)
+		    masked = 0;
+		else
+		  {
+		      if (token_start)
+			  masked = 1;
+		  }
+		continue;
+	    }
+	  token_start = 0;
+	  if (masked || c == '\r')
+	      continue;
+	  if (c == '\n')
+	    {
+		if (!skipping)
+		  {
+		      vrttxt_add_field (line, offset);
+		      vrttxt_line_end (line, offset);
+		      vrttxt_add_line (parser, base + line->offset);
+		      if (parser->error)
+			  break;
+		  }
+		skipping = 0;
+		if (offset + 1 >= parser->limit)
+		    break;	/* any further Line belongs to the next chunk */
+		vrttxt_line_init (line, offset + 1);
+		token_start = 1;
+		continue;
+	    }
+	  if (c == txt->field_separator)
+	    {
+		if (!skipping)
+		    vrttxt_add_field (line, offset);
+		token_start = 1;
+	    }
+      }
+    return NULL;
+}
+
+static int
+vrttxt_parse_threads (gaiaTextReaderPtr txt, int requested)
+{
+/*
+/ determining how many parser threads should be used
+/
+/ a positive REQUESTED count forces the number of chunks whatever
+/ the CPUs and the file size may be; 0 or less means automatic
+*/
+#if !defined(_WIN32) && !defined(WIN32)
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    off_t chunks = txt->mapped_size / VRTTXT_CHUNK_MIN;
+    int threads = (cpus > VRTTXT_MAX_THREADS) ? VRTTXT_MAX_THREADS : cpus;
+#endif
+    if (requested > 0)
+      {
+	  if (requested > VRTTXT_MAX_THREADS)
+	      return VRTTXT_MAX_THREADS;
+	  return requested;
+      }
+#if !defined(_WIN32) && !defined(WIN32)
+    if (threads > chunks)
+	threads = chunks;
+    if (threads < 2)
+	return 1;
+    return threads;
+#else
+    txt = txt;			/* unused arg warning suppression */
+    return 1;
+#endif
+}
+
+static void
+vrttxt_run_chunks (struct vrttxt_parser **chunks, int count,
+		   void *(*chunk_main) (void *))
+{
+/* processing all chunks [each one by a separate thread, if possible] */
+    int i;
+#if !defined(_WIN32) && !defined(WIN32)
+    for (i = 1; i < count; i++)
+	chunks[i]->started =
+	    (pthread_create
+	     (&(chunks[i]->thread), NULL, chunk_main, chunks[i]) == 0);
+    chunk_main (chunks[0]);
+    for (i = 1; i < count; i++)
+      {
+	  if (chunks[i]->started)
+	      pthread_join (chunks[i]->thread, NULL);
+	  else
+	      chunk_main (chunks[i]);	/* no thread: processing it here */
+	  chunks[i]->started = 0;
+      }
+#else
+    for (i = 0; i < count; i++)
+	chunk_main (chunks[i]);
+#endif
+}
+
+static int
+vrttxt_parse_mapped (gaiaTextReaderPtr txt, struct vrttxt_parser *parser,
+		     int requested)
+{
+/* preliminary parsing: scanning the memory-mapped input file */
+    struct vrttxt_parser extra[VRTTXT_MAX_THREADS - 1];
+    struct vrttxt_parser *chunks[VRTTXT_MAX_THREADS];
+    const char *nl;
+    off_t size = txt->mapped_size;
+    off_t pos = 0;
+    off_t target;
+    int threads = vrttxt_parse_threads (txt, requested);
+    int count = 0;
+    int masked;
+    int i;
+    int ok = 1;
+    while (pos < size && count < threads)
+      {
+	  /* splitting the input file into chunks, just after some LF */
+	  struct vrttxt_parser *chunk = parser;
+	  if (count > 0)
+	    {
+		chunk = extra + (count - 1);
+		vrttxt_parser_init (chunk, txt);
+		chunk->first_line = 0;
+	    }
+	  chunk->begin = pos;
+	  chunk->limit = size;
+	  target = (size / threads) * (count + 1);
+	  if (count < threads - 1 && target > pos)
+	    {
+		nl = memchr (txt->mapped_file + target, '\n', size - target);
+		if (nl != NULL)
+		    chunk->limit = (nl - txt->mapped_file) + 1;
+	    }
+	  chunks[count++] = chunk;
+	  pos = chunk->limit;
+      }
+    if (count > 1)
+      {
+	  /* resolving the quoting state at the start of each chunk */
+	  vrttxt_run_chunks (chunks, count, vrttxt_state_main);
+	  masked = 0;
+	  for (i = 0; i < count; i++)
+	    {
+		chunks[i]->start_masked = masked;
+		masked = chunks[i]->end_masked[masked];
+	    }
+      }
+    if (count > 0)
+	vrttxt_run_chunks (chunks, count, vrttxt_chunk_main);
+    for (i = 1; i < count; i++)
+      {
+	  /* merging the chunks in order */
+	  if (ok && !vrttxt_parser_merge (parser, chunks[i]))
+	      ok = 0;
+	  vrttxt_parser_cleanup (chunks[i]);
+      }
+    if (parser->error)
+	ok = 0;
+    return ok;
+}
+
+static int
+vrttxt_complete_columns (gaiaTextReaderPtr txt)
+{
+/* setting the final column names and the number of rows */
+    char name[64];
+    int ind;
+    int i2;
     if (txt->first_line_titles)
       {
-	  /* checking for duplicate column names */
+	  /* checking for missing or duplicate column names */
 	  for (ind = 0; ind < txt->max_fields; ind++)
 	    {
+		if (txt->columns[ind].name == NULL)
+		  {
+		      /* some line has more fields than the first one */
+		      sprintf (name, "COL%03d", ind + 1);
+		      if (!vrttxt_set_column_title (txt, ind, name))
+			{
+			    txt->error = 1;
+			    return 0;
+			}
+		  }
 		for (i2 = 0; i2 < ind; i2++)
 		  {
 		      if (strcasecmp
@@ -1642,38 +2611,74 @@ gaiaTextReaderParse (gaiaTextReaderPtr txt)
       }
     if (txt->error)
 	return 0;
-    vrttxt_build_line_array (txt);
-    if (txt->error)
-	return 0;
+/* the first line could contain column names */
+    txt->num_rows = txt->index.num_lines;
+    if (txt->first_line_titles && txt->num_rows > 0)
+	txt->num_rows--;
     return 1;
 }
 
-GAIAGEO_DECLARE int
-gaiaTextReaderGetRow (gaiaTextReaderPtr txt, int line_no)
+static int
+vrttxt_read_line (gaiaTextReaderPtr txt, int line_no)
 {
-/* reading a Line (identified by relative number */
+/* reading a Line (identified by absolute number) and splitting its Fields */
     int i;
     char c;
     int masked = 0;
     int token_start = 1;
     int fld = 0;
     int offset = 0;
-    struct vrttxt_row *p_row;
+    off_t row_offset;
+    int row_len;
+    struct vrttxt_scanner scanner;
+    const char *line;
+    const char *end;
+    const char *p;
     txt->current_line_ready = 0;
     txt->max_current_field = 0;
-    if (line_no < 0 || line_no >= txt->num_rows || txt->rows == NULL)
+    if (txt->max_fields <= 0)
 	return 0;
-    p_row = *(txt->rows + line_no);
-    if (fseek (txt->text_file, p_row->offset, SEEK_SET) != 0)
+    if (!vrttxt_index_lookup (&(txt->index), line_no, &row_offset, &row_len))
 	return 0;
-    if (fread (txt->line_buffer, 1, p_row->len, txt->text_file) !=
-	(unsigned int) (p_row->len))
+    if (!vrttxt_grow_buffers (txt, row_len))
 	return 0;
+    if (txt->mapped_file != NULL)
+      {
+	  /* memory-mapped file: directly accessing the Line */
+	  if (row_offset < 0 || row_offset + row_len > txt->mapped_size)
+	      return 0;
+	  line = txt->mapped_file + row_offset;
+      }
+    else
+      {
+	  if (fseek (txt->text_file, row_offset, SEEK_SET) != 0)
+	      return 0;
+	  if (fread (txt->line_buffer, 1, row_len, txt->text_file) !=
+	      (unsigned int) (row_len))
+	      return 0;
+	  line = txt->line_buffer;
+      }
+    txt->current_line = line;
     txt->field_offsets[0] = 0;
-    for (i = 0; i < p_row->len; i++)
+    vrttxt_scanner_init (txt, &scanner);
+    end = line + row_len;
+    for (i = 0; i < row_len; i++)
       {
 	  /* parsing Fields */
-	  c = *(txt->line_buffer + i);
+	  if (!masked)
+	    {
+		/* quickly skipping any plain char */
+		p = vrttxt_scan (&scanner, line + i, end);
+		if (p != line + i)
+		  {
+		      token_start = 0;
+		      offset += p - (line + i);
+		      i = p - line;
+		      if (i >= row_len)
+			  break;
+		  }
+	    }
+	  c = *(line + i);
 	  if (c == txt->text_separator)
 	    {
 		if (masked)
@@ -1694,7 +2699,7 @@ gaiaTextReaderGetRow (gaiaTextReaderPtr txt, int line_no)
 	    }
 	  if (c == txt->field_separator)
 	    {
-		if (masked)
+		if (masked || fld + 1 >= txt->max_fields)
 		  {
 		      offset++;
 		      continue;
@@ -1720,6 +2725,115 @@ gaiaTextReaderGetRow (gaiaTextReaderPtr txt, int line_no)
     return 1;
 }
 
+static int
+vrttxt_load_titles (gaiaTextReaderPtr txt)
+{
+/* setting the Column names from the first line */
+    int ind;
+    int len;
+    if (!vrttxt_read_line (txt, 0))
+	return 0;
+    for (ind = 0; ind < txt->max_current_field; ind++)
+      {
+	  len = txt->field_lens[ind];
+	  memcpy (txt->field_buffer,
+		  txt->current_line + txt->field_offsets[ind], len);
+	  *(txt->field_buffer + len) = '\0';
+	  /* skipping trailing CRs, if any */
+	  len = strlen (txt->field_buffer);
+	  while (len > 0 && *(txt->field_buffer + len - 1) == '\r')
+	      *(txt->field_buffer + --len) = '\0';
+	  if (!vrttxt_set_column_title (txt, ind, txt->field_buffer))
+	      return 0;
+      }
+    txt->current_line_ready = 0;
+    txt->max_current_field = 0;
+    return 1;
+}
+
+static int
+vrttxt_install_index (gaiaTextReaderPtr txt, struct vrttxt_row_index *index,
+		      int max_fields)
+{
+/* installing a Row Index [ownership is transferred to the TXT-Reader] */
+    if (!vrttxt_grow_columns (txt, max_fields))
+	return 0;
+    txt->index = *index;
+    vrttxt_index_init (index);
+    txt->max_fields = max_fields;
+    txt->line_no = txt->index.num_lines;
+    return 1;
+}
+
+static int
+vrttxt_finish_columns (gaiaTextReaderPtr txt)
+{
+/* setting the Column names once the Row Index has been installed */
+    if (txt->first_line_titles && txt->index.num_lines > 0)
+      {
+	  if (!vrttxt_load_titles (txt))
+	    {
+		txt->error = 1;
+		return 0;
+	    }
+      }
+    return vrttxt_complete_columns (txt);
+}
+
+GAIAGEO_DECLARE int
+gaiaTextReaderParse (gaiaTextReaderPtr txt)
+{
+/* preliminary parsing - the number of chunks is automatically set */
+    return gaiaTextReaderParse_ex (txt, 0);
+}
+
+GAIAGEO_DECLARE int
+gaiaTextReaderParse_ex (gaiaTextReaderPtr txt, int chunks)
+{
+/* 
+/ preliminary parsing
+/ - reading the input file until EOF
+/ - then feeding the Row offsets structs
+/   to be used for any subsequent access
+*/
+    int ret;
+    int i;
+    struct vrttxt_parser parser;
+    vrttxt_parser_init (&parser, txt);
+    if (txt->mapped_file != NULL)
+	ret = vrttxt_parse_mapped (txt, &parser, chunks);
+    else
+	ret = vrttxt_parse_stdio (txt, &parser);
+    if (ret && !parser.error
+	&& vrttxt_install_index (txt, &(parser.index), parser.max_fields))
+      {
+	  for (i = 0; i < parser.max_fields; i++)
+	      txt->columns[i].type = parser.types[i];
+      }
+    else
+	ret = 0;
+    vrttxt_parser_cleanup (&parser);
+    if (!ret || txt->error)
+      {
+	  txt->error = 1;
+	  return 0;
+      }
+    return vrttxt_finish_columns (txt);
+}
+
+GAIAGEO_DECLARE int
+gaiaTextReaderGetRow (gaiaTextReaderPtr txt, int line_no)
+{
+/* reading a Line (identified by relative number */
+    txt->current_line_ready = 0;
+    txt->max_current_field = 0;
+    if (line_no < 0 || line_no >= txt->num_rows)
+	return 0;
+    if (txt->first_line_titles)
+	line_no++;		/* skipping the first line (column names) */
+    return vrttxt_read_line (txt, line_no);
+}
+
 GAIAGEO_DECLARE int
 gaiaTextReaderFetchField (gaiaTextReaderPtr txt, int field_idx, int *type,
 			  const char **value)
@@ -1750,7 +2864,7 @@ gaiaTextReaderFetchField (gaiaTextReaderPtr txt, int field_idx, int *type,
     *type = txt->columns[field_idx].type;
     if (txt->field_lens[field_idx] == 0)
 	*(txt->field_buffer) = '\0';
-    memcpy (txt->field_buffer, txt->line_buffer + txt->field_offsets[field_idx],
+    memcpy (txt->field_buffer, txt->current_line + txt->field_offsets[field_idx],
 	    txt->field_lens[field_idx]);
     *(txt->field_buffer + txt->field_lens[field_idx]) = '\0';
     *value = txt->field_buffer;
@@ -1771,7 +2885,7 @@ gaiaTextReaderFetchField (gaiaTextReaderPtr txt, int field_idx, int *type,
 		str[len - 1] = '\0';
 		len--;
 	    }
-	  if (str[0] == txt->text_separator
+	  if (len > 0 && str[0] == txt->text_separator
 	      && str[len - 1] == txt->text_separator)
 	    {
 		/* cleaning the enclosing quotes */
@@ -1800,4 +2914,511 @@ gaiaTextReaderFetchField (gaiaTextReaderPtr txt, int field_idx, int *type,
     return 1;
 }
 
+/*
+/ Row Index sidecar files
+/
+/ the index file stores everything gaiaTextReaderParse() would
+/ compute, except the column names (that are simply read again
+/ from the first line): all numbers are little endian
+/
+/ - header [56 bytes]: magic "VRTTXTIX", version, the field, text
+/   and decimal separators, the titles flag, the input file size
+/   and last modification time, number of lines, number of fields,
+/   number of checkpoints, length of the encoded lengths stream
+/ - column types [one byte for each field]
+/ - checkpoints [16 bytes each: offset, stream position]
+/ - encoded lengths stream
+*/
+
+#define VRTTXT_INDEX_MAGIC	"VRTTXTIX"
+#define VRTTXT_INDEX_VERSION	1
+#define VRTTXT_INDEX_HEADER	56
+
+static void
+vrttxt_reset (gaiaTextReaderPtr txt)
+{
+/* resetting an unparsed TXT-Reader */
+    int col;
+    vrttxt_index_cleanup (&(txt->index));
+    for (col = 0; col < txt->columns_sz; col++)
+      {
+	  if (txt->columns[col].name != NULL)
+	      free (txt->columns[col].name);
+	  txt->columns[col].name = NULL;
+	  txt->columns[col].type = VRTTXT_NULL;
+      }
+    txt->error = 0;
+    txt->num_rows = 0;
+    txt->line_no = 0;
+    txt->max_fields = 0;
+    txt->max_current_field = 0;
+    txt->current_line_ready = 0;
+    fseek (txt->text_file, 0, SEEK_SET);
+}
+
+GAIAGEO_DECLARE int
+gaiaTextReaderLoadIndex (gaiaTextReaderPtr txt, const char *index_path)
+{
+/* loading a previously saved Row Index */
+    unsigned char hdr[VRTTXT_INDEX_HEADER];
+    unsigned char buf[16];
+    int endian_arch = gaiaEndianArch ();
+    FILE *in;
+    int i;
+    int num_lines;
+    int max_fields;
+    int num_checkpoints;
+    sqlite3_int64 lengths_len;
+    unsigned char *types = NULL;
+    struct vrttxt_row_index index;
+    if (txt == NULL || index_path == NULL || txt->index.num_lines > 0)
+	return 0;
+    in = fopen (index_path, "rb");
+    if (in == NULL)
+	return 0;
+    vrttxt_index_init (&index);
+    if (fread (hdr, 1, VRTTXT_INDEX_HEADER, in) != VRTTXT_INDEX_HEADER)
+	goto error;
+    if (memcmp (hdr, VRTTXT_INDEX_MAGIC, 8) != 0)
+	goto error;
+    if (gaiaImport32 (hdr + 8, 1, endian_arch) != VRTTXT_INDEX_VERSION)
+	goto error;
+/* checking if the index still matches the input file */
+    if ((char) hdr[12] != txt->field_separator
+	|| (char) hdr[13] != txt->text_separator
+	|| (char) hdr[14] != txt->decimal_separator
+	|| hdr[15] != (txt->first_line_titles ? 1 : 0))
+	goto error;
+    if (gaiaImportI64 (hdr + 16, 1, endian_arch) !=
+	(sqlite3_int64) (txt->file_size)
+	|| gaiaImportI64 (hdr + 24, 1, endian_arch) != txt->file_mtime)
+	goto error;
+    num_lines = gaiaImport32 (hdr + 32, 1, endian_arch);
+    max_fields = gaiaImport32 (hdr + 36, 1, endian_arch);
+    num_checkpoints = gaiaImport32 (hdr + 40, 1, endian_arch);
+    lengths_len = gaiaImportI64 (hdr + 48, 1, endian_arch);
+    if (num_lines < 0 || max_fields < 0 || max_fields > VRTTXT_FIELDS_MAX)
+	goto error;
+    if (num_checkpoints !=
+	(num_lines + VRTTXT_INDEX_STEP - 1) / VRTTXT_INDEX_STEP)
+	goto error;
+    if (lengths_len < num_lines || lengths_len > (sqlite3_int64) (txt->file_size)
+	|| (num_lines > 0 && max_fields == 0))
+	goto error;
+/* loading the column types */
+    types = malloc (max_fields + 1);
+    if (types == NULL)
+	goto error;
+    if (fread (types, 1, max_fields, in) != (size_t) max_fields)
+	goto error;
+    for (i = 0; i < max_fields; i++)
+      {
+	  if (types[i] < VRTTXT_TEXT || types[i] > VRTTXT_NULL)
+	      goto error;
+      }
+/* loading the checkpoints */
+    if (num_checkpoints > 0)
+      {
+	  index.checkpoints =
+	      malloc (sizeof (struct vrttxt_row_checkpoint) * num_checkpoints);
+	  if (index.checkpoints == NULL)
+	      goto error;
+	  index.checkpoints_sz = num_checkpoints;
+      }
+    for (i = 0; i < num_checkpoints; i++)
+      {
+	  struct vrttxt_row_checkpoint *cp = index.checkpoints + i;
+	  sqlite3_int64 offset;
+	  sqlite3_int64 pos;
+	  if (fread (buf, 1, 16, in) != 16)
+	      goto error;
+	  offset = gaiaImportI64 (buf, 1, endian_arch);
+	  pos = gaiaImportI64 (buf + 8, 1, endian_arch);
+	  if (offset < 0 || offset > (sqlite3_int64) (txt->file_size)
+	      || pos < 0 || pos >= lengths_len)
+	      goto error;
+	  cp->offset = (off_t) offset;
+	  cp->pos = (size_t) pos;
+      }
+    index.num_checkpoints = num_checkpoints;
+/* loading the encoded lengths stream */
+    if (lengths_len > 0)
+      {
+	  index.lengths = malloc ((size_t) lengths_len);
+	  if (index.lengths == NULL)
+	      goto error;
+	  index.lengths_sz = (size_t) lengths_len;
+	  if (fread (index.lengths, 1, (size_t) lengths_len, in) !=
+	      (size_t) lengths_len)
+	      goto error;
+      }
+    index.lengths_len = (size_t) lengths_len;
+    index.num_lines = num_lines;
+    if (fgetc (in) != EOF)
+	goto error;		/* unexpected trailing data */
+    fclose (in);
+    in = NULL;
+
+/* installing the Row Index */
+    if (!vrttxt_install_index (txt, &index, max_fields))
+	goto error;
+    for (i = 0; i < max_fields; i++)
+	txt->columns[i].type = types[i];
+    free (types);
+    types = NULL;
+    if (!vrttxt_finish_columns (txt))
+	goto error;
+    return 1;
+
+  error:
+    if (in != NULL)
+	fclose (in);
+    if (types != NULL)
+	free (types);
+    vrttxt_index_cleanup (&index);
+    vrttxt_reset (txt);
+    return 0;
+}
+
+GAIAGEO_DECLARE int
+gaiaTextReaderSaveIndex (gaiaTextReaderPtr txt, const char *index_path)
+{
+/* saving the Row Index into a sidecar file */
+    unsigned char hdr[VRTTXT_INDEX_HEADER];
+    unsigned char buf[16];
+    int endian_arch = gaiaEndianArch ();
+    char *tmp_path;
+    FILE *out;
+    int i;
+    int ok = 0;
+    struct vrttxt_row_index *index;
+    if (txt == NULL || index_path == NULL || txt->error)
+	return 0;
+    index = &(txt->index);
+    if (index->num_lines > 0 && txt->max_fields <= 0)
+	return 0;
+    memset (hdr, 0, VRTTXT_INDEX_HEADER);
+    memcpy (hdr, VRTTXT_INDEX_MAGIC, 8);
+    gaiaExport32 (hdr + 8, VRTTXT_INDEX_VERSION, 1, endian_arch);
+    hdr[12] = (unsigned char) (txt->field_separator);
+    hdr[13] = (unsigned char) (txt->text_separator);
+    hdr[14] = (unsigned char) (txt->decimal_separator);
+    hdr[15] = txt->first_line_titles ? 1 : 0;
+    gaiaExportI64 (hdr + 16, (sqlite3_int64) (txt->file_size), 1,
+		   endian_arch);
+    gaiaExportI64 (hdr + 24, txt->file_mtime, 1, endian_arch);
+    gaiaExport32 (hdr + 32, index->num_lines, 1, endian_arch);
+    gaiaExport32 (hdr + 36, txt->max_fields, 1, endian_arch);
+    gaiaExport32 (hdr + 40, index->num_checkpoints, 1, endian_arch);
+    gaiaExportI64 (hdr + 48, (sqlite3_int64) (index->lengths_len), 1,
+		   endian_arch);
+
+/* writing a temporary file, then atomically replacing the index */
+    tmp_path = sqlite3_mprintf ("%s.tmp", index_path);
+    if (tmp_path == NULL)
+	return 0;
+    out = fopen (tmp_path, "wb");
+    if (out == NULL)
+      {
+	  sqlite3_free (tmp_path);
+	  return 0;
+      }
+    if (fwrite (hdr, 1, VRTTXT_INDEX_HEADER, out) != VRTTXT_INDEX_HEADER)
+	goto stop;
+    for (i = 0; i < txt->max_fields; i++)
+      {
+	  if (fputc (txt->columns[i].type, out) == EOF)
+	      goto stop;
+      }
+    for (i = 0; i < index->num_checkpoints; i++)
+      {
+	  gaiaExportI64 (buf,
+			 (sqlite3_int64) (index->checkpoints[i].offset), 1,
+			 endian_arch);
+	  gaiaExportI64 (buf + 8, (sqlite3_int64) (index->checkpoints[i].pos),
+			 1, endian_arch);
+	  if (fwrite (buf, 1, 16, out) != 16)
+	      goto stop;
+      }
+    if (index->lengths_len > 0)
+      {
+	  if (fwrite (index->lengths, 1, index->lengths_len, out) !=
+	      index->lengths_len)
+	      goto stop;
+      }
+    ok = 1;
+  stop:
+    if (fclose (out) != 0)
+	ok = 0;
+    if (ok)
+      {
+#if defined(_WIN32) || defined(WIN32)
+	  /* rename() can't replace an existing file on Windows */
+	  remove (index_path);
+#endif
+	  if (rename (tmp_path, index_path) != 0)
+	      ok = 0;
+      }
+    if (!ok)
+	remove (tmp_path);
+    sqlite3_free (tmp_path);
+    return ok;
+}
+
+/*
+**
+** bulk loading a CSV/TXT file into a newly created table
+**
+*/
+
+static void
+load_text_error (const char *format, const char *arg, char *err_msg)
+{
+/* reporting a load TXT error */
+    char *msg = sqlite3_mprintf (format, arg);
+    if (!err_msg)
+	spatialite_e ("load TXT error: %s\n", msg);
+    else
+	sprintf (err_msg, "load TXT error: %s\n", msg);
+    sqlite3_free (msg);
+}
+
+static void
+load_text_bind (sqlite3_stmt * stmt, int pos, int type, const char *value)
+{
+/* binding a Field value [the same conversions applied by VirtualText] */
+    char buf[4096];
+    if (type == VRTTXT_INTEGER && strlen (value) < sizeof (buf))
+      {
+	  strcpy (buf, value);
+	  text_clean_integer (buf);
+#if defined(_WIN32) || defined(__MINGW32__)
+/* CAVEAT - M$ runtime has non-standard functions for 64 bits */
+	  sqlite3_bind_int64 (stmt, pos, _atoi64 (buf));
+#else
+	  sqlite3_bind_int64 (stmt, pos, atoll (buf));
+#endif
+      }
+    else if (type == VRTTXT_DOUBLE && strlen (value) < sizeof (buf))
+      {
+	  strcpy (buf, value);
+	  text_clean_double (buf);
+	  sqlite3_bind_double (stmt, pos, atof (buf));
+      }
+    else if (type == VRTTXT_TEXT)
+	sqlite3_bind_text (stmt, pos, value, strlen (value), free);
+    else if (type == VRTTXT_NULL)
+	sqlite3_bind_null (stmt, pos);
+    else
+	sqlite3_bind_text (stmt, pos, value, strlen (value), SQLITE_TRANSIENT);
+}
+
+SPATIALITE_DECLARE int
+load_text (sqlite3 * sqlite, char *text_path, char *table, char *charset,
+	   int first_line_titles, char decimal_separator, char text_separator,
+	   char field_separator, int verbose, int *rows, char *err_msg)
+{
+/*
+/ loading a CSV/TXT file into a newly created table:
+/ the preliminary parsing is the usual (parallel) one, then
+/ all rows are inserted by the calling thread
+*/
+    sqlite3_stmt *stmt = NULL;
+    int ret;
+    char *errMsg = NULL;
+    char *sql;
+    char *xname;
+    char *xtable = NULL;
+    char name[64];
+    int already_exists = 0;
+    int sqlError = 0;
+    int current_row = 0;
+    int col;
+    int type;
+    const char *value;
+    gaiaOutBuffer sql_statement;
+    gaiaTextReaderPtr text = NULL;
+    if (rows)
+	*rows = 0;
+/* checking if TABLE already exists */
+    sql = sqlite3_mprintf ("SELECT name FROM sqlite_master WHERE "
+			   "type = 'table' AND Lower(name) = Lower(%Q)", table);
+    ret = sqlite3_prepare_v2 (sqlite, sql, strlen (sql), &stmt, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+      {
+	  load_text_error ("<%s>", sqlite3_errmsg (sqlite), err_msg);
+	  return 0;
+      }
+    while (1)
+      {
+	  /* scrolling the result set */
+	  ret = sqlite3_step (stmt);
+	  if (ret == SQLITE_DONE)
+	      break;		/* end of result set */
+	  if (ret == SQLITE_ROW)
+	      already_exists = 1;
+	  else
+	      break;
+      }
+    sqlite3_finalize (stmt);
+    stmt = NULL;
+    if (already_exists)
+      {
+	  load_text_error ("table '%s' already exists", table, err_msg);
+	  return 0;
+      }
+    text = gaiaTextReaderAlloc (text_path, field_separator, text_separator,
+				decimal_separator, first_line_titles, charset);
+    if (text == NULL)
+      {
+	  load_text_error ("cannot open '%s'", text_path, err_msg);
+	  return 0;
+      }
+    if (!gaiaTextReaderParse (text))
+      {
+	  load_text_error ("invalid data source '%s'", text_path, err_msg);
+	  gaiaTextReaderDestroy (text);
+	  return 0;
+      }
+    if (verbose)
+	spatialite_e ("========\nLoading TXT at '%s' into SQLite table '%s'\n",
+		      text_path, table);
+/* starting a transaction */
+    if (verbose)
+	spatialite_e ("\nBEGIN;\n");
+    ret = sqlite3_exec (sqlite, "BEGIN", NULL, 0, &errMsg);
+    if (ret != SQLITE_OK)
+      {
+	  load_text_error ("<%s>", errMsg, err_msg);
+	  sqlite3_free (errMsg);
+	  gaiaTextReaderDestroy (text);
+	  return 0;
+      }
+/* creating the Table */
+    xtable = gaiaDoubleQuotedSql (table);
+    gaiaOutBufferInitialize (&sql_statement);
+    sql = sqlite3_mprintf ("CREATE TABLE \"%s\" (\n\"PK_UID\" "
+			   "INTEGER PRIMARY KEY AUTOINCREMENT", xtable);
+    gaiaAppendToOutBuffer (&sql_statement, sql);
+    sqlite3_free (sql);
+    for (col = 0; col < text->max_fields; col++)
+      {
+	  const char *col_name = text->columns[col].name;
+	  const char *col_type = "TEXT";
+	  if (strcasecmp (col_name, "PK_UID") == 0)
+	    {
+		/* the Primary Key name is reserved */
+		sprintf (name, "COL%03d", col + 1);
+		col_name = name;
+	    }
+	  if (text->columns[col].type == VRTTXT_INTEGER)
+	      col_type = "INTEGER";
+	  else if (text->columns[col].type == VRTTXT_DOUBLE)
+	      col_type = "DOUBLE";
+	  xname = gaiaDoubleQuotedSql (col_name);
+	  sql = sqlite3_mprintf (",\n\"%s\" %s", xname, col_type);
+	  free (xname);
+	  gaiaAppendToOutBuffer (&sql_statement, sql);
+	  sqlite3_free (sql);
+      }
+    gaiaAppendToOutBuffer (&sql_statement, ")");
+    ret = SQLITE_ERROR;
+    if (sql_statement.Error == 0 && sql_statement.Buffer != NULL)
+      {
+	  if (verbose)
+	      spatialite_e ("%s;\n", sql_statement.Buffer);
+	  ret = sqlite3_exec (sqlite, sql_statement.Buffer, NULL, 0, &errMsg);
+      }
+    gaiaOutBufferReset (&sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  load_text_error ("<%s>", errMsg ? errMsg : "out of memory", err_msg);
+	  if (errMsg)
+	      sqlite3_free (errMsg);
+	  sqlError = 1;
+	  goto clean_up;
+      }
+/* preparing the INSERT INTO parameterized statement */
+    sql = sqlite3_mprintf ("INSERT INTO \"%s\" VALUES (NULL", xtable);
+    gaiaAppendToOutBuffer (&sql_statement, sql);
+    sqlite3_free (sql);
+    for (col = 0; col < text->max_fields; col++)
+	gaiaAppendToOutBuffer (&sql_statement, ", ?");
+    gaiaAppendToOutBuffer (&sql_statement, ")");
+    ret = SQLITE_ERROR;
+    if (sql_statement.Error == 0 && sql_statement.Buffer != NULL)
+	ret =
+	    sqlite3_prepare_v2 (sqlite, sql_statement.Buffer,
+				strlen (sql_statement.Buffer), &stmt, NULL);
+    gaiaOutBufferReset (&sql_statement);
+    if (ret != SQLITE_OK)
+      {
+	  load_text_error ("<%s>", sqlite3_errmsg (sqlite), err_msg);
+	  sqlError = 1;
+	  goto clean_up;
+      }
+/* inserting all rows */
+    while (gaiaTextReaderGetRow (text, current_row))
+      {
+	  sqlite3_reset (stmt);
+	  sqlite3_clear_bindings (stmt);
+	  for (col = 0; col < text->max_fields; col++)
+	    {
+		if (!gaiaTextReaderFetchField (text, col, &type, &value)
+		    || value == NULL)
+		    sqlite3_bind_null (stmt, col + 1);
+		else
+		    load_text_bind (stmt, col + 1, type, value);
+	    }
+	  ret = sqlite3_step (stmt);
+	  if (ret != SQLITE_DONE && ret != SQLITE_ROW)
+	    {
+		load_text_error ("<%s>", sqlite3_errmsg (sqlite), err_msg);
+		sqlError = 1;
+		goto clean_up;
+	    }
+	  current_row++;
+      }
+
+  clean_up:
+    if (stmt != NULL)
+	sqlite3_finalize (stmt);
+    if (xtable)
+	free (xtable);
+    gaiaTextReaderDestroy (text);
+    if (rows)
+	*rows = current_row;
+    if (sqlError)
+      {
+	  /* some error occurred - ROLLBACK */
+	  if (verbose)
+	      spatialite_e ("ROLLBACK;\n");
+	  ret = sqlite3_exec (sqlite, "ROLLBACK", NULL, 0, &errMsg);
+	  if (ret != SQLITE_OK)
+	    {
+		spatialite_e ("load TXT error: <%s>\n", errMsg);
+		sqlite3_free (errMsg);
+	    }
+	  return 0;
+      }
+/* ok - confirming pending transaction - COMMIT */
+    if (verbose)
+	spatialite_e ("COMMIT;\n");
+    ret = sqlite3_exec (sqlite, "COMMIT", NULL, 0, &errMsg);
+    if (ret != SQLITE_OK)
+      {
+	  load_text_error ("<%s>", errMsg, err_msg);
+	  sqlite3_free (errMsg);
+	  return 0;
+      }
+    if (verbose)
+	spatialite_e ("\nInserted %d rows into '%s' from TXT\n========\n",
+		      current_row, table);
+    if (err_msg)
+	sprintf (err_msg, "Inserted %d rows into '%s' from TXT", current_row,
+		 table);
+    return 1;
+}
+
 #endif /* ICONV enabled/disabled */
@@ -49,6 +49,176 @@ the terms of any one of the MPL, the GPL or the LGPL.
 
 #include "sqlite3.h"
 #include "spatialite.h"
+#include "spatialite/gaiageo.h"
+
+#ifndef OMIT_ICONV	/* only if ICONV is supported */
+
+#define DECODER_ROWS	5
+
+static int
+write_decoder_dbf (const char *path)
+{
+/* writing a DBF exercising both the fast decoder and its fallbacks */
+    static const char *names[] = { "NAME", "NUM", "DBL", "LONGDBL", "FLT",
+	"NOTE"
+    };
+    static const char types[] = { 'C', 'N', 'N', 'N', 'F', 'C' };
+    static const int lengths[] = { 20, 10, 12, 30, 20, 250 };
+    static const int decimals[] = { 0, 0, 3, 10, 0, 0 };
+    static const char *values[DECODER_ROWS][6] = {
+	{"Citt\xe0 d\xb4Italia", "42", "3.250", "123456789012.1234567890",
+	 "1.5e3", "plain ascii"},
+	{"", "", "", "", "", ""},
+	{"M\xfcnchen", "-7", "-0.125", "-0.0000000001", "-2.5E-2",
+	 "caf\xe9 cr\xe8me br\xfbl\xe9" "e"},
+	{"ASCII only", "+12", "1e2", "9007199254740993.5", "   ", NULL},
+	{"\x80 euro", "   ", "   ", "   ", "0.1", NULL}
+    };
+    unsigned char header[32];
+    unsigned char record[512];
+    int reclen = 1;
+    int hdsz = 32 + (6 * 32) + 1;
+    int i;
+    int row;
+    int off;
+    int len;
+    FILE *out = fopen (path, "wb");
+    if (out == NULL)
+	return 0;
+    for (i = 0; i < 6; i++)
+	reclen += lengths[i];
+    memset (header, 0, 32);
+    header[0] = 0x03;
+    header[4] = DECODER_ROWS;
+    header[8] = hdsz & 0xff;
+    header[9] = (hdsz >> 8) & 0xff;
+    header[10] = reclen & 0xff;
+    header[11] = (reclen >> 8) & 0xff;
+    fwrite (header, 1, 32, out);
+    for (i = 0; i < 6; i++)
+      {
+	  memset (header, 0, 32);
+	  strcpy ((char *) header, names[i]);
+	  header[11] = types[i];
+	  header[16] = lengths[i];
+	  header[17] = decimals[i];
+	  fwrite (header, 1, 32, out);
+      }
+    fputc (0x0d, out);
+    for (row = 0; row < DECODER_ROWS; row++)
+      {
+	  memset (record, ' ', reclen);
+	  off = 1;
+	  for (i = 0; i < 6; i++)
+	    {
+		if (i == 5 && values[row][i] == NULL)
+		  {
+		      /* a long non-ASCII text: overflowing the batch buffer */
+		      memset (record + off, 0x80, lengths[i]);
+		  }
+		else if (row == 1)
+		  {
+		      /* NULL values */
+		      record[off] = '\0';
+		  }
+		else
+		  {
+		      len = strlen (values[row][i]);
+		      if (types[i] == 'C')
+			  memcpy (record + off, values[row][i], len);
+		      else
+			  memcpy (record + off + lengths[i] - len,
+				  values[row][i], len);
+		  }
+		off += lengths[i];
+	    }
+	  fwrite (record, 1, reclen, out);
+      }
+    fputc (0x1a, out);
+    fclose (out);
+    return 1;
+}
+
+static int
+compare_decoder_dbf (const char *path, const char *charset,
+		     int expect_decoder, const char *expected)
+{
+/* reading the same DBF both through the fast decoder and field by field */
+    gaiaDbfPtr fast = gaiaAllocDbf ();
+    gaiaDbfPtr slow = gaiaAllocDbf ();
+    void *decoder;
+    gaiaDbfFieldPtr fld1;
+    gaiaDbfFieldPtr fld2;
+    int row;
+    int deleted;
+    int ret = 0;
+    gaiaOpenDbfRead (fast, path, charset, "UTF-8");
+    gaiaOpenDbfRead (slow, path, charset, "UTF-8");
+    if (!fast->Valid || !slow->Valid)
+      {
+	  fprintf (stderr, "unable to open \"%s\" as %s\n", path, charset);
+	  goto stop;
+      }
+    if ((fast->DecoderObj != NULL) != expect_decoder)
+      {
+	  fprintf (stderr, "unexpected DBF decoder for %s\n", charset);
+	  goto stop;
+      }
+/* disabling the decoder: parseDbfField() is used for every field */
+    decoder = slow->DecoderObj;
+    slow->DecoderObj = NULL;
+    for (row = 0; row < DECODER_ROWS; row++)
+      {
+	  if (!gaiaReadDbfEntity (fast, row, &deleted)
+	      || !gaiaReadDbfEntity (slow, row, &deleted))
+	    {
+		fprintf (stderr, "%s: unable to read DBF row %d\n", charset,
+			 row);
+		goto restore;
+	    }
+	  fld1 = fast->Dbf->First;
+	  fld2 = slow->Dbf->First;
+	  while (fld1 && fld2)
+	    {
+		if (fld1->Value == NULL || fld2->Value == NULL
+		    || fld1->Value->Type != fld2->Value->Type)
+		    goto mismatch;
+		if (fld1->Value->Type == GAIA_INT_VALUE
+		    && fld1->Value->IntValue != fld2->Value->IntValue)
+		    goto mismatch;
+		if (fld1->Value->Type == GAIA_DOUBLE_VALUE
+		    && fld1->Value->DblValue != fld2->Value->DblValue)
+		    goto mismatch;
+		if (fld1->Value->Type == GAIA_TEXT_VALUE
+		    && strcmp (fld1->Value->TxtValue,
+			       fld2->Value->TxtValue) != 0)
+		    goto mismatch;
+		fld1 = fld1->Next;
+		fld2 = fld2->Next;
+	    }
+	  if (expected != NULL && row == 0
+	      && strcmp (fast->Dbf->First->Value->TxtValue,
+			 expected) != 0)
+	    {
+		fprintf (stderr, "%s: unexpected UTF-8 text \"%s\"\n", charset,
+			 fast->Dbf->First->Value->TxtValue);
+		goto restore;
+	    }
+      }
+    ret = 1;
+    goto restore;
+  mismatch:
+    fprintf (stderr, "%s: DBF decoder mismatch on row %d, field %s\n",
+	     charset, row, fld1->Name);
+  restore:
+    slow->DecoderObj = decoder;
+  stop:
+    gaiaFreeDbf (fast);
+    gaiaFreeDbf (slow);
+    return ret;
+}
+
+#endif /* end ICONV conditional */
 
 int main (int argc, char *argv[])
 {
@@ -99,6 +269,26 @@ int main (int argc, char *argv[])
         
     spatialite_cleanup_ex(cache);
 
+    if (!write_decoder_dbf ("./decodertest.dbf")) {
+        fprintf (stderr, "unable to create decodertest.dbf\n");
+	return -6;
+    }
+    if (!compare_decoder_dbf ("./decodertest.dbf", "CP1252", 1,
+			      "Citt\xc3\xa0 d\xc2\xb4Italia")) {
+	remove ("./decodertest.dbf");
+	return -7;
+    }
+    if (!compare_decoder_dbf ("./decodertest.dbf", "ISO-8859-15", 1, NULL)) {
+	remove ("./decodertest.dbf");
+	return -8;
+    }
+    /* EBCDIC isn't ASCII-compatible: the decoder must be disabled */
+    if (!compare_decoder_dbf ("./decodertest.dbf", "IBM037", 0, NULL)) {
+	remove ("./decodertest.dbf");
+	return -9;
+    }
+    remove ("./decodertest.dbf");
+
 #endif	/* end ICONV conditional */
 
     return 0;
@@ -50,11 +50,35 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "sqlite3.h"
 #include "spatialite.h"
 
+#ifndef OMIT_ICONV	/* only if ICONV is supported */
+static int
+count_shared_rows (sqlite3 *handle, const char *rowid)
+{
+/* counts the rows of the shared cache having the given rowid */
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int count;
+    char *sql = sqlite3_mprintf ("SELECT Count(*) FROM cache_sh WHERE rowid = %s", rowid);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return -1;
+    count = -1;
+    if (rows == 1 && columns == 1 && results[1] != NULL)
+	count = atoi (results[1]);
+    sqlite3_free_table (results);
+    return count;
+}
+#endif	/* end ICONV conditional */
+
 int main (int argc, char *argv[])
 {
 #ifndef OMIT_ICONV	/* only if ICONV is supported */
     int ret;
     sqlite3 *handle;
+    sqlite3 *handle2;
     char *err_msg = NULL;
     int row_count;
     char **results;
@@ -62,6 +86,7 @@ int main (int argc, char *argv[])
     int columns;
     int pt;
     void *cache = spatialite_alloc_connection();
+    void *cache2;
 
     if (argc > 1 || argv[0] == NULL)
 	argc = 1;		/* silencing stupid compiler warnings */
@@ -347,6 +372,23 @@ int main (int argc, char *argv[])
     }
     sqlite3_free_table (results);
 
+    rows = 0;
+    columns = 0;
+    ret = sqlite3_get_table (handle, "SELECT Count(*) FROM cache_Councils_geom WHERE mbr = FilterMbrIntersects(-1e10, -1e10, 1e10, 1e10);",
+			     &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error in Mbr SELECT full frame: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -43;
+    }
+    if ((rows != 1) || (columns != 1) || strcmp(results[1], "61") != 0) {
+	fprintf (stderr, "Unexpected error: full frame bad cache result: %i/%i.\n", rows, columns);
+	sqlite3_free_table (results);
+	sqlite3_close(handle);
+	return -43;
+    }
+    sqlite3_free_table (results);
+
     ret = sqlite3_exec (handle, "DROP TABLE Councils;", NULL, NULL, &err_msg);
     if (ret != SQLITE_OK) {
 	fprintf (stderr, "DROP TABLE Councils error: %s\n", err_msg);
@@ -488,8 +530,159 @@ int main (int argc, char *argv[])
         fprintf (stderr, "sqlite3_close() error: %s\n", sqlite3_errmsg (handle));
 	return -62;
     }
-    
+
+    spatialite_cleanup_ex (cache);
+
+/* testing an MbrCache shared by two connections */
+    remove ("mbrcache_shared.sqlite");
+    cache = spatialite_alloc_connection();
+    ret = sqlite3_open_v2 ("mbrcache_shared.sqlite", &handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK) {
+	fprintf(stderr, "cannot open mbrcache_shared db: %s\n", sqlite3_errmsg (handle));
+	sqlite3_close(handle);
+	return -63;
+    }
+    spatialite_init_ex (handle, cache, 0);
+    ret = sqlite3_exec (handle, "CREATE TABLE sh (id INTEGER PRIMARY KEY, g BLOB);"
+                        "INSERT INTO sh (id, g) VALUES (1, MakePoint(1, 1));"
+                        "INSERT INTO sh (id, g) VALUES (2, MakePoint(2, 2));"
+                        "INSERT INTO sh (id, g) VALUES (3, MakePoint(3, 3));"
+                        "CREATE VIRTUAL TABLE cache_sh USING MbrCache(sh, g, shared);",
+                        NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "shared MbrCache create error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -64;
+    }
+    cache2 = spatialite_alloc_connection();
+    ret = sqlite3_open_v2 ("mbrcache_shared.sqlite", &handle2, SQLITE_OPEN_READWRITE, NULL);
+    if (ret != SQLITE_OK) {
+	fprintf(stderr, "cannot reopen mbrcache_shared db: %s\n", sqlite3_errmsg (handle2));
+	sqlite3_close(handle2);
+	return -65;
+    }
+    spatialite_init_ex (handle2, cache2, 0);
+    ret = sqlite3_get_table (handle2, "SELECT Count(*) FROM cache_sh;",
+			     &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error in shared Mbr SELECT: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -66;
+    }
+    if ((rows != 1) || (columns != 1) || strcmp(results[1], "3") != 0) {
+	fprintf (stderr, "Unexpected error: shared cache bad result: %i/%i.\n", rows, columns);
+	sqlite3_free_table (results);
+	return -67;
+    }
+    sqlite3_free_table (results);
+    /* the first connection updates the cache loaded by the second one */
+    ret = sqlite3_exec (handle, "INSERT INTO cache_sh (rowid, mbr) VALUES (100, BuildMbrFilter(5, 5, 6, 6));",
+                        NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "shared MbrCache INSERT error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -68;
+    }
+    ret = sqlite3_get_table (handle2, "SELECT rowid FROM cache_sh WHERE mbr = FilterMbrIntersects(2.5, 2.5, 7, 7);",
+			     &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error in shared Mbr SELECT2: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -69;
+    }
+    if ((rows != 2) || (columns != 1) || strcmp(results[1], "3") != 0 || strcmp(results[2], "100") != 0) {
+	fprintf (stderr, "Unexpected error: shared cache bad result2: %i/%i.\n", rows, columns);
+	sqlite3_free_table (results);
+	return -70;
+    }
+    sqlite3_free_table (results);
+    /* uncommitted changes are only seen by their own connection */
+    ret = sqlite3_exec (handle, "BEGIN; INSERT INTO cache_sh (rowid, mbr) VALUES (200, BuildMbrFilter(8, 8, 9, 9));",
+                        NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "shared MbrCache uncommitted INSERT error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -71;
+    }
+    if (count_shared_rows (handle, "200") != 1) {
+	fprintf (stderr, "Unexpected error: uncommitted change not seen by its own connection\n");
+	return -72;
+    }
+    if (count_shared_rows (handle2, "200") != 0) {
+	fprintf (stderr, "Unexpected error: uncommitted change seen by another connection\n");
+	return -73;
+    }
+    /* rolled back changes are never seen */
+    ret = sqlite3_exec (handle, "ROLLBACK;", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "shared MbrCache ROLLBACK error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -74;
+    }
+    if (count_shared_rows (handle, "200") != 0 || count_shared_rows (handle2, "200") != 0) {
+	fprintf (stderr, "Unexpected error: rolled back change still in the shared cache\n");
+	return -75;
+    }
+    /* committed changes are seen by every connection */
+    ret = sqlite3_exec (handle, "BEGIN; DELETE FROM cache_sh WHERE rowid = 100; "
+                        "INSERT INTO cache_sh (rowid, mbr) VALUES (201, BuildMbrFilter(8, 8, 9, 9)); COMMIT;",
+                        NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "shared MbrCache COMMIT error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -76;
+    }
+    if (count_shared_rows (handle2, "201") != 1 || count_shared_rows (handle2, "100") != 0
+        || count_shared_rows (handle, "201") != 1) {
+	fprintf (stderr, "Unexpected error: committed change not in the shared cache\n");
+	return -77;
+    }
+    /* changes rolled back to a savepoint are never published */
+    ret = sqlite3_exec (handle, "BEGIN; INSERT INTO cache_sh (rowid, mbr) VALUES (300, BuildMbrFilter(8, 8, 9, 9)); "
+                        "SAVEPOINT sp; INSERT INTO cache_sh (rowid, mbr) VALUES (301, BuildMbrFilter(8, 8, 9, 9)); "
+                        "ROLLBACK TO sp; RELEASE sp; COMMIT;",
+                        NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "shared MbrCache SAVEPOINT error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -78;
+    }
+    if (count_shared_rows (handle2, "300") != 1 || count_shared_rows (handle2, "301") != 0
+        || count_shared_rows (handle, "301") != 0) {
+	fprintf (stderr, "Unexpected error: change rolled back to a savepoint in the shared cache\n");
+	return -79;
+    }
+    /* changes written straight into the table are detected and reloaded */
+    ret = sqlite3_exec (handle2, "INSERT INTO sh (id, g) VALUES (4, MakePoint(4, 4));"
+                        "UPDATE sh SET g = MakePoint(50, 50) WHERE id = 1;",
+                        NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "external table change error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -80;
+    }
+    if (count_shared_rows (handle, "4") != 1 || count_shared_rows (handle2, "4") != 1) {
+	fprintf (stderr, "Unexpected error: external INSERT not in the shared cache\n");
+	return -81;
+    }
+    ret = sqlite3_get_table (handle, "SELECT rowid FROM cache_sh WHERE mbr = FilterMbrIntersects(49, 49, 51, 51);",
+			     &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error in shared Mbr SELECT3: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -82;
+    }
+    if ((rows != 1) || (columns != 1) || strcmp(results[1], "1") != 0) {
+	fprintf (stderr, "Unexpected error: external UPDATE not in the shared cache: %i/%i.\n", rows, columns);
+	sqlite3_free_table (results);
+	return -83;
+    }
+    sqlite3_free_table (results);
+    sqlite3_close (handle2);
+    spatialite_cleanup_ex (cache2);
+    sqlite3_close (handle);
     spatialite_cleanup_ex (cache);
+    remove ("mbrcache_shared.sqlite");
 #endif	/* end ICONV conditional */
 
     return 0;
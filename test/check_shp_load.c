@@ -51,6 +51,66 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "sqlite3.h"
 #include "spatialite.h"
 
+#ifndef OMIT_ICONV	/* only if ICONV is supported */
+
+static int
+check_threaded_load (sqlite3 * handle, int threads)
+{
+/* loading the same Shapefile sequentially and on decoder threads */
+    int ret;
+    char *err_msg = NULL;
+    char **results;
+    int rows;
+    int columns;
+    int row_count;
+    int ok;
+
+    ret = load_shapefile_ex2 (handle, "./shapetest_big", "big_seq", "UTF-8",
+			      4326, "geom", "POLYGON", "pk", 0, 0, 0, 0, 0,
+			      &row_count, err_msg);
+    if (!ret || row_count != 1000) {
+	fprintf (stderr, "sequential load_shapefile_ex2() error\n");
+	return 0;
+    }
+    ret = load_shapefile_ex2 (handle, "./shapetest_big", "big_thr", "UTF-8",
+			      4326, "geom", "POLYGON", "pk", 0, 0, 0, 0,
+			      threads, &row_count, err_msg);
+    if (!ret || row_count != 1000) {
+	fprintf (stderr, "threaded load_shapefile_ex2() error (%d)\n", threads);
+	return 0;
+    }
+
+    ret = sqlite3_get_table (handle, "SELECT Count(*) FROM big_seq AS s "
+			     "JOIN big_thr AS t ON (s.pk = t.pk) "
+			     "WHERE s.id IS t.id AND s.name IS t.name "
+			     "AND s.value IS t.value AND s.geom IS t.geom",
+			     &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "compare error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return 0;
+    }
+    ok = (rows == 1 && atoi (results[1]) == 1000);
+    sqlite3_free_table (results);
+    if (!ok) {
+	fprintf (stderr, "threaded load (%d) differs from the sequential one\n", threads);
+	return 0;
+    }
+
+    ret = sqlite3_exec (handle, "SELECT DiscardGeometryColumn('big_seq', 'geom'); "
+			"SELECT DiscardGeometryColumn('big_thr', 'geom'); "
+			"DROP TABLE big_seq; DROP TABLE big_thr",
+			NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return 0;
+    }
+    return 1;
+}
+
+#endif /* end ICONV conditional */
+
 int main (int argc, char *argv[])
 {
 #ifndef OMIT_ICONV	/* only if ICONV is supported */
@@ -119,6 +179,55 @@ int main (int argc, char *argv[])
     }
 
 #endif /* end LWGEOM conditionals */
+
+    /* more rows than two decoder batches: the threaded path is used */
+    ret = sqlite3_exec (handle, "CREATE TABLE big (id INTEGER PRIMARY KEY, "
+			"name TEXT, value DOUBLE)", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "CREATE TABLE big error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	sqlite3_close(handle);
+	return -9;
+    }
+    ret = sqlite3_exec (handle, "SELECT AddGeometryColumn('big', 'geom', "
+			"4326, 'POLYGON', 'XY')", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "AddGeometryColumn error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	sqlite3_close(handle);
+	return -10;
+    }
+    ret = sqlite3_exec (handle, "INSERT INTO big (id, name, value, geom) "
+			"WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL "
+			"SELECT i + 1 FROM c WHERE i < 1000) "
+			"SELECT i, 'row ' || i, i / 7.0, CASE WHEN i % 97 = 0 "
+			"THEN NULL ELSE BuildMbr(i, i, i + 1 + (i % 5), i + 2, "
+			"4326) END FROM c", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "INSERT INTO big error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	sqlite3_close(handle);
+	return -11;
+    }
+    ret = dump_shapefile (handle, "big", "geom", "./shapetest_big", "UTF-8",
+			  "POLYGON", 0, &row_count, err_msg);
+    if (!ret || row_count != 1000) {
+        fprintf (stderr, "dump_shapefile() error: %s\n", err_msg);
+	sqlite3_close(handle);
+	return -12;
+    }
+    if (!check_threaded_load (handle, 3)) {
+	sqlite3_close(handle);
+	return -13;
+    }
+    /* more decoder threads than batches */
+    if (!check_threaded_load (handle, 8)) {
+	sqlite3_close(handle);
+	return -14;
+    }
+    remove ("./shapetest_big.shp");
+    remove ("./shapetest_big.shx");
+    remove ("./shapetest_big.dbf");
     
     ret = sqlite3_close (handle);
     if (ret != SQLITE_OK) {
@@ -51,6 +51,131 @@ the terms of any one of the MPL, the GPL or the LGPL.
 #include "sqlite3.h"
 #include "spatialite.h"
 
+#ifndef OMIT_ICONV	/* only if ICONV is supported */
+
+static int
+check_transcoded (sqlite3 * handle, const char *shp_path, const char *table,
+		  int expected)
+{
+/* the directly transcoded BLOBs should match the ones built by VirtualShape */
+    int ret;
+    char *err_msg = NULL;
+    int row_count;
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int matching;
+
+    ret = load_shapefile (handle, (char *) shp_path, (char *) table, "CP1252",
+			  25832, "geom", 0, 0, 0, 0, &row_count, NULL);
+    if (!ret || row_count != expected) {
+	fprintf (stderr, "load_shapefile() error: %s\n", shp_path);
+	return 0;
+    }
+    sql = sqlite3_mprintf ("CREATE VIRTUAL TABLE vshape USING VirtualShape('%q', 'CP1252', 25832)", shp_path);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "CREATE VIRTUAL TABLE vshape error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return 0;
+    }
+    sql = sqlite3_mprintf ("SELECT Count(*) FROM \"%w\" AS r JOIN vshape AS v "
+			   "ON (r.ROWID = v.PKUID) WHERE r.geom IS v.Geometry", table);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, &err_msg);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "Error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return 0;
+    }
+    matching = (rows == 1) ? atoi (results[columns + 0]) : -1;
+    sqlite3_free_table (results);
+    if (matching != expected) {
+        fprintf (stderr, "Unexpected error: transcoded %s mismatch: %d\n", table, matching);
+        return 0;
+    }
+    ret = sqlite3_exec (handle, "SELECT DropVirtualGeometry('vshape')", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "DropVirtualGeometry vshape error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return 0;
+    }
+    return 1;
+}
+
+static int
+copy_corrupted (const char *suffix, long patch_at, int value)
+{
+/* copying shp/merano-3d/roads into corrupted3d; optionally patching a 32 bit LE value */
+    char in_path[64];
+    char out_path[64];
+    unsigned char buf[4096];
+    size_t rd;
+    FILE *in;
+    FILE *out;
+    sprintf (in_path, "shp/merano-3d/roads.%s", suffix);
+    sprintf (out_path, "corrupted3d.%s", suffix);
+    in = fopen (in_path, "rb");
+    if (in == NULL)
+	return 0;
+    out = fopen (out_path, "wb");
+    if (out == NULL) {
+	fclose (in);
+	return 0;
+    }
+    while ((rd = fread (buf, 1, sizeof (buf), in)) > 0)
+	fwrite (buf, 1, rd, out);
+    fclose (in);
+    if (patch_at >= 0) {
+	buf[0] = value & 0xff;
+	buf[1] = (value >> 8) & 0xff;
+	buf[2] = (value >> 16) & 0xff;
+	buf[3] = (value >> 24) & 0xff;
+	fseek (out, patch_at, SEEK_SET);
+	fwrite (buf, 1, 4, out);
+    }
+    fclose (out);
+    return 1;
+}
+
+static int
+check_corrupted (long patch_at, int value)
+{
+/* a record declaring more parts/points than it contains must be rejected */
+    gaiaShapefilePtr shp;
+    int ret;
+    if (!copy_corrupted ("shp", patch_at, value) || !copy_corrupted ("shx", -1, 0)
+	|| !copy_corrupted ("dbf", -1, 0))
+	return 0;
+    shp = gaiaAllocShapefile ();
+    gaiaOpenShpRead (shp, "corrupted3d", "CP1252", "UTF-8");
+    if (!shp->Valid) {
+	fprintf (stderr, "gaiaOpenShpRead() error: %s\n", shp->LastError);
+	gaiaFreeShapefile (shp);
+	return 0;
+    }
+    ret = gaiaReadShpEntity (shp, 0, 25832);
+    if (ret || shp->LastError == NULL) {
+	fprintf (stderr, "corrupted record unexpectedly accepted (%ld)\n", patch_at);
+	gaiaFreeShapefile (shp);
+	return 0;
+    }
+    ret = gaiaReadShpEntity (shp, 1, 25832);
+    gaiaFreeShapefile (shp);
+    if (!ret) {
+	fprintf (stderr, "intact record unexpectedly rejected\n");
+	return 0;
+    }
+    remove ("corrupted3d.shp");
+    remove ("corrupted3d.shx");
+    remove ("corrupted3d.dbf");
+    return 1;
+}
+
+#endif /* end ICONV conditional */
+
 int main (int argc, char *argv[])
 {
 #ifndef OMIT_ICONV	/* only if ICONV is supported */
@@ -116,7 +241,54 @@ int main (int argc, char *argv[])
 	sqlite3_close(handle);
 	return -5;
     }
-    
+
+/* the directly transcoded BLOBs should match the ones built by VirtualShape */
+    ret = sqlite3_exec (handle, "CREATE VIRTUAL TABLE vroads USING VirtualShape('shp/merano-3d/roads', 'CP1252', 25832)", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "CREATE VIRTUAL TABLE vroads error: %s\n", err_msg);
+	sqlite3_free(err_msg);
+	sqlite3_close(handle);
+	return -63;
+    }
+    sql = "SELECT Count(*) FROM roads AS r JOIN vroads AS v USING (OBJECTID) "
+          "WHERE r.geom = v.Geometry";
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+        fprintf (stderr, "Error: %s\n", err_msg);
+        sqlite3_free (err_msg);
+        return -64;
+    }
+    if (rows != 1 || atoi(results[columns+0]) != 18) {
+        fprintf (stderr, "Unexpected error: transcoded roads mismatch: %s\n", results[columns+0]);
+        return -65;
+    }
+    sqlite3_free_table (results);
+    ret = sqlite3_exec (handle, "SELECT DropVirtualGeometry('vroads')", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "DropVirtualGeometry vroads error: %s\n", err_msg);
+	sqlite3_free(err_msg);
+	sqlite3_close(handle);
+	return -66;
+    }
+/* POLYGON ZM with holes, MULTIPOLYGON with holes and POINT */
+    if (!check_transcoded (handle, "shp/merano-3d/polygons", "polygons_blob", 10)) {
+	sqlite3_close(handle);
+	return -67;
+    }
+    if (!check_transcoded (handle, "shp/foggia/local_councils", "councils_blob", 61)) {
+	sqlite3_close(handle);
+	return -68;
+    }
+    if (!check_transcoded (handle, "shp/merano-3d/points", "points_blob", 20)) {
+	sqlite3_close(handle);
+	return -69;
+    }
+/* the first record of roads [POLYLINE]: NumParts at 144, NumPoints at 148 */
+    if (!check_corrupted (148, 0x7fffffff) || !check_corrupted (144, 0x10000)) {
+	sqlite3_close(handle);
+	return -70;
+    }
+
     ret = sqlite3_exec (handle, "INSERT INTO polygons (FEATURE_ID, DATUM, HAUSNR) VALUES (1250000, 0.1, 'alpha')", NULL, NULL, &err_msg);
     if (ret != SQLITE_OK) {
 	fprintf (stderr, "INSERT polygons (1) error: %s\n", err_msg);
@@ -0,0 +1,1473 @@
+/*
+
+ check_virtualnetwork.c -- SpatiaLite Test Case
+
+ Author: Sandro Furieri <a.furieri@lqt.it>
+
+ ------------------------------------------------------------------------------
+
+ Version: MPL 1.1/GPL 2.0/LGPL 2.1
+
+ The contents of this file are subject to the Mozilla Public License Version
+ 1.1 (the "License"); you may not use this file except in compliance with
+ the License. You may obtain a copy of the License at
+ http://www.mozilla.org/MPL/
+
+Software distributed under the License is distributed on an "AS IS" basis,
+WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+for the specific language governing rights and limitations under the
+License.
+
+The Original Code is the SpatiaLite library
+
+The Initial Developer of the Original Code is Alessandro Furieri
+
+Portions created by the Initial Developer are Copyright (C) 2013
+the Initial Developer. All Rights Reserved.
+
+Contributor(s):
+
+Alternatively, the contents of this file may be used under the terms of
+either the GNU General Public License Version 2 or later (the "GPL"), or
+the GNU Lesser General Public License Version 2.1 or later (the "LGPL"),
+in which case the provisions of the GPL or the LGPL are applicable instead
+of those above. If you wish to allow use of your version of this file only
+under the terms of either the GPL or the LGPL, and not to allow others to
+use your version of this file under the terms of the MPL, indicate your
+decision by deleting the provisions above and replace them with the notice
+and other provisions required by the GPL or the LGPL. If you do not delete
+the provisions above, a recipient may use your version of this file under
+the terms of any one of the MPL, the GPL or the LGPL.
+
+*/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include "sqlite3.h"
+#include "spatialite.h"
+#include "spatialite/gaiageo.h"
+
+/* the test network is a GRID_SIZE x GRID_SIZE grid of nodes */
+#define GRID_SIZE	8
+#define NUM_NODES	(GRID_SIZE * GRID_SIZE)
+
+struct test_arc
+{
+    int rowid;
+    int from;
+    int to;
+    double cost;
+    int oneway;
+};
+
+static int num_arcs = 0;
+static struct test_arc arcs[NUM_NODES * 2];
+static double dijkstra_costs[NUM_NODES][NUM_NODES];
+
+static unsigned int
+next_random (unsigned int *seed)
+{
+/* a trivial deterministic pseudo-random generator */
+    *seed = (*seed * 1103515245) + 12345;
+    return (*seed / 65536) % 32768;
+}
+
+static void
+build_arcs (void)
+{
+/* arcs connect adjacent nodes; costs are never less than the length */
+    unsigned int seed = 1234;
+    int x;
+    int y;
+    num_arcs = 0;
+    for (y = 0; y < GRID_SIZE; y++)
+      {
+	  for (x = 0; x < GRID_SIZE; x++)
+	    {
+		int node = (y * GRID_SIZE) + x + 1;
+		if (x < GRID_SIZE - 1)
+		  {
+		      arcs[num_arcs].rowid = num_arcs + 1;
+		      arcs[num_arcs].from = node;
+		      arcs[num_arcs].to = node + 1;
+		      arcs[num_arcs].cost =
+			  10.0 + (double) (next_random (&seed) % 1000) / 50.0;
+		      arcs[num_arcs].oneway = (next_random (&seed) % 8) == 0;
+		      num_arcs++;
+		  }
+		if (y < GRID_SIZE - 1)
+		  {
+		      arcs[num_arcs].rowid = num_arcs + 1;
+		      arcs[num_arcs].from = node;
+		      arcs[num_arcs].to = node + GRID_SIZE;
+		      arcs[num_arcs].cost =
+			  10.0 + (double) (next_random (&seed) % 1000) / 50.0;
+		      arcs[num_arcs].oneway = (next_random (&seed) % 8) == 0;
+		      num_arcs++;
+		  }
+	    }
+      }
+}
+
+static unsigned char *
+put_string (unsigned char *p, unsigned char marker, const char *str,
+	    int endian_arch)
+{
+/* exporting a varlen string into the NetworkData header */
+    int len = strlen (str) + 1;
+    *p++ = marker;
+    gaiaExport16 (p, len, 1, endian_arch);
+    p += 2;
+    strcpy ((char *) p, str);
+    return p + len;
+}
+
+static int
+store_network (sqlite3 * handle, double extra_cost)
+{
+/* building the NetworkData table [A* enabled, integer Ids] */
+    int endian_arch = gaiaEndianArch ();
+    unsigned char blob[65536];
+    unsigned char *p;
+    sqlite3_stmt *stmt;
+    int ret;
+    int node;
+    int i;
+    ret = sqlite3_exec (handle, "DELETE FROM roads_net_data", NULL, NULL,
+			NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    ret = sqlite3_prepare_v2 (handle,
+			      "INSERT INTO roads_net_data (Id, NetworkData) VALUES (?, ?)",
+			      -1, &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+/* the header */
+    p = blob;
+    *p++ = GAIA_NET64_A_STAR_START;
+    *p++ = GAIA_NET_HEADER;
+    gaiaExport32 (p, NUM_NODES, 1, endian_arch);
+    p += 4;
+    *p++ = GAIA_NET_ID;
+    *p++ = 0;
+    p = put_string (p, GAIA_NET_TABLE, "roads", endian_arch);
+    p = put_string (p, GAIA_NET_FROM, "node_from", endian_arch);
+    p = put_string (p, GAIA_NET_TO, "node_to", endian_arch);
+    p = put_string (p, GAIA_NET_GEOM, "geometry", endian_arch);
+    p = put_string (p, GAIA_NET_NAME, "name", endian_arch);
+    *p++ = GAIA_NET_A_STAR_COEFF;
+    gaiaExport64 (p, 1.0, 1, endian_arch);
+    p += 8;
+    *p++ = GAIA_NET_END;
+    sqlite3_bind_int (stmt, 1, 0);
+    sqlite3_bind_blob (stmt, 2, blob, p - blob, SQLITE_TRANSIENT);
+    if (sqlite3_step (stmt) != SQLITE_DONE)
+	goto error;
+/* a single block containing all nodes */
+    p = blob;
+    *p++ = GAIA_NET_BLOCK;
+    gaiaExport16 (p, NUM_NODES, 1, endian_arch);
+    p += 2;
+    for (node = 1; node <= NUM_NODES; node++)
+      {
+	  int cnt = 0;
+	  unsigned char *p_cnt;
+	  *p++ = GAIA_NET_NODE;
+	  gaiaExport32 (p, node - 1, 1, endian_arch);
+	  p += 4;
+	  gaiaExportI64 (p, node, 1, endian_arch);
+	  p += 8;
+	  gaiaExport64 (p, (double) ((node - 1) % GRID_SIZE) * 10.0, 1,
+			endian_arch);
+	  p += 8;
+	  gaiaExport64 (p, (double) ((node - 1) / GRID_SIZE) * 10.0, 1,
+			endian_arch);
+	  p += 8;
+	  p_cnt = p;
+	  p += 2;
+	  for (i = 0; i < num_arcs; i++)
+	    {
+		int to;
+		double cost = arcs[i].cost;
+		if (i == 0)
+		    cost += extra_cost;
+		if (arcs[i].from == node)
+		    to = arcs[i].to;
+		else if (arcs[i].to == node && !arcs[i].oneway)
+		    to = arcs[i].from;
+		else
+		    continue;
+		*p++ = GAIA_NET_ARC;
+		gaiaExportI64 (p, arcs[i].rowid, 1, endian_arch);
+		p += 8;
+		gaiaExport32 (p, to - 1, 1, endian_arch);
+		p += 4;
+		gaiaExport64 (p, cost, 1, endian_arch);
+		p += 8;
+		*p++ = GAIA_NET_END;
+		cnt++;
+	    }
+	  gaiaExport16 (p_cnt, cnt, 1, endian_arch);
+	  *p++ = GAIA_NET_END;
+      }
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int (stmt, 1, 1);
+    sqlite3_bind_blob (stmt, 2, blob, p - blob, SQLITE_TRANSIENT);
+    if (sqlite3_step (stmt) != SQLITE_DONE)
+	goto error;
+    sqlite3_finalize (stmt);
+    return 1;
+  error:
+    sqlite3_finalize (stmt);
+    return 0;
+}
+
+static int
+store_roads (sqlite3 * handle)
+{
+/* creating the arcs table */
+    char *sql;
+    int ret;
+    int i;
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE roads (id INTEGER PRIMARY KEY, node_from INTEGER, "
+		      "node_to INTEGER, name TEXT, geometry BLOB)", NULL, NULL,
+		      NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (i = 0; i < num_arcs; i++)
+      {
+	  int x1 = (arcs[i].from - 1) % GRID_SIZE;
+	  int y1 = (arcs[i].from - 1) / GRID_SIZE;
+	  int x2 = (arcs[i].to - 1) % GRID_SIZE;
+	  int y2 = (arcs[i].to - 1) / GRID_SIZE;
+	  sql =
+	      sqlite3_mprintf
+	      ("INSERT INTO roads VALUES (%d, %d, %d, 'road %d', "
+	       "GeomFromText('LINESTRING(%d %d, %d %d)', 4326))",
+	       arcs[i].rowid, arcs[i].from, arcs[i].to, arcs[i].rowid,
+	       x1 * 10, y1 * 10, x2 * 10, y2 * 10);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	      return 0;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE roads_net_data (Id INTEGER PRIMARY KEY, "
+		      "NetworkData BLOB NOT NULL)", NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    return 1;
+}
+
+static int
+check_path (sqlite3 * handle, const char *table, int from, int to,
+	    const char *algorithm, double *total)
+{
+/*
+/ checks that the solution is a connected sequence of arcs going
+/ from the origin to the destination and whose costs sum up to the total
+*/
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int i;
+    int node = from;
+    double sum = 0.0;
+    sql =
+	sqlite3_mprintf
+	("SELECT Algorithm, ArcRowid, NodeFrom, NodeTo, Cost FROM \"%s\" "
+	 "WHERE NodeFrom = %d AND NodeTo = %d", table, from, to);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (rows < 1 || columns != 5)
+	goto error;
+    if (strcmp (results[columns + 0], algorithm) != 0)
+      {
+	  fprintf (stderr, "unexpected Algorithm %s (expected %s)\n",
+		   results[columns + 0], algorithm);
+	  goto error;
+      }
+    *total = (results[columns + 4] == NULL) ? 0.0 :
+	atof (results[columns + 4]);
+    for (i = 2; i <= rows; i++)
+      {
+	  const char *arc_from = results[(i * columns) + 2];
+	  const char *arc_to = results[(i * columns) + 3];
+	  if (arc_from == NULL || arc_to == NULL)
+	      goto error;
+	  if (atoi (arc_from) != node)
+	      goto error;
+	  node = atoi (arc_to);
+	  sum += atof (results[(i * columns) + 4]);
+      }
+    if (rows > 1 && node != to)
+	goto error;
+    if (fabs (sum - *total) > 1e-6)
+	goto error;
+    sqlite3_free_table (results);
+    return 1;
+  error:
+    sqlite3_free_table (results);
+    return 0;
+}
+
+static int
+store_decrease_key (sqlite3 * handle)
+{
+/*
+/ building a tiny network where Dijkstra and A* queue Node 4 through
+/ the expensive 1-2-4 route and then find the cheaper 1-3-4 one: so
+/ Node 4 must be moved up by a decrease-key before being popped
+*/
+    static const double coords[6][2] = {
+	{0.0, 0.0}, {10.0, 0.0}, {0.0, 10.0}, {10.0, 10.0}, {20.0, 10.0},
+	{0.0, -10.0}
+    };
+    static const int dk_arcs[6][2] = {
+	{1, 2}, {1, 3}, {2, 4}, {3, 4}, {4, 5}, {1, 6}
+    };
+    static const double dk_costs[6] = { 10.0, 30.0, 100.0, 10.0, 10.0, 35.0 };
+    int endian_arch = gaiaEndianArch ();
+    unsigned char blob[4096];
+    unsigned char *p;
+    sqlite3_stmt *stmt;
+    char *sql;
+    int ret;
+    int node;
+    int i;
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE dk_roads (id INTEGER PRIMARY KEY, node_from INTEGER, "
+		      "node_to INTEGER, name TEXT, geometry BLOB); "
+		      "CREATE TABLE dk_net_data (Id INTEGER PRIMARY KEY, "
+		      "NetworkData BLOB NOT NULL)", NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (i = 0; i < 6; i++)
+      {
+	  const double *c1 = coords[dk_arcs[i][0] - 1];
+	  const double *c2 = coords[dk_arcs[i][1] - 1];
+	  sql =
+	      sqlite3_mprintf
+	      ("INSERT INTO dk_roads VALUES (%d, %d, %d, 'dk road %d', "
+	       "GeomFromText('LINESTRING(%f %f, %f %f)', 4326))", i + 1,
+	       dk_arcs[i][0], dk_arcs[i][1], i + 1, c1[0], c1[1], c2[0],
+	       c2[1]);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	      return 0;
+      }
+    ret = sqlite3_prepare_v2 (handle,
+			      "INSERT INTO dk_net_data (Id, NetworkData) VALUES (?, ?)",
+			      -1, &stmt, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+/* the header */
+    p = blob;
+    *p++ = GAIA_NET64_A_STAR_START;
+    *p++ = GAIA_NET_HEADER;
+    gaiaExport32 (p, 6, 1, endian_arch);
+    p += 4;
+    *p++ = GAIA_NET_ID;
+    *p++ = 0;
+    p = put_string (p, GAIA_NET_TABLE, "dk_roads", endian_arch);
+    p = put_string (p, GAIA_NET_FROM, "node_from", endian_arch);
+    p = put_string (p, GAIA_NET_TO, "node_to", endian_arch);
+    p = put_string (p, GAIA_NET_GEOM, "geometry", endian_arch);
+    p = put_string (p, GAIA_NET_NAME, "name", endian_arch);
+    *p++ = GAIA_NET_A_STAR_COEFF;
+    gaiaExport64 (p, 1.0, 1, endian_arch);
+    p += 8;
+    *p++ = GAIA_NET_END;
+    sqlite3_bind_int (stmt, 1, 0);
+    sqlite3_bind_blob (stmt, 2, blob, p - blob, SQLITE_TRANSIENT);
+    if (sqlite3_step (stmt) != SQLITE_DONE)
+	goto error;
+/* a single block containing all nodes [oneway arcs only] */
+    p = blob;
+    *p++ = GAIA_NET_BLOCK;
+    gaiaExport16 (p, 6, 1, endian_arch);
+    p += 2;
+    for (node = 1; node <= 6; node++)
+      {
+	  int cnt = 0;
+	  unsigned char *p_cnt;
+	  *p++ = GAIA_NET_NODE;
+	  gaiaExport32 (p, node - 1, 1, endian_arch);
+	  p += 4;
+	  gaiaExportI64 (p, node, 1, endian_arch);
+	  p += 8;
+	  gaiaExport64 (p, coords[node - 1][0], 1, endian_arch);
+	  p += 8;
+	  gaiaExport64 (p, coords[node - 1][1], 1, endian_arch);
+	  p += 8;
+	  p_cnt = p;
+	  p += 2;
+	  for (i = 0; i < 6; i++)
+	    {
+		if (dk_arcs[i][0] != node)
+		    continue;
+		*p++ = GAIA_NET_ARC;
+		gaiaExportI64 (p, i + 1, 1, endian_arch);
+		p += 8;
+		gaiaExport32 (p, dk_arcs[i][1] - 1, 1, endian_arch);
+		p += 4;
+		gaiaExport64 (p, dk_costs[i], 1, endian_arch);
+		p += 8;
+		*p++ = GAIA_NET_END;
+		cnt++;
+	    }
+	  gaiaExport16 (p_cnt, cnt, 1, endian_arch);
+	  *p++ = GAIA_NET_END;
+      }
+    sqlite3_reset (stmt);
+    sqlite3_clear_bindings (stmt);
+    sqlite3_bind_int (stmt, 1, 1);
+    sqlite3_bind_blob (stmt, 2, blob, p - blob, SQLITE_TRANSIENT);
+    if (sqlite3_step (stmt) != SQLITE_DONE)
+	goto error;
+    sqlite3_finalize (stmt);
+    return 1;
+  error:
+    sqlite3_finalize (stmt);
+    return 0;
+}
+
+static int
+check_decrease_key (sqlite3 * handle)
+{
+/* the decrease-key network: 1-3-4-5 (cost 50) is the only right answer */
+    static const char *algorithms[] = { "Dijkstra", "A*", "BiDijkstra",
+	"BiA*"
+    };
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int i;
+    int ok;
+    double cost;
+    if (!store_decrease_key (handle))
+      {
+	  fprintf (stderr, "unable to create the decrease-key network: %s\n",
+		   sqlite3_errmsg (handle));
+	  return 0;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE dk_net USING VirtualNetwork(dk_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE dk_net error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return 0;
+      }
+    for (i = 0; i < 4; i++)
+      {
+	  sql =
+	      sqlite3_mprintf ("UPDATE dk_net SET Algorithm = %Q",
+			       algorithms[i]);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	      return 0;
+	  if (!check_path (handle, "dk_net", 1, 5, algorithms[i], &cost)
+	      || fabs (cost - 50.0) > 1e-6)
+	    {
+		fprintf (stderr, "%s: unexpected decrease-key cost %f\n",
+			 algorithms[i], cost);
+		return 0;
+	    }
+	  ret =
+	      sqlite3_get_table (handle,
+				 "SELECT ArcRowid FROM dk_net WHERE NodeFrom = 1 "
+				 "AND NodeTo = 5", &results, &rows, &columns,
+				 NULL);
+	  if (ret != SQLITE_OK)
+	      return 0;
+	  ok = (rows == 4 && atoi (results[2]) == 2 && atoi (results[3]) == 4
+		&& atoi (results[4]) == 5);
+	  sqlite3_free_table (results);
+	  if (!ok)
+	    {
+		fprintf (stderr, "%s: unexpected decrease-key path\n",
+			 algorithms[i]);
+		return 0;
+	    }
+      }
+    ret = sqlite3_exec (handle, "DROP TABLE dk_net", NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    return 1;
+}
+
+static int
+check_matrix (sqlite3 * handle, const char *table, const char *from,
+	      const char *to, const char *algorithm, int expected)
+{
+/* checks a One-to-Many / Many-to-Many solution against the Dijkstra costs */
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int i;
+    sql =
+	sqlite3_mprintf
+	("SELECT Algorithm, NodeFrom, NodeTo, Cost FROM \"%s\" "
+	 "WHERE NodeFrom = %s AND NodeTo = %s", table, from, to);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (rows != expected)
+      {
+	  fprintf (stderr, "unexpected matrix rows %d (expected %d)\n", rows,
+		   expected);
+	  goto error;
+      }
+    for (i = 1; i <= rows; i++)
+      {
+	  const char *algo = results[(i * columns) + 0];
+	  int node_from = atoi (results[(i * columns) + 1]);
+	  int node_to = atoi (results[(i * columns) + 2]);
+	  const char *cost = results[(i * columns) + 3];
+	  double reference = dijkstra_costs[node_from - 1][node_to - 1];
+	  if (strcmp (algo, algorithm) != 0)
+	    {
+		fprintf (stderr, "unexpected Algorithm %s (expected %s)\n",
+			 algo, algorithm);
+		goto error;
+	    }
+	  if (cost == NULL)
+	    {
+		/* unreachable: Dijkstra must have found no path at all */
+		if (node_from == node_to || reference != 0.0)
+		    goto error;
+		continue;
+	    }
+	  if (fabs (atof (cost) - reference) > 1e-6)
+	    {
+		fprintf (stderr, "unexpected matrix cost %d -> %d: %s\n",
+			 node_from, node_to, cost);
+		goto error;
+	    }
+      }
+    sqlite3_free_table (results);
+    return 1;
+  error:
+    sqlite3_free_table (results);
+    return 0;
+}
+
+static int
+check_isochrone (sqlite3 * handle, const char *table, int from,
+		 double budget, int strict)
+{
+/* checks an Isochrone solution against the Dijkstra costs */
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int i;
+    int expected = 0;
+    char limit[64];
+    sprintf (limit, "%1.17g", budget);
+    sql =
+	sqlite3_mprintf
+	("SELECT ArcRowid, NodeFrom, NodeTo, Cost, Geometry FROM \"%s\" "
+	 "WHERE NodeFrom = %d AND Cost %s %s", table, from,
+	 (strict) ? "<" : "<=", limit);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    for (i = 0; i < NUM_NODES; i++)
+      {
+	  /* counting the reachable nodes */
+	  double cost = dijkstra_costs[from - 1][i];
+	  if (i == from - 1)
+	      cost = 0.0;
+	  else if (cost == 0.0)
+	      continue;		/* unreachable */
+	  if (strict ? cost < budget : cost <= budget)
+	      expected++;
+      }
+    if (rows != expected + 1)
+      {
+	  fprintf (stderr, "unexpected isochrone rows %d (expected %d)\n",
+		   rows - 1, expected);
+	  goto error;
+      }
+    if (atoi (results[columns + 1]) != from
+	|| fabs (atof (results[columns + 3]) - budget) > 1e-6)
+	goto error;
+#ifndef OMIT_GEOS		/* only if GEOS is supported */
+#ifdef GEOS_TRUNK		/* only if GEOS_TRUNK is supported */
+    if (expected >= 3 && results[columns + 4] == NULL)
+      {
+	  fprintf (stderr, "isochrone: missing Concave Hull\n");
+	  goto error;
+      }
+#endif /* end GEOS_TRUNK conditional */
+#endif /* end GEOS conditional */
+    for (i = 2; i <= rows; i++)
+      {
+	  const char *arc = results[(i * columns) + 0];
+	  int node_from = atoi (results[(i * columns) + 1]);
+	  int node_to = atoi (results[(i * columns) + 2]);
+	  double cost = atof (results[(i * columns) + 3]);
+	  if (fabs (cost - dijkstra_costs[from - 1][node_to - 1]) > 1e-6)
+	    {
+		fprintf (stderr, "unexpected isochrone cost %d -> %d: %f\n",
+			 from, node_to, cost);
+		goto error;
+	    }
+	  if (arc == NULL)
+	    {
+		/* only the origin itself has no Arc */
+		if (node_from != from || node_to != from)
+		    goto error;
+		continue;
+	    }
+	  if (node_from != from
+	      && dijkstra_costs[from - 1][node_from - 1] >= cost)
+	      goto error;
+      }
+    sqlite3_free_table (results);
+    return 1;
+  error:
+    sqlite3_free_table (results);
+    return 0;
+}
+
+static int
+check_overrides_a_star (sqlite3 * handle, const char *table)
+{
+/* checks that A* and bidirectional searches match Dijkstra using overrides */
+    const char *algorithms[4] = { "Dijkstra", "A*", "BiDijkstra", "BiA*" };
+    double costs[NUM_NODES][NUM_NODES];
+    char *sql;
+    int ret;
+    int i;
+    int from;
+    int to;
+    double cost;
+    for (i = 0; i < 4; i++)
+      {
+	  sql =
+	      sqlite3_mprintf ("UPDATE \"%s\" SET Algorithm = %Q", table,
+			       algorithms[i]);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	      return 0;
+	  for (from = 1; from <= NUM_NODES; from += GRID_SIZE + 1)
+	    {
+		for (to = 1; to <= NUM_NODES; to++)
+		  {
+		      if (from == to)
+			  continue;
+		      if (!check_path
+			  (handle, table, from, to, algorithms[i], &cost))
+			{
+			    fprintf (stderr,
+				     "overrides: invalid %s path %d -> %d\n",
+				     algorithms[i], from, to);
+			    return 0;
+			}
+		      if (i == 0)
+			  costs[from - 1][to - 1] = cost;
+		      else if (fabs (cost - costs[from - 1][to - 1]) > 1e-6)
+			{
+			    fprintf (stderr,
+				     "overrides: unexpected %s cost %d -> %d: "
+				     "%f (expected %f)\n", algorithms[i], from,
+				     to, cost, costs[from - 1][to - 1]);
+			    return 0;
+			}
+		  }
+	    }
+      }
+/* restoring the default algorithm */
+    sql =
+	sqlite3_mprintf ("UPDATE \"%s\" SET Algorithm = 'Dijkstra'", table);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    return (ret == SQLITE_OK);
+}
+
+static int
+check_overrides (sqlite3 * handle)
+{
+/* checks the Arc cost overrides: closures, costs and multipliers */
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int i;
+    int arc;
+    double arc_cost;
+    double cost;
+    double reference = dijkstra_costs[0][NUM_NODES - 1];
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE TABLE traffic (ArcRowid INTEGER, Cost DOUBLE);"
+		      "CREATE TABLE jam (arc_rowid INTEGER, Multiplier DOUBLE);"
+		      "CREATE VIRTUAL TABLE net_traffic USING "
+		      "VirtualNetwork(roads_net_data, traffic);"
+		      "CREATE VIRTUAL TABLE net_jam USING "
+		      "VirtualNetwork(roads_net_data, jam)", NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "overrides: %s\n", sqlite3_errmsg (handle));
+	  return 0;
+      }
+/* not a valid overrides table */
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE net_bad USING "
+		      "VirtualNetwork(roads_net_data, roads_net_data)", NULL,
+		      NULL, NULL);
+    if (ret == SQLITE_OK)
+      {
+	  fprintf (stderr, "overrides: unexpected success (net_bad)\n");
+	  return 0;
+      }
+/* no overrides yet: Dijkstra, because the Hierarchy ignores any override */
+    if (!check_path (handle, "net_traffic", 1, NUM_NODES, "Dijkstra", &cost)
+	|| fabs (cost - reference) > 1e-6)
+      {
+	  fprintf (stderr, "overrides: unexpected cost %f\n", cost);
+	  return 0;
+      }
+    sql =
+	sqlite3_mprintf
+	("SELECT ArcRowid, Cost FROM net_traffic WHERE NodeFrom = 1 "
+	 "AND NodeTo = %d LIMIT 1 OFFSET 1", NUM_NODES);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK || rows != 1)
+	return 0;
+    arc = atoi (results[columns + 0]);
+    arc_cost = atof (results[columns + 1]);
+    sqlite3_free_table (results);
+/* closing the first Arc of the path */
+    sql = sqlite3_mprintf ("INSERT INTO traffic VALUES (%d, NULL)", arc);
+    ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (!check_path (handle, "net_traffic", 1, NUM_NODES, "Dijkstra", &cost)
+	|| cost < reference - 1e-6)
+      {
+	  fprintf (stderr, "overrides: unexpected closure cost %f\n", cost);
+	  return 0;
+      }
+    sql =
+	sqlite3_mprintf
+	("SELECT ArcRowid FROM net_traffic WHERE NodeFrom = 1 "
+	 "AND NodeTo = %d AND ArcRowid = %d", NUM_NODES, arc);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return 0;
+    sqlite3_free_table (results);
+    if (rows != 0)
+      {
+	  fprintf (stderr, "overrides: a closed Arc has been used\n");
+	  return 0;
+      }
+/* making the same Arc cheaper */
+    ret =
+	sqlite3_exec (handle, "UPDATE traffic SET Cost = 0.5", NULL, NULL,
+		      NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    if (!check_path (handle, "net_traffic", 1, NUM_NODES, "Dijkstra", &cost)
+	|| fabs (cost - (reference - arc_cost + 0.5)) > 1e-6)
+      {
+	  fprintf (stderr, "overrides: unexpected override cost %f\n", cost);
+	  return 0;
+      }
+/* doubling the cost of any Arc */
+    for (i = 0; i < num_arcs; i++)
+      {
+	  sql =
+	      sqlite3_mprintf ("INSERT INTO jam VALUES (%d, 2.0)",
+			       arcs[i].rowid);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	      return 0;
+      }
+    if (!check_path (handle, "net_jam", 1, NUM_NODES, "Dijkstra", &cost)
+	|| fabs (cost - (reference * 2.0)) > 1e-6)
+      {
+	  fprintf (stderr, "overrides: unexpected multiplier cost %f\n",
+		   cost);
+	  return 0;
+      }
+/* making some Arcs much cheaper than their length */
+    ret =
+	sqlite3_exec (handle,
+		      "UPDATE jam SET Multiplier = 0.05 WHERE arc_rowid % 3 = 0",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    return check_overrides_a_star (handle, "net_jam");
+}
+
+static int
+check_arc_cache (sqlite3 * handle)
+{
+/* checks that cached and freshly read Arc Geometries give the same solution */
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    int pass;
+    char *geometry[3];
+    const char *budget[3] = { "SELECT SetNetworkArcCacheSize(8192)",
+	"SELECT SetNetworkArcCacheSize(8192)",
+	"SELECT SetNetworkArcCacheSize(0)"
+    };
+    int ok = 1;
+    for (pass = 0; pass < 3; pass++)
+	geometry[pass] = NULL;
+    for (pass = 0; pass < 3; pass++)
+      {
+	  /* the first pass fills the cache, the last one disables it */
+	  ret =
+	      sqlite3_get_table (handle, budget[pass], &results, &rows,
+				 &columns, NULL);
+	  if (ret != SQLITE_OK)
+	      return 0;
+	  if (rows != 1 || results[1] == NULL
+	      || strcmp (results[1], "8192") != 0)
+	      ok = 0;
+	  sqlite3_free_table (results);
+	  sql =
+	      sqlite3_mprintf
+	      ("SELECT Hex(Geometry), GeometryType(Geometry), "
+	       "NumPoints(Geometry) FROM net_plain WHERE NodeFrom = 1 "
+	       "AND NodeTo = %d LIMIT 1", NUM_NODES);
+	  ret =
+	      sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	      return 0;
+	  if (rows == 1 && results[3] != NULL && results[4] != NULL
+	      && results[5] != NULL && strcmp (results[4], "LINESTRING") == 0
+	      && atoi (results[5]) >= 2)
+	    {
+		geometry[pass] = malloc (strlen (results[3]) + 1);
+		strcpy (geometry[pass], results[3]);
+	    }
+	  else
+	      ok = 0;
+	  sqlite3_free_table (results);
+      }
+    for (pass = 1; pass < 3 && ok; pass++)
+      {
+	  if (geometry[0] == NULL || geometry[pass] == NULL
+	      || strcmp (geometry[0], geometry[pass]) != 0)
+	      ok = 0;
+      }
+    for (pass = 0; pass < 3; pass++)
+      {
+	  if (geometry[pass])
+	      free (geometry[pass]);
+      }
+/* restoring the default budget */
+    ret =
+	sqlite3_exec (handle, "SELECT SetNetworkArcCacheSize(8192)", NULL,
+		      NULL, NULL);
+    if (ret != SQLITE_OK)
+	return 0;
+    return ok;
+}
+
+static int
+has_fingerprint (sqlite3 * handle, const char *kind)
+{
+/* checks if a fingerprint is currently stored for roads_net_data */
+    char *sql;
+    char **results;
+    int rows;
+    int columns;
+    int ret;
+    sql =
+	sqlite3_mprintf
+	("SELECT Count(*) FROM roads_net_data_fingerprint WHERE Kind = %Q",
+	 kind);
+    ret = sqlite3_get_table (handle, sql, &results, &rows, &columns, NULL);
+    sqlite3_free (sql);
+    if (ret != SQLITE_OK)
+	return -1;
+    ret = (rows == 1 && strcmp (results[1], "1") == 0) ? 1 : 0;
+    sqlite3_free_table (results);
+    return ret;
+}
+
+int
+main (int argc, char *argv[])
+{
+    sqlite3 *handle = NULL;
+    sqlite3 *handle2 = NULL;
+    void *cache2;
+    int ret;
+    int from;
+    int to;
+    int i;
+    char *sql;
+    double cost;
+    char **results;
+    int rows;
+    int columns;
+    void *cache = spatialite_alloc_connection ();
+
+    if (argc > 1 || argv[0] == NULL)
+	argc = 1;		/* silencing stupid compiler warnings */
+
+    ret =
+	sqlite3_open_v2 (":memory:", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open in-memory db: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  return -1;
+      }
+    spatialite_init_ex (handle, cache, 0);
+
+/* building the test network */
+    build_arcs ();
+    if (!store_roads (handle))
+      {
+	  fprintf (stderr, "unable to create the roads table: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -2;
+      }
+    if (!store_network (handle, 0.0))
+      {
+	  fprintf (stderr, "unable to create the NetworkData table: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -3;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE net_plain USING VirtualNetwork(roads_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE net_plain error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -4;
+      }
+
+/* Dijkstra: reference costs for any pair of nodes */
+    for (from = 1; from <= NUM_NODES; from++)
+      {
+	  for (to = 1; to <= NUM_NODES; to++)
+	    {
+		if (!check_path
+		    (handle, "net_plain", from, to, "Dijkstra",
+		     &(dijkstra_costs[from - 1][to - 1])))
+		  {
+		      fprintf (stderr, "Dijkstra: invalid path %d -> %d\n",
+			       from, to);
+		      return -5;
+		  }
+	    }
+      }
+
+/* A*: same costs as Dijkstra */
+    ret =
+	sqlite3_exec (handle, "UPDATE net_plain SET Algorithm = 'A*'", NULL,
+		      NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "UPDATE net_plain error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -6;
+      }
+    for (from = 1; from <= NUM_NODES; from++)
+      {
+	  for (to = 1; to <= NUM_NODES; to++)
+	    {
+		if (!check_path (handle, "net_plain", from, to, "A*", &cost))
+		  {
+		      fprintf (stderr, "A*: invalid path %d -> %d\n", from,
+			       to);
+		      return -7;
+		  }
+		if (fabs (cost - dijkstra_costs[from - 1][to - 1]) > 1e-6)
+		  {
+		      fprintf (stderr, "A*: unexpected cost %d -> %d: %f\n",
+			       from, to, cost);
+		      return -8;
+		  }
+	    }
+      }
+
+/* bidirectional Dijkstra and A*: same costs as Dijkstra */
+    for (i = 0; i < 2; i++)
+      {
+	  const char *algorithm = (i == 0) ? "BiDijkstra" : "BiA*";
+	  sql =
+	      sqlite3_mprintf ("UPDATE net_plain SET Algorithm = %Q",
+			       algorithm);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	    {
+		fprintf (stderr, "UPDATE net_plain error: %s\n",
+			 sqlite3_errmsg (handle));
+		return -9;
+	    }
+	  for (from = 1; from <= NUM_NODES; from++)
+	    {
+		for (to = 1; to <= NUM_NODES; to++)
+		  {
+		      if (!check_path
+			  (handle, "net_plain", from, to, algorithm, &cost))
+			{
+			    fprintf (stderr, "%s: invalid path %d -> %d\n",
+				     algorithm, from, to);
+			    return -10;
+			}
+		      if (fabs (cost - dijkstra_costs[from - 1][to - 1]) >
+			  1e-6)
+			{
+			    fprintf (stderr,
+				     "%s: unexpected cost %d -> %d: %f\n",
+				     algorithm, from, to, cost);
+			    return -11;
+			}
+		  }
+	    }
+      }
+
+/* building the Contraction Hierarchy */
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT CreateNetworkHierarchy('roads_net_data'), "
+			   "CreateNetworkHierarchy('no_such_table')",
+			   &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CreateNetworkHierarchy error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -12;
+      }
+    if (rows != 1 || strcmp (results[2], "1") != 0
+	|| strcmp (results[3], "0") != 0)
+      {
+	  fprintf (stderr, "CreateNetworkHierarchy: unexpected result\n");
+	  return -13;
+      }
+    sqlite3_free_table (results);
+    if (has_fingerprint (handle, "hierarchy") != 1)
+      {
+	  fprintf (stderr, "CreateNetworkHierarchy: missing fingerprint\n");
+	  return -57;
+      }
+
+/* CH: the default algorithm once an Hierarchy is available */
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE net_ch USING VirtualNetwork(roads_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE net_ch error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -14;
+      }
+    for (from = 1; from <= NUM_NODES; from++)
+      {
+	  for (to = 1; to <= NUM_NODES; to++)
+	    {
+		if (!check_path (handle, "net_ch", from, to, "CH", &cost))
+		  {
+		      fprintf (stderr, "CH: invalid path %d -> %d\n", from,
+			       to);
+		      return -15;
+		  }
+		if (fabs (cost - dijkstra_costs[from - 1][to - 1]) > 1e-6)
+		  {
+		      fprintf (stderr, "CH: unexpected cost %d -> %d: %f\n",
+			       from, to, cost);
+		      return -16;
+		  }
+	    }
+      }
+/* One-to-Many / Many-to-Many matrices */
+    ret =
+	sqlite3_exec (handle, "CREATE TABLE all_nodes (node INTEGER)", NULL,
+		      NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE TABLE all_nodes error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -17;
+      }
+    for (from = 1; from <= NUM_NODES; from++)
+      {
+	  char *sql =
+	      sqlite3_mprintf ("INSERT INTO all_nodes VALUES (%d)", from);
+	  ret = sqlite3_exec (handle, sql, NULL, NULL, NULL);
+	  sqlite3_free (sql);
+	  if (ret != SQLITE_OK)
+	    {
+		fprintf (stderr, "INSERT INTO all_nodes error: %s\n",
+			 sqlite3_errmsg (handle));
+		return -18;
+	    }
+      }
+    if (!check_matrix
+	(handle, "net_plain", "'1,5, 9,64'", "' 2,17,33,64,999'", "Dijkstra",
+	 16))
+      {
+	  fprintf (stderr, "net_plain: invalid Many-to-Many matrix\n");
+	  return -19;
+      }
+    if (!check_matrix
+	(handle, "net_plain", "7", "'@all_nodes(node)'", "Dijkstra",
+	 NUM_NODES))
+      {
+	  fprintf (stderr, "net_plain: invalid One-to-Many matrix\n");
+	  return -20;
+      }
+    if (!check_matrix
+	(handle, "net_ch", "'@all_nodes'", "'@all_nodes(node)'", "CH",
+	 NUM_NODES * NUM_NODES))
+      {
+	  fprintf (stderr, "net_ch: invalid Many-to-Many matrix\n");
+	  return -21;
+      }
+    if (!check_matrix (handle, "net_ch", "'1,2'", "'998,999'", "CH", 0))
+      {
+	  fprintf (stderr, "net_ch: unknown nodes not ignored\n");
+	  return -22;
+      }
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT Cost FROM net_ch WHERE NodeFrom = '@no_such_table' "
+			   "AND NodeTo = 1", &results, &rows, &columns, NULL);
+    if (ret == SQLITE_OK)
+      {
+	  sqlite3_free_table (results);
+	  fprintf (stderr, "net_ch: unexpected success (no_such_table)\n");
+	  return -23;
+      }
+
+/* Isochrones */
+    for (from = 1; from <= NUM_NODES; from += 9)
+      {
+	  if (!check_isochrone (handle, "net_plain", from, 45.001, 0))
+	    {
+		fprintf (stderr, "net_plain: invalid isochrone from %d\n",
+			 from);
+		return -24;
+	    }
+	  if (!check_isochrone (handle, "net_ch", from, 75.001, 1))
+	    {
+		fprintf (stderr, "net_ch: invalid strict isochrone from %d\n",
+			 from);
+		return -25;
+	    }
+      }
+    if (!check_isochrone (handle, "net_plain", 1, -1.0, 0)
+	|| !check_isochrone (handle, "net_plain", 1, 0.0, 0)
+	|| !check_isochrone (handle, "net_plain", 1, 0.0, 1))
+      {
+	  fprintf (stderr, "net_plain: invalid empty or zero cost isochrone\n");
+	  return -26;
+      }
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT Cost FROM net_plain WHERE NodeFrom = 1 AND "
+			   "NodeTo = '@all_nodes' AND Cost <= 45.001",
+			   &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "filtered matrix error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -27;
+      }
+    sqlite3_free_table (results);
+    for (to = 0, from = 0; to < NUM_NODES; to++)
+      {
+	  if (to == 0 || (dijkstra_costs[0][to] > 0.0
+			  && dijkstra_costs[0][to] <= 45.001))
+	      from++;
+      }
+    if (rows != from)
+      {
+	  fprintf (stderr, "filtered matrix: unexpected rows %d\n", rows);
+	  return -28;
+      }
+
+    ret =
+	sqlite3_exec (handle, "UPDATE net_ch SET Algorithm = 'Dijkstra'",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "UPDATE net_ch error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -29;
+      }
+    if (!check_path (handle, "net_ch", 1, NUM_NODES, "Dijkstra", &cost))
+      {
+	  fprintf (stderr, "net_ch: unable to switch back to Dijkstra\n");
+	  return -30;
+      }
+
+/* Arc Geometries cache */
+    if (!check_arc_cache (handle))
+	return -31;
+
+/* Arc cost overrides */
+    if (!check_overrides (handle))
+	return -32;
+
+/* a binary image: same costs as parsing the NetworkData table */
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT CreateNetworkImage('roads_net_data'), "
+			   "CreateNetworkImage('no_such_table'), "
+			   "CreateNetworkImage('roads_net_data', 1)",
+			   &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CreateNetworkImage error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -33;
+      }
+    if (rows != 1 || strcmp (results[3], "1") != 0
+	|| strcmp (results[4], "0") != 0 || strcmp (results[5], "0") != 0)
+      {
+	  fprintf (stderr, "CreateNetworkImage: unexpected result\n");
+	  return -34;
+      }
+    sqlite3_free_table (results);
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE net_image USING VirtualNetwork(roads_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE net_image error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -35;
+      }
+    for (from = 1; from <= NUM_NODES; from++)
+      {
+	  for (to = 1; to <= NUM_NODES; to++)
+	    {
+		if (!check_path (handle, "net_image", from, to, "CH", &cost)
+		    || fabs (cost - dijkstra_costs[from - 1][to - 1]) > 1e-6)
+		  {
+		      fprintf (stderr, "net_image: invalid path %d -> %d\n",
+			       from, to);
+		      return -36;
+		  }
+	    }
+      }
+
+/* a stale Hierarchy must be ignored */
+    if (!store_network (handle, 5.0))
+      {
+	  fprintf (stderr, "unable to update the NetworkData table: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -37;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE net_stale USING VirtualNetwork(roads_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE net_stale error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -38;
+      }
+    if (!check_path (handle, "net_stale", 1, NUM_NODES, "Dijkstra", &cost))
+      {
+	  fprintf (stderr, "net_stale: the stale Hierarchy was used\n");
+	  return -39;
+      }
+
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -40;
+      }
+
+/* a sidecar image for a file-based DB */
+    unlink ("network_image.sqlite");
+    unlink ("network_image.sqlite.roads_net_data.vnet");
+    ret =
+	sqlite3_open_v2 ("network_image.sqlite", &handle,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open network_image.sqlite: %s\n",
+		   sqlite3_errmsg (handle));
+	  sqlite3_close (handle);
+	  return -41;
+      }
+    spatialite_init_ex (handle, cache, 0);
+    if (!store_roads (handle) || !store_network (handle, 0.0))
+      {
+	  fprintf (stderr, "unable to create the sidecar network: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -42;
+      }
+    ret =
+	sqlite3_get_table (handle,
+			   "SELECT CreateNetworkImage('roads_net_data', 1)",
+			   &results, &rows, &columns, NULL);
+    if (ret != SQLITE_OK || rows != 1 || strcmp (results[1], "1") != 0)
+      {
+	  fprintf (stderr, "CreateNetworkImage: sidecar not created\n");
+	  return -43;
+      }
+    sqlite3_free_table (results);
+    if (access ("network_image.sqlite.roads_net_data.vnet", F_OK) != 0)
+      {
+	  fprintf (stderr, "CreateNetworkImage: missing sidecar file\n");
+	  return -44;
+      }
+    if (has_fingerprint (handle, "network") != 1)
+      {
+	  fprintf (stderr, "CreateNetworkImage: missing fingerprint\n");
+	  return -55;
+      }
+    ret =
+	sqlite3_exec (handle,
+		      "CREATE VIRTUAL TABLE net_sidecar USING VirtualNetwork(roads_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE net_sidecar error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -45;
+      }
+    for (to = 1; to <= NUM_NODES; to++)
+      {
+	  if (!check_path (handle, "net_sidecar", 1, to, "Dijkstra", &cost)
+	      || fabs (cost - dijkstra_costs[0][to - 1]) > 1e-6)
+	    {
+		fprintf (stderr, "net_sidecar: invalid path 1 -> %d\n", to);
+		return -46;
+	    }
+      }
+
+/* a second connection shares the same NETWORK */
+    cache2 = spatialite_alloc_connection ();
+    ret =
+	sqlite3_open_v2 ("network_image.sqlite", &handle2,
+			 SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "cannot open network_image.sqlite: %s\n",
+		   sqlite3_errmsg (handle2));
+	  sqlite3_close (handle2);
+	  return -47;
+      }
+    spatialite_init_ex (handle2, cache2, 0);
+    for (to = 1; to <= NUM_NODES; to++)
+      {
+	  if (!check_path (handle2, "net_sidecar", 1, to, "Dijkstra", &cost)
+	      || fabs (cost - dijkstra_costs[0][to - 1]) > 1e-6)
+	    {
+		fprintf (stderr, "shared net_sidecar: invalid path 1 -> %d\n",
+			 to);
+		return -48;
+	    }
+      }
+/* a changed NetworkData table is never served from the shared NETWORK */
+    if (!store_network (handle2, 5.0))
+      {
+	  fprintf (stderr, "unable to update the NetworkData table: %s\n",
+		   sqlite3_errmsg (handle2));
+	  return -49;
+      }
+    if (has_fingerprint (handle2, "network") != 0)
+      {
+	  fprintf (stderr, "the NetworkData fingerprint wasn't invalidated\n");
+	  return -56;
+      }
+    ret =
+	sqlite3_exec (handle2,
+		      "CREATE VIRTUAL TABLE net_reloaded USING VirtualNetwork(roads_net_data)",
+		      NULL, NULL, NULL);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "CREATE VIRTUAL TABLE net_reloaded error: %s\n",
+		   sqlite3_errmsg (handle2));
+	  return -50;
+      }
+    if (!check_path (handle2, "net_reloaded", 1, NUM_NODES, "Dijkstra", &cost)
+	|| cost <= dijkstra_costs[0][NUM_NODES - 1] + 1e-6)
+      {
+	  fprintf (stderr, "net_reloaded: the stale NETWORK was used\n");
+	  return -51;
+      }
+    if (has_fingerprint (handle2, "network") != 1)
+      {
+	  fprintf (stderr, "net_reloaded: the fingerprint wasn't stored\n");
+	  return -58;
+      }
+    ret = sqlite3_close (handle2);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle2));
+	  return -52;
+      }
+
+/* a shorter path found after a longer one was queued */
+    if (!check_decrease_key (handle))
+	return -54;
+    spatialite_cleanup_ex (cache2);
+    ret = sqlite3_close (handle);
+    if (ret != SQLITE_OK)
+      {
+	  fprintf (stderr, "sqlite3_close() error: %s\n",
+		   sqlite3_errmsg (handle));
+	  return -53;
+      }
+    unlink ("network_image.sqlite");
+    unlink ("network_image.sqlite.roads_net_data.vnet");
+
+    spatialite_cleanup_ex (cache);
+
+    return 0;
+}
@@ -51,11 +51,139 @@ the terms of any one of the MPL, the GPL or the LGPL.
 
 #include "sqlite3.h"
 #include "spatialite.h"
+#include "spatialite/gaiageo.h"
 
 #ifdef _WIN32
 #include "asprintf4win.h"
 #endif
 
+#ifndef OMIT_ICONV	/* only if ICONV is supported */
+
+static int
+vtx_exists (const char *index_path)
+{
+/* checking if the sidecar Row Index file exists */
+    FILE *in = fopen (index_path, "rb");
+    if (in == NULL)
+	return 0;
+    fclose (in);
+    return 1;
+}
+
+static int
+vtx_loads (const char *path, const char *index_path)
+{
+/* checking if the sidecar Row Index is accepted for the given file */
+    int ret;
+    gaiaTextReaderPtr text =
+	gaiaTextReaderAlloc (path, '\t', '"', '.', 0, "UTF-8");
+    if (text == NULL)
+	return 0;
+    ret = gaiaTextReaderLoadIndex (text, index_path);
+    gaiaTextReaderDestroy (text);
+    return ret;
+}
+
+static int
+vtx_tamper (const char *index_path, long offset)
+{
+/* altering a 64 bit value into the sidecar header [file size or mtime] */
+    unsigned char buf[8];
+    FILE *io = fopen (index_path, "r+b");
+    if (io == NULL)
+	return 0;
+    if (fseek (io, offset, SEEK_SET) != 0 || fread (buf, 1, 8, io) != 8) {
+	fclose (io);
+	return 0;
+    }
+    buf[0] ^= 0x01;
+    if (fseek (io, offset, SEEK_SET) != 0 || fwrite (buf, 1, 8, io) != 8) {
+	fclose (io);
+	return 0;
+    }
+    fclose (io);
+    return 1;
+}
+
+static int
+write_chunked_csv (const char *path)
+{
+/* writing a CSV file where most LF chars are within quoted fields */
+    int i;
+    FILE *out = fopen (path, "wb");
+    if (out == NULL)
+	return 0;
+    fprintf (out, "id,name,note,value\n");
+    for (i = 1; i <= 400; i++)
+      {
+	  fprintf (out, "%d,\"name %d\",\"first line %d\n", i, i, i);
+	  fprintf (out, "a quoted, comma; and\n\n");
+	  if (i % 3 == 0)
+	      fprintf (out, "\n\n\n");
+	  fprintf (out, "last line\",%d.5\n", i);
+      }
+    fclose (out);
+    return 1;
+}
+
+static int
+check_chunked_parse (int chunks)
+{
+/* comparing a chunked Text Reader against the serial one */
+    gaiaTextReaderPtr serial;
+    gaiaTextReaderPtr chunked;
+    int row;
+    int col;
+    int type1;
+    int type2;
+    const char *value1;
+    const char *value2;
+    int ok = 1;
+
+    serial = gaiaTextReaderAlloc ("chunked.csv", ',', '"', '.', 1, "UTF-8");
+    chunked = gaiaTextReaderAlloc ("chunked.csv", ',', '"', '.', 1, "UTF-8");
+    if (serial == NULL || chunked == NULL) {
+	fprintf (stderr, "gaiaTextReaderAlloc error\n");
+	ok = 0;
+	goto stop;
+    }
+    if (!gaiaTextReaderParse_ex (serial, 1) || !gaiaTextReaderParse_ex (chunked, chunks)) {
+	fprintf (stderr, "gaiaTextReaderParse_ex (%d chunks) error\n", chunks);
+	ok = 0;
+	goto stop;
+    }
+    if (serial->num_rows != 400 || chunked->num_rows != 400
+	|| serial->max_fields != chunked->max_fields) {
+	fprintf (stderr, "Unexpected error: %d chunks bad result: %d/%d.\n", chunks, chunked->num_rows, chunked->max_fields);
+	ok = 0;
+	goto stop;
+    }
+    for (row = 0; row < serial->num_rows && ok; row++) {
+	if (!gaiaTextReaderGetRow (serial, row) || !gaiaTextReaderGetRow (chunked, row)) {
+	    ok = 0;
+	    break;
+	}
+	for (col = 0; col < serial->max_fields; col++) {
+	    if (!gaiaTextReaderFetchField (serial, col, &type1, &value1)
+		|| !gaiaTextReaderFetchField (chunked, col, &type2, &value2)
+		|| type1 != type2 || strcmp (value1, value2) != 0) {
+		ok = 0;
+		break;
+	    }
+	}
+    }
+    if (!ok)
+	fprintf (stderr, "Unexpected error: %d chunks mismatch at row %d.\n", chunks, row);
+  stop:
+    if (serial)
+	gaiaTextReaderDestroy (serial);
+    if (chunked)
+	gaiaTextReaderDestroy (chunked);
+    return ok;
+}
+
+#endif /* end ICONV conditional */
+
 int main (int argc, char *argv[])
 {
 #ifndef OMIT_ICONV	/* only if ICONV is supported */
@@ -66,6 +194,8 @@ int main (int argc, char *argv[])
     char **results;
     int rows;
     int columns;
+    int i;
+    char msg[1024];
     void *cache = spatialite_alloc_connection();
 
     if (argc > 1 || argv[0] == NULL)
@@ -342,6 +472,199 @@ int main (int argc, char *argv[])
 	return -47;
     }
 
+/* sidecar row index: the first time it's created, then it's reloaded */
+    remove ("testcase1.csv.vtx");
+    for (i = 0; i < 2; i++) {
+	ret = sqlite3_exec (db_handle, "create VIRTUAL TABLE places USING VirtualText(\"testcase1.csv\", UTF-8, 0, POINT, DOUBLEQUOTE, TAB, 1);", NULL, NULL, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "VirtualText (use_index) error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -48;
+	}
+	if (!vtx_exists ("testcase1.csv.vtx")) {
+	    fprintf (stderr, "Unexpected error: missing sidecar index (use_index %d)\n", i);
+	    return -73;
+	}
+	if (i == 1 && !vtx_loads ("testcase1.csv", "testcase1.csv.vtx")) {
+	    fprintf (stderr, "Unexpected error: the sidecar index was not reloaded\n");
+	    return -74;
+	}
+	ret = sqlite3_get_table (db_handle, "SELECT col003, col012 FROM places WHERE col012 >= 20000.0 AND col012 < 24000.0", &results, &rows, &columns, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "Error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -49;
+	}
+	if ((rows != 2) || (columns != 2)) {
+	    fprintf (stderr, "Unexpected error: select columns bad result (use_index %d): %i/%i.\n", i, rows, columns);
+	    return  -50;
+	}
+	if (strcmp(results[0], "COL003") != 0 || strcmp(results[1], "COL012") != 0) {
+	    fprintf (stderr, "Unexpected error: header() bad result (use_index %d): %s/%s.\n", i, results[0], results[1]);
+	    return  -51;
+	}
+	sqlite3_free_table (results);
+	ret = sqlite3_exec (db_handle, "DROP TABLE places;", NULL, NULL, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -52;
+	}
+    }
+/* a sidecar index not matching the file size or mtime is rejected, then rewritten */
+    for (i = 0; i < 2; i++) {
+	if (!vtx_tamper ("testcase1.csv.vtx", (i == 0) ? 16 : 24)) {
+	    fprintf (stderr, "unable to alter the sidecar index\n");
+	    return -75;
+	}
+	if (vtx_loads ("testcase1.csv", "testcase1.csv.vtx")) {
+	    fprintf (stderr, "Unexpected error: stale sidecar index accepted (%s)\n", (i == 0) ? "size" : "mtime");
+	    return -76;
+	}
+	ret = sqlite3_exec (db_handle, "create VIRTUAL TABLE places USING VirtualText(\"testcase1.csv\", UTF-8, 0, POINT, DOUBLEQUOTE, TAB, 1);", NULL, NULL, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "VirtualText (stale index) error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -77;
+	}
+	ret = sqlite3_get_table (db_handle, "SELECT Count(*) FROM places", &results, &rows, &columns, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "Error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -78;
+	}
+	if (rows != 1 || strcmp(results[1], "17") != 0) {
+	    fprintf (stderr, "Unexpected error: stale index bad rows count: %s.\n", results[1]);
+	    return -79;
+	}
+	sqlite3_free_table (results);
+	ret = sqlite3_exec (db_handle, "DROP TABLE places;", NULL, NULL, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -80;
+	}
+	if (!vtx_loads ("testcase1.csv", "testcase1.csv.vtx")) {
+	    fprintf (stderr, "Unexpected error: the stale sidecar index was not rewritten\n");
+	    return -81;
+	}
+    }
+    remove ("testcase1.csv.vtx");
+
+/* bulk loading the same file into a table */
+    ret = load_text (db_handle, "testcase1.csv", "places_txt", "UTF-8", 0, '.', '"', '\t', 0, &rows, msg);
+    if (!ret) {
+	fprintf (stderr, "load_text error: %s\n", msg);
+	return -53;
+    }
+    if (rows != 17) {
+	fprintf (stderr, "Unexpected error: load_text bad rows count: %i.\n", rows);
+	return -54;
+    }
+    ret = sqlite3_get_table (db_handle, "SELECT typeof(col001), col003 FROM places_txt WHERE col012 = 23940.0", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -55;
+    }
+    if ((rows != 2) || (columns != 2)) {
+	fprintf (stderr, "Unexpected error: load_text select bad result: %i/%i.\n", rows, columns);
+	return  -56;
+    }
+    if (strcmp(results[2], "integer") != 0) {
+	fprintf (stderr, "Unexpected error: load_text bad column type: %s.\n", results[2]);
+	return  -57;
+    }
+    sqlite3_free_table (results);
+    ret = load_text (db_handle, "testcase1.csv", "places_txt", "UTF-8", 0, '.', '"', '\t', 0, &rows, msg);
+    if (ret) {
+	fprintf (stderr, "Unexpected error: load_text into an existing table\n");
+	return -58;
+    }
+
+/* typed column caches, rowid seeks and LIMIT */
+    ret = sqlite3_exec (db_handle, "create VIRTUAL TABLE places USING VirtualText(\"testcase1.csv\", UTF-8, 0, POINT, DOUBLEQUOTE, TAB, 0, 1);", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "VirtualText (use_cache) error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -59;
+    }
+    for (i = 0; i < 2; i++) {
+	ret = sqlite3_get_table (db_handle, "SELECT col001, col012 FROM places WHERE col012 >= 20000.0 AND col012 < 24000.0 AND col006 > 143.86", &results, &rows, &columns, &err_msg);
+	if (ret != SQLITE_OK) {
+	    fprintf (stderr, "Error: %s\n", err_msg);
+	    sqlite3_free (err_msg);
+	    return -60;
+	}
+	if ((rows != 1) || (columns != 2) || strcmp(results[3], "23940") != 0) {
+	    fprintf (stderr, "Unexpected error: use_cache bad result (%d): %i/%i.\n", i, rows, columns);
+	    return  -61;
+	}
+	sqlite3_free_table (results);
+    }
+    ret = sqlite3_get_table (db_handle, "SELECT ROWNO FROM places WHERE rowid > 3 AND ROWNO <= 6 AND col001 > 0", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -62;
+    }
+    if ((rows != 3) || (columns != 1) || strcmp(results[1], "4") != 0 || strcmp(results[3], "6") != 0) {
+	fprintf (stderr, "Unexpected error: rowid range bad result: %i/%i.\n", rows, columns);
+	return  -63;
+    }
+    sqlite3_free_table (results);
+    ret = sqlite3_get_table (db_handle, "SELECT col003 FROM places WHERE col001 > 0 LIMIT 2", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -64;
+    }
+    if ((rows != 2) || (columns != 1)) {
+	fprintf (stderr, "Unexpected error: LIMIT bad result: %i/%i.\n", rows, columns);
+	return  -65;
+    }
+    sqlite3_free_table (results);
+    ret = sqlite3_exec (db_handle, "DROP TABLE places;", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -66;
+    }
+
+/* chunked parsing: quoted LF chars across the chunk boundaries */
+    if (!write_chunked_csv ("chunked.csv")) {
+	fprintf (stderr, "unable to create chunked.csv\n");
+	return -67;
+    }
+    ret = sqlite3_exec (db_handle, "create VIRTUAL TABLE serial USING VirtualText(\"chunked.csv\", UTF-8, 1, POINT, DOUBLEQUOTE, ',');", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "VirtualText (serial) error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -68;
+    }
+    ret = sqlite3_get_table (db_handle, "SELECT Count(*), Sum(value) FROM serial WHERE note LIKE 'first line %last line'", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -69;
+    }
+    if ((rows != 1) || strcmp(results[2], "400") != 0 || atof(results[3]) != 80400.0) {
+	fprintf (stderr, "Unexpected error: serial bad result: %s/%s.\n", results[2], results[3]);
+	return  -70;
+    }
+    sqlite3_free_table (results);
+    for (i = 2; i <= 8; i++) {
+	if (!check_chunked_parse (i))
+	    return -71;
+    }
+    ret = sqlite3_exec (db_handle, "DROP TABLE serial;", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -72;
+    }
+    remove ("chunked.csv");
+
     sqlite3_close (db_handle);
     spatialite_cleanup_ex (cache);
 #endif	/* end ICONV conditional */
@@ -738,6 +738,73 @@ int do_test(sqlite3 *db_handle)
     }
     sqlite3_free_table (results);
 
+    ret = sqlite3_exec (db_handle, "create VIRTUAL TABLE shapetest5 USING VirtualShape(\"shp/merano-3d/points\", CP1252, 25832);", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "VirtualShape error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -133;
+    }
+    ret = sqlite3_get_table (db_handle, "SELECT group_concat(PKUID) FROM shapetest5 WHERE search_frame = BuildMbr(667500, 5169350, 667600, 5169450)", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "search_frame error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -134;
+    }
+    if ((rows != 1) || (columns != 1)) {
+	fprintf (stderr, "search_frame Unexpected error: select columns bad result: %i/%i.\n", rows, columns);
+	return  -135;
+    }
+    if (strcmp(results[1], "4,5,6,7,8,9,12") != 0) {
+	fprintf (stderr, "search_frame Unexpected error: bad result: %s.\n", results[1]);
+	return  -136;
+    }
+    sqlite3_free_table (results);
+
+    ret = sqlite3_exec (db_handle, "create VIRTUAL TABLE shapetest6 USING VirtualShape(\"shp/merano-3d/points\", CP1252, 25832, SpatialIndex);", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "VirtualShape error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -137;
+    }
+    ret = sqlite3_get_table (db_handle, "SELECT group_concat(PKUID) FROM shapetest6 WHERE search_frame = BuildMbr(667500, 5169350, 667600, 5169450) AND PKUID > 5 AND rowid <= 9", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "search_frame (Spatial Index) error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -138;
+    }
+    if ((rows != 1) || (columns != 1)) {
+	fprintf (stderr, "search_frame (Spatial Index) Unexpected error: select columns bad result: %i/%i.\n", rows, columns);
+	return  -139;
+    }
+    if (strcmp(results[1], "6,7,8,9") != 0) {
+	fprintf (stderr, "search_frame (Spatial Index) Unexpected error: bad result: %s.\n", results[1]);
+	return  -140;
+    }
+    sqlite3_free_table (results);
+
+    ret = sqlite3_get_table (db_handle, "SELECT PKUID, X(Geometry) FROM shapetest6 WHERE rowid = 20", &results, &rows, &columns, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "ROWID seek error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -141;
+    }
+    if ((rows != 1) || (columns != 2)) {
+	fprintf (stderr, "ROWID seek Unexpected error: select columns bad result: %i/%i.\n", rows, columns);
+	return  -142;
+    }
+    if (strcmp(results[2], "20") != 0) {
+	fprintf (stderr, "ROWID seek Unexpected error: bad result: %s.\n", results[2]);
+	return  -143;
+    }
+    sqlite3_free_table (results);
+
+    ret = sqlite3_exec (db_handle, "DROP TABLE shapetest5; DROP TABLE shapetest6;", NULL, NULL, &err_msg);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -144;
+    }
+
 /* final DB cleanup */
     ret = sqlite3_exec (db_handle, "DELETE FROM spatialite_history WHERE geometry_column IS NOT NULL", NULL, NULL, &err_msg);
     if (ret != SQLITE_OK) {
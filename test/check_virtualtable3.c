@@ -530,6 +530,24 @@ int main (int argc, char *argv[])
     }
     sqlite3_free_table (results);
 
+    asprintf(&sql_statement, "select testcase2 from dbftest where rowid = 2;");
+    ret = sqlite3_get_table (db_handle, sql_statement, &results, &rows, &columns, &err_msg);
+    free(sql_statement);
+    if (ret != SQLITE_OK) {
+	fprintf (stderr, "Error: %s\n", err_msg);
+	sqlite3_free (err_msg);
+	return -102;
+    }
+    if ((rows != 1) || (columns != 1)) {
+	fprintf (stderr, "Unexpected error: select columns bad result: %i/%i.\n", rows, columns);
+	return  -103;
+    }
+    if (strcmp(results[1], "20") != 0) {
+	fprintf (stderr, "Unexpected error: projected column bad result: %s.\n", results[1]);
+	return  -104;
+    }
+    sqlite3_free_table (results);
+
     ret = sqlite3_exec (db_handle, "DROP TABLE dbftest;", NULL, NULL, &err_msg);
     if (ret != SQLITE_OK) {
 	fprintf (stderr, "DROP TABLE error: %s\n", err_msg);
@@ -70,13 +70,89 @@ void cleanup_shapefile(const char *filename)
     unlink(nam);
 }
 
+#ifndef OMIT_ICONV	/* only if ICONV is supported */
+int compare_dbf_dumps(const char *filename1, const char *filename2)
+{
+/* checking that two dumped DBFs have the same fields and rows */
+    char nam[1000];
+    gaiaDbfPtr dbf1 = gaiaAllocDbf ();
+    gaiaDbfPtr dbf2 = gaiaAllocDbf ();
+    gaiaDbfFieldPtr fld1;
+    gaiaDbfFieldPtr fld2;
+    int row = 0;
+    int deleted;
+    int ret1;
+    int ret2;
+    int ok = 0;
+
+    snprintf(nam, 1000, "%s.dbf", filename1);
+    gaiaOpenDbfRead (dbf1, nam, "UTF-8", "UTF-8");
+    snprintf(nam, 1000, "%s.dbf", filename2);
+    gaiaOpenDbfRead (dbf2, nam, "UTF-8", "UTF-8");
+    if (!dbf1->Valid || !dbf2->Valid)
+	goto stop;
+    fld1 = dbf1->Dbf->First;
+    fld2 = dbf2->Dbf->First;
+    while (fld1 && fld2) {
+	if (strcmp (fld1->Name, fld2->Name) != 0 || fld1->Type != fld2->Type
+	    || fld1->Length != fld2->Length || fld1->Decimals != fld2->Decimals) {
+	    fprintf (stderr, "DBF field mismatch: %s %c(%d,%d) / %s %c(%d,%d)\n",
+		     fld1->Name, fld1->Type, fld1->Length, fld1->Decimals,
+		     fld2->Name, fld2->Type, fld2->Length, fld2->Decimals);
+	    goto stop;
+	}
+	fld1 = fld1->Next;
+	fld2 = fld2->Next;
+    }
+    if (fld1 || fld2)
+	goto stop;
+    while (1) {
+	ret1 = gaiaReadDbfEntity (dbf1, row, &deleted);
+	ret2 = gaiaReadDbfEntity (dbf2, row, &deleted);
+	if (ret1 != ret2)
+	    goto stop;
+	if (!ret1)
+	    break;
+	fld1 = dbf1->Dbf->First;
+	fld2 = dbf2->Dbf->First;
+	while (fld1 && fld2) {
+	    if (fld1->Value == NULL || fld2->Value == NULL
+		|| fld1->Value->Type != fld2->Value->Type)
+		goto mismatch;
+	    if (fld1->Value->Type == GAIA_INT_VALUE
+		&& fld1->Value->IntValue != fld2->Value->IntValue)
+		goto mismatch;
+	    if (fld1->Value->Type == GAIA_DOUBLE_VALUE
+		&& fld1->Value->DblValue != fld2->Value->DblValue)
+		goto mismatch;
+	    if (fld1->Value->Type == GAIA_TEXT_VALUE
+		&& strcmp (fld1->Value->TxtValue, fld2->Value->TxtValue) != 0)
+		goto mismatch;
+	    fld1 = fld1->Next;
+	    fld2 = fld2->Next;
+	}
+	row++;
+    }
+    ok = 1;
+    goto stop;
+mismatch:
+    fprintf (stderr, "DBF value mismatch: row %d, field %s\n", row, fld1->Name);
+stop:
+    gaiaFreeDbf (dbf1);
+    gaiaFreeDbf (dbf2);
+    return ok;
+}
+#endif	/* end ICONV conditional */
+
 int do_test(sqlite3 *handle)
 {
 /* testing some DB */
 #ifndef OMIT_ICONV	/* only if ICONV is supported */
     char *dumpname = __FILE__"dump";
+    char *statsname = __FILE__"stats";
     char *err_msg = NULL;
     int row_count;
+    int stats_count;
     int ret;
     gaiaVectorLayersListPtr list;
 	
@@ -544,12 +620,40 @@ int do_test(sqlite3 *handle)
 	return -63;
     }
     
+/* no geomZM field statistics yet [none at all on legacy DBs: full rescan] */
+    ret = dump_shapefile_ex (handle, "Polygon_Test", "geomZM", statsname, "UTF-8", "", 1, 1, &stats_count, err_msg);
+    if (!ret) {
+        fprintf (stderr, "dump_shapefile_ex() error for POLYGON XYZM (no stats): %s\n", err_msg);
+	sqlite3_close(handle);
+	return -67;
+    }
+
     ret = dump_shapefile (handle, "Polygon_Test", "geomZM", dumpname, "UTF-8", "", 1, &row_count, err_msg);
     if (!ret) {
         fprintf (stderr, "dump_shapefile() error for POLYGON XYZM: %s\n", err_msg);
 	sqlite3_close(handle);
 	return -64;
     }
+    if (stats_count != row_count || !compare_dbf_dumps (dumpname, statsname)) {
+        fprintf (stderr, "dump_shapefile_ex() mismatch for POLYGON XYZM (no stats)\n");
+	sqlite3_close(handle);
+	return -68;
+    }
+    cleanup_shapefile(statsname);
+
+/* the field statistics are now available */
+    ret = dump_shapefile_ex (handle, "Polygon_Test", "geomZM", statsname, "UTF-8", "", 1, 1, &stats_count, err_msg);
+    if (!ret) {
+        fprintf (stderr, "dump_shapefile_ex() error for POLYGON XYZM: %s\n", err_msg);
+	sqlite3_close(handle);
+	return -69;
+    }
+    if (stats_count != row_count || !compare_dbf_dumps (dumpname, statsname)) {
+        fprintf (stderr, "dump_shapefile_ex() mismatch for POLYGON XYZM\n");
+	sqlite3_close(handle);
+	return -70;
+    }
+    cleanup_shapefile(statsname);
     cleanup_shapefile(dumpname);
 
 /* testing VectorLayersList (several flavors) */